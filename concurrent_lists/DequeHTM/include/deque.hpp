@@ -0,0 +1,255 @@
+#define USER_NODE_POOL USER_MEM_POOL
+
+#include <iostream>
+#include "../../../include/SafeTree.hpp"
+
+
+
+using namespace SafeTree;
+
+template <class ContentType>
+class DequeItem {
+    private:
+        ContentType item;
+        DequeItem* next;
+    public:
+        DequeItem(ContentType item, DequeItem* next): item(item), next(next) {}
+        DequeItem(DequeItem& item): item(item.item), next(item.next){}
+
+        DequeItem& operator=(DequeItem other) {
+            item = other.item;
+            next = other.next;
+
+            return *this;
+        }
+
+        ~DequeItem(){}
+
+        DequeItem* getChild(int i) {
+            (void)i;
+            return next;
+        }
+
+        void setChild(int i, DequeItem* new_item) {
+            (void)i;
+            next = new_item;
+        }
+
+        DequeItem** getChildPointer(int i) {
+            (void)i;
+            return &next;
+        }
+
+        static constexpr int maxChildren() {
+            return 1;
+        }
+
+        static constexpr int treeType() {
+            return GENERAL_TREE;
+        }
+
+        ContentType getItem() const {
+            return item;
+        }
+};
+
+// Deque: a double-ended queue made of two stacks, one for each end, whose
+// tops are the ends of the deque. Each end is a root of its own, so the
+// operations on opposite ends don't conflict.
+// A pop which finds its end empty moves the bottom half of the other end,
+// reversed, to its own in one group of both roots, and pops the last
+// item of the other end. Items are copied when they are moved, so
+// pushed items never change.
+template <class ContentType>
+class Deque {
+    private:
+        using Item =  DequeItem<ContentType>;
+
+        Item* front_;
+        Item* back_;
+
+        // the result of moving the items of the other end
+        enum Refill {
+            REFILLED,
+            BOTH_EMPTY,
+            END_NOT_EMPTY
+        };
+
+        static Item* new_item(ContentType content, Item* next) {
+            #ifdef USER_NODE_POOL
+                return ConnPoint<Item>::create_new_node(content, next);
+            #else
+                return new DequeItem<ContentType>(content, next);
+            #endif
+        }
+
+        static void push(Item** end, ContentType content) {
+            TM_SAFE_OPERATION_START(30) {
+                PathTracker<Item> tracker(end);
+
+                auto conn_point_snapshot = tracker.connectHere();
+
+                ConnPoint<Item> conn(conn_point_snapshot);
+
+                auto top = conn.wrap_no_validate(conn.getConnPointer());
+
+                auto node_to_be_inserted = conn.create_safe(new_item(content, nullptr));
+
+                conn.setRoot(node_to_be_inserted);
+
+                node_to_be_inserted->setChild(0, top);
+            } TM_SAFE_OPERATION_END
+        }
+
+        // pops the top of the end, nullptr if it is empty
+        static const Item* pop_top(Item** end) {
+            // returned once it is connected, the
+            // operation is retried if it fails
+            const Item* popped = nullptr;
+
+            TM_SAFE_OPERATION_START(30) {
+                PathTracker<Item> tracker(end);
+
+                auto const top = tracker.getNode();
+
+                if (!top) {
+                    return nullptr;
+                }
+
+                auto conn_point_snapshot = tracker.connectHere();
+
+                ConnPoint<Item> conn(conn_point_snapshot);
+
+                conn.setRoot(conn.wrap_no_validate(top->getChild(0)));
+
+                popped = top;
+            } TM_SAFE_OPERATION_END
+
+            return popped;
+        }
+
+        // refill: with the end empty, pops the bottom of the other end
+        // and moves the items above it, up to half of the other end, to
+        // the end. popped is set to the bottom if REFILLED.
+        static Refill refill(Item** end, Item** other, const Item*& popped) {
+            Refill result = BOTH_EMPTY;
+
+            TM_SAFE_OPERATION_START(30) {
+                // both ends change together
+                ConnPointGroup group;
+
+                if (group.active()) {
+                    PathTracker<Item> end_tracker(end);
+
+                    if (end_tracker.getNode()) {
+                        result = END_NOT_EMPTY;
+                        break;
+                    }
+
+                    PathTracker<Item> other_tracker(other);
+
+                    Item* const top = other_tracker.getNode();
+
+                    int n_items = 0;
+                    for (Item* item = top; item; item = item->getChild(0)) {
+                        ++n_items;
+                    }
+
+                    if (!n_items) {
+                        result = BOTH_EMPTY;
+                        break;
+                    }
+
+                    // the top half stays, copied down to the
+                    // cut. The rest but the bottom is reversed.
+                    const int n_kept = n_items / 2;
+
+                    Item* kept = nullptr;
+                    Item* kept_last = nullptr;
+                    Item* moved = nullptr;
+
+                    Item* item = top;
+                    for (int i = 0; i < n_items - 1; i++, item = item->getChild(0)) {
+                        if (i < n_kept) {
+                            Item* const copy = new_item(item->getItem(), nullptr);
+
+                            if (kept_last) {
+                                kept_last->setChild(0, copy);
+                            } else {
+                                kept = copy;
+                            }
+
+                            kept_last = copy;
+                        } else {
+                            moved = new_item(item->getItem(), moved);
+                        }
+                    }
+
+                    {
+                        auto conn_point_snapshot = other_tracker.connectHere();
+
+                        ConnPoint<Item> conn(conn_point_snapshot);
+
+                        conn.setRoot(kept ? conn.create_safe(kept) : nullptr);
+                    }
+
+                    if (moved) {
+                        auto conn_point_snapshot = end_tracker.connectHere();
+
+                        ConnPoint<Item> conn(conn_point_snapshot);
+
+                        conn.setRoot(conn.create_safe(moved));
+                    }
+
+                    popped = item;
+                    result = REFILLED;
+                }
+            } TM_SAFE_OPERATION_END
+
+            return result;
+        }
+
+        static const Item* pop(Item** end, Item** other) {
+            for (;;) {
+                const Item* popped = pop_top(end);
+
+                if (popped) {
+                    return popped;
+                }
+
+                switch (refill(end, other, popped)) {
+                    case REFILLED:
+                        return popped;
+                    case BOTH_EMPTY:
+                        return nullptr;
+                    default:
+                        break;  // pushed to meanwhile
+                }
+            }
+        }
+
+    public:
+        Deque(): front_(nullptr), back_(nullptr) {}
+
+        void push_front(ContentType content) {
+            push(&front_, content);
+        }
+
+        void push_back(ContentType content) {
+            push(&back_, content);
+        }
+
+        // the popped items, nullptr if the deque is empty
+        const DequeItem<ContentType>* pop_front() {
+            return pop(&front_, &back_);
+        }
+
+        const DequeItem<ContentType>* pop_back() {
+            return pop(&back_, &front_);
+        }
+
+        // exact only when no operation runs
+        bool empty() const {
+            return !front_ && !back_;
+        }
+};
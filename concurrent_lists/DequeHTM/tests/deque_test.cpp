@@ -0,0 +1,241 @@
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <deque>
+#include "../include/deque.hpp"
+#include "../../../include/catch2/catch.hpp"
+#include "../../../include/list_test_bench.hpp"
+
+constexpr int N_ITEMS = 10000;
+constexpr int THREADS = 6;
+
+
+TEST_CASE("Deque Init Test","[init]") {
+    Deque<int> deque;
+
+    REQUIRE(deque.empty());
+    REQUIRE(deque.pop_front() == nullptr);
+    REQUIRE(deque.pop_back() == nullptr);
+}
+
+TEST_CASE("Deque Order Test","[init]") {
+    Deque<int> deque;
+
+    SECTION("one end is a stack") {
+        for (int i = 0; i < N_ITEMS; i++) {
+            deque.push_back(i);
+        }
+
+        for (int i = N_ITEMS - 1; i >= 0; i--) {
+            REQUIRE(deque.pop_back()->getItem() == i);
+        }
+
+        for (int i = 0; i < N_ITEMS; i++) {
+            deque.push_front(i);
+        }
+
+        for (int i = N_ITEMS - 1; i >= 0; i--) {
+            REQUIRE(deque.pop_front()->getItem() == i);
+        }
+
+        REQUIRE(deque.empty());
+    }
+
+    // the items move between the ends
+    SECTION("both ends are a queue") {
+        for (int i = 0; i < N_ITEMS; i++) {
+            deque.push_back(i);
+        }
+
+        for (int i = 0; i < N_ITEMS; i++) {
+            REQUIRE(deque.pop_front()->getItem() == i);
+        }
+
+        for (int i = 0; i < N_ITEMS; i++) {
+            deque.push_front(i);
+        }
+
+        for (int i = 0; i < N_ITEMS; i++) {
+            REQUIRE(deque.pop_back()->getItem() == i);
+        }
+
+        REQUIRE(deque.pop_back() == nullptr);
+        REQUIRE(deque.empty());
+    }
+
+    SECTION("random operations") {
+        std::deque<int> expected;
+        unsigned seed = 12345;
+
+        for (int i = 0; i < 20 * N_ITEMS; i++) {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+
+            switch (seed % 4) {
+                case 0:
+                    deque.push_front(i);
+                    expected.push_front(i);
+                    break;
+                case 1:
+                    deque.push_back(i);
+                    expected.push_back(i);
+                    break;
+                case 2:
+                    if (expected.empty()) {
+                        REQUIRE(deque.pop_front() == nullptr);
+                    } else {
+                        REQUIRE(deque.pop_front()->getItem() == expected.front());
+                        expected.pop_front();
+                    }
+                    break;
+                default:
+                    if (expected.empty()) {
+                        REQUIRE(deque.pop_back() == nullptr);
+                    } else {
+                        REQUIRE(deque.pop_back()->getItem() == expected.back());
+                        expected.pop_back();
+                    }
+            }
+        }
+
+        while (!expected.empty()) {
+            REQUIRE(deque.pop_front()->getItem() == expected.front());
+            expected.pop_front();
+        }
+
+        REQUIRE(deque.empty());
+    }
+}
+
+TEST_CASE("Deque Multithreaded Test","[mt]") {
+    Deque<int> deque;
+
+    std::atomic<int> counts[N_ITEMS*THREADS];
+
+    for (auto& count: counts) {
+        count = 0;
+    }
+
+    // owners push and pop at the back, and the
+    // others steal from the front
+    SECTION("work stealing") {
+        std::atomic<int> owners_done(0);
+        std::vector<std::thread> threads;
+
+        for (int i = 0; i < THREADS / 2; i++) {
+            threads.emplace_back([&deque, &counts, &owners_done](int t_id) {
+                for (int j = t_id * 2 * N_ITEMS; j < (t_id + 1) * 2 * N_ITEMS; j++) {
+                    deque.push_back(j);
+
+                    if (j % 3 == 0) {
+                        auto item = deque.pop_back();
+
+                        if (item) {
+                            ++counts[item->getItem()];
+                        }
+                    }
+                }
+
+                ++owners_done;
+            }, i);
+
+            threads.emplace_back([&deque, &counts, &owners_done]() {
+                for (;;) {
+                    const bool done = owners_done == THREADS / 2;
+                    auto item = deque.pop_front();
+
+                    if (item) {
+                        ++counts[item->getItem()];
+                    } else if (done) {
+                        break;
+                    }
+                }
+            });
+        }
+
+        for (auto& thread: threads) {
+            thread.join();
+        }
+    }
+
+    SECTION("both ends") {
+        std::vector<std::thread> threads;
+
+        for (int i = 0; i < THREADS; i++) {
+            threads.emplace_back([&deque, &counts](int t_id) {
+                for (int j = t_id * N_ITEMS; j < (t_id + 1) * N_ITEMS; j++) {
+                    if (j % 2) {
+                        deque.push_back(j);
+                    } else {
+                        deque.push_front(j);
+                    }
+
+                    if (j % 4 < 2) {
+                        auto item = t_id % 2 ? deque.pop_back() : deque.pop_front();
+
+                        if (item) {
+                            ++counts[item->getItem()];
+                        }
+                    }
+                }
+            }, i);
+        }
+
+        for (auto& thread: threads) {
+            thread.join();
+        }
+
+        for (auto item = deque.pop_back(); item; item = deque.pop_back()) {
+            ++counts[item->getItem()];
+        }
+    }
+
+    REQUIRE(deque.empty());
+
+    for (int i = 0; i < N_ITEMS*THREADS; i++) {
+        REQUIRE(counts[i] == 1);
+    }
+}
+
+
+TEST_CASE("THROUGHPUT TESTS","[tp]") {
+    using Bench = ListTestBench<Deque<int>>;
+
+    std::vector<int> threads_to_use = {1,2,4,7,14,20,28};
+
+    auto push_back = [](Deque<int>& deque, int item) {
+        deque.push_back(item);
+    };
+
+    auto pop_front = [](Deque<int>& deque) {
+        return deque.pop_front();
+    };
+
+    // each thread at an end of its own
+    auto push_any = [](Deque<int>& deque, int item) {
+        if ((item >> 24) % 2) {
+            deque.push_back(item);
+        } else {
+            deque.push_front(item);
+        }
+    };
+
+    auto pop_any = [](Deque<int>& deque) {
+        thread_local int t_id = -1;
+        static std::atomic<int> n_threads(0);
+
+        if (t_id < 0) {
+            t_id = n_threads++;
+        }
+
+        return t_id % 2 ? deque.pop_back() : deque.pop_front();
+    };
+
+    // AS A QUEUE
+    Bench::test(Bench::experiment(50, 1000), threads_to_use, push_back, pop_front);
+    Bench::test(Bench::experiment(50, 1000), threads_to_use, push_back, pop_front, true);
+
+    // AT BOTH ENDS
+    Bench::test(Bench::experiment(50, 1000), threads_to_use, push_any, pop_any);
+}
@@ -0,0 +1,342 @@
+#define USER_NODE_POOL USER_MEM_POOL
+
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <array>
+#include "../../../include/SafeTree.hpp"
+
+
+
+using namespace SafeTree;
+
+// HeapItem: a node of a leftist heap. The rank of a node is the length of
+// the path to the nearest missing child, following the short child, whose
+// rank is never larger than the rank of the other one. Which child is the
+// short one is kept in the node, so that no children are moved when it
+// changes.
+template <class ContentType>
+class HeapItem {
+    private:
+        ContentType item;
+        int rank;
+        int short_child;
+        HeapItem* children[2];
+    public:
+        HeapItem(ContentType item, HeapItem* long_child): item(item), rank(1), short_child(1), children{long_child, nullptr} {}
+        HeapItem(HeapItem& item): item(item.item), rank(item.rank), short_child(item.short_child), children{item.children[0], item.children[1]} {}
+
+        HeapItem& operator=(HeapItem other) {
+            item = other.item;
+            rank = other.rank;
+            short_child = other.short_child;
+            children[0] = other.children[0];
+            children[1] = other.children[1];
+
+            return *this;
+        }
+
+        ~HeapItem(){}
+
+        HeapItem* getChild(int i) {
+            return children[i];
+        }
+
+        void setChild(int i, HeapItem* new_item) {
+            children[i] = new_item;
+        }
+
+        HeapItem** getChildPointer(int i) {
+            return &children[i];
+        }
+
+        static constexpr int maxChildren() {
+            return 2;
+        }
+
+        static constexpr int treeType() {
+            return GENERAL_TREE;
+        }
+
+        ContentType getItem() const {
+            return item;
+        }
+
+        int shortChild() const {
+            return short_child;
+        }
+
+        int longChild() const {
+            return 1 - short_child;
+        }
+
+        // after a child changed, nodes of
+        // the tree of copies only
+        void update() {
+            if (rank_of(children[longChild()]) < rank_of(children[short_child])) {
+                short_child = longChild();
+            }
+
+            rank = rank_of(children[short_child]) + 1;
+        }
+
+        static int rank_of(const HeapItem* node) {
+            return node ? node->rank : 0;
+        }
+};
+
+// PriorityQueue: a min-priority queue on a leftist heap, the smallest item
+// by Compare is at the root. Every path along the short children has
+// O(log n) nodes.
+// push walks down the short children to the first larger item and puts the
+// new node there, with the larger item's subtree as its long child. The
+// ranks above change only up to the first subtree whose rank stays the
+// same, and the tree of copies is connected there, so pushes far apart
+// on the path don't conflict.
+// pop_min merges the two subtrees of the root along their short paths,
+// copying the nodes of the paths, and connects the result at the root.
+template <class ContentType, class Compare = std::less<ContentType>>
+class PriorityQueue {
+    public:
+        // the most items pop_min_n pops in one operation
+        enum { MAX_BATCH = 16 };
+
+    private:
+        using Item = HeapItem<ContentType>;
+        using Safe = SafeNode<Item>;
+
+        // ranks above this need more items than fit in memory
+        enum { MAX_RANK = 64 };
+
+        Item* root_;
+        Compare less_;
+
+        static Item* new_item(ContentType content, Item* long_child) {
+            #ifdef USER_NODE_POOL
+                return ConnPoint<Item>::create_new_node(content, long_child);
+            #else
+                return new HeapItem<ContentType>(content, long_child);
+            #endif
+        }
+
+        // merge: merges two heaps of the tree of copies,
+        // copying the nodes on their short paths
+        Safe* merge(Safe* a, Safe* b) {
+            if (!a) {
+                return b;
+            }
+
+            if (!b) {
+                return a;
+            }
+
+            if (less_(b->peekOriginal()->getItem(), a->peekOriginal()->getItem())) {
+                std::swap(a, b);
+            }
+
+            Item* const node = a->rwRef();
+            const int short_child = node->shortChild();
+
+            a->setChild(short_child, merge(a->getChild(short_child), b));
+            node->update();
+
+            return a;
+        }
+
+        // the most SafeNodes popping the root of the tree of copies
+        // takes, one for each node the merge copies and the root
+        static int pop_cost(ConnPoint<Item>& conn) {
+            Item* const top = conn.getRoot()->rwRef();
+            return 3 + Item::rank_of(top->getChild(0)) + Item::rank_of(top->getChild(1));
+        }
+
+        // pops the root of the tree of copies, returns the popped node
+        const Item* pop_root(ConnPoint<Item>& conn) {
+            Safe* const top = conn.getRoot();
+
+            const Item* const popped = top->peekOriginal();
+
+            conn.setRoot(merge(top->getChild(0), top->getChild(1)));
+
+            return popped;
+        }
+
+        bool is_leftist(Item* node) const {
+            if (!node) {
+                return true;
+            }
+
+            for (int i = 0; i < Item::maxChildren(); i++) {
+                if (node->getChild(i) && less_(node->getChild(i)->getItem(), node->getItem())) {
+                    return false;
+                }
+            }
+
+            const int short_rank = Item::rank_of(node->getChild(node->shortChild()));
+
+            return Item::rank_of(node->getChild(node->longChild())) >= short_rank &&
+                   Item::rank_of(node) == short_rank + 1 &&
+                   is_leftist(node->getChild(0)) && is_leftist(node->getChild(1));
+        }
+
+        int count(Item* node) const {
+            return node ? 1 + count(node->getChild(0)) + count(node->getChild(1)) : 0;
+        }
+
+    public:
+        explicit PriorityQueue(const Compare& less = Compare()): root_(nullptr), less_(less) {}
+
+        // the node of the smallest item, nullptr if empty
+        const HeapItem<ContentType>* peek_min() const {
+            return root_;
+        }
+
+        bool empty() const {
+            return !root_;
+        }
+
+        void push(ContentType content) {
+            TM_SAFE_OPERATION_START(30) {
+                PathTracker<Item> tracker(&root_);
+
+                // the nodes of the short path above the new node
+                std::array<Item*, MAX_RANK> path;
+                int depth = 0;
+
+                Item* node = tracker.getNode();
+
+                while (node && !less_(content, node->getItem())) {
+                    path[depth++] = node;
+                    node = tracker.moveToChild(node->shortChild());
+                }
+
+                // the new node's subtree has rank 1, the ranks above
+                // change up to the level where the rank stays the same
+                int level = depth;
+                int new_rank = 1;
+
+                while (level > 0 && new_rank != Item::rank_of(level == depth ? node : path[level])) {
+                    Item* const parent = path[--level];
+                    new_rank = std::min(new_rank, Item::rank_of(parent->getChild(parent->longChild()))) + 1;
+                }
+
+                if (level < depth) {
+                    tracker.moveUp(depth - level);
+                }
+
+                auto conn_point_snapshot = tracker.connectHere();
+
+                ConnPoint<Item> conn(conn_point_snapshot);
+
+                Safe* const new_node = conn.create_safe(new_item(content, nullptr));
+
+                if (level == depth) {
+                    // the larger item is its long child
+                    new_node->setChild(0, conn.wrap_no_validate(conn.getConnPointer()));
+                    conn.setRoot(new_node);
+                } else {
+                    std::array<Safe*, MAX_RANK> copies;
+
+                    copies[level] = conn.getRoot();
+
+                    for (int i = level; i < depth - 1; i++) {
+                        copies[i + 1] = copies[i]->getChild(copies[i]->rwRef()->shortChild());
+                    }
+
+                    Safe* const parent = copies[depth - 1];
+                    const int short_child = parent->rwRef()->shortChild();
+
+                    new_node->setChild(0, conn.wrap_no_validate(parent->peekChild(short_child)));
+                    parent->setChild(short_child, new_node);
+
+                    for (int i = depth - 1; i >= level; i--) {
+                        copies[i]->rwRef()->update();
+                    }
+                }
+            } TM_SAFE_OPERATION_END
+        }
+
+        // pop_min: pops the smallest item, returns its node
+        // or nullptr if the queue is empty
+        const HeapItem<ContentType>* pop_min() {
+            // returned once it is connected, the
+            // operation is retried if it fails
+            const Item* popped = nullptr;
+
+            TM_SAFE_OPERATION_START(30) {
+                PathTracker<Item> tracker(&root_);
+
+                if (!tracker.getNode()) {
+                    return nullptr;
+                }
+
+                auto conn_point_snapshot = tracker.connectHere();
+
+                ConnPoint<Item> conn(conn_point_snapshot);
+
+                popped = pop_root(conn);
+            } TM_SAFE_OPERATION_END
+
+            return popped;
+        }
+
+        // pop_min_n: pops up to n of the smallest items, which are written
+        // to out in order. Each operation pops up to MAX_BATCH of them,
+        // as many as the nodes copied fit in its ConnPoint.
+        // Returns the amount popped.
+        template <class OutputIterator>
+        int pop_min_n(const int n, OutputIterator out) {
+            int n_popped = 0;
+
+            while (n_popped < n) {
+                std::array<const Item*, MAX_BATCH> popped;
+                int n_batch = 0;
+
+                TM_SAFE_OPERATION_START(30) {
+                    PathTracker<Item> tracker(&root_);
+
+                    n_batch = 0;
+
+                    if (!tracker.getNode()) {
+                        break;
+                    }
+
+                    auto conn_point_snapshot = tracker.connectHere();
+
+                    ConnPoint<Item> conn(conn_point_snapshot);
+
+                    // the next ones are popped from the tree of copies
+                    int n_safe_nodes = 0;
+
+                    do {
+                        n_safe_nodes += pop_cost(conn);
+                        popped[n_batch++] = pop_root(conn);
+                    } while (n_batch < MAX_BATCH && n_popped + n_batch < n && conn.getRoot() &&
+                             n_safe_nodes + pop_cost(conn) <= CONN_POINT_MAX_SAFE_NODES);
+                } TM_SAFE_OPERATION_END
+
+                for (int i = 0; i < n_batch; i++) {
+                    *out++ = popped[i]->getItem();
+                }
+
+                n_popped += n_batch;
+
+                if (!n_batch) {
+                    break;
+                }
+            }
+
+            return n_popped;
+        }
+
+        // isLeftist: heap order, ranks and
+        // short children are right
+        bool isLeftist() const {
+            return is_leftist(root_);
+        }
+
+        // exact only when no operation runs
+        int size() const {
+            return count(root_);
+        }
+};
@@ -0,0 +1,318 @@
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <iterator>
+#include <mutex>
+#include <queue>
+#include <functional>
+#include "../include/priority_queue.hpp"
+#include "../../../include/catch2/catch.hpp"
+#include "../../../include/list_test_bench.hpp"
+
+constexpr int N_ITEMS = 10000;
+constexpr int THREADS = 6;
+
+// the same random order for every run
+std::vector<int> shuffled(const int n_items, unsigned seed) {
+    std::vector<int> items(n_items);
+
+    for (int i = 0; i < n_items; i++) {
+        items[i] = i;
+    }
+
+    for (int i = n_items - 1; i > 0; i--) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+
+        std::swap(items[i], items[seed % (i + 1)]);
+    }
+
+    return items;
+}
+
+
+TEST_CASE("PriorityQueue Init Test","[init]") {
+    PriorityQueue<int> queue;
+
+    REQUIRE(queue.empty());
+    REQUIRE(queue.peek_min() == nullptr);
+    REQUIRE(queue.pop_min() == nullptr);
+    REQUIRE(queue.isLeftist());
+}
+
+TEST_CASE("PriorityQueue Order Test","[init]") {
+    PriorityQueue<int> queue;
+
+    SECTION("random pushes") {
+        int min = N_ITEMS;
+
+        for (int item: shuffled(N_ITEMS, 7)) {
+            queue.push(item);
+            min = std::min(min, item);
+
+            REQUIRE(queue.peek_min()->getItem() == min);
+        }
+
+        REQUIRE(queue.isLeftist());
+        REQUIRE(queue.size() == N_ITEMS);
+
+        for (int i = 0; i < N_ITEMS; i++) {
+            REQUIRE(queue.pop_min()->getItem() == i);
+
+            if (i % 1000 == 0) {
+                REQUIRE(queue.isLeftist());
+            }
+        }
+
+        REQUIRE(queue.empty());
+    }
+
+    SECTION("increasing and decreasing pushes") {
+        for (int i = 0; i < N_ITEMS; i++) {
+            queue.push(i);
+            queue.push(2 * N_ITEMS - i);
+        }
+
+        REQUIRE(queue.isLeftist());
+
+        for (int i = 0; i < N_ITEMS; i++) {
+            REQUIRE(queue.pop_min()->getItem() == i);
+        }
+
+        REQUIRE(queue.isLeftist());
+        REQUIRE(queue.peek_min()->getItem() == N_ITEMS + 1);
+    }
+
+    SECTION("equal items") {
+        for (int i = 0; i < N_ITEMS; i++) {
+            queue.push(i % 10);
+        }
+
+        REQUIRE(queue.isLeftist());
+
+        for (int i = 0; i < N_ITEMS; i++) {
+            REQUIRE(queue.pop_min()->getItem() == i / (N_ITEMS / 10));
+        }
+    }
+
+    SECTION("pushes and pops") {
+        std::priority_queue<int, std::vector<int>, std::greater<int>> expected;
+
+        for (int item: shuffled(4 * N_ITEMS, 11)) {
+            if (item % 3 == 0 && !expected.empty()) {
+                REQUIRE(queue.pop_min()->getItem() == expected.top());
+                expected.pop();
+            } else {
+                queue.push(item);
+                expected.push(item);
+            }
+        }
+
+        REQUIRE(queue.isLeftist());
+        REQUIRE(queue.size() == static_cast<int>(expected.size()));
+    }
+}
+
+TEST_CASE("PriorityQueue Compare Test","[init]") {
+    PriorityQueue<int, std::greater<int>> queue;
+
+    for (int item: shuffled(N_ITEMS, 3)) {
+        queue.push(item);
+    }
+
+    REQUIRE(queue.isLeftist());
+
+    for (int i = N_ITEMS - 1; i >= 0; i--) {
+        REQUIRE(queue.pop_min()->getItem() == i);
+    }
+}
+
+TEST_CASE("PriorityQueue Batch Test","[batch]") {
+    PriorityQueue<int> queue;
+
+    for (int item: shuffled(N_ITEMS, 5)) {
+        queue.push(item);
+    }
+
+    std::vector<int> popped;
+
+    // more than a batch of one operation
+    REQUIRE(queue.pop_min_n(3, std::back_inserter(popped)) == 3);
+    REQUIRE(queue.pop_min_n(PriorityQueue<int>::MAX_BATCH * 3 + 1, std::back_inserter(popped)) == PriorityQueue<int>::MAX_BATCH * 3 + 1);
+    REQUIRE(queue.isLeftist());
+
+    REQUIRE(queue.pop_min_n(N_ITEMS, std::back_inserter(popped)) == N_ITEMS - static_cast<int>(popped.size()));
+    REQUIRE(queue.pop_min_n(10, std::back_inserter(popped)) == 0);
+    REQUIRE(queue.empty());
+
+    for (int i = 0; i < N_ITEMS; i++) {
+        REQUIRE(popped[i] == i);
+    }
+}
+
+TEST_CASE("PriorityQueue Multithreaded Test","[mt]") {
+    PriorityQueue<int> queue;
+
+    std::atomic<int> counts[N_ITEMS*THREADS];
+
+    for (auto& count: counts) {
+        count = 0;
+    }
+
+    SECTION("pushes") {
+        std::vector<std::thread> threads;
+
+        for (int i = 0; i < THREADS; i++) {
+            threads.emplace_back([&queue](int t_id) {
+                for (int item: shuffled(N_ITEMS, t_id + 1)) {
+                    queue.push(item * THREADS + t_id);
+                }
+            }, i);
+        }
+
+        for (auto& thread: threads) {
+            thread.join();
+        }
+
+        REQUIRE(queue.isLeftist());
+
+        for (int i = 0; i < N_ITEMS*THREADS; i++) {
+            REQUIRE(queue.pop_min()->getItem() == i);
+            ++counts[i];
+        }
+    }
+
+    SECTION("pushes and pops") {
+        std::vector<std::thread> threads;
+
+        for (int i = 0; i < THREADS; i++) {
+            threads.emplace_back([&queue, &counts](int t_id) {
+                std::vector<int> popped;
+
+                for (int item: shuffled(N_ITEMS, t_id + 1)) {
+                    queue.push(item * THREADS + t_id);
+
+                    if (item % 2) {
+                        auto node = queue.pop_min();
+
+                        if (node) {
+                            ++counts[node->getItem()];
+                        }
+                    } else if (item % 5 == 0) {
+                        popped.clear();
+                        queue.pop_min_n(4, std::back_inserter(popped));
+
+                        for (int taken: popped) {
+                            ++counts[taken];
+                        }
+                    }
+                }
+            }, i);
+        }
+
+        for (auto& thread: threads) {
+            thread.join();
+        }
+
+        REQUIRE(queue.isLeftist());
+
+        for (auto node = queue.pop_min(); node; node = queue.pop_min()) {
+            ++counts[node->getItem()];
+        }
+    }
+
+    for (int i = 0; i < N_ITEMS*THREADS; i++) {
+        REQUIRE(counts[i] == 1);
+    }
+}
+
+
+// the baseline of the benchmarks
+class LockedPriorityQueue {
+    private:
+        std::mutex mutex_;
+        std::priority_queue<int, std::vector<int>, std::greater<int>> queue_;
+
+    public:
+        void push(int item) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push(item);
+        }
+
+        TakenItem pop_min() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            TakenItem taken;
+
+            taken.found = !queue_.empty();
+            taken.item = taken.found ? queue_.top() : 0;
+
+            if (taken.found) {
+                queue_.pop();
+            }
+
+            return taken;
+        }
+};
+
+TEST_CASE("BATCH BENCHMARKS","[tp][tp_batch]") {
+    std::vector<int> items = shuffled(64, 9);
+    std::vector<int> popped(64);
+
+    BENCHMARK("push and pop_min 64 items") {
+        PriorityQueue<int> queue;
+
+        for (int item: items) {
+            queue.push(item);
+        }
+
+        for (std::size_t i = 0; i < items.size(); i++) {
+            popped[i] = queue.pop_min()->getItem();
+        }
+
+        return popped[0];
+    };
+
+    BENCHMARK("push and pop_min_n 64 items") {
+        PriorityQueue<int> queue;
+
+        for (int item: items) {
+            queue.push(item);
+        }
+
+        return queue.pop_min_n(64, popped.begin());
+    };
+}
+
+TEST_CASE("THROUGHPUT TESTS","[tp]") {
+    std::vector<int> threads_to_use = {1,2,4,7,14,20,28};
+
+    // a pop copies O(log n) nodes, which the node pools never
+    // reuse, shorter runs keep them within the pools
+    using Bench = ListTestBench<PriorityQueue<int>, 1000>;
+
+    auto push = [](PriorityQueue<int>& queue, int item) {
+        queue.push(item);
+    };
+
+    auto pop_min = [](PriorityQueue<int>& queue) {
+        return queue.pop_min();
+    };
+
+    using LockedBench = ListTestBench<LockedPriorityQueue, 1000>;
+
+    auto locked_push = [](LockedPriorityQueue& queue, int item) {
+        queue.push(item);
+    };
+
+    auto locked_pop_min = [](LockedPriorityQueue& queue) {
+        return queue.pop_min();
+    };
+
+    // MIXED PRODUCERS/CONSUMERS
+    std::cout << "LEFTIST HEAP" << std::endl;
+    Bench::test(Bench::experiment(50, 10000), threads_to_use, push, pop_min);
+
+    std::cout << "LOCKED STD::PRIORITY_QUEUE" << std::endl;
+    LockedBench::test(LockedBench::experiment(50, 10000), threads_to_use, locked_push, locked_pop_min);
+}
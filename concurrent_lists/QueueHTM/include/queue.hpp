@@ -1,8 +1,10 @@
 #define USER_NODE_POOL USER_MEM_POOL
-#define TREE_TYPE GENERAL_TREE
 
 #include <iostream>
+#include <chrono>
+#include <cassert>
 #include "../../../include/SafeTree.hpp"
+#include "../../../include/event_count.hpp"
 
 
 
@@ -45,90 +47,226 @@ class QueueItem {
             return 1;
         }
 
+        static constexpr int treeType() {
+            return GENERAL_TREE;
+        }
+
         ContentType getItem() const {
             return item;
         }
 };
 
+// Queue: the items are after a sentinel node, the head, which the
+// dequeued item becomes. The last item is kept in tail_, a second root
+// of the list, so enqueue and dequeue take constant time and only
+// conflict with operations on the same end.
 template <class ContentType>
 class Queue {
     private:
-        QueueItem<ContentType>* top_item;
         using Item =  QueueItem<ContentType>;
 
-        // last_elem: connection point at the last element
-        // of the list
-        ConnPointData<QueueItem<ContentType>> last_elem() {
-            PathTracker<Item> tracker(&top_item);
+        // apart so that enqueues and dequeues
+        // don't conflict on their line
+        alignas(TSX::ALIGNMENT) QueueItem<ContentType>* head_;
+        alignas(TSX::ALIGNMENT) QueueItem<ContentType>* tail_;
 
-            auto curr = tracker.getNode();
-            while ((curr = tracker.getNode()))
-            {
-                tracker.moveToChild(0);
-            }
+        // threads sleeping in dequeue_wait
+        alignas(TSX::ALIGNMENT) EventCount consumers_;
+
+        // registered with the group, the consumers
+        // are woken up once the items are visible
+        void wake_consumers(ConnPointGroup& group, const bool all) {
+            group.onCommit(all ? &EventCount::notifyAllOf : &EventCount::notifyOf, &consumers_);
+        }
 
-            return tracker.connectHere();
+        static Item* new_item(ContentType content) {
+            #ifdef USER_NODE_POOL
+                return ConnPoint<Item>::create_new_node(content, nullptr);
+            #else
+                return new QueueItem<ContentType>(content, nullptr);
+            #endif
         }
 
     
     public:
-        Queue(): top_item(nullptr) {}
+        Queue(): head_(new QueueItem<ContentType>(ContentType(), nullptr)), tail_(head_) {}
+
+        // the first item, nullptr if empty
         QueueItem<ContentType>* next() {
-            return top_item;
+            return head_->getChild(0);
         }
 
         const QueueItem<ContentType>* dequeue() {
+            // returned once it is connected, the
+            // operation is retried if it fails
+            const Item* dequeued = nullptr;
+
             // transaction block
             TM_SAFE_OPERATION_START(30) {
 
-                // PathTracker makes root the connection point
-                PathTracker<Item> tracker(&top_item);
+                // PathTracker makes the head the connection point
+                PathTracker<Item> tracker(&head_);
+
+                // the next pointer of the head is
+                // only set once, it needs no validation
+                auto const first = tracker.getNode()->getChild(0);
+
+                if (!first) {
+                    return nullptr;
+                }
 
                 auto conn_point_snapshot = tracker.connectHere();
 
                 ConnPoint<Item> conn(conn_point_snapshot);
 
-                // remove the root element
-                // replace with the next element
-                auto top = conn.getRoot();
-                auto const old_top = top? top->peekOriginal() : nullptr;
+                // the first item is the new head
+                conn.setRoot(conn.wrap_no_validate(first));
 
-                if (!top) {
-                    return nullptr;
-                }
+                dequeued = first;
+            } TM_SAFE_OPERATION_END
+
+            return dequeued;
+        }
+
+        // dequeue_wait: dequeues an item, if the queue is empty
+        // sleeps until an item is enqueued. Not in a group.
+        const QueueItem<ContentType>* dequeue_wait() {
+            assert(!ConnPointGroup::current());
+            return consumers_.awaitResult([this]() { return dequeue(); });
+        }
+
+        // returns nullptr if no item is enqueued before the timeout
+        template <class Rep, class Period>
+        const QueueItem<ContentType>* dequeue_wait(const std::chrono::duration<Rep, Period>& timeout) {
+            assert(!ConnPointGroup::current());
+            return consumers_.awaitResult([this]() { return dequeue(); }, EventCount::Clock::now() + timeout);
+        }
+
+        void enqueue(ContentType content) {
+            TM_SAFE_OPERATION_START(30) {
+                // both connection points commit together
+                ConnPointGroup group;
+
+                if (group.active()) {
+                    wake_consumers(group, false);
+
+                    Item* node_to_be_inserted = nullptr;
+
+                    {
+                        // the next pointer of the
+                        // tail is the connection point
+                        PathTracker<Item> tracker(&tail_);
+                        tracker.moveToChild(0);
+
+                        auto conn_point_snapshot = tracker.connectHere();
+
+                        ConnPoint<Item> conn(conn_point_snapshot);
+
+                        node_to_be_inserted = new_item(content);
+
+                        // merely append the new node
+                        conn.setRoot(conn.create_safe(node_to_be_inserted));
+                    }
 
-                auto after_top = top->getChild(0);
+                    {
+                        // then the tail moves to it
+                        PathTracker<Item> tracker(&tail_);
 
-                // set the next element
-                conn.setRoot(after_top);
+                        auto conn_point_snapshot = tracker.connectHere();
 
-                return old_top;
+                        ConnPoint<Item> conn(conn_point_snapshot);
+
+                        conn.setRoot(conn.create_safe(node_to_be_inserted));
+                    }
+                }
             } TM_SAFE_OPERATION_END
+        }
+
+        // enqueue_n: enqueues the items of the range in order. The items
+        // are linked before the operation, which only connects the chain.
+        template <class Iterator>
+        void enqueue_n(Iterator first, Iterator last) {
+            if (first == last) {
+                return;
+            }
+
+            Item* const chain = new_item(*first);
+            Item* chain_last = chain;
+
+            for (++first; first != last; ++first) {
+                Item* const item = new_item(*first);
+                chain_last->setChild(0, item);
+                chain_last = item;
+            }
+
+            TM_SAFE_OPERATION_START(30) {
+                ConnPointGroup group;
+
+                if (group.active()) {
+                    wake_consumers(group, true);
+
+                    {
+                        PathTracker<Item> tracker(&tail_);
+                        tracker.moveToChild(0);
+
+                        auto conn_point_snapshot = tracker.connectHere();
+
+                        ConnPoint<Item> conn(conn_point_snapshot);
+
+                        conn.setRoot(conn.create_safe(chain));
+                    }
 
-            return nullptr;
+                    {
+                        PathTracker<Item> tracker(&tail_);
 
+                        auto conn_point_snapshot = tracker.connectHere();
+
+                        ConnPoint<Item> conn(conn_point_snapshot);
+
+                        conn.setRoot(conn.create_safe(chain_last));
+                    }
+                }
+            } TM_SAFE_OPERATION_END
         }
 
-        void enqueue(ContentType content) {
+        // dequeue_n: dequeues up to n items in one operation, their
+        // contents are written to out in order. Returns the amount
+        // dequeued.
+        template <class OutputIterator>
+        int dequeue_n(const int n, OutputIterator out) {
+            Item* head = nullptr;
+            int n_dequeued = 0;
+
             TM_SAFE_OPERATION_START(30) {
+                PathTracker<Item> tracker(&head_);
 
-                // last elem is connection point
-                auto conn_point_snapshot = last_elem();
+                head = tracker.getNode();
+                n_dequeued = 0;
 
-                ConnPoint<Item> conn(conn_point_snapshot);
+                // the last item dequeued is the new head, the
+                // next pointers are only set once
+                Item* new_head = head;
+                while (n_dequeued < n && new_head->getChild(0)) {
+                    new_head = new_head->getChild(0);
+                    ++n_dequeued;
+                }
 
-                auto top = conn.getRoot();
+                if (!n_dequeued) {
+                    return 0;
+                }
 
-                #ifdef USER_NODE_POOL
-                    auto node_to_be_inserted = conn.create_safe(ConnPoint<Item>::create_new_node(content, nullptr));
-                #else
-                    auto node_to_be_inserted = conn.create_safe(new QueueItem<ContentType>(content, nullptr));
-                #endif
+                auto conn_point_snapshot = tracker.connectHere();
 
-                // merely append the new node
-                conn.setRoot(node_to_be_inserted);
+                ConnPoint<Item> conn(conn_point_snapshot);
 
-                node_to_be_inserted->setChild(0, top);
+                conn.setRoot(conn.wrap_no_validate(new_head));
             } TM_SAFE_OPERATION_END
+
+            for (int i = 0; i < n_dequeued; i++) {
+                head = head->getChild(0);
+                *out++ = head->getItem();
+            }
+
+            return n_dequeued;
         }
-};
\ No newline at end of file
+};
@@ -1,6 +1,12 @@
 #include <thread>
+#include <atomic>
+#include <vector>
+#include <iterator>
+#include <chrono>
 #include "../include/queue.hpp"
+#include "../../../concurrent_maps/AVLHTM/include/avl.hpp"
 #include "../../../include/catch2/catch.hpp"
+#include "../../../include/list_test_bench.hpp"
 
 constexpr int N_ITEMS = 1000;
 constexpr int THREADS = 6;
@@ -46,6 +52,30 @@ TEST_CASE("Queue Pop Test","[init]") {
      }
 }
 
+// the list is longer than any path of a tracker
+TEST_CASE("Queue Long Test","[init]") {
+    Queue<int> queue;
+
+    for (int i = 0; i < 20 * N_ITEMS; ++i) {
+        queue.enqueue(i);
+    }
+
+    for (int i = 0; i < 20 * N_ITEMS; ++i) {
+        REQUIRE(queue.dequeue()->getItem() == i);
+    }
+
+    REQUIRE(queue.dequeue() == nullptr);
+    REQUIRE(queue.next() == nullptr);
+
+    // the tail is the head again
+    queue.enqueue(1);
+    queue.enqueue(2);
+    REQUIRE(queue.next()->getItem() == 1);
+    REQUIRE(queue.dequeue()->getItem() == 1);
+    REQUIRE(queue.dequeue()->getItem() == 2);
+    REQUIRE(queue.dequeue() == nullptr);
+}
+
 void insert(int i, Queue<int>& queue) {
     const int start = i*N_ITEMS;
     for (int j = start; j < start + N_ITEMS; j++) {
@@ -87,11 +117,14 @@ TEST_CASE("Queue Multithreaded Push Test","[mt_enqueue]") {
     }
 }
 
+std::atomic<int> n_dequeued(0);
+
 void dequeue(bool* exists, Queue<int>& queue) {
     const QueueItem<int>* item;
     while ((item = queue.dequeue())) {
         auto n = item->getItem();
         exists[n] = true;
+        ++n_dequeued;
     }
 }
 
@@ -103,6 +136,7 @@ TEST_CASE("Queue Multithreaded Pop Test","[mt_enqueue]") {
     for (int j = 0; j < 1; j++) { 
             Queue<int> queue;
             std::thread threads[THREADS];
+            n_dequeued = 0;
 
             for (int i = 0; i < N_ITEMS*THREADS;i++) {
                 exists[i] = false;
@@ -124,11 +158,304 @@ TEST_CASE("Queue Multithreaded Pop Test","[mt_enqueue]") {
                 }
                 REQUIRE(exists[i]);
             }
+
+            // each item is dequeued once
+            REQUIRE(n_dequeued == N_ITEMS*THREADS);
+    }
+}
+
+
+// items are moved from the queue to an index, each
+// one should end up in exactly one of them
+TEST_CASE("Queue Atomic Move Test","[atomically]") {
+    TSX::SpinLock lock;
+
+    SECTION("move to index") {
+        Queue<int> queue;
+        AVLTree<int> index(nullptr, lock);
+
+        for (int i = 0; i < N_ITEMS*THREADS; i++) {
+            queue.enqueue(i);
+        }
+
+        std::thread threads[THREADS];
+
+        for (int i = 0; i < THREADS; i++) {
+            threads[i] = std::thread([&queue, &index](int t_id) {
+                bool moved = true;
+
+                while (moved) {
+                    SafeTree::atomically([&]() {
+                        auto item = queue.dequeue();
+                        moved = item != nullptr;
+
+                        if (moved) {
+                            index.insert(item->getItem(), t_id, t_id);
+                        }
+                    });
+                }
+            }, i);
+        }
+
+        for (int i = 0; i < THREADS; i++) {
+            threads[i].join();
+        }
+
+        REQUIRE(queue.next() == nullptr);
+        REQUIRE(index.size() == N_ITEMS*THREADS);
+
+        for (int i = 0; i < N_ITEMS*THREADS; i++) {
+            REQUIRE(index.lookup(i).found);
+        }
+
+        REQUIRE(index.isBalanced());
+    }
+
+    SECTION("changes are seen in the operation") {
+        Queue<int> queue;
+        AVLTree<int> index(nullptr, lock);
+
+        queue.enqueue(1);
+        queue.enqueue(2);
+
+        SafeTree::atomically([&]() {
+            auto item = queue.dequeue();
+            index.insert(item->getItem(), 10, 0);
+
+            REQUIRE(queue.next()->getItem() == 2);
+            REQUIRE(index.lookup(1).val == 10);
+
+            // tree transactions join the operation
+            index.transaction([](AVLTree<int>::Transaction& tx) {
+                tx.upsert(1, 11);
+                tx.insert(2, 20);
+            }, 0);
+
+            REQUIRE(index.lookup(1).val == 11);
+        });
+
+        REQUIRE(queue.next()->getItem() == 2);
+        REQUIRE(index.size() == 2);
+        REQUIRE(index.lookup(1).val == 11);
     }
 }
 
 
+TEST_CASE("Queue Batch Test","[batch]") {
+    Queue<int> queue;
+
+    SECTION("a batch is enqueued in order") {
+        std::vector<int> items = {1, 2, 3, 4, 5};
+
+        queue.enqueue(0);
+        queue.enqueue_n(items.begin(), items.end());
+        queue.enqueue_n(items.begin(), items.begin());
+        queue.enqueue(6);
 
+        std::vector<int> dequeued;
+        REQUIRE(queue.dequeue_n(3, std::back_inserter(dequeued)) == 3);
+        REQUIRE(dequeued == std::vector<int>({0, 1, 2}));
+
+        REQUIRE(queue.dequeue()->getItem() == 3);
+
+        // fewer items than asked for
+        REQUIRE(queue.dequeue_n(10, std::back_inserter(dequeued)) == 3);
+        REQUIRE(dequeued == std::vector<int>({0, 1, 2, 4, 5, 6}));
+
+        REQUIRE(queue.next() == nullptr);
+        REQUIRE(queue.dequeue_n(10, std::back_inserter(dequeued)) == 0);
+
+        // the tail moved to the end of the batch
+        queue.enqueue_n(items.begin(), items.end());
+        queue.enqueue(7);
+        REQUIRE(queue.dequeue_n(10, std::back_inserter(dequeued)) == 6);
+        REQUIRE(dequeued.back() == 7);
+    }
+
+    SECTION("multithreaded batches") {
+        std::atomic<int> counts[N_ITEMS*THREADS];
+
+        for (auto& count: counts) {
+            count = 0;
+        }
+
+        std::thread threads[THREADS];
+
+        for (int i = 0; i < THREADS; i++) {
+            threads[i] = std::thread([&queue, &counts](int t_id) {
+                std::vector<int> batch;
+                int dequeued[16];
+
+                for (int j = t_id * N_ITEMS; j < (t_id + 1) * N_ITEMS; j++) {
+                    batch.push_back(j);
+
+                    if (batch.size() == 16) {
+                        queue.enqueue_n(batch.begin(), batch.end());
+                        batch.clear();
+
+                        const int n = queue.dequeue_n(8, dequeued);
+                        for (int k = 0; k < n; k++) {
+                            ++counts[dequeued[k]];
+                        }
+                    }
+                }
 
+                queue.enqueue_n(batch.begin(), batch.end());
+            }, i);
+        }
 
+        for (int i = 0; i < THREADS; i++) {
+            threads[i].join();
+        }
 
+        for (const QueueItem<int>* item = queue.dequeue(); item; item = queue.dequeue()) {
+            ++counts[item->getItem()];
+        }
+
+        for (int i = 0; i < N_ITEMS*THREADS; i++) {
+            REQUIRE(counts[i] == 1);
+        }
+    }
+}
+
+
+TEST_CASE("Queue Blocking Dequeue Test","[wait]") {
+    Queue<int> queue;
+
+    SECTION("an empty queue times out") {
+        REQUIRE(queue.dequeue_wait(std::chrono::milliseconds(20)) == nullptr);
+
+        queue.enqueue(1);
+        REQUIRE(queue.dequeue_wait(std::chrono::milliseconds(20))->getItem() == 1);
+    }
+
+    SECTION("a sleeping consumer is woken up") {
+        std::atomic<int> dequeued(-1);
+
+        std::thread consumer([&queue, &dequeued]() {
+            dequeued = queue.dequeue_wait()->getItem();
+        });
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        REQUIRE(dequeued == -1);
+
+        queue.enqueue(7);
+        consumer.join();
+
+        REQUIRE(dequeued == 7);
+        REQUIRE(queue.next() == nullptr);
+    }
+
+    SECTION("a batch or a group wakes up the consumers") {
+        std::atomic<int> sum(0);
+        std::vector<std::thread> consumers;
+
+        for (int i = 0; i < THREADS; i++) {
+            consumers.emplace_back([&queue, &sum]() {
+                sum += queue.dequeue_wait()->getItem();
+            });
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+        std::vector<int> items(THREADS - 1, 1);
+        queue.enqueue_n(items.begin(), items.end());
+
+        // woken up once the operation commits
+        SafeTree::atomically([&]() {
+            queue.enqueue(1);
+        });
+
+        for (auto& consumer: consumers) {
+            consumer.join();
+        }
+
+        REQUIRE(sum == THREADS);
+    }
+
+    SECTION("producers and sleeping consumers") {
+        std::atomic<int> counts[N_ITEMS*THREADS];
+
+        for (auto& count: counts) {
+            count = 0;
+        }
+
+        std::vector<std::thread> threads;
+
+        for (int i = 0; i < THREADS; i++) {
+            threads.emplace_back([&queue, i]() {
+                for (int j = i * N_ITEMS; j < (i + 1) * N_ITEMS; j++) {
+                    queue.enqueue(j);
+
+                    if (j % 64 == 0) {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+
+            threads.emplace_back([&queue, &counts]() {
+                for (int j = 0; j < N_ITEMS; j++) {
+                    ++counts[queue.dequeue_wait()->getItem()];
+                }
+            });
+        }
+
+        for (auto& thread: threads) {
+            thread.join();
+        }
+
+        REQUIRE(queue.next() == nullptr);
+
+        for (int i = 0; i < N_ITEMS*THREADS; i++) {
+            REQUIRE(counts[i] == 1);
+        }
+    }
+}
+
+
+TEST_CASE("BATCH BENCHMARKS","[tp][tp_batch]") {
+    std::vector<int> items(64);
+    std::vector<int> dequeued(64);
+
+    BENCHMARK("enqueue and dequeue 64 items one by one") {
+        Queue<int> queue;
+
+        for (int item: items) {
+            queue.enqueue(item);
+        }
+
+        for (std::size_t i = 0; i < items.size(); i++) {
+            dequeued[i] = queue.dequeue()->getItem();
+        }
+
+        return dequeued[0];
+    };
+
+    BENCHMARK("enqueue_n and dequeue_n of 64 items") {
+        Queue<int> queue;
+
+        queue.enqueue_n(items.begin(), items.end());
+        return queue.dequeue_n(64, dequeued.begin());
+    };
+}
+
+
+TEST_CASE("THROUGHPUT TESTS","[tp]") {
+    using Bench = ListTestBench<Queue<int>>;
+
+    std::vector<int> threads_to_use = {1,2,4,7,14,20,28};
+
+    auto put = [](Queue<int>& queue, int item) {
+        queue.enqueue(item);
+    };
+
+    auto take = [](Queue<int>& queue) {
+        return queue.dequeue();
+    };
+
+    // MIXED PRODUCERS/CONSUMERS
+    Bench::test(Bench::experiment(50, 1000), threads_to_use, put, take);
+
+    // HALF PRODUCERS, HALF CONSUMERS
+    Bench::test(Bench::experiment(50, 1000), threads_to_use, put, take, true);
+}
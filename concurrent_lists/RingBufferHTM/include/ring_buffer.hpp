@@ -0,0 +1,243 @@
+#ifndef RING_BUFFER_HPP
+    #define RING_BUFFER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <iostream>
+#include "../../../include/TSXGuard.hpp"
+
+
+// RingBuffer: a bounded multi producer, multi consumer queue on an array,
+// which allocates nothing after its construction.
+// Each slot has a sequence number, which tells the lap of the slot and if
+// it holds an item: an enqueue at position pos finds the sequence pos in a
+// free slot and leaves pos + 1, a dequeue finds pos + 1 and leaves the pos
+// of the next lap.
+// An operation claims its position, moves the item and publishes the slot
+// in one transaction. When transactions keep failing it falls back to a
+// compare and swap on the position, which takes no lock, so the operations
+// in transactions never wait for it. Either one sees the other's changes
+// as a whole, as a transaction aborts when a fallback writes what it read.
+template <class ContentType>
+class RingBuffer {
+    public:
+        enum {
+            DEFAULT_CAPACITY = 1024,
+            TX_RETRIES = 10
+        };
+
+    private:
+        // each slot on its own cache lines
+        struct alignas(TSX::ALIGNMENT) Slot {
+            std::atomic<std::size_t> seq;
+            ContentType item;
+        };
+
+        // the result of an operation in a transaction
+        enum TxResult {
+            TX_DONE,
+            TX_FULL,
+            TX_EMPTY,
+            TX_FAILED
+        };
+
+        Slot* slots_;
+        std::size_t mask_;
+        int tx_retries_;
+
+        // never taken, the fallback doesn't lock
+        TSX::SpinLock lock_;
+
+        // the next position to enqueue at and to
+        // dequeue from, apart so that producers and
+        // consumers don't conflict on their line
+        alignas(TSX::ALIGNMENT) std::atomic<std::size_t> tail_;
+        alignas(TSX::ALIGNMENT) std::atomic<std::size_t> head_;
+
+        static std::ptrdiff_t distance(const std::size_t seq, const std::size_t pos) {
+            return static_cast<std::ptrdiff_t>(seq - pos);
+        }
+
+        TxResult tx_enqueue(const ContentType& item) {
+            int retries = tx_retries_;
+            unsigned char err_status = 0;
+
+            TSX::TSXTransOnlyGuard guard(retries, lock_, err_status, TSX::__internal__trans_stats);
+
+            if (err_status == TSX::ABORT_VALIDATION_FAILURE) {
+                return TX_FAILED;
+            }
+
+            const std::size_t pos = tail_.load(std::memory_order_relaxed);
+            Slot& slot = slots_[pos & mask_];
+            const std::size_t seq = slot.seq.load(std::memory_order_acquire);
+
+            if (seq != pos) {
+                // an item of the last lap is still there, unless a
+                // fallback has claimed the slot and not filled it yet
+                return distance(seq, pos) < 0 ? TX_FULL : TX_FAILED;
+            }
+
+            slot.item = item;
+            slot.seq.store(pos + 1, std::memory_order_release);
+            tail_.store(pos + 1, std::memory_order_relaxed);
+
+            return TX_DONE;
+        }
+
+        TxResult tx_dequeue(ContentType& item) {
+            int retries = tx_retries_;
+            unsigned char err_status = 0;
+
+            TSX::TSXTransOnlyGuard guard(retries, lock_, err_status, TSX::__internal__trans_stats);
+
+            if (err_status == TSX::ABORT_VALIDATION_FAILURE) {
+                return TX_FAILED;
+            }
+
+            const std::size_t pos = head_.load(std::memory_order_relaxed);
+            Slot& slot = slots_[pos & mask_];
+            const std::size_t seq = slot.seq.load(std::memory_order_acquire);
+
+            if (seq != pos + 1) {
+                return distance(seq, pos + 1) < 0 ? TX_EMPTY : TX_FAILED;
+            }
+
+            item = slot.item;
+            slot.seq.store(pos + mask_ + 1, std::memory_order_release);
+            head_.store(pos + 1, std::memory_order_relaxed);
+
+            return TX_DONE;
+        }
+
+        bool cas_enqueue(const ContentType& item) {
+            std::size_t pos = tail_.load(std::memory_order_relaxed);
+            Slot* slot;
+
+            for (;;) {
+                slot = &slots_[pos & mask_];
+                const std::ptrdiff_t dist = distance(slot->seq.load(std::memory_order_acquire), pos);
+
+                if (dist == 0) {
+                    if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if (dist < 0) {
+                    return false;
+                } else {
+                    pos = tail_.load(std::memory_order_relaxed);
+                }
+            }
+
+            slot->item = item;
+            slot->seq.store(pos + 1, std::memory_order_release);
+
+            return true;
+        }
+
+        bool cas_dequeue(ContentType& item) {
+            std::size_t pos = head_.load(std::memory_order_relaxed);
+            Slot* slot;
+
+            for (;;) {
+                slot = &slots_[pos & mask_];
+                const std::ptrdiff_t dist = distance(slot->seq.load(std::memory_order_acquire), pos + 1);
+
+                if (dist == 0) {
+                    if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if (dist < 0) {
+                    return false;
+                } else {
+                    pos = head_.load(std::memory_order_relaxed);
+                }
+            }
+
+            item = slot->item;
+            slot->seq.store(pos + mask_ + 1, std::memory_order_release);
+
+            return true;
+        }
+
+    public:
+        // the capacity is rounded up to a power of two. With
+        // tx_retries 0 the operations only use the fallback.
+        explicit RingBuffer(const std::size_t capacity = DEFAULT_CAPACITY, const int tx_retries = TX_RETRIES):
+        slots_(nullptr), mask_(1), tx_retries_(tx_retries), tail_(0), head_(0) {
+            while (mask_ < capacity) {
+                mask_ <<= 1;
+            }
+
+            void* memory;
+            if (posix_memalign(&memory, TSX::ALIGNMENT, mask_ * sizeof(Slot))) {
+                throw std::bad_alloc();
+            }
+
+            slots_ = static_cast<Slot*>(memory);
+
+            for (std::size_t i = 0; i < mask_; i++) {
+                new (&slots_[i]) Slot();
+                slots_[i].seq.store(i, std::memory_order_relaxed);
+            }
+
+            --mask_;
+        }
+
+        // no copying or moving
+        RingBuffer(const RingBuffer&) = delete;
+        RingBuffer& operator=(const RingBuffer&) = delete;
+
+        ~RingBuffer() {
+            for (std::size_t i = 0; i <= mask_; i++) {
+                slots_[i].~Slot();
+            }
+
+            free(slots_);
+        }
+
+        // enqueue: false if the buffer is full
+        bool enqueue(const ContentType& item) {
+            switch (tx_enqueue(item)) {
+                case TX_DONE:
+                    return true;
+                case TX_FULL:
+                    return false;
+                default:
+                    return cas_enqueue(item);
+            }
+        }
+
+        // dequeue: false if the buffer is empty, otherwise
+        // the first item is moved to item
+        bool dequeue(ContentType& item) {
+            switch (tx_dequeue(item)) {
+                case TX_DONE:
+                    return true;
+                case TX_EMPTY:
+                    return false;
+                default:
+                    return cas_dequeue(item);
+            }
+        }
+
+        std::size_t capacity() const {
+            return mask_ + 1;
+        }
+
+        // exact only when no operation runs
+        std::size_t size() const {
+            // the head first, it never passes the tail
+            const std::size_t head = head_.load(std::memory_order_acquire);
+            return tail_.load(std::memory_order_acquire) - head;
+        }
+
+        bool empty() const {
+            return !size();
+        }
+};
+
+#endif
@@ -0,0 +1,164 @@
+#include <thread>
+#include <atomic>
+#include <vector>
+#include "../include/ring_buffer.hpp"
+#include "../../QueueHTM/include/queue.hpp"
+#include "../../../include/catch2/catch.hpp"
+#include "../../../include/list_test_bench.hpp"
+
+constexpr int N_ITEMS = 10000;
+constexpr int THREADS = 6;
+
+// with transactions, and with the fallback only
+const std::vector<int> TX_RETRIES = {RingBuffer<int>::TX_RETRIES, 0};
+
+
+TEST_CASE("RingBuffer Init Test","[init]") {
+    RingBuffer<int> ring(1000);
+
+    REQUIRE(ring.capacity() == 1024);
+    REQUIRE(ring.empty());
+
+    RingBuffer<int> single(1);
+    REQUIRE(single.capacity() == 1);
+
+    RingBuffer<int> by_default;
+    REQUIRE(by_default.capacity() == RingBuffer<int>::DEFAULT_CAPACITY);
+}
+
+TEST_CASE("RingBuffer Order Test","[init]") {
+    for (const int tx_retries: TX_RETRIES) {
+        RingBuffer<int> ring(8, tx_retries);
+        int item = -1;
+
+        REQUIRE(!ring.dequeue(item));
+        REQUIRE(item == -1);
+
+        for (int i = 0; i < 8; i++) {
+            REQUIRE(ring.enqueue(i));
+        }
+
+        REQUIRE(ring.size() == 8);
+        REQUIRE(!ring.enqueue(8));
+
+        for (int i = 0; i < 8; i++) {
+            REQUIRE(ring.dequeue(item));
+            REQUIRE(item == i);
+        }
+
+        REQUIRE(!ring.dequeue(item));
+        REQUIRE(ring.empty());
+    }
+}
+
+// the positions go around the array many times
+TEST_CASE("RingBuffer Wrap Around Test","[init]") {
+    for (const int tx_retries: TX_RETRIES) {
+        RingBuffer<int> ring(4, tx_retries);
+        int next_dequeued = 0;
+        int item;
+
+        for (int i = 0; i < N_ITEMS; i++) {
+            REQUIRE(ring.enqueue(i));
+
+            if (i % 2) {
+                REQUIRE(ring.dequeue(item));
+                REQUIRE(item == next_dequeued++);
+                REQUIRE(ring.dequeue(item));
+                REQUIRE(item == next_dequeued++);
+            }
+        }
+
+        REQUIRE(next_dequeued == N_ITEMS);
+        REQUIRE(ring.empty());
+    }
+}
+
+TEST_CASE("RingBuffer Multithreaded Test","[mt]") {
+    for (const int tx_retries: TX_RETRIES) {
+        // smaller than the items, producers find it full
+        RingBuffer<int> ring(64, tx_retries);
+
+        std::atomic<int> counts[N_ITEMS*THREADS];
+
+        for (auto& count: counts) {
+            count = 0;
+        }
+
+        std::vector<std::thread> threads;
+
+        for (int i = 0; i < THREADS; i++) {
+            threads.emplace_back([&ring, i]() {
+                for (int j = i * N_ITEMS; j < (i + 1) * N_ITEMS; j++) {
+                    while (!ring.enqueue(j)) {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+
+            threads.emplace_back([&ring, &counts]() {
+                int item;
+
+                for (int j = 0; j < N_ITEMS; j++) {
+                    while (!ring.dequeue(item)) {
+                        std::this_thread::yield();
+                    }
+
+                    ++counts[item];
+                }
+            });
+        }
+
+        for (auto& thread: threads) {
+            thread.join();
+        }
+
+        REQUIRE(ring.empty());
+
+        for (int i = 0; i < N_ITEMS*THREADS; i++) {
+            REQUIRE(counts[i] == 1);
+        }
+    }
+}
+
+
+TEST_CASE("THROUGHPUT TESTS","[tp]") {
+    std::vector<int> threads_to_use = {1,2,4,7,14,20,28};
+
+    using Bench = ListTestBench<RingBuffer<int>>;
+
+    auto put = [](RingBuffer<int>& ring, int item) {
+        return ring.enqueue(item);
+    };
+
+    auto take = [](RingBuffer<int>& ring) {
+        TakenItem taken;
+        taken.found = ring.dequeue(taken.item);
+        return taken;
+    };
+
+    // the linked queue, to compare
+    using QueueBench = ListTestBench<Queue<int>>;
+
+    auto enqueue = [](Queue<int>& queue, int item) {
+        queue.enqueue(item);
+    };
+
+    auto dequeue = [](Queue<int>& queue) {
+        return queue.dequeue();
+    };
+
+    // MIXED PRODUCERS/CONSUMERS
+    std::cout << "RING BUFFER" << std::endl;
+    Bench::test(Bench::experiment(50, 512), threads_to_use, put, take);
+
+    std::cout << "LINKED QUEUE" << std::endl;
+    QueueBench::test(QueueBench::experiment(50, 512), threads_to_use, enqueue, dequeue);
+
+    // HALF PRODUCERS, HALF CONSUMERS
+    std::cout << "RING BUFFER" << std::endl;
+    Bench::test(Bench::experiment(50, 512), threads_to_use, put, take, true);
+
+    std::cout << "LINKED QUEUE" << std::endl;
+    QueueBench::test(QueueBench::experiment(50, 512), threads_to_use, enqueue, dequeue, true);
+}
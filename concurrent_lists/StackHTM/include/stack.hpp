@@ -1,8 +1,12 @@
 #define USER_NODE_POOL USER_MEM_POOL
-#define TREE_TYPE GENERAL_TREE
 
 #include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cassert>
+#include <cstdint>
 #include "../../../include/SafeTree.hpp"
+#include "../../../include/event_count.hpp"
 
 
 
@@ -45,52 +49,214 @@ class StackItem {
             return 1;
         }
 
+        static constexpr int treeType() {
+            return GENERAL_TREE;
+        }
+
         ContentType getItem() const {
             return item;
         }
 };
 
+// EliminationArray: a push and a pop which meet here cancel each other
+// out without touching the stack. A push offers its item in a slot and
+// waits a little for a pop to take it, a pop takes any item offered.
+template <class Item>
+class EliminationArray {
+    private:
+        static constexpr int SLOTS = 8;
+        static constexpr int WAIT_SPINS = 256;
+
+        // the slot was taken by a pop
+        static Item* taken() {
+            return reinterpret_cast<Item*>(std::uintptr_t(1));
+        }
+
+        struct alignas(64) Slot {
+            std::atomic<Item*> offer;
+        };
+
+        Slot slots_[SLOTS];
+
+        static int random_slot() {
+            thread_local unsigned seed = static_cast<unsigned>(reinterpret_cast<std::uintptr_t>(&seed) >> 4) | 1;
+
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+
+            return seed % SLOTS;
+        }
+
+    public:
+        EliminationArray() {
+            for (auto& slot: slots_) {
+                slot.offer.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        // true if a pop took the item
+        bool push(Item* item) {
+            auto& offer = slots_[random_slot()].offer;
+
+            Item* expected = nullptr;
+            if (!offer.compare_exchange_strong(expected, item, std::memory_order_release, std::memory_order_relaxed)) {
+                return false;
+            }
+
+            for (int i = 0; i < WAIT_SPINS && offer.load(std::memory_order_relaxed) == item; i++) {
+                _mm_pause();
+            }
+
+            // withdraw the offer, unless a pop took it
+            expected = item;
+            if (offer.compare_exchange_strong(expected, nullptr, std::memory_order_relaxed)) {
+                return false;
+            }
+
+            offer.store(nullptr, std::memory_order_relaxed);
+            return true;
+        }
+
+        // an item offered by a push, nullptr if none
+        Item* pop() {
+            auto& offer = slots_[random_slot()].offer;
+
+            Item* item = offer.load(std::memory_order_acquire);
+            if (!item || item == taken() || !offer.compare_exchange_strong(item, taken(), std::memory_order_acquire)) {
+                return nullptr;
+            }
+
+            return item;
+        }
+};
+
+
 template <class ContentType>
 class Stack {
     private:
         StackItem<ContentType>* top_item;
         using Item =  StackItem<ContentType>;
 
+        // pushes and pops whose transaction failed try
+        // to eliminate each other before they retry
+        bool eliminate_;
+        EliminationArray<Item> elimination_;
+
+        // threads sleeping in pop_wait
+        EventCount consumers_;
+
+        // once the items are visible, in a
+        // group once the group commits
+        void wake_consumers(const bool all) {
+            auto group = ConnPointGroup::current();
+
+            if (group) {
+                group->onCommit(all ? &EventCount::notifyAllOf : &EventCount::notifyOf, &consumers_);
+            } else if (all) {
+                consumers_.notifyAll();
+            } else {
+                consumers_.notify();
+            }
+        }
+
+        // not in a group, whose operations have to commit
+        // together, nor holding the fallback lock
+        bool eliminating() const {
+            return eliminate_ && !ConnPointGroup::current() && !TSX::__internal__trans_pointer->has_locked();
+        }
+
+        static Item* new_item(ContentType content) {
+            #ifdef USER_NODE_POOL
+                return ConnPoint<Item>::create_new_node(content, nullptr);
+            #else
+                return new StackItem<ContentType>(content, nullptr);
+            #endif
+        }
+
     
     public:
-        Stack(): top_item(nullptr) {}
+        explicit Stack(const bool eliminate = true): top_item(nullptr), eliminate_(eliminate) {}
         StackItem<ContentType>* top() {
             return top_item;
         }
 
+        void setElimination(const bool eliminate) {
+            eliminate_ = eliminate;
+        }
+
         const StackItem<ContentType>* pop() {
+            // returned once it is connected, the
+            // operation is retried if it fails
+            const Item* popped = nullptr;
+            bool retry = false;
+
             TM_SAFE_OPERATION_START(30) {
-                PathTracker<Item> tracker(&top_item);
+                if (retry && eliminating()) {
+                    auto const item = elimination_.pop();
 
-                auto conn_point_snapshot = tracker.connectHere();
+                    if (item) {
+                        return item;
+                    }
+                }
 
-                ConnPoint<Item> conn(conn_point_snapshot);
+                retry = true;
 
-                auto top = conn.getRoot();
-                auto const old_top = top? top->peekOriginal() : nullptr;
+                PathTracker<Item> tracker(&top_item);
+
+                auto const top = tracker.getNode();
 
                 if (!top) {
                     return nullptr;
                 }
 
-                auto after_top = top->getChild(0);
+                auto conn_point_snapshot = tracker.connectHere();
 
-                conn.setRoot(after_top);
+                ConnPoint<Item> conn(conn_point_snapshot);
+
+                // pushed items never change, only
+                // the top needs to be validated
+                conn.setRoot(conn.wrap_no_validate(top->getChild(0)));
 
-                return old_top;
+                popped = top;
             } TM_SAFE_OPERATION_END
 
-            return nullptr;
+            return popped;
+        }
+
+        // pop_wait: pops an item, if the stack is empty
+        // sleeps until an item is pushed. Not in a group.
+        const StackItem<ContentType>* pop_wait() {
+            assert(!ConnPointGroup::current());
+            return consumers_.awaitResult([this]() { return pop(); });
+        }
 
+        // returns nullptr if no item is pushed before the timeout
+        template <class Rep, class Period>
+        const StackItem<ContentType>* pop_wait(const std::chrono::duration<Rep, Period>& timeout) {
+            assert(!ConnPointGroup::current());
+            return consumers_.awaitResult([this]() { return pop(); }, EventCount::Clock::now() + timeout);
         }
 
         void push(ContentType content) {
+            // the item offered for elimination, pushed if no pop takes it
+            Item* offered = nullptr;
+            bool retry = false;
+
             TM_SAFE_OPERATION_START(30) {
+                if (retry && eliminating()) {
+                    // made out of any connection point,
+                    // so that a failed one keeps it
+                    if (!offered) {
+                        offered = new_item(content);
+                    }
+
+                    if (elimination_.push(offered)) {
+                        break;
+                    }
+                }
+
+                retry = true;
 
                 PathTracker<Item> tracker(&top_item);
 
@@ -98,17 +264,88 @@ class Stack {
 
                 ConnPoint<Item> conn(conn_point_snapshot);
 
-                auto top = conn.getRoot();
+                auto top = conn.wrap_no_validate(conn.getConnPointer());
 
-                #ifdef USER_NODE_POOL
-                    auto node_to_be_inserted = conn.create_safe(ConnPoint<Item>::create_new_node(content, nullptr));
-                #else
-                    auto node_to_be_inserted = conn.create_safe(new StackItem<ContentType>(content, nullptr));
-                #endif
+                auto node_to_be_inserted = conn.create_safe(offered ? offered : new_item(content));
 
                 conn.setRoot(node_to_be_inserted);
 
                 node_to_be_inserted->setChild(0, top);
             } TM_SAFE_OPERATION_END
+
+            wake_consumers(false);
         }
-};
\ No newline at end of file
+
+        // push_n: pushes the items of the range in order, the last one
+        // ends up on top. The items are linked before the operation,
+        // which only connects the chain.
+        template <class Iterator>
+        void push_n(Iterator first, Iterator last) {
+            if (first == last) {
+                return;
+            }
+
+            Item* const bottom = new_item(*first);
+            Item* chain = bottom;
+
+            for (++first; first != last; ++first) {
+                Item* const item = new_item(*first);
+                item->setChild(0, chain);
+                chain = item;
+            }
+
+            TM_SAFE_OPERATION_START(30) {
+                PathTracker<Item> tracker(&top_item);
+
+                auto conn_point_snapshot = tracker.connectHere();
+
+                ConnPoint<Item> conn(conn_point_snapshot);
+
+                // the chain is not published yet
+                bottom->setChild(0, conn.getConnPointer());
+
+                conn.setRoot(conn.create_safe(chain));
+            } TM_SAFE_OPERATION_END
+
+            wake_consumers(true);
+        }
+
+        // pop_n: pops up to n items in one operation, their
+        // contents are written to out from the top down.
+        // Returns the amount popped.
+        template <class OutputIterator>
+        int pop_n(const int n, OutputIterator out) {
+            Item* popped = nullptr;
+            int n_popped = 0;
+
+            TM_SAFE_OPERATION_START(30) {
+                PathTracker<Item> tracker(&top_item);
+
+                popped = tracker.getNode();
+                n_popped = 0;
+
+                // pushed items never change
+                Item* rest = popped;
+                while (rest && n_popped < n) {
+                    rest = rest->getChild(0);
+                    ++n_popped;
+                }
+
+                if (!n_popped) {
+                    return 0;
+                }
+
+                auto conn_point_snapshot = tracker.connectHere();
+
+                ConnPoint<Item> conn(conn_point_snapshot);
+
+                conn.setRoot(conn.wrap_no_validate(rest));
+            } TM_SAFE_OPERATION_END
+
+            for (int i = 0; i < n_popped; i++, popped = popped->getChild(0)) {
+                *out++ = popped->getItem();
+            }
+
+            return n_popped;
+        }
+};
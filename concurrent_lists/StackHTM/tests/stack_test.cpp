@@ -1,6 +1,11 @@
 #include <thread>
+#include <atomic>
+#include <vector>
+#include <iterator>
+#include <chrono>
 #include "../include/stack.hpp"
 #include "../../../include/catch2/catch.hpp"
+#include "../../../include/list_test_bench.hpp"
 
 constexpr int N_ITEMS = 10000;
 constexpr int THREADS = 6;
@@ -129,7 +134,290 @@ TEST_CASE("Stack Multithreaded Pop Test","[mt_push]") {
 }
 
 
+TEST_CASE("Stack Elimination Test","[elimination]") {
+    using Item = StackItem<int>;
 
+    SECTION("an offer nobody takes is withdrawn") {
+        EliminationArray<Item> elimination;
+        Item item(1, nullptr);
 
+        REQUIRE(!elimination.push(&item));
+        REQUIRE(elimination.pop() == nullptr);
+    }
+
+    SECTION("a push and a pop meet") {
+        EliminationArray<Item> elimination;
+        Item item(1, nullptr);
+
+        std::thread pusher([&elimination, &item]() {
+            while (!elimination.push(&item));
+        });
+
+        const Item* popped = nullptr;
+        while (!(popped = elimination.pop()));
+
+        pusher.join();
+
+        REQUIRE(popped == &item);
+        REQUIRE(elimination.pop() == nullptr);
+    }
+
+    SECTION("pushes and pops with elimination") {
+        Stack<int> stack;
+        bool exists[N_ITEMS*THREADS];
+
+        for (int i = 0; i < N_ITEMS*THREADS; i++) {
+            exists[i] = false;
+        }
+
+        std::thread threads[THREADS];
+
+        // every thread pushes its items and then pops
+        // as many, the pops can find anybody's items
+        for (int i = 0; i < THREADS; i++) {
+            threads[i] = std::thread([&stack, &exists](int t_id) {
+                for (int j = t_id * N_ITEMS; j < (t_id + 1) * N_ITEMS; j++) {
+                    stack.push(j);
+
+                    if (j % 2) {
+                        auto item = stack.pop();
+                        exists[item->getItem()] = true;
+                        item = stack.pop();
+                        exists[item->getItem()] = true;
+                    }
+                }
+            }, i);
+        }
+
+        for (int i = 0; i < THREADS; i++) {
+            threads[i].join();
+        }
+
+        REQUIRE(stack.top() == nullptr);
+
+        for (int i = 0; i < N_ITEMS*THREADS; i++) {
+            REQUIRE(exists[i]);
+        }
+    }
+}
+
+
+TEST_CASE("Stack Batch Test","[batch]") {
+    Stack<int> stack;
+
+    SECTION("a batch is pushed in order") {
+        std::vector<int> items = {1, 2, 3, 4, 5};
+
+        stack.push(0);
+        stack.push_n(items.begin(), items.end());
+        stack.push_n(items.begin(), items.begin());
+
+        REQUIRE(stack.top()->getItem() == 5);
+
+        std::vector<int> popped;
+        REQUIRE(stack.pop_n(3, std::back_inserter(popped)) == 3);
+        REQUIRE(popped == std::vector<int>({5, 4, 3}));
+
+        REQUIRE(stack.pop()->getItem() == 2);
+
+        // fewer items than asked for
+        REQUIRE(stack.pop_n(10, std::back_inserter(popped)) == 2);
+        REQUIRE(popped == std::vector<int>({5, 4, 3, 1, 0}));
+
+        REQUIRE(stack.top() == nullptr);
+        REQUIRE(stack.pop_n(10, std::back_inserter(popped)) == 0);
+    }
+
+    SECTION("multithreaded batches") {
+        std::atomic<int> counts[N_ITEMS*THREADS];
+
+        for (auto& count: counts) {
+            count = 0;
+        }
+
+        std::thread threads[THREADS];
+
+        for (int i = 0; i < THREADS; i++) {
+            threads[i] = std::thread([&stack, &counts](int t_id) {
+                std::vector<int> batch;
+                int popped[16];
+
+                for (int j = t_id * N_ITEMS; j < (t_id + 1) * N_ITEMS; j++) {
+                    batch.push_back(j);
+
+                    if (batch.size() == 16) {
+                        stack.push_n(batch.begin(), batch.end());
+                        batch.clear();
+
+                        const int n = stack.pop_n(8, popped);
+                        for (int k = 0; k < n; k++) {
+                            ++counts[popped[k]];
+                        }
+                    }
+                }
+
+                stack.push_n(batch.begin(), batch.end());
+            }, i);
+        }
+
+        for (int i = 0; i < THREADS; i++) {
+            threads[i].join();
+        }
+
+        for (const StackItem<int>* item = stack.pop(); item; item = stack.pop()) {
+            ++counts[item->getItem()];
+        }
+
+        for (int i = 0; i < N_ITEMS*THREADS; i++) {
+            REQUIRE(counts[i] == 1);
+        }
+    }
+}
+
+
+TEST_CASE("Stack Blocking Pop Test","[wait]") {
+    Stack<int> stack;
+
+    SECTION("an empty stack times out") {
+        REQUIRE(stack.pop_wait(std::chrono::milliseconds(20)) == nullptr);
+
+        stack.push(1);
+        REQUIRE(stack.pop_wait(std::chrono::milliseconds(20))->getItem() == 1);
+    }
 
+    SECTION("a sleeping consumer is woken up") {
+        std::atomic<int> popped(-1);
 
+        std::thread consumer([&stack, &popped]() {
+            popped = stack.pop_wait()->getItem();
+        });
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        REQUIRE(popped == -1);
+
+        stack.push(7);
+        consumer.join();
+
+        REQUIRE(popped == 7);
+        REQUIRE(stack.top() == nullptr);
+    }
+
+    SECTION("a batch wakes up all the consumers") {
+        std::atomic<int> sum(0);
+        std::vector<std::thread> consumers;
+
+        for (int i = 0; i < THREADS; i++) {
+            consumers.emplace_back([&stack, &sum]() {
+                sum += stack.pop_wait()->getItem();
+            });
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+        std::vector<int> items(THREADS, 1);
+        stack.push_n(items.begin(), items.end());
+
+        for (auto& consumer: consumers) {
+            consumer.join();
+        }
+
+        REQUIRE(sum == THREADS);
+    }
+
+    SECTION("producers and sleeping consumers") {
+        std::atomic<int> counts[N_ITEMS*THREADS];
+
+        for (auto& count: counts) {
+            count = 0;
+        }
+
+        std::vector<std::thread> threads;
+
+        for (int i = 0; i < THREADS; i++) {
+            threads.emplace_back([&stack, i]() {
+                for (int j = i * N_ITEMS; j < (i + 1) * N_ITEMS; j++) {
+                    stack.push(j);
+
+                    if (j % 64 == 0) {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+
+            threads.emplace_back([&stack, &counts]() {
+                for (int j = 0; j < N_ITEMS; j++) {
+                    ++counts[stack.pop_wait()->getItem()];
+                }
+            });
+        }
+
+        for (auto& thread: threads) {
+            thread.join();
+        }
+
+        REQUIRE(stack.top() == nullptr);
+
+        for (int i = 0; i < N_ITEMS*THREADS; i++) {
+            REQUIRE(counts[i] == 1);
+        }
+    }
+}
+
+
+TEST_CASE("BATCH BENCHMARKS","[tp][tp_batch]") {
+    std::vector<int> items(64);
+    std::vector<int> popped(64);
+
+    BENCHMARK("push and pop 64 items one by one") {
+        Stack<int> stack;
+
+        for (int item: items) {
+            stack.push(item);
+        }
+
+        for (std::size_t i = 0; i < items.size(); i++) {
+            popped[i] = stack.pop()->getItem();
+        }
+
+        return popped[0];
+    };
+
+    BENCHMARK("push_n and pop_n of 64 items") {
+        Stack<int> stack;
+
+        stack.push_n(items.begin(), items.end());
+        return stack.pop_n(64, popped.begin());
+    };
+}
+
+
+TEST_CASE("THROUGHPUT TESTS","[tp]") {
+    using Bench = ListTestBench<Stack<int>>;
+
+    std::vector<int> threads_to_use = {1,2,4,7,14,20,28};
+
+    auto put = [](Stack<int>& stack, int item) {
+        stack.push(item);
+    };
+
+    auto take = [](Stack<int>& stack) {
+        return stack.pop();
+    };
+
+    std::cout << "STACK WITH ELIMINATION" << std::endl;
+
+    // 50-50 PUSH/POP
+    Bench::test(Bench::experiment(50, 1000), threads_to_use, put, take);
+
+    // HALF PUSHERS, HALF POPPERS
+    Bench::test(Bench::experiment(50, 1000), threads_to_use, put, take, true);
+
+    std::cout << "STACK WITHOUT ELIMINATION" << std::endl;
+
+    auto no_elimination = [](Stack<int>& stack) {
+        stack.setElimination(false);
+    };
+
+    Bench::test(Bench::experiment(50, 1000), threads_to_use, put, take, no_elimination, false);
+    Bench::test(Bench::experiment(50, 1000), threads_to_use, put, take, no_elimination, true);
+}
@@ -0,0 +1,1171 @@
+#ifndef INCLUDE_ART_HPP
+#define INCLUDE_ART_HPP
+
+#define USER_NODE_POOL USER_MEM_POOL
+
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <emmintrin.h>
+#include "../../../include/SafeTree.hpp"
+
+
+using namespace SafeTree;
+
+
+constexpr int THREAD_AMOUNT_MAX = 100;
+TSX::TSXStats stats[THREAD_AMOUNT_MAX];
+
+template <class ValueType>
+class ARTree;
+
+
+// ArtArena: memory of a thread for the arrays of the nodes, whose size
+// depends on the kind of node, and for the keys of the leaves. Like the
+// node pools nothing is freed on its own. The arena is shared by all
+// the trees, each one acquire()s it, and the release() of the last one
+// frees the memory of every thread at once.
+class ArtArena {
+    private:
+        static constexpr std::size_t CHUNK_BYTES = std::size_t(1) << 20;
+
+        struct Chunk {
+            char* memory;
+            std::size_t used;
+            std::size_t size;
+            unsigned generation;
+        };
+
+        struct Chunks {
+            TSX::SpinLock lock;
+            std::vector<char*> all;
+            std::atomic<unsigned> generation;
+            int users;
+
+            Chunks(): generation(0), users(0) {}
+        };
+
+        static Chunks& chunks() {
+            static Chunks chunks;
+            return chunks;
+        }
+
+        // a chunk of a released generation is not used again
+        static Chunk& chunk_of_thread() {
+            thread_local Chunk chunk = {nullptr, 0, 0, 0};
+            return chunk;
+        }
+
+    public:
+        static void* allocate(std::size_t bytes) {
+            Chunk& chunk = chunk_of_thread();
+            Chunks& all = chunks();
+
+            // keeps the arrays of pointers aligned
+            bytes = (bytes + 15) & ~std::size_t(15);
+
+            const unsigned generation = all.generation.load(std::memory_order_acquire);
+
+            if (!chunk.memory || chunk.generation != generation || chunk.used + bytes > chunk.size) {
+                chunk.size = std::max(bytes, CHUNK_BYTES);
+                chunk.memory = new char[chunk.size];
+                chunk.used = 0;
+                chunk.generation = generation;
+
+                all.lock.lock();
+                all.all.push_back(chunk.memory);
+                all.lock.unlock();
+            }
+
+            void* memory = chunk.memory + chunk.used;
+            chunk.used += bytes;
+
+            return memory;
+        }
+
+        static void acquire() {
+            Chunks& all = chunks();
+
+            all.lock.lock();
+            ++all.users;
+            all.lock.unlock();
+        }
+
+        // frees the memory once no tree uses the arena
+        static void release() {
+            Chunks& all = chunks();
+
+            all.lock.lock();
+            if (--all.users > 0) {
+                all.lock.unlock();
+                return;
+            }
+
+            for (char* memory: all.all) {
+                delete [] memory;
+            }
+
+            all.all.clear();
+            all.generation.fetch_add(1, std::memory_order_release);
+            all.lock.unlock();
+        }
+};
+
+
+// A node of an adaptive radix tree, for keys of bytes. Inner nodes are of
+// four kinds, with room for 4, 16, 48 or 256 children, and change kind
+// as they fill up or empty. The bytes shared by all the keys below a
+// node are kept once, as its prefix. Leaves have the whole key.
+//
+// For SafeTree a child is at a slot, the position in the array of
+// children. Nodes of 4 and 16 keep the byte of each slot, nodes of 48
+// the slot of each byte, and in nodes of 256 the slot is the byte.
+// Slot TERMINAL has the leaf of the key which ends at the node.
+template <class ValueType>
+class ARTNode {
+    friend class ARTree<ValueType>;
+    public:
+        enum Kind: std::uint8_t {
+            LEAF,
+            NODE4,
+            NODE16,
+            NODE48,
+            NODE256
+        };
+
+        static constexpr int TERMINAL = 256;
+
+        // bytes of the prefix kept in the node, the rest are
+        // read from a leaf below it when needed
+        static constexpr std::uint32_t MAX_PREFIX = 10;
+
+    private:
+        Kind kind;
+        std::uint16_t count;
+        std::uint32_t prefix_len;
+        std::uint8_t prefix[MAX_PREFIX];
+        std::uint8_t keys[16];          // NODE4, NODE16: the byte of each slot
+        std::uint8_t* index;            // NODE48: slot + 1 of each byte, 0 if none
+        ARTNode** children;
+        ARTNode* terminal;
+        const std::uint8_t* key;        // LEAF
+        std::uint32_t key_len;
+        ValueType value;
+
+
+        static int capacity(const Kind kind) {
+            switch (kind) {
+                case NODE4: return 4;
+                case NODE16: return 16;
+                case NODE48: return 48;
+                case NODE256: return 256;
+                default: return 0;
+            }
+        }
+
+        // arrays of the kind, copied from the other node if given
+        void allocate_arrays(const ARTNode* other) {
+            const int n_children = capacity(kind);
+
+            children = nullptr;
+            index = nullptr;
+
+            if (!n_children) {
+                return;
+            }
+
+            children = static_cast<ARTNode**>(ArtArena::allocate(n_children * sizeof(ARTNode*)));
+
+            if (other) {
+                std::copy(other->children, other->children + n_children, children);
+            } else {
+                std::fill(children, children + n_children, nullptr);
+            }
+
+            if (kind == NODE48) {
+                index = static_cast<std::uint8_t*>(ArtArena::allocate(256));
+
+                if (other) {
+                    std::memcpy(index, other->index, 256);
+                } else {
+                    std::memset(index, 0, 256);
+                }
+            }
+        }
+
+        void copy_from(const ARTNode& other) {
+            kind = other.kind;
+            count = other.count;
+            prefix_len = other.prefix_len;
+            std::memcpy(prefix, other.prefix, MAX_PREFIX);
+            std::memcpy(keys, other.keys, sizeof(keys));
+            terminal = other.terminal;
+            key = other.key;
+            key_len = other.key_len;
+            value = other.value;
+
+            // the key of a leaf never changes, it is shared
+            allocate_arrays(&other);
+        }
+
+    public:
+        // a leaf
+        ARTNode(const std::uint8_t* key_bytes, const std::uint32_t key_length, ValueType val):
+        kind(LEAF), count(0), prefix_len(0), index(nullptr), children(nullptr), terminal(nullptr),
+        key_len(key_length), value(val) {
+            std::uint8_t* bytes = static_cast<std::uint8_t*>(ArtArena::allocate(key_length));
+            std::memcpy(bytes, key_bytes, key_length);
+            key = bytes;
+        }
+
+        // an inner node without children
+        ARTNode(const Kind kind, const std::uint8_t* prefix_bytes, const std::uint32_t prefix_length):
+        kind(kind), count(0), prefix_len(prefix_length), terminal(nullptr), key(nullptr), key_len(0), value() {
+            std::memcpy(prefix, prefix_bytes, std::min(prefix_length, MAX_PREFIX));
+            allocate_arrays(nullptr);
+        }
+
+        ARTNode(const ARTNode& other) {
+            copy_from(other);
+        }
+
+        ARTNode& operator=(const ARTNode& other) {
+            if (this != &other) {
+                copy_from(other);
+            }
+
+            return *this;
+        }
+
+        // the arrays are freed with the arena
+        ~ARTNode() {}
+
+        bool isLeaf() const {
+            return kind == LEAF;
+        }
+
+        Kind getKind() const {
+            return kind;
+        }
+
+        // children, without the terminal leaf
+        int size() const {
+            return count;
+        }
+
+        bool full() const {
+            return count == capacity(kind);
+        }
+
+        std::uint32_t prefixLength() const {
+            return prefix_len;
+        }
+
+        std::string getKey() const {
+            return std::string(reinterpret_cast<const char*>(key), key_len);
+        }
+
+        ValueType getValue() const {
+            return value;
+        }
+
+        bool keyEquals(const std::uint8_t* other, const std::uint32_t other_len) const {
+            return key_len == other_len && !std::memcmp(key, other, other_len);
+        }
+
+        // slot of the child for the byte, -1 if none
+        int findChild(const std::uint8_t byte) const {
+            switch (kind) {
+                case NODE4:
+                    for (int i = 0; i < count; i++) {
+                        if (keys[i] == byte) {
+                            return i;
+                        }
+                    }
+
+                    return -1;
+                case NODE16: {
+                    // all 16 bytes compared at once
+                    const __m128i all = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys));
+                    const __m128i cmp = _mm_cmpeq_epi8(all, _mm_set1_epi8(static_cast<char>(byte)));
+                    const int mask = _mm_movemask_epi8(cmp) & ((1 << count) - 1);
+
+                    return mask ? __builtin_ctz(mask) : -1;
+                }
+                case NODE48:
+                    return index[byte] - 1;
+                case NODE256:
+                    return children[byte] ? byte : -1;
+                default:
+                    return -1;
+            }
+        }
+
+        // the byte of the child at the slot
+        std::uint8_t byteOf(const int slot) const {
+            switch (kind) {
+                case NODE4:
+                case NODE16:
+                    return keys[slot];
+                case NODE48:
+                    for (int b = 0; b < 256; b++) {
+                        if (index[b] == slot + 1) {
+                            return b;
+                        }
+                    }
+
+                    assert(false);
+                    return 0;
+                default:
+                    return slot;
+            }
+        }
+
+        // makes room for a child for the byte, returns its slot.
+        // Only on a node no one else sees, which is not full.
+        int addChild(const std::uint8_t byte) {
+            assert(!full() && findChild(byte) < 0);
+
+            int slot = count;
+
+            switch (kind) {
+                case NODE4:
+                case NODE16:
+                    keys[slot] = byte;
+                    break;
+                case NODE48:
+                    index[byte] = slot + 1;
+                    break;
+                default:
+                    slot = byte;
+                    break;
+            }
+
+            ++count;
+
+            return slot;
+        }
+
+        // removes the child at the slot, the last one moves to
+        // its slot. Only on a node no one else sees.
+        void removeChild(const int slot) {
+            const int last = count - 1;
+
+            switch (kind) {
+                case NODE4:
+                case NODE16:
+                    keys[slot] = keys[last];
+                    children[slot] = children[last];
+                    children[last] = nullptr;
+                    break;
+                case NODE48: {
+                    const std::uint8_t byte = byteOf(slot);
+                    index[byteOf(last)] = slot + 1;
+                    index[byte] = 0;
+                    children[slot] = children[last];
+                    children[last] = nullptr;
+                    break;
+                }
+                default:
+                    children[slot] = nullptr;
+                    break;
+            }
+
+            --count;
+        }
+
+        // calls fn(byte, slot) for the children, in the order of the bytes
+        template <typename F>
+        void forEachChild(F&& fn) const {
+            switch (kind) {
+                case NODE4:
+                case NODE16: {
+                    int slots[16];
+                    for (int i = 0; i < count; i++) {
+                        slots[i] = i;
+                    }
+
+                    std::sort(slots, slots + count, [this](int a, int b) {
+                        return keys[a] < keys[b];
+                    });
+
+                    for (int i = 0; i < count; i++) {
+                        fn(keys[slots[i]], slots[i]);
+                    }
+
+                    break;
+                }
+                case NODE48:
+                    for (int b = 0; b < 256; b++) {
+                        if (index[b]) {
+                            fn(b, index[b] - 1);
+                        }
+                    }
+
+                    break;
+                case NODE256:
+                    for (int b = 0; b < 256; b++) {
+                        if (children[b]) {
+                            fn(b, b);
+                        }
+                    }
+
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        ARTNode* getChild(const int i) {
+            assert(i >= 0 && i <= TERMINAL);
+
+            if (i == TERMINAL) {
+                return terminal;
+            }
+
+            return i < capacity(kind) ? children[i] : nullptr;
+        }
+
+        // slots past the capacity of the kind are always empty
+        void setChild(const int i, ARTNode* child) {
+            assert(i >= 0 && i <= TERMINAL);
+
+            if (i == TERMINAL) {
+                terminal = child;
+            } else if (i < capacity(kind)) {
+                children[i] = child;
+            } else {
+                assert(!child);
+            }
+        }
+
+        ARTNode** getChildPointer(const int i) {
+            assert(i == TERMINAL || i < capacity(kind));
+            return i == TERMINAL ? &terminal : &children[i];
+        }
+
+        static constexpr int maxChildren() {
+            return TERMINAL + 1;
+        }
+
+        static constexpr int treeType() {
+            return GENERAL_TREE;
+        }
+};
+
+
+template <class ValueType>
+struct Result {
+    bool found;
+    ValueType val;
+
+};
+
+
+// An adaptive radix tree, a map from strings of bytes to values.
+// The depth of a key is at most its length, so the operations copy
+// and validate a few nodes, whatever the amount of keys. Keys can be
+// prefixes of each other.
+//
+// The int operations map an int to 4 bytes in the same order,
+// for the same interface as the other maps.
+template <class ValueType>
+class ARTree {
+    private:
+        using TreeNode = ARTNode<ValueType>;
+        using Kind = typename TreeNode::Kind;
+
+        static constexpr int TERMINAL = TreeNode::TERMINAL;
+        static constexpr std::uint32_t MAX_PREFIX = TreeNode::MAX_PREFIX;
+
+        TreeNode* root;
+        TSX::SpinLock &_lock;
+
+        // an int as bytes in big endian order, with the sign
+        // flipped, so that they compare as the ints do
+        struct IntKey {
+            std::uint8_t bytes[4];
+
+            explicit IntKey(const int k) {
+                const std::uint32_t u = static_cast<std::uint32_t>(k) ^ 0x80000000u;
+
+                bytes[0] = u >> 24;
+                bytes[1] = u >> 16;
+                bytes[2] = u >> 8;
+                bytes[3] = u;
+            }
+
+            static int decode(const std::uint8_t* bytes) {
+                const std::uint32_t u = (std::uint32_t(bytes[0]) << 24) | (std::uint32_t(bytes[1]) << 16) |
+                                        (std::uint32_t(bytes[2]) << 8) | bytes[3];
+
+                return static_cast<int>(u ^ 0x80000000u);
+            }
+        };
+
+        enum class Removal {
+            REMOVED,
+            NOT_FOUND,
+            RETRY
+        };
+
+        template <typename ...Args>
+        static TreeNode* new_node(Args&& ...args) {
+            #ifdef USER_NODE_POOL
+                return ConnPoint<TreeNode>::create_new_node(std::forward<Args>(args)...);
+            #else
+                return new TreeNode(std::forward<Args>(args)...);
+            #endif
+        }
+
+        static const std::uint8_t* bytes_of(const std::string& k) {
+            return reinterpret_cast<const std::uint8_t*>(k.data());
+        }
+
+        // a leaf below the node, all of them
+        // have the bytes of its prefix
+        static TreeNode* any_leaf(TreeNode* node) {
+            while (node && !node->isLeaf()) {
+                if (node->terminal) {
+                    node = node->terminal;
+                } else if (node->kind == TreeNode::NODE256) {
+                    TreeNode* child = nullptr;
+                    for (int b = 0; b < 256 && !child; b++) {
+                        child = node->children[b];
+                    }
+
+                    node = child;
+                } else {
+                    node = node->children[0];
+                }
+            }
+
+            return node;
+        }
+
+        // the byte of the prefix of the node at position i,
+        // the node is at the given depth of the key
+        static std::uint8_t prefix_byte(const TreeNode* node, TreeNode* leaf, const std::uint32_t depth, const std::uint32_t i) {
+            return i < MAX_PREFIX ? node->prefix[i] : leaf->key[depth + i];
+        }
+
+        // the position of the first byte of the prefix which
+        // is not in the key, the length of the prefix if all are
+        static std::uint32_t prefix_mismatch(TreeNode* node, const std::uint8_t* k, const std::uint32_t len, const std::uint32_t depth) {
+            const std::uint32_t max = std::min(node->prefix_len, len - depth);
+            TreeNode* leaf = node->prefix_len > MAX_PREFIX ? any_leaf(node) : nullptr;
+
+            std::uint32_t i = 0;
+            for (; i < max; i++) {
+                if (i >= MAX_PREFIX && !leaf) {
+                    break;
+                }
+
+                if (prefix_byte(node, leaf, depth, i) != k[depth + i]) {
+                    return i;
+                }
+            }
+
+            return i;
+        }
+
+        // the stored bytes of the prefix match the key, the rest is
+        // checked with the leaf, as lookups don't read other leaves
+        static bool prefix_may_match(const TreeNode* node, const std::uint8_t* k, const std::uint32_t len, const std::uint32_t depth) {
+            if (node->prefix_len > len - depth) {
+                return false;
+            }
+
+            const std::uint32_t stored = std::min(node->prefix_len, MAX_PREFIX);
+            return !std::memcmp(node->prefix, k + depth, stored);
+        }
+
+        // a node of another kind with the same prefix and children
+        static TreeNode* resized(const Kind kind, const TreeNode* from) {
+            TreeNode* node = new_node(kind, from->prefix, from->prefix_len);
+
+            node->terminal = from->terminal;
+            from->forEachChild([node, from](std::uint8_t byte, int slot) {
+                node->children[node->addChild(byte)] = from->children[slot];
+            });
+
+            return node;
+        }
+
+        static Kind grown_kind(const Kind kind) {
+            return kind == TreeNode::NODE4 ? TreeNode::NODE16 :
+                   kind == TreeNode::NODE16 ? TreeNode::NODE48 : TreeNode::NODE256;
+        }
+
+        // the kind to change to after a remove, the same if none.
+        // Well below the capacity of the smaller kind, so that
+        // a few inserts and removes don't change it back and forth
+        static Kind shrunk_kind(const TreeNode* node) {
+            switch (node->kind) {
+                case TreeNode::NODE256: return node->count <= 40 ? TreeNode::NODE48 : TreeNode::NODE256;
+                case TreeNode::NODE48: return node->count <= 12 ? TreeNode::NODE16 : TreeNode::NODE48;
+                case TreeNode::NODE16: return node->count <= 3 ? TreeNode::NODE4 : TreeNode::NODE16;
+                default: return node->kind;
+            }
+        }
+
+        // an inner node over the leaf and a new leaf with the
+        // key, the keys are the same up to the depth
+        static TreeNode* split_leaf(TreeNode* leaf, const std::uint8_t* k, const std::uint32_t len, const std::uint32_t depth, const ValueType& val) {
+            std::uint32_t common = 0;
+            while (depth + common < len && depth + common < leaf->key_len && leaf->key[depth + common] == k[depth + common]) {
+                common++;
+            }
+
+            TreeNode* node = new_node(TreeNode::NODE4, k + depth, common);
+            TreeNode* new_leaf = new_node(k, len, val);
+            const std::uint32_t at = depth + common;
+
+            node->setChild(at == leaf->key_len ? TERMINAL : node->addChild(leaf->key[at]), leaf);
+            node->setChild(at == len ? TERMINAL : node->addChild(k[at]), new_leaf);
+
+            return node;
+        }
+
+        // the key leaves the prefix of the target at the mismatch,
+        // an inner node is put above it with the common part
+        static SafeNode<TreeNode>* split_prefix(ConnPoint<TreeNode>& conn, TreeNode* target, const std::uint8_t* k, const std::uint32_t len,
+                                               const std::uint32_t depth, const std::uint32_t mismatch, const ValueType& val) {
+            TreeNode* leaf = target->prefix_len > MAX_PREFIX ? any_leaf(target) : nullptr;
+
+            auto above = conn.create_safe(new_node(TreeNode::NODE4, k + depth, mismatch));
+            TreeNode* above_node = above->rwRef();
+
+            // the rest of the prefix, after the byte of the target
+            auto old = conn.getRoot();
+            TreeNode* old_node = old->rwRef();
+            const std::uint32_t rest = target->prefix_len - mismatch - 1;
+
+            for (std::uint32_t i = 0; i < std::min(rest, MAX_PREFIX); i++) {
+                old_node->prefix[i] = prefix_byte(target, leaf, depth, mismatch + 1 + i);
+            }
+            old_node->prefix_len = rest;
+
+            above->setChild(above_node->addChild(prefix_byte(target, leaf, depth, mismatch)), old);
+
+            const std::uint32_t at = depth + mismatch;
+            above->setChild(at == len ? TERMINAL : above_node->addChild(k[at]), conn.create_safe(new_node(k, len, val)));
+
+            return above;
+        }
+
+        // the node of the conn point gets a child for the byte,
+        // in a copy or in a bigger node if it is full
+        static void add_child(ConnPoint<TreeNode>& conn, const std::uint8_t byte, TreeNode* leaf) {
+            auto target = conn.getRoot();
+            TreeNode* copy = target->rwRef();
+
+            if (!copy->full()) {
+                target->setChild(copy->addChild(byte), conn.create_safe(leaf));
+                return;
+            }
+
+            TreeNode* grown = resized(grown_kind(copy->kind), copy);
+            grown->setChild(grown->addChild(byte), leaf);
+
+            // the original is still validated,
+            // its children were copied
+            conn.setRoot(conn.create_safe(grown));
+        }
+
+        // returns false if the key is there and not overwritten
+        bool insert_step(const std::uint8_t* k, const std::uint32_t len, const ValueType& val, const bool overwrite, bool& inserted) {
+            PathTracker<TreeNode> tracker(&root);
+            std::uint32_t depth = 0;
+
+            for (TreeNode* node = tracker.getNode(); node; node = tracker.getNode()) {
+                if (node->isLeaf()) {
+                    const bool exists = node->keyEquals(k, len);
+
+                    if (exists && !overwrite) {
+                        return false;
+                    }
+
+                    auto conn_point_snapshot = tracker.connectHere();
+                    ConnPoint<TreeNode> conn(conn_point_snapshot);
+
+                    if (exists) {
+                        conn.getRoot()->rwRef()->value = val;
+                    } else {
+                        conn.setRoot(conn.create_safe(split_leaf(node, k, len, depth, val)));
+                    }
+
+                    inserted = !exists;
+                    return true;
+                }
+
+                const std::uint32_t mismatch = prefix_mismatch(node, k, len, depth);
+
+                if (mismatch < node->prefix_len) {
+                    auto conn_point_snapshot = tracker.connectHere();
+                    ConnPoint<TreeNode> conn(conn_point_snapshot);
+
+                    conn.setRoot(split_prefix(conn, node, k, len, depth, mismatch, val));
+
+                    inserted = true;
+                    return true;
+                }
+
+                depth += node->prefix_len;
+
+                // the key ends here
+                if (depth == len) {
+                    tracker.moveToChild(TERMINAL);
+                    continue;
+                }
+
+                const int slot = node->findChild(k[depth]);
+
+                if (slot < 0) {
+                    auto conn_point_snapshot = tracker.connectHere();
+                    ConnPoint<TreeNode> conn(conn_point_snapshot);
+
+                    add_child(conn, k[depth], new_node(k, len, val));
+
+                    inserted = true;
+                    return true;
+                }
+
+                tracker.moveToChild(slot);
+                ++depth;
+            }
+
+            // an empty tree or terminal slot
+            auto conn_point_snapshot = tracker.connectHere();
+            ConnPoint<TreeNode> conn(conn_point_snapshot);
+
+            conn.setRoot(conn.create_safe(new_node(k, len, val)));
+
+            inserted = true;
+            return true;
+        }
+
+        bool insert_impl(const std::uint8_t* k, const std::uint32_t len, const ValueType& val, const bool overwrite) {
+            bool inserted = false;
+
+            TM_SAFE_OPERATION_START(30) {
+                if (!insert_step(k, len, val, overwrite, inserted)) {
+                    return false;
+                }
+            } TM_SAFE_OPERATION_END
+
+            return inserted;
+        }
+
+        // the node of the conn point, copied, loses the child at the
+        // slot. With a single child or leaf left, that takes its place,
+        // and nodes with few children become of a smaller kind.
+        static void remove_child(ConnPoint<TreeNode>& conn, SafeNode<TreeNode>* target, TreeNode* copy, const int slot) {
+            if (slot == TERMINAL) {
+                copy->terminal = nullptr;
+            } else {
+                copy->removeChild(slot);
+            }
+
+            if (copy->count + (copy->terminal ? 1 : 0) > 1) {
+                const Kind kind = shrunk_kind(copy);
+
+                if (kind != copy->kind) {
+                    conn.setRoot(conn.create_safe(resized(kind, copy)));
+                }
+
+                return;
+            }
+
+            if (!copy->count) {
+                conn.setRoot(conn.wrap_no_validate(copy->terminal));
+                return;
+            }
+
+            // one child left
+            std::uint8_t byte = 0;
+            int only = 0;
+            copy->forEachChild([&byte, &only](std::uint8_t b, int s) {
+                byte = b;
+                only = s;
+            });
+
+            TreeNode* child = copy->children[only];
+
+            if (child->isLeaf()) {
+                conn.setRoot(conn.wrap_no_validate(child));
+                return;
+            }
+
+            // the child gets the prefix of the node, and its byte
+            auto merged = target->getChild(only);
+            TreeNode* merged_node = merged->rwRef();
+
+            std::uint8_t prefix[MAX_PREFIX];
+            std::uint32_t stored = std::min(copy->prefix_len, MAX_PREFIX);
+            std::memcpy(prefix, copy->prefix, stored);
+
+            if (stored < MAX_PREFIX) {
+                prefix[stored++] = byte;
+            }
+
+            for (std::uint32_t i = 0; stored < MAX_PREFIX && i < child->prefix_len; i++) {
+                prefix[stored++] = child->prefix[i];
+            }
+
+            std::memcpy(merged_node->prefix, prefix, stored);
+            merged_node->prefix_len = copy->prefix_len + 1 + child->prefix_len;
+
+            conn.setRoot(merged);
+        }
+
+        Removal remove_step(const std::uint8_t* k, const std::uint32_t len) {
+            PathTracker<TreeNode> tracker(&root);
+            std::uint32_t depth = 0;
+            TreeNode* node = tracker.getNode();
+
+            if (!node) {
+                return Removal::NOT_FOUND;
+            }
+
+            if (node->isLeaf()) {
+                if (!node->keyEquals(k, len)) {
+                    return Removal::NOT_FOUND;
+                }
+
+                auto conn_point_snapshot = tracker.connectHere();
+                ConnPoint<TreeNode> conn(conn_point_snapshot);
+
+                conn.setRoot(nullptr);
+                return Removal::REMOVED;
+            }
+
+            for (;;) {
+                if (!prefix_may_match(node, k, len, depth)) {
+                    return Removal::NOT_FOUND;
+                }
+
+                depth += node->prefix_len;
+
+                const int slot = depth == len ? TERMINAL : node->findChild(k[depth]);
+                TreeNode* child = slot < 0 ? nullptr : node->getChild(slot);
+
+                if (!child) {
+                    return Removal::NOT_FOUND;
+                }
+
+                if (!child->isLeaf()) {
+                    tracker.moveToChild(slot);
+                    ++depth;
+
+                    node = tracker.getNode();
+                    if (!node) {
+                        return Removal::RETRY;
+                    }
+
+                    continue;
+                }
+
+                if (!child->keyEquals(k, len)) {
+                    return Removal::NOT_FOUND;
+                }
+
+                // the node is copied without the leaf
+                auto conn_point_snapshot = tracker.connectHere();
+                ConnPoint<TreeNode> conn(conn_point_snapshot);
+
+                auto target = conn.getRoot();
+                TreeNode* copy = target->rwRef();
+
+                // the leaf was replaced since it was read
+                if (copy->getChild(slot) != child) {
+                    conn.setRoot(conn.wrap_no_validate(node));
+                    return Removal::RETRY;
+                }
+
+                remove_child(conn, target, copy, slot);
+                return Removal::REMOVED;
+            }
+        }
+
+        bool remove_impl(const std::uint8_t* k, const std::uint32_t len) {
+            for (;;) {
+                Removal removal = Removal::NOT_FOUND;
+
+                TM_SAFE_OPERATION_START(30) {
+                    removal = remove_step(k, len);
+
+                    if (removal == Removal::NOT_FOUND) {
+                        return false;
+                    }
+                } TM_SAFE_OPERATION_END
+
+                if (removal == Removal::REMOVED) {
+                    return true;
+                }
+            }
+        }
+
+        // the published nodes don't change but for
+        // their children, a lookup needs no transaction
+        Result<ValueType> lookup_impl(const std::uint8_t* k, const std::uint32_t len) {
+            TreeNode* node = root;
+            std::uint32_t depth = 0;
+
+            while (node && !node->isLeaf()) {
+                if (!prefix_may_match(node, k, len, depth)) {
+                    return {false, ValueType()};
+                }
+
+                depth += node->prefix_len;
+
+                if (depth == len) {
+                    node = node->terminal;
+                } else {
+                    const int slot = node->findChild(k[depth]);
+                    node = slot < 0 ? nullptr : node->getChild(slot);
+                    ++depth;
+                }
+            }
+
+            if (node && node->keyEquals(k, len)) {
+                return {true, node->value};
+            }
+
+            return {false, ValueType()};
+        }
+
+
+        // calls fn(leaf, depth) for the leaves in the order of their keys
+        template <typename F>
+        static void for_each_leaf(TreeNode* node, F&& fn, const int depth = 1) {
+            if (!node) {
+                return;
+            }
+
+            if (node->isLeaf()) {
+                fn(node, depth);
+                return;
+            }
+
+            for_each_leaf(node->terminal, fn, depth + 1);
+            node->forEachChild([&](std::uint8_t, int slot) {
+                for_each_leaf(node->children[slot], fn, depth + 1);
+            });
+        }
+
+        // every inner node has at least two children or a child and
+        // a leaf, and as many children in its slots as it counts
+        static bool isArtHelper(TreeNode* node) {
+            if (!node || node->isLeaf()) {
+                return true;
+            }
+
+            int n_children = 0;
+            bool valid = true;
+
+            node->forEachChild([&](std::uint8_t byte, int slot) {
+                TreeNode* child = node->children[slot];
+                n_children += child != nullptr;
+                valid = valid && child && node->findChild(byte) == slot && isArtHelper(child);
+            });
+
+            return valid && n_children == node->count && node->count + (node->terminal ? 1 : 0) >= 2 &&
+                   (!node->terminal || node->terminal->isLeaf());
+        }
+
+    public:
+
+    ARTree(TreeNode* root, TSX::SpinLock &lock): root(root), _lock(lock) {
+        #ifdef USER_NODE_POOL
+            ConnPoint<TreeNode>::init_node_pool();
+        #endif
+
+        ArtArena::acquire();
+
+        for (int i = 0; i < THREAD_AMOUNT_MAX; i++) {
+            stats[i].reset();
+        }
+    }
+
+    ~ARTree() {
+        #ifdef USER_NODE_POOL
+            ConnPoint<TreeNode>::reset_node_pool();
+        #endif
+
+        ArtArena::release();
+    }
+
+    bool insert(const std::string& k, ValueType val, int t_id) {
+        (void)t_id;
+        return insert_impl(bytes_of(k), k.size(), val, false);
+    }
+
+    // returns true if the key was inserted,
+    // false if its value was overwritten
+    bool upsert(const std::string& k, ValueType val, int t_id) {
+        (void)t_id;
+        return insert_impl(bytes_of(k), k.size(), val, true);
+    }
+
+    bool remove(const std::string& k, int t_id) {
+        (void)t_id;
+        return remove_impl(bytes_of(k), k.size());
+    }
+
+    Result<ValueType> lookup(const std::string& k) {
+        return lookup_impl(bytes_of(k), k.size());
+    }
+
+    bool insert(const int k, ValueType val, int t_id) {
+        (void)t_id;
+        const IntKey key(k);
+        return insert_impl(key.bytes, sizeof(key.bytes), val, false);
+    }
+
+    bool upsert(const int k, ValueType val, int t_id) {
+        (void)t_id;
+        const IntKey key(k);
+        return insert_impl(key.bytes, sizeof(key.bytes), val, true);
+    }
+
+    bool remove(const int k, int t_id) {
+        (void)t_id;
+        const IntKey key(k);
+        return remove_impl(key.bytes, sizeof(key.bytes));
+    }
+
+    Result<ValueType> lookup(const int k) {
+        const IntKey key(k);
+        return lookup_impl(key.bytes, sizeof(key.bytes));
+    }
+
+    TreeNode* getRoot() {
+        return root;
+    }
+
+    /* VALIDATORS */
+
+    int size() {
+        int amount = 0;
+        for_each_leaf(root, [&amount](TreeNode*, int) {
+            amount++;
+        });
+
+        return amount;
+    }
+
+    // of the keys inserted as ints
+    std::size_t key_sum() {
+        std::size_t sum = 0;
+        for_each_leaf(root, [&sum](TreeNode* leaf, int) {
+            if (leaf->key_len == sizeof(int)) {
+                sum += IntKey::decode(leaf->key);
+            }
+        });
+
+        return sum;
+    }
+
+    // the keys are in order, every one of them is found
+    // and the inner nodes are well formed
+    bool isSorted() {
+        bool sorted = true;
+        TreeNode* previous = nullptr;
+
+        for_each_leaf(root, [&](TreeNode* leaf, int) {
+            if (previous && !std::lexicographical_compare(previous->key, previous->key + previous->key_len,
+                                                          leaf->key, leaf->key + leaf->key_len)) {
+                sorted = false;
+            }
+
+            sorted = sorted && lookup_impl(leaf->key, leaf->key_len).found;
+            previous = leaf;
+        });
+
+        return sorted && isArtHelper(root);
+    }
+
+    /* END OF VALIDATORS */
+
+    void longest_branch() {
+        int longest = 0;
+        for_each_leaf(root, [&longest](TreeNode*, int depth) {
+            longest = std::max(longest, depth);
+        });
+
+        std::cout << "Longest branch is: " << longest << std::endl;
+    }
+
+    void average_branch() {
+        long total = 0;
+        int leaves = 0;
+        for_each_leaf(root, [&](TreeNode*, int depth) {
+            total += depth;
+            leaves++;
+        });
+
+        std::cout << "Average branch is: " << (leaves ? static_cast<double>(total) / leaves : 0.0) << std::endl;
+    }
+
+    // amount of inner nodes of each kind
+    void print_kinds() {
+        int kinds[5] = {0, 0, 0, 0, 0};
+
+        std::vector<TreeNode*> nodes;
+        if (root) {
+            nodes.push_back(root);
+        }
+
+        while (!nodes.empty()) {
+            TreeNode* node = nodes.back();
+            nodes.pop_back();
+            kinds[node->kind]++;
+
+            for (int i = 0; i <= TERMINAL; i++) {
+                if (node->getChild(i)) {
+                    nodes.push_back(node->getChild(i));
+                }
+            }
+        }
+
+        std::cout << "Leaves: " << kinds[TreeNode::LEAF] << " Node4: " << kinds[TreeNode::NODE4]
+                  << " Node16: " << kinds[TreeNode::NODE16] << " Node48: " << kinds[TreeNode::NODE48]
+                  << " Node256: " << kinds[TreeNode::NODE256] << std::endl;
+    }
+
+    void stat_report(int n_threads) {
+        TSX::TSXStats t_stats;
+        for (int i = 0; i < n_threads; i++) {
+            t_stats += stats[i];
+        }
+        std::cout << std::endl << std::endl;
+        t_stats.print_stats();
+        std::cout << std::endl << std::endl;
+    }
+
+
+    void lite_stat(int n_threads, long long n_ops = -1) {
+        TSX::TSXStats total_stats;
+        for (int i = 0; i < n_threads; i++) {
+            total_stats += stats[i];
+        }
+
+        if (n_ops > 0) {
+            std::cout << std::endl;
+            std::cout << "ABORTS/OP: " << (total_stats.tx_aborts * 100.0)/(n_ops) << "%" << std::endl;
+        }
+        total_stats.print_lite_stats();
+    }
+
+
+};
+
+
+#endif
@@ -0,0 +1,368 @@
+#include <iostream>
+#include <array>
+#include <thread>
+#include <cstdlib>
+#include <random>
+#include <chrono>
+#include <atomic>
+#include <string>
+#include <set>
+
+#include "../include/art.hpp"
+#include "../../../include/catch2/catch.hpp"
+#include "../../../include/TSXGuard.hpp"
+#include "../../../include/test_bench.hpp"
+
+
+using namespace SafeTree;
+
+#ifndef HACI3COMP
+const static int THREADS = std::thread::hardware_concurrency();
+#else
+const static int THREADS = 28;
+#endif
+
+constexpr static int OPERATION_MULTIPLIER = 10000;
+
+using TestBenchType = TestBench<ARTree<int>>;
+using Node = ARTNode<int>;
+
+TSX::SpinLock& lock = TestBenchType::global_lock;
+
+TEST_CASE("ART Init Test","[init]") {
+    ARTree<int> someTree(nullptr, lock);
+    REQUIRE(someTree.getRoot() == nullptr);
+    REQUIRE(someTree.size() == 0);
+    REQUIRE(!someTree.lookup(1).found);
+    REQUIRE(!someTree.remove(1,0));
+}
+
+
+void insert(int i, ARTree<int>& tree, int t_id) {
+    for (int j = i * OPERATION_MULTIPLIER; j < (i+1)*OPERATION_MULTIPLIER; j++) {
+         tree.insert(j,j,t_id);
+    }
+}
+
+
+void even_remove(ARTree<int>& tree, int i) {
+    for (int j = i * OPERATION_MULTIPLIER; j < (i+1)*OPERATION_MULTIPLIER; j++) {
+        if (j % 2 == 0) {
+            tree.remove(j,i);
+        }
+    }
+}
+
+
+TEST_CASE("ART Insert Test","[insert]") {
+    std::cout << "SINGLE THREADED INSERT" << std::endl;
+    ARTree<int> someTree(nullptr, lock);
+
+    SECTION("empty insert") {
+        REQUIRE(someTree.insert(1,2,0));
+        REQUIRE(someTree.getRoot()->isLeaf());
+        REQUIRE(someTree.lookup(1).val == 2);
+        REQUIRE(!someTree.insert(1,3,0));
+        REQUIRE(someTree.lookup(1).val == 2);
+        REQUIRE(!someTree.lookup(2).found);
+    }
+
+    SECTION("negative keys are in order") {
+        for (int k : {5, -1, 0, -100, 100}) {
+            REQUIRE(someTree.insert(k,k,0));
+        }
+
+        for (int k : {5, -1, 0, -100, 100}) {
+            REQUIRE(someTree.lookup(k).val == k);
+        }
+
+        REQUIRE(someTree.size() == 5);
+        REQUIRE(someTree.key_sum() == 4);
+        REQUIRE(someTree.isSorted());
+    }
+
+    SECTION("upsert") {
+        REQUIRE(someTree.upsert(5,1,0));
+        REQUIRE(!someTree.upsert(5,2,0));
+        REQUIRE(someTree.lookup(5).val == 2);
+        REQUIRE(someTree.size() == 1);
+    }
+
+    SECTION("nodes grow with their children") {
+        // children of the same node, for the last byte
+        REQUIRE(someTree.insert(0,0,0));
+        REQUIRE(someTree.insert(1,1,0));
+        REQUIRE(someTree.getRoot()->getKind() == Node::NODE4);
+        REQUIRE(someTree.getRoot()->prefixLength() == 3);
+
+        for (int i = 2; i < 5; i++) {
+            REQUIRE(someTree.insert(i,i,0));
+        }
+        REQUIRE(someTree.getRoot()->getKind() == Node::NODE16);
+
+        for (int i = 5; i < 17; i++) {
+            REQUIRE(someTree.insert(i,i,0));
+        }
+        REQUIRE(someTree.getRoot()->getKind() == Node::NODE48);
+
+        for (int i = 17; i < 256; i++) {
+            REQUIRE(someTree.insert(i,i,0));
+        }
+        REQUIRE(someTree.getRoot()->getKind() == Node::NODE256);
+        REQUIRE(someTree.getRoot()->size() == 256);
+
+        for (int i = 0; i < 256; i++) {
+            REQUIRE(someTree.lookup(i).val == i);
+        }
+
+        REQUIRE(someTree.key_sum() == 255 * 256 / 2);
+        REQUIRE(someTree.isSorted());
+    }
+
+    SECTION("many inserts") {
+        std::mt19937 gen(1);
+        std::uniform_int_distribution<int> dist(-100000, 100000);
+        std::set<int> keys;
+
+        for (int i = 0; i < 20000; i++) {
+            const int k = dist(gen);
+            REQUIRE(someTree.insert(k,k,0) == keys.insert(k).second);
+        }
+
+        for (int k : keys) {
+            REQUIRE(someTree.lookup(k).val == k);
+        }
+
+        REQUIRE(someTree.size() == static_cast<int>(keys.size()));
+        REQUIRE(someTree.isSorted());
+    }
+}
+
+
+TEST_CASE("ART String Key Test","[insert]") {
+    ARTree<int> someTree(nullptr, lock);
+
+    SECTION("keys which are prefixes of others") {
+        REQUIRE(someTree.insert(std::string("romane"),1,0));
+        REQUIRE(someTree.insert(std::string("romanus"),2,0));
+        REQUIRE(someTree.insert(std::string("roman"),3,0));
+        REQUIRE(someTree.insert(std::string("rom"),4,0));
+        REQUIRE(someTree.insert(std::string(""),5,0));
+        REQUIRE(!someTree.insert(std::string("roman"),6,0));
+
+        REQUIRE(someTree.lookup(std::string("romane")).val == 1);
+        REQUIRE(someTree.lookup(std::string("romanus")).val == 2);
+        REQUIRE(someTree.lookup(std::string("roman")).val == 3);
+        REQUIRE(someTree.lookup(std::string("rom")).val == 4);
+        REQUIRE(someTree.lookup(std::string("")).val == 5);
+        REQUIRE(!someTree.lookup(std::string("ro")).found);
+        REQUIRE(!someTree.lookup(std::string("romanes")).found);
+        REQUIRE(someTree.size() == 5);
+        REQUIRE(someTree.isSorted());
+
+        REQUIRE(someTree.remove(std::string("roman"),0));
+        REQUIRE(!someTree.lookup(std::string("roman")).found);
+        REQUIRE(someTree.lookup(std::string("romanus")).val == 2);
+        REQUIRE(someTree.isSorted());
+    }
+
+    SECTION("prefixes longer than the stored bytes") {
+        const std::string common(40, 'x');
+
+        REQUIRE(someTree.insert(common + "a",1,0));
+        REQUIRE(someTree.insert(common + "b",2,0));
+        REQUIRE(someTree.getRoot()->prefixLength() == 40);
+
+        // splits the prefix past the stored bytes
+        REQUIRE(someTree.insert(std::string(30, 'x') + "y",3,0));
+        REQUIRE(someTree.insert(std::string(35, 'x'),4,0));
+
+        REQUIRE(someTree.lookup(common + "a").val == 1);
+        REQUIRE(someTree.lookup(common + "b").val == 2);
+        REQUIRE(someTree.lookup(std::string(30, 'x') + "y").val == 3);
+        REQUIRE(someTree.lookup(std::string(35, 'x')).val == 4);
+        REQUIRE(!someTree.lookup(std::string(20, 'x') + std::string(20, 'z') + "a").found);
+        REQUIRE(someTree.isSorted());
+
+        // the nodes merge back
+        REQUIRE(someTree.remove(std::string(30, 'x') + "y",0));
+        REQUIRE(someTree.remove(std::string(35, 'x'),0));
+        REQUIRE(someTree.getRoot()->prefixLength() == 40);
+        REQUIRE(someTree.lookup(common + "a").val == 1);
+        REQUIRE(someTree.isSorted());
+    }
+}
+
+
+TEST_CASE("ART Remove Test","[remove]") {
+    ARTree<int> someTree(nullptr, lock);
+
+    SECTION("remove and insert again") {
+        REQUIRE(someTree.insert(1,1,0));
+        REQUIRE(someTree.remove(1,0));
+        REQUIRE(!someTree.remove(1,0));
+        REQUIRE(someTree.getRoot() == nullptr);
+        REQUIRE(someTree.insert(1,2,0));
+        REQUIRE(someTree.lookup(1).val == 2);
+    }
+
+    SECTION("nodes shrink and collapse") {
+        for (int i = 0; i < 256; i++) {
+            REQUIRE(someTree.insert(i,i,0));
+        }
+
+        for (int i = 255; i >= 40; i--) {
+            REQUIRE(someTree.remove(i,0));
+        }
+        REQUIRE(someTree.getRoot()->getKind() == Node::NODE48);
+
+        for (int i = 39; i >= 12; i--) {
+            REQUIRE(someTree.remove(i,0));
+        }
+        REQUIRE(someTree.getRoot()->getKind() == Node::NODE16);
+
+        for (int i = 11; i >= 3; i--) {
+            REQUIRE(someTree.remove(i,0));
+        }
+        REQUIRE(someTree.getRoot()->getKind() == Node::NODE4);
+        REQUIRE(someTree.isSorted());
+
+        REQUIRE(someTree.remove(0,0));
+        REQUIRE(someTree.remove(2,0));
+        REQUIRE(someTree.getRoot()->isLeaf());
+        REQUIRE(someTree.lookup(1).val == 1);
+        REQUIRE(someTree.size() == 1);
+    }
+
+    SECTION("random removes") {
+        std::mt19937 gen(1);
+        std::uniform_int_distribution<int> dist(0, 5000);
+
+        for (int i = 0; i < 50000; i++) {
+            const int k = dist(gen);
+
+            if (i % 2) {
+                someTree.insert(k,1,0);
+                REQUIRE(someTree.lookup(k).found);
+            } else {
+                someTree.remove(k,0);
+                REQUIRE(!someTree.lookup(k).found);
+            }
+        }
+
+        REQUIRE(someTree.isSorted());
+    }
+
+    SECTION("other trees outlive a tree") {
+        for (int i = 0; i < 1000; i++) {
+            REQUIRE(someTree.insert(i,i,0));
+        }
+
+        {
+            ARTree<int> otherTree(nullptr, lock);
+
+            for (int i = 0; i < 1000; i++) {
+                REQUIRE(otherTree.insert(i,i,0));
+            }
+        }
+
+        for (int i = 0; i < 1000; i++) {
+            REQUIRE(someTree.lookup(i).val == i);
+        }
+
+        REQUIRE(someTree.insert(1000,1000,0));
+        REQUIRE(someTree.isSorted());
+        REQUIRE(someTree.size() == 1001);
+    }
+}
+
+
+TEST_CASE("ART Multithreaded Insert Test","[mt_insert]") {
+    std::cout << "MULTITHREADED INSERT" << std::endl;
+
+    ARTree<int> someTree(nullptr,lock);
+    std::thread threads[THREADS];
+
+    for (int i = 0; i < THREADS; i++) {
+        threads[i] = std::thread(insert, i, std::ref(someTree), i);
+    }
+
+    for (int i = 0; i < THREADS; i++) {
+        threads[i].join();
+    }
+
+    for (int i = 0; i < THREADS*OPERATION_MULTIPLIER; i++) {
+        if (someTree.lookup(i).val != i) {
+            std::cout << "NOT " << i << std::endl;
+            REQUIRE(someTree.lookup(i).found);
+        }
+    }
+
+    REQUIRE(someTree.size() == THREADS*OPERATION_MULTIPLIER);
+    REQUIRE(someTree.isSorted());
+    someTree.longest_branch();
+    someTree.print_kinds();
+}
+
+
+TEST_CASE("ART MULTITHREADED Remove Test","[remove_mt]") {
+    SECTION("intro") {
+        std::cout << "MULTITHREADED Remove Test" << std::endl;
+    }
+
+
+    std::thread threads[THREADS];
+
+
+    SECTION("mt remove") {
+        for (int j = 0; j < 10; j++) {
+            ARTree<int> someTree(nullptr, lock);
+            TestBenchType::binary_insert_map(0, THREADS*OPERATION_MULTIPLIER - 1,someTree);
+
+            for (int i = 0; i < THREADS; i++) {
+                threads[i] = std::thread(even_remove, std::ref(someTree), i);
+            }
+
+            for (int i = 0; i < THREADS; i++) {
+                threads[i].join();
+            }
+
+            for (int i = 0; i < THREADS*OPERATION_MULTIPLIER; i++) {
+                if (i % 2 == 0) {
+                    REQUIRE(!someTree.lookup(i).found);
+                } else {
+                    if (!someTree.lookup(i).found) {
+                        std::cerr << "MISSING " << i << std::endl;
+                        REQUIRE(someTree.lookup(i).found);
+                    }
+                }
+            }
+
+            REQUIRE(someTree.isSorted());
+        }
+
+    }
+}
+
+
+TEST_CASE("THROUGHPUT TESTS","[tp]") {
+    const int OPERATION_MULTIPLIERS[] = {1000000,10000,1000};
+
+    for (int i = 0; i < 3; i++) {
+        std::cout << "Start of tests for tree size: " << OPERATION_MULTIPLIERS[i] << std::endl;
+        const std::size_t RANGE_OF_KEYS = 2 * OPERATION_MULTIPLIERS[i]; // RANGE IS 1 TO RANGE_OF_KEYS
+
+        std::vector<int> threads_to_use = {1,2,4,7,14,20,28};
+        // RANDOM OPS
+        TestBenchType::experiment exp1(33,33,34);
+        TestBenchType::test(exp1,THREADS,RANGE_OF_KEYS,threads_to_use);
+
+        // 100% LOOKUPS
+        TestBenchType::experiment exp2(0,0,100);
+        TestBenchType::test(exp2,THREADS,RANGE_OF_KEYS, threads_to_use);
+
+        // 50-50 UPDATES
+        TestBenchType::experiment exp3(50,50,0);
+        TestBenchType::test(exp3,THREADS,RANGE_OF_KEYS,threads_to_use);
+    }
+}
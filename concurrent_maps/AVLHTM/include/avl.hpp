@@ -5,9 +5,18 @@
 
 
 #include <cassert>
+#include <algorithm>
+#include <cstdlib>
+#include <new>
 #include <limits>
 #include <tuple>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <vector>
 #include "../../../include/SafeTree.hpp"
+#include "../../../include/augmentations.hpp"
+#include "../../../include/published_values.hpp"
 
 using namespace SafeTree;
 
@@ -15,22 +24,41 @@ using namespace SafeTree;
 constexpr int THREAD_AMOUNT_MAX = 100;
 TSX::TSXStats stats[THREAD_AMOUNT_MAX];
 
-template <class ValueType>
+template <class ValueType, class Augmentation = NoAugmentation>
 class AVLTree;
     
 
-template <class ValueType>
+template <class ValueType, class Augmentation = NoAugmentation>
 class AVLNode {
-    friend class AVLTree<ValueType>;
+    friend class AVLTree<ValueType, Augmentation>;
+    friend struct PublishedValues<AVLNode, ValueType>;
     private:
         int key;
-        ValueType value; 
+        // large values are shared by the copies
+        StoredValue<ValueType, AVLNode> value;
+        NodeVersion version;
         AVLNode* children[2];
         int height;
+        Augmentation aug;
+        // removed logically, still linked in the tree
+        bool deleted;
+
+
 
+        using SafeAVLNode = SafeNode<AVLNode<ValueType, Augmentation>>;
 
+        // augmented data of a node
+        // or nullptr if there is no node
+        static const Augmentation* aug_of(const AVLNode* node) {
+            return node ? &node->aug : nullptr;
+        }
 
-        using SafeAVLNode = SafeNode<AVLNode<ValueType>>;
+        // recalculate height and augmented data
+        // after the children of a node have changed
+        static inline void refresh(AVLNode* node) {
+            node->height = max_height(node->getL(), node->getR()) + 1;
+            node->aug.update(*node, aug_of(node->getL()), aug_of(node->getR()));
+        }
 
         // return how balanced the current node is
         static int node_balance(AVLNode *node) {
@@ -91,8 +119,8 @@ class AVLNode {
             auto z_safe = z->rwRef();   // for values get a reference
             auto newRoot_safe = newRoot->rwRef();
 
-            z_safe->height = max_height(z_safe->getL(), z_safe->getR()) + 1;
-            newRoot_safe->height = max_height(newRoot_safe->getChild(0), newRoot_safe->getChild(1)) + 1;
+            refresh(z_safe);
+            refresh(newRoot_safe);
 
             return newRoot;
         }
@@ -120,17 +148,18 @@ class AVLNode {
             auto z_safe = z->rwRef();
             auto newRoot_safe = newRoot->rwRef();
 
-            z_safe->height = max_height(z_safe->getChild(0), z_safe->getChild(1)) + 1;
-            newRoot_safe->height = max_height(newRoot_safe->getChild(0), newRoot_safe->getChild(1)) + 1;
+            refresh(z_safe);
+            refresh(newRoot_safe);
             return newRoot;
         }
 
     public:
         using KeyType = int;
 
-        AVLNode(int key, ValueType val, AVLNode* left_child, AVLNode* right_child): key(key), value(val), height(1) {
+        AVLNode(int key, ValueType val, AVLNode* left_child, AVLNode* right_child): key(key), value(val), height(1), deleted(false) {
             children[0] = left_child;
             children[1] = right_child;
+            aug.update(*this, aug_of(left_child), aug_of(right_child));
         }
 
         // to satisfy search tree interface
@@ -177,8 +206,8 @@ class AVLNode {
             return key;
         }
 
-        int getValue() const {
-            return value;
+        ValueType getValue() const {
+            return value.get();
         }
 
         void setKey(int new_key) {
@@ -186,7 +215,11 @@ class AVLNode {
         }
 
         void setValue(ValueType new_val) {
-            value = new_val;
+            value.set(new_val);
+        }
+
+        unsigned getVersion() const {
+            return version.load();
         }
 
         AVLNode* getL() {
@@ -210,6 +243,10 @@ class AVLNode {
             return height;
         }
 
+        const Augmentation& getAugmentation() const {
+            return aug;
+        }
+
         AVLNode** getChildren() {
             return children;
         }
@@ -223,18 +260,172 @@ struct Result {
 
 };
 
+// result of the ordered queries, also
+// returns the key of the node found
+template <class ValueType>
+struct Entry {
+    bool found;
+    int key;
+    ValueType val;
+};
+
+// result of lookup_ref: points to the value in the tree, nullptr if the
+// key was not found. Published nodes are replaced by copies, and the
+// pools keep the replaced nodes and values until the last tree of the
+// type is destroyed, so the value can be read in place while the
+// ValueRef and its tree live.
+template <class ValueType, bool Copied = false>
+class ValueRef {
+    private:
+        const ValueType* val_;
+    public:
+        explicit ValueRef(const ValueType* val): val_(val) {}
+
+        const ValueType* get() const {
+            return val_;
+        }
+
+        explicit operator bool() const {
+            return val_ != nullptr;
+        }
+
+        const ValueType& operator*() const {
+            return *val_;
+        }
+
+        const ValueType* operator->() const {
+            return val_;
+        }
+};
+
+// values written in place change under the reader,
+// they are small and copied into the ValueRef instead
 template <class ValueType>
+class ValueRef<ValueType, true> {
+    private:
+        bool found_;
+        ValueType val_;
+    public:
+        ValueRef(bool found, const ValueType& val): found_(found), val_(val) {}
+
+        const ValueType* get() const {
+            return found_ ? &val_ : nullptr;
+        }
+
+        explicit operator bool() const {
+            return found_;
+        }
+
+        const ValueType& operator*() const {
+            return val_;
+        }
+
+        const ValueType* operator->() const {
+            return get();
+        }
+};
+
+template <class ValueType, class Augmentation>
 class AVLTree {
-    friend class AVLNode<ValueType>;
+    friend class AVLNode<ValueType, Augmentation>;
     private:
-        AVLNode<ValueType>* root;
+        AVLNode<ValueType, Augmentation>* root;
         TSX::SpinLock &_lock;
-        using TreeNode = AVLNode<ValueType>;
+
+        // augmented data can't be written in place,
+        // it changes up to the root
+        static constexpr bool IN_PLACE_ELIGIBLE = in_place_eligible<ValueType>::value && !Augmentation::enabled;
+
+        // existing values are updated in place
+        bool in_place_;
+        using TreeNode = AVLNode<ValueType, Augmentation>;
         const int trans_retries = 30;
+
+        // augmented data can't be left stale, it
+        // is read by the queries up to the root
+        static constexpr bool RELAXED_ELIGIBLE = !Augmentation::enabled;
+
+        // RELAXED BALANCE: updates don't rebalance, they record the
+        // lowest node they changed, and a rebalancer fixes the heights
+        // and rotates later, from each recorded node up
+        bool relaxed_;
+
+        // updates whose connection point is this deep fix their
+        // path right after, so the branches left for later stay short
+        static constexpr int RELAXED_MAX_DEPTH = 16;
+
+        // keys of the nodes to fix from, per thread to not
+        // share a cache line, taken by the rebalancer.
+        // Allocated when relaxed balance is set.
+        struct alignas(64) PendingFixes {
+            TSX::SpinLock lock;
+            std::vector<int> keys;
+        };
+        PendingFixes* pending_;
+
+        std::atomic<bool> rebalancer_running_;
+        std::thread rebalancer_;
+
+        // augmented data would have to skip
+        // the tombstones, like the queries
+        static constexpr bool TOMBSTONES_ELIGIBLE = !Augmentation::enabled;
+
+        // TOMBSTONE REMOVES: a node with two children is only marked as
+        // removed, and unlinked later by a compaction
+        bool tombstone_removes_;
+
+        // compact when the tombstones are more than
+        // this fraction of the nodes, 0 to never compact
+        double compaction_ratio_;
+
+        // approximate amount of nodes and tombstones, kept per
+        // thread, counting only the changes of the single operations.
+        // Allocated when tombstone removes are set.
+        struct alignas(64) NodeCounter {
+            std::atomic<long> nodes;
+            std::atomic<long> tombstones;
+            std::atomic<unsigned long> marks;
+
+            NodeCounter(): nodes(0), tombstones(0), marks(0) {}
+        };
+        NodeCounter* node_counts_;
+
+        std::atomic<bool> compacting_;
         
 
         // helpers
 
+        // the per thread data has the alignment of a cache
+        // line, which plain new doesn't give before C++17
+        template <class T>
+        static T* allocate_per_thread() {
+            void* memory = nullptr;
+
+            if (posix_memalign(&memory, alignof(T), THREAD_AMOUNT_MAX * sizeof(T))) {
+                throw std::bad_alloc();
+            }
+
+            T* counters = static_cast<T*>(memory);
+            for (int i = 0; i < THREAD_AMOUNT_MAX; i++) {
+                new (&counters[i]) T();
+            }
+
+            return counters;
+        }
+
+        template <class T>
+        static void release_per_thread(T* counters) {
+            if (!counters) {
+                return;
+            }
+
+            for (int i = 0; i < THREAD_AMOUNT_MAX; i++) {
+                counters[i].~T();
+            }
+
+            free(counters);
+        }
+
         // sum of keys of tree
         // for validation
         static std::size_t key_sum_helper(TreeNode* node) {
@@ -242,7 +433,93 @@ class AVLTree {
                 return 0;
             } 
 
-            return node->getKey() + key_sum_helper(node->getChild(0)) + key_sum_helper(node->getChild(1));
+            return (node->deleted ? 0 : node->getKey()) + key_sum_helper(node->getChild(0)) + key_sum_helper(node->getChild(1));
+        }
+
+        // in place writes are seen at once, so not
+        // used by operations which are part of a group
+        bool in_place() const {
+            return in_place_ && !ConnPointGroup::current();
+        }
+
+        // reads and in place writes of the values
+        using Values = PublishedValues<TreeNode, ValueType>;
+
+        // the ValueRef of a published node, the value is copied
+        // only if it can be written in place
+        static ValueRef<ValueType> make_ref(const TreeNode* node, std::false_type) {
+            return ValueRef<ValueType>(node ? &node->value.get() : nullptr);
+        }
+
+        static ValueRef<ValueType, true> make_ref(const TreeNode* node, std::true_type) {
+            return node ? ValueRef<ValueType, true>(true, Values::read(node)) : ValueRef<ValueType, true>(false, ValueType());
+        }
+
+        // key value pair of a node
+        // for the ordered queries
+        static Entry<ValueType> entry_of(TreeNode* node) {
+            if (!node) {
+                return {false, 0, ValueType()};
+            }
+
+            return {true, node->getKey(), Values::read(node)};
+        }
+
+        // sum of keys from the augmented data
+        static std::size_t key_sum_of(TreeNode* node, std::true_type) {
+            return node ? node->getAugmentation().key_sum : 0;
+        }
+
+        static std::size_t key_sum_of(TreeNode* node, std::false_type) {
+            return key_sum_helper(node);
+        }
+
+        // aggregate of the values of the nodes
+        // with keys >= lo in the subtree of node
+        template <class Aug>
+        static typename Aug::AggregateType aggregate_from(TreeNode* node, int lo) {
+            auto result = Aug::identity();
+
+            while (node) {
+                if (node->getKey() >= lo) {
+                    // node and its right subtree are
+                    // in range, keep looking left
+                    auto right = Aug::combine(node->getValue(), Aug::agg_of(TreeNode::aug_of(node->getR())));
+                    result = Aug::combine(right, result);
+                    node = node->getL();
+                } else {
+                    node = node->getR();
+                }
+            }
+
+            return result;
+        }
+
+        // aggregate of the values of the nodes
+        // with keys <= hi in the subtree of node
+        template <class Aug>
+        static typename Aug::AggregateType aggregate_to(TreeNode* node, int hi) {
+            auto result = Aug::identity();
+
+            while (node) {
+                if (node->getKey() <= hi) {
+                    // node and its left subtree are
+                    // in range, keep looking right
+                    auto left = Aug::combine(Aug::agg_of(TreeNode::aug_of(node->getL())), node->getValue());
+                    result = Aug::combine(result, left);
+                    node = node->getR();
+                } else {
+                    node = node->getL();
+                }
+            }
+
+            return result;
+        }
+
+        // number of nodes of a subtree
+        // from the augmented data
+        static int count_of(TreeNode* node) {
+            return node ? node->getAugmentation().count() : 0;
         }
 
         // number of nodes of tree
@@ -251,16 +528,68 @@ class AVLTree {
                 return 0;
             }
 
-            return 1 + count_nodes(node->getChild(0)) + count_nodes(node->getChild(1));
+            return (node->deleted ? 0 : 1) + count_nodes(node->getChild(0)) + count_nodes(node->getChild(1));
+        }
+
+        // TOMBSTONES: a node removed logically stays in the tree until
+        // it is unlinked by a compaction, all the operations skip it
+
+        // the node, if it is not a tombstone
+        static TreeNode* live(TreeNode* node) {
+            return node && !node->deleted ? node : nullptr;
+        }
+
+        static bool found_live(const ConnPointData<TreeNode>& conn_point_snapshot) {
+            return conn_point_snapshot.found() && !conn_point_snapshot.target()->deleted;
+        }
+
+        // the first node after node in key order which is
+        // not a tombstone, in the same snapshot of the tree
+        static TreeNode* next_live(TreeNode* snapshot, TreeNode* node) {
+            while (node && node->deleted) {
+                node = find_ceiling<TreeNode>(snapshot, node->getKey(), false);
+            }
+
+            return node;
+        }
+
+        static TreeNode* previous_live(TreeNode* snapshot, TreeNode* node) {
+            while (node && node->deleted) {
+                node = find_floor<TreeNode>(snapshot, node->getKey(), false);
+            }
+
+            return node;
+        }
+
+        static int count_tombstones(TreeNode* node) {
+            if (!node) {
+                return 0;
+            }
+
+            return (node->deleted ? 1 : 0) + count_tombstones(node->getChild(0)) + count_tombstones(node->getChild(1));
+        }
+
+        static void collect_tombstones(TreeNode* node, std::vector<int>& keys) {
+            if (!node) {
+                return;
+            }
+
+            collect_tombstones(node->getChild(0), keys);
+
+            if (node->deleted) {
+                keys.push_back(node->getKey());
+            }
+
+            collect_tombstones(node->getChild(1), keys);
         }
 
 
         // copy the tree
-        void node_copy(AVLNode<ValueType>* curr, AVLNode<ValueType>* copy_curr = nullptr) {
+        void node_copy(TreeNode* curr, TreeNode* copy_curr = nullptr) {
             if (!curr) return;
 
             if (!copy_curr) {
-                copy_curr = new AVLNode<ValueType>*(curr);
+                copy_curr = new TreeNode*(curr);
             }
 
             copy_curr->setChild(0, curr->getChild(0));
@@ -271,7 +600,7 @@ class AVLTree {
         }
 
         // print the tree pre-order
-        void print_contents(AVLNode<ValueType>* root) {
+        void print_contents(TreeNode* root) {
             if (!root) {
                 return;
             }
@@ -282,7 +611,7 @@ class AVLTree {
         }
 
         //print in-order
-        void print_sorted_contents(AVLNode<ValueType>* root) {
+        void print_sorted_contents(TreeNode* root) {
             if (!root) {
                 return;
             }
@@ -293,7 +622,7 @@ class AVLTree {
         }
 
         // print up to a certain height (depth)
-        void print_depth(AVLNode<ValueType>* root,int depth) {
+        void print_depth(TreeNode* root,int depth) {
             if (depth <= 0 || !root) {
                 return;
             }
@@ -304,7 +633,7 @@ class AVLTree {
         }
 
         // tree's longest branch
-        int longest_branch(AVLNode<ValueType>* root) {
+        int longest_branch(TreeNode* root) {
             if (!root) {
                 return 0;
             }
@@ -317,7 +646,7 @@ class AVLTree {
         }
         
         // tree's averge branch size
-        void averageBranchHelper(AVLNode<ValueType>* root,int& total_leaves, int& total_length, int curr_branch_length = 1) {
+        void averageBranchHelper(TreeNode* root,int& total_leaves, int& total_length, int curr_branch_length = 1) {
             if (!root) {
                 return;
             }
@@ -331,7 +660,7 @@ class AVLTree {
             averageBranchHelper(root->getChild(1), total_leaves, total_length,  curr_branch_length + 1);
         }
 
-        int averageBranchLength(AVLNode<ValueType>* root) {
+        int averageBranchLength(TreeNode* root) {
             int total_leaves = 0;
             int total_length = 0;
 
@@ -367,6 +696,23 @@ class AVLTree {
             return abs(l_height - r_height) < 2 && isBalancedHelper(node->getL()) && isBalancedHelper(node->getR());
         }
 
+        // the stored heights are the real ones,
+        // relaxed trees can have stale ones
+        int checkedHeight(TreeNode* node) {
+            if (!node) {
+                return 0;
+            }
+
+            const int l_height = checkedHeight(node->getL());
+            const int r_height = checkedHeight(node->getR());
+
+            if (l_height == -1 || r_height == -1 || node->height != (l_height > r_height ? l_height : r_height) + 1) {
+                return -1;
+            }
+
+            return node->height;
+        }
+
         // recursively delete
         void rec_delete(TreeNode* node) {
             if (!node) return;
@@ -384,7 +730,7 @@ class AVLTree {
             auto n_values = n->rwRef();
 
             // calculate node height
-            n_values->height = TreeNode::max_height(n_values->getL(), n_values->getR()) + 1;
+            TreeNode::refresh(n_values);
 
             
             // calculate node's balance
@@ -400,37 +746,113 @@ class AVLTree {
                 n = TreeNode::left_rotate(n);
             } else if (balance > 1 && k > n_values->getL()->key) { // left right rotate
                 n->setChild(0 ,TreeNode::left_rotate(n->getChild(0)));
-                n_values->height = TreeNode::max_height(n_values->getL(), n_values->getR()) + 1;
+                TreeNode::refresh(n_values);
                 n = TreeNode::right_rotate(n);
             } else if (balance < -1 && k < n_values->getR()->key) { // right Left Rotate
                 n->setChild(1,TreeNode::right_rotate(n->getChild(1)));
-                n_values->height = TreeNode::max_height(n_values->getL(), n_values->getR()) + 1;
+                TreeNode::refresh(n_values);
                 n = TreeNode::left_rotate(n);
             } else {
                 rotation_happened = false;
             }
 
             // calculate new height
-            n_values->height = TreeNode::max_height(n_values->getL(), n_values->getR()) + 1;
+            TreeNode::refresh(n_values);
 
             return n;
 
         }
 
-        // the insert operation
-        bool insert_impl(const int k, ValueType val, int t_id) {
+        // connect a new node with key k as the root of the tree
+        // of copies and rebalance up the path, unless relaxed
+        void insert_step(ConnPoint<TreeNode>& conn, const bool at_root, const int k, ValueType val, const bool relaxed) {
+            // build new node
+            #ifdef USER_NODE_POOL
+                auto node_to_be_inserted = conn.create_safe(ConnPoint<TreeNode>::create_new_node(k,val,nullptr,nullptr));
+            #else
+                auto node_to_be_inserted = conn.create_safe(new TreeNode(k,val,nullptr,nullptr));
+            #endif
 
-            (void)t_id;
+
+            // insert it
+            conn.setRoot(node_to_be_inserted);
+
+            // identical to bst up to this point
+
+
+            // if not inserting at root, the
+            // rebalancer fixes relaxed trees later
+            if (!at_root && !relaxed) {
+                
+                bool rotation_happened = false;
+                
+                
+
+                /* REBALANCE */
+                
+                // go up path and rebalance
+                for (SafeNode<TreeNode>* n = conn.pop_path(); n != nullptr; n = conn.pop_path()) {
+                    auto n_values = n->rwRef();
+                    int height_old = n_values->height;
+
+                    n = rebalance_ins(n, k , rotation_happened); // apply rebalancing to all
+                                                                // required nodes
+                                                                // rotation returns the new root to place
+                                                                // below the connection point
+
+                    conn.setRoot(n);    // change the root of the
+                                        // tree of copies to make the change visible
+
+                    // augmented data has to be updated up to the root
+                    if (!Augmentation::enabled && height_old == n_values->height && !rotation_happened) {
+                        break;
+                    }
+
+                }
+            }
+        }
+
+        // replace the value of the node found, which is the
+        // root of the tree of copies. The structure does not
+        // change, so only the node is copied, unless there is
+        // augmented data to update up to the root.
+        void update_step(ConnPoint<TreeNode>& conn, ValueType val) {
+            auto target_values = conn.getRoot()->rwRef();
+            target_values->setValue(val);
+
+            if (Augmentation::enabled) {
+                TreeNode::refresh(target_values);
+
+                for (SafeNode<TreeNode>* n = conn.pop_path(); n != nullptr; n = conn.pop_path()) {
+                    TreeNode::refresh(n->rwRef());
+                }
+            }
+        }
+
+        // turn the tombstone found, which is the root
+        // of the tree of copies, back into a key
+        void revive_step(ConnPoint<TreeNode>& conn, ValueType val) {
+            conn.getRoot()->rwRef()->deleted = false;
+            update_step(conn, val);
+        }
+
+        // the insert operation, revived is set if
+        // a tombstone was reused instead of inserting
+        bool insert_impl(const int k, ValueType val, int t_id, bool& revived) {
+
+            bool deferred = false;
+            bool deep = false;
+            int fix_key = k;
             
             TM_SAFE_OPERATION_START(30) {
 
                 /* FIND PHASE */
 
                 
-                auto conn_point_snapshot = find_conn_point<TreeNode>(k,&root);
+                auto conn_point_snapshot = find_conn_point<TreeNode>(k,root_of(&root));
 
 
-                if (conn_point_snapshot.found()) {
+                if (found_live(conn_point_snapshot)) {
                     return false;
                 }
 
@@ -439,59 +861,113 @@ class AVLTree {
 
                 ConnPoint<TreeNode> conn(conn_point_snapshot);
 
+                revived = conn_point_snapshot.found();
+                deferred = !revived && defer_rebalance(conn_point_snapshot, k, fix_key, deep);
+
                 /* INSERT */
 
-                // build new node
-                #ifdef USER_NODE_POOL
-                    auto node_to_be_inserted = conn.create_safe(ConnPoint<TreeNode>::create_new_node(k,val,nullptr,nullptr));
-                #else
-                    auto node_to_be_inserted = conn.create_safe(new AVLNode<ValueType>(k,val,nullptr,nullptr));
-                #endif
+                if (revived) {
+                    revive_step(conn, val);
+                } else {
+                    insert_step(conn, !conn_point_snapshot.connection_point(), k, val, deferred);
+                }
+            } TM_SAFE_OPERATION_END
+
+            // OPERATION END can be omitted if
+            // not using EARLY ABORT COMPILATION FLAGS
+            
+            if (deferred) {
+                fix_relaxed(t_id, fix_key, deep);
+            }
+       
+            return true;
+
+        }
+
+        // insert or replace the value,
+        // returns true if a new node was inserted
+        bool upsert_impl(const int k, ValueType val, int t_id, bool& revived) {
+            bool inserted = false;
+            bool deferred = false;
+            bool deep = false;
+            int fix_key = k;
 
+            TM_SAFE_OPERATION_START(30) {
+                auto conn_point_snapshot = find_conn_point<TreeNode>(k,root_of(&root));
 
-                // insert it
-                conn.setRoot(node_to_be_inserted);
+                inserted = !found_live(conn_point_snapshot);
+                revived = inserted && conn_point_snapshot.found();
+                deferred = inserted && !revived && defer_rebalance(conn_point_snapshot, k, fix_key, deep);
 
-                // identical to bst up to this point
+                ConnPoint<TreeNode> conn(conn_point_snapshot);
 
+                if (revived) {
+                    revive_step(conn, val);
+                } else if (inserted) {
+                    insert_step(conn, !conn_point_snapshot.connection_point(), k, val, deferred);
+                } else {
+                    update_step(conn, val);
+                }
+            } TM_SAFE_OPERATION_END
 
-                // if not inserting at root
-                if (conn_point_snapshot.connection_point()) {
-                    
-                    bool rotation_happened = false;
-                    
-                    
+            if (deferred) {
+                fix_relaxed(t_id, fix_key, deep);
+            }
 
-                    /* REBALANCE */
-                    
-                    // go up path and rebalance
-                    for (SafeNode<TreeNode>* n = conn.pop_path(); n != nullptr; n = conn.pop_path()) {
-                        auto n_values = n->rwRef();
-                        int height_old = n_values->height;
+            return inserted;
+        }
 
-                        n = rebalance_ins(n, k , rotation_happened); // apply rebalancing to all
-                                                                    // required nodes
-                                                                    // rotation returns the new root to place
-                                                                    // below the connection point
+        // replace the value with fn(value) if the key exists
+        template <class F>
+        Result<ValueType> compute_impl(const int k, F& fn, int t_id) {
+            (void)t_id;
 
-                        conn.setRoot(n);    // change the root of the
-                                            // tree of copies to make the change visible
+            Result<ValueType> result = {false, ValueType()};
 
-                        if (height_old == n_values->height && !rotation_happened) {
-                            break;
-                        }
+            TM_SAFE_OPERATION_START(30) {
+                auto conn_point_snapshot = find_conn_point<TreeNode>(k,root_of(&root));
 
-                    }
+                if (!found_live(conn_point_snapshot)) {
+                    return {false, ValueType()};
                 }
+
+                ConnPoint<TreeNode> conn(conn_point_snapshot);
+
+                const ValueType new_val = fn(Values::read_copy(conn));
+
+                update_step(conn, new_val);
+
+                result = {true, new_val};
             } TM_SAFE_OPERATION_END
 
-            // OPERATION END can be omitted if
-            // not using EARLY ABORT COMPILATION FLAGS
-            
-            
-       
-            return true;
+            return result;
+        }
+
+        // replace the value with desired if it equals expected
+        bool compare_and_set_impl(const int k, const ValueType& expected, ValueType desired, int t_id) {
+            (void)t_id;
+
+            bool swapped = false;
+
+            TM_SAFE_OPERATION_START(30) {
+                auto conn_point_snapshot = find_conn_point<TreeNode>(k,root_of(&root));
+
+                if (!found_live(conn_point_snapshot) || !(Values::read(conn_point_snapshot.target()) == expected)) {
+                    return false;
+                }
+
+                ConnPoint<TreeNode> conn(conn_point_snapshot);
+
+                // again on the copy, as it may have
+                // been written in place meanwhile
+                swapped = Values::read_copy(conn) == expected;
 
+                if (swapped) {
+                    update_step(conn, desired);
+                }
+            } TM_SAFE_OPERATION_END
+
+            return swapped;
         }
 
     // rebalance for removes
@@ -501,7 +977,7 @@ class AVLTree {
 		// calculate node height
         // can peek children from a rwRef
         // could also use n->peekChild
-		n_value->height = TreeNode::max_height(n_value->getL(), n_value->getR()) + 1;
+		TreeNode::refresh(n_value);
 
 		// calculate node's balance
 		int balance = TreeNode::node_balance(n_value);
@@ -514,11 +990,11 @@ class AVLTree {
 			n = TreeNode::left_rotate(n);
 	  	} else if (balance > 1 && TreeNode::node_balance(n_value->getL()) < 0) { // left right rotate
 			n->setChild(0, TreeNode::left_rotate(n->getChild(0)));
-			n_value->height = TreeNode::max_height(n_value->getL(), n_value->getR()) + 1;
+			TreeNode::refresh(n_value);
 			n = TreeNode::right_rotate(n);
 		} else if (balance < -1 && TreeNode::node_balance(n_value->getR()) > 0 ) { // right Left Rotate
 			n->setChild(1, TreeNode::right_rotate(n->getChild(1)));
-			n_value->height = TreeNode::max_height(n_value->getL(), n_value->getR()) + 1;
+			TreeNode::refresh(n_value);
 			n = TreeNode::left_rotate(n);
 		} else {
             rotation_happened = false;
@@ -532,115 +1008,129 @@ class AVLTree {
         return rebalance_rem(n, r_h);
     }
 
+    // relaxed trees are not rebalanced by the updates
+    SafeNode<TreeNode>* rebalance_if_strict(SafeNode<TreeNode>* n, const bool relaxed) {
+        return relaxed ? n : rebalance_rem(n);
+    }
 
-    bool remove_impl(const int k, const int t_id) {
-        (void)t_id;
-        
-        TM_SAFE_OPERATION_START(30) {
-
-            /* FIND PHASE */
+    // relaxed updates leave the rebalancing out of their transaction.
+    // Sets fix_key to the connection point, the lowest node above the
+    // change, or k at the root, and deep if the update has to fix
+    // the path itself, see fix_relaxed().
+    bool defer_rebalance(const ConnPointData<TreeNode>& snapshot, const int k, int& fix_key, bool& deep) const {
+        const auto conn_point = snapshot.connection_point();
+        fix_key = conn_point ? conn_point->getKey() : k;
+        deep = snapshot.depth() >= RELAXED_MAX_DEPTH;
 
-                
-            auto conn_point_snapshot = find_conn_point<TreeNode>(k,&root);
+        return relaxed_;
+    }
 
+    // keep the key of a node to fix for the rebalancer
+    void record_fix(const int t_id, const int k) {
+        auto& pending = pending_[t_id % THREAD_AMOUNT_MAX];
 
-            if (!conn_point_snapshot.found()) {
-                return false;
-            }
+        pending.lock.lock();
+        pending.keys.push_back(k);
+        pending.lock.unlock();
+    }
 
+    // move the recorded keys to keys, sorted and once each
+    void take_fixes(std::vector<int>& keys) {
+        if (!pending_) {
+            return;
+        }
 
-            /* FIND PHASE END */
+        for (int i = 0; i < THREAD_AMOUNT_MAX; i++) {
+            auto& pending = pending_[i];
 
-            ConnPoint<TreeNode> conn(conn_point_snapshot);
+            pending.lock.lock();
+            keys.insert(keys.end(), pending.keys.begin(), pending.keys.end());
+            pending.keys.clear();
+            pending.lock.unlock();
+        }
 
-            /* REMOVE */
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    }
 
-            auto node_to_be_deleted = conn.getRoot();
+    // a relaxed update with a deep connection point fixes the path
+    // right after its transaction, as the rebalancer would, so the
+    // branches the updates leave stay short. Others record the node
+    // for the rebalancer.
+    void fix_relaxed(const int t_id, const int k, const bool deep) {
+        if (!deep) {
+            record_fix(t_id, k);
+            return;
+        }
 
-            // just read them to see if they exist
-            auto l_child = node_to_be_deleted->peekChild(0);
-            auto r_child = node_to_be_deleted->peekChild(1);
+        std::vector<int> later;
+        rebalance_path(k, t_id, later);
 
+        for (int l : later) {
+            record_fix(t_id, l);
+        }
+    }
 
-            // one or no children, at point of insertion
-            if (!l_child && !r_child) {
-                conn.setRoot(nullptr);
-                node_to_be_deleted = nullptr;
-            }
-            else if (!l_child || !r_child) {
-                auto temp = l_child ? node_to_be_deleted->getChild(0): node_to_be_deleted->getChild(1);
+    // the height of the node is the one of
+    // its children and it is balanced
+    static bool settled(TreeNode* node) {
+        return node->height == static_cast<int>(TreeNode::max_height(node->getL(), node->getR())) + 1 && abs(TreeNode::node_balance(node)) < 2;
+    }
 
-                // just set it as new root
-                // of copied tree, if it exists
-                node_to_be_deleted = nullptr;
-                conn.setRoot(temp);
-            } else {
-                // search for smallest of the right subtree
+    // a rotation moves the imbalance of a relaxed tree by one
+    // level, keep the rotated nodes which are still unbalanced
+    static void keep_unbalanced(TreeNode* node, int* keys, int& amount) {
+        TreeNode* rotated[] = {node, node->getL(), node->getR()};
 
-                NodeStack<SafeNode<TreeNode>, 10000> del_stack;
+        for (auto n : rotated) {
+            if (n && abs(TreeNode::node_balance(n)) > 1) {
+                keys[amount++] = n->getKey();
+            }
+        }
+    }
 
-                auto smallest = node_to_be_deleted->getChild(1);
+    // fix the heights and rotate from the node with key k, or the
+    // last node of its path if it was removed, up to the first node
+    // which needs no fix, in a transaction of its own. Returns the
+    // amount of nodes fixed, the nodes left to fix are added to later.
+    int rebalance_path(const int k, const int t_id, std::vector<int>& later) {
+        (void)t_id;
 
-                while (smallest->getChild(0)) {
-                    del_stack.push(smallest);
-                    smallest = smallest->getChild(0);
-                }
+        // room for the rotations of a few levels, the
+        // walk stops before it runs out of it
+        static constexpr int MAX_KEPT = 16;
+        int kept[MAX_KEPT];
+        int kept_amount = 0;
 
-                auto node_to_be_deleted_values = node_to_be_deleted->rwRef();
-                auto smallest_ref = smallest->rwRef();
+        int fixes = 0;
 
-                node_to_be_deleted_values->setKey(smallest_ref->getKey());
-                node_to_be_deleted_values->setValue(smallest_ref->getValue());
+        TM_SAFE_OPERATION_START(30) {
+            kept_amount = 0;
+            fixes = 0;
 
-                // directly below node
-                // at its right
-                // delete and set its right child as the next child of
-                // the proper node
-                if (del_stack.Empty()) {
-                    node_to_be_deleted->setChild(1, conn.wrap_no_validate(smallest_ref->getChild(1)));
-                } else {
-                    auto parent_of_smallest = del_stack.pop();
-                    
-                    // delete node which was removed
-                    parent_of_smallest->setChild(0, conn.wrap_no_validate(smallest_ref->getChild(1)));
+            auto conn_point_snapshot = find_conn_point<TreeNode>(k,root_of(&root));
+            const bool found = conn_point_snapshot.found();
+            auto start = found ? conn_point_snapshot.target() : conn_point_snapshot.connection_point();
 
-                    // rebalance its parent
-                    auto new_child = rebalance_rem(parent_of_smallest);
+            // fixed meanwhile, or the tree is empty
+            if (!start || settled(start)) {
+                return 0;
+            }
 
-                    // while there is a path to 
-                    // the node to be deleted
-                    while(!del_stack.Empty()) {
-                        // remove from path
-                        auto temp_child = del_stack.pop();
+            ConnPoint<TreeNode> conn(conn_point_snapshot);
 
-                        // connect already rebalanced
-                        temp_child->setChild(0, new_child);
+            bool rotation_happened = false;
 
-                        // create new rebalanced
-                        new_child = rebalance_rem(temp_child);
-                    }
+            for (SafeNode<TreeNode>* n = found ? conn.getRoot() : conn.pop_path(); n != nullptr; n = conn.pop_path()) {
+                auto n_values = n->rwRef();
 
-                    // finally add as child of node to be deleted
-                    node_to_be_deleted->setChild(1, new_child);
+                // a later pass goes on from here
+                if (kept_amount + 4 > MAX_KEPT) {
+                    kept[kept_amount++] = n_values->getKey();
+                    break;
                 }
 
-            }
-
-            // tree is now balanced up to the right
-            // subtree of the new node
-
-            // now rebalance the root of the copied tree
-            if (node_to_be_deleted) {
-                conn.setRoot(rebalance_rem(node_to_be_deleted));
-            }
-
-            int height_old;
-
-            bool rotation_happened = false;
-            // now rebalance upwards
-            for (SafeNode<TreeNode>* n = conn.pop_path(); n != nullptr; n = conn.pop_path()) {
-                auto n_values = n->rwRef();
-                height_old = n_values->height;
+                const int height_old = n_values->height;
 
                 n = rebalance_rem(n, rotation_happened);
 
@@ -648,21 +1138,288 @@ class AVLTree {
 
                 if (height_old == n_values->height && !rotation_happened) {
                     break;
-                } 
+                }
+
+                ++fixes;
+
+                if (rotation_happened) {
+                    keep_unbalanced(n->rwRef(), kept, kept_amount);
+                }
             }
         } TM_SAFE_OPERATION_END
 
-        return true;
+        later.insert(later.end(), kept, kept + kept_amount);
+
+        return fixes;
     }
 
 
+    // the nodes a relaxed remove leaves to the rebalancer, by key: the
+    // lowest one it changed, and the one which took the key of the
+    // successor, as the fixes recorded for that key are now its own
+    struct RemoveFixes {
+        int lowest;
+        int moved;
+    };
 
+    void fix_relaxed(const int t_id, const RemoveFixes& fixes, const bool deep) {
+        fix_relaxed(t_id, fixes.lowest, deep);
 
-    public:
+        if (fixes.moved != fixes.lowest) {
+            fix_relaxed(t_id, fixes.moved, deep);
+        }
+    }
 
-    AVLTree(TreeNode* root, TSX::SpinLock &lock): root(root), _lock(lock){
-        #ifdef USER_NODE_POOL
-            ConnPoint<TreeNode>::init_node_pool();
+    // remove the node found, which is the root of the tree of copies,
+    // and rebalance upwards. If fixes is set the tree is relaxed and
+    // the rebalancing is left for later, fixes are set when the nodes
+    // to fix are below the removed one.
+    void remove_step(ConnPoint<TreeNode>& conn, RemoveFixes* fixes = nullptr) {
+        const bool relaxed = fixes != nullptr;
+
+        auto node_to_be_deleted = conn.getRoot();
+
+        // just read them to see if they exist
+        auto l_child = node_to_be_deleted->peekChild(0);
+        auto r_child = node_to_be_deleted->peekChild(1);
+
+
+        // one or no children, at point of insertion
+        if (!l_child && !r_child) {
+            conn.setRoot(nullptr);
+            node_to_be_deleted = nullptr;
+        }
+        else if (!l_child || !r_child) {
+            auto temp = l_child ? node_to_be_deleted->getChild(0): node_to_be_deleted->getChild(1);
+
+            // just set it as new root
+            // of copied tree, if it exists
+            node_to_be_deleted = nullptr;
+            conn.setRoot(temp);
+        } else {
+            // search for smallest of the right subtree
+
+            NodeStack<SafeNode<TreeNode>, 10000> del_stack;
+
+            auto smallest = node_to_be_deleted->getChild(1);
+
+            while (smallest->getChild(0)) {
+                del_stack.push(smallest);
+                smallest = smallest->getChild(0);
+            }
+
+            auto node_to_be_deleted_values = node_to_be_deleted->rwRef();
+            auto smallest_ref = smallest->rwRef();
+
+            node_to_be_deleted_values->setKey(smallest_ref->getKey());
+            node_to_be_deleted_values->value = smallest_ref->value;
+            node_to_be_deleted_values->deleted = smallest_ref->deleted;
+
+            // directly below node
+            // at its right
+            // delete and set its right child as the next child of
+            // the proper node
+            if (del_stack.Empty()) {
+                node_to_be_deleted->setChild(1, conn.wrap_no_validate(smallest_ref->getChild(1)));
+
+                if (relaxed) {
+                    fixes->lowest = fixes->moved = node_to_be_deleted_values->getKey();
+                }
+            } else {
+                auto parent_of_smallest = del_stack.pop();
+                
+                // delete node which was removed
+                parent_of_smallest->setChild(0, conn.wrap_no_validate(smallest_ref->getChild(1)));
+
+                if (relaxed) {
+                    fixes->lowest = parent_of_smallest->rwRef()->getKey();
+                    fixes->moved = node_to_be_deleted_values->getKey();
+                }
+
+                // rebalance its parent
+                auto new_child = rebalance_if_strict(parent_of_smallest, relaxed);
+
+                // while there is a path to 
+                // the node to be deleted
+                while(!del_stack.Empty()) {
+                    // remove from path
+                    auto temp_child = del_stack.pop();
+
+                    // connect already rebalanced
+                    temp_child->setChild(0, new_child);
+
+                    // create new rebalanced
+                    new_child = rebalance_if_strict(temp_child, relaxed);
+                }
+
+                // finally add as child of node to be deleted
+                node_to_be_deleted->setChild(1, new_child);
+            }
+
+        }
+
+        // tree is now balanced up to the right
+        // subtree of the new node
+
+        // now rebalance the root of the copied tree
+        if (node_to_be_deleted) {
+            conn.setRoot(rebalance_if_strict(node_to_be_deleted, relaxed));
+        }
+
+        if (relaxed) {
+            return;
+        }
+
+        int height_old;
+
+        bool rotation_happened = false;
+        // now rebalance upwards
+        for (SafeNode<TreeNode>* n = conn.pop_path(); n != nullptr; n = conn.pop_path()) {
+            auto n_values = n->rwRef();
+            height_old = n_values->height;
+
+            n = rebalance_rem(n, rotation_happened);
+
+            conn.setRoot(n);
+
+            if (!Augmentation::enabled && height_old == n_values->height && !rotation_happened) {
+                break;
+            } 
+        }
+    }
+
+    // with tombstone removes, a node with two children is only
+    // marked, as unlinking it copies the path down to its successor
+    // and rebalances twice. Nodes with one child or none are cheap
+    // to unlink, so they are removed at once. Returns true if the
+    // node was only marked.
+    bool remove_or_mark(ConnPoint<TreeNode>& conn, RemoveFixes* fixes = nullptr) {
+        auto node_to_be_deleted = conn.getRoot();
+
+        if (tombstone_removes_ && node_to_be_deleted->peekChild(0) && node_to_be_deleted->peekChild(1)) {
+            // only the node is copied
+            node_to_be_deleted->rwRef()->deleted = true;
+            return true;
+        }
+
+        remove_step(conn, fixes);
+
+        return false;
+    }
+
+    // marked is set if the node became a tombstone
+    bool remove_impl(const int k, const int t_id, bool& marked) {
+        bool deferred = false;
+        bool deep = false;
+        RemoveFixes fixes = {k, k};
+        
+        TM_SAFE_OPERATION_START(30) {
+
+            /* FIND PHASE */
+
+                
+            auto conn_point_snapshot = find_conn_point<TreeNode>(k,root_of(&root));
+
+
+            if (!found_live(conn_point_snapshot)) {
+                return false;
+            }
+
+
+            /* FIND PHASE END */
+
+            ConnPoint<TreeNode> conn(conn_point_snapshot);
+
+            /* REMOVE */
+
+            deferred = defer_rebalance(conn_point_snapshot, k, fixes.lowest, deep);
+            fixes.moved = fixes.lowest;
+            marked = remove_or_mark(conn, deferred ? &fixes : nullptr);
+        } TM_SAFE_OPERATION_END
+
+        if (deferred && !marked) {
+            fix_relaxed(t_id, fixes, deep);
+        }
+
+        return true;
+    }
+
+    // unlink the tombstone with key k, unless it was
+    // revived or unlinked meanwhile
+    bool unlink_tombstone(const int k, const int t_id) {
+        bool deferred = false;
+        bool deep = false;
+        RemoveFixes fixes = {k, k};
+
+        TM_SAFE_OPERATION_START(30) {
+            auto conn_point_snapshot = find_conn_point<TreeNode>(k,root_of(&root));
+
+            if (!conn_point_snapshot.found() || !conn_point_snapshot.target()->deleted) {
+                return false;
+            }
+
+            ConnPoint<TreeNode> conn(conn_point_snapshot);
+
+            deferred = defer_rebalance(conn_point_snapshot, k, fixes.lowest, deep);
+            fixes.moved = fixes.lowest;
+            remove_step(conn, deferred ? &fixes : nullptr);
+        } TM_SAFE_OPERATION_END
+
+        if (deferred) {
+            fix_relaxed(t_id, fixes, deep);
+        }
+
+        return true;
+    }
+
+    // count the changes of an operation, for the compaction
+    void count_nodes_change(const int t_id, const long nodes, const long tombstones) {
+        if (tombstone_removes_) {
+            auto& counter = node_counts_[t_id % THREAD_AMOUNT_MAX];
+            counter.nodes.fetch_add(nodes, std::memory_order_relaxed);
+            counter.tombstones.fetch_add(tombstones, std::memory_order_relaxed);
+        }
+    }
+
+    // after every few marks of a thread, compact if there are
+    // too many tombstones and no other thread is compacting
+    void compact_if_needed(const int t_id) {
+        auto& counter = node_counts_[t_id % THREAD_AMOUNT_MAX];
+
+        if (compaction_ratio_ <= 0 || counter.marks.fetch_add(1, std::memory_order_relaxed) % 64 != 63) {
+            return;
+        }
+
+        long nodes = 0;
+        long tombstones = 0;
+
+        for (int i = 0; i < THREAD_AMOUNT_MAX; i++) {
+            nodes += node_counts_[i].nodes.load(std::memory_order_relaxed);
+            tombstones += node_counts_[i].tombstones.load(std::memory_order_relaxed);
+        }
+
+        // the sums are approximate, a tree with
+        // tombstones has at least one node
+        nodes = std::max(nodes, 1L);
+
+        if (tombstones <= compaction_ratio_ * nodes || compacting_.exchange(true)) {
+            return;
+        }
+
+        compact(t_id);
+
+        compacting_ = false;
+    }
+
+
+
+
+    public:
+
+    AVLTree(TreeNode* root, TSX::SpinLock &lock): root(root), _lock(lock), in_place_(IN_PLACE_ELIGIBLE), relaxed_(false), pending_(nullptr), rebalancer_running_(false), tombstone_removes_(false), compaction_ratio_(0.25), node_counts_(nullptr), compacting_(false) {
+        #ifdef USER_NODE_POOL
+            ConnPoint<TreeNode>::init_node_pool();
+            StoredValue<ValueType, TreeNode>::init_pool();
         #endif
 
         for (int i = 0; i < THREAD_AMOUNT_MAX; i++) {
@@ -670,49 +1427,548 @@ class AVLTree {
         }
     }
     ~AVLTree() {
+        stopRebalancer();
+
+        release_per_thread(pending_);
+        release_per_thread(node_counts_);
+
         #ifndef USER_NODE_POOL
             rec_delete(root);
         #endif
 
         #ifdef USER_NODE_POOL
             ConnPoint<TreeNode>::reset_node_pool();
+            StoredValue<ValueType, TreeNode>::reset_pool();
         #endif
     }
 
     bool insert(const int k, ValueType val, int t_id) {
-        return insert_impl(k,val, t_id);
+        bool revived = false;
+        const bool inserted = insert_impl(k,val, t_id, revived);
+
+        if (inserted) {
+            count_nodes_change(t_id, revived ? 0 : 1, revived ? -1 : 0);
+        }
+
+        return inserted;
     }
 
+    // insert the key or replace its value if it exists,
+    // returns true if the key was inserted
+    bool upsert(const int k, ValueType val, int t_id) {
+        if (in_place() && Values::update_in_place(&root, k, val, trans_retries, live)) {
+            return false;
+        }
+
+        bool revived = false;
+        const bool inserted = upsert_impl(k, val, t_id, revived);
+
+        if (inserted) {
+            count_nodes_change(t_id, revived ? 0 : 1, revived ? -1 : 0);
+        }
+
+        return inserted;
+    }
+
+    // if the key exists, replace its value with fn(value)
+    // and return the new value. fn can be called more than
+    // once if the operation is retried, so it should have
+    // no side effects.
+    template <class F>
+    Result<ValueType> compute(const int k, F fn, int t_id) {
+        if (in_place()) {
+            Result<ValueType> result = {false, ValueType()};
+            result.found = Values::compute_in_place(&root, k, fn, result.val, trans_retries, live);
+
+            return result;
+        }
+
+        return compute_impl(k, fn, t_id);
+    }
+
+    // set the value of the key to desired, only if
+    // it is currently equal to expected
+    bool compare_and_set(const int k, const ValueType& expected, ValueType desired, int t_id) {
+        if (in_place()) {
+            return Values::compare_and_set_in_place(&root, k, expected, desired, trans_retries, live);
+        }
+
+        return compare_and_set_impl(k, expected, desired, t_id);
+    }
+
+    // use in place updates for existing keys when the value type
+    // allows it, else copy the node. Set before the tree is shared.
+    void setInPlaceUpdates(const bool enabled) {
+        in_place_ = enabled && IN_PLACE_ELIGIBLE;
+    }
+
+    bool inPlaceUpdates() const {
+        return in_place_;
+    }
+
+    /* RELAXED BALANCE */
+
+    // updates only insert and remove nodes, without fixing heights
+    // or rotating, so they copy just the nodes they change and don't
+    // conflict near the root. They record the lowest node they changed
+    // and the tree is rebalanced later by rebalance() or the rebalancer
+    // thread, with a small transaction per recorded node. Updates deep
+    // in the tree fix their path right after, and multi key transactions
+    // rebalance at once, which bounds the branches, still the rebalancer
+    // should keep up with the updates. Not available with augmented
+    // data. Set before the tree is shared.
+    void setRelaxedBalance(const bool enabled) {
+        relaxed_ = enabled && RELAXED_ELIGIBLE;
+
+        if (relaxed_ && !pending_) {
+            pending_ = allocate_per_thread<PendingFixes>();
+        }
+    }
+
+    bool relaxedBalance() const {
+        return relaxed_;
+    }
+
+    // fix the tree up from the nodes recorded since the last pass,
+    // returns the amount of nodes fixed, 0 when the tree is balanced.
+    // A rotation can leave work for the next pass. Can run together
+    // with updates, each path is fixed atomically.
+    int rebalance(const int t_id) {
+        std::vector<int> keys;
+        take_fixes(keys);
+
+        std::vector<int> later;
+        int fixes = 0;
+
+        for (int k : keys) {
+            fixes += rebalance_path(k, t_id, later);
+        }
+
+        for (int k : later) {
+            record_fix(t_id, k);
+        }
+
+        return fixes;
+    }
+
+    // start a thread running rebalancing passes while
+    // there are nodes to fix, t_id is used for its stats
+    void startRebalancer(const int t_id) {
+        if (rebalancer_running_) {
+            return;
+        }
+
+        rebalancer_running_ = true;
+
+        rebalancer_ = std::thread([this, t_id]() {
+            while (rebalancer_running_) {
+                // a pass that fixes nothing has caught up
+                if (!rebalance(t_id)) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+            }
+        });
+    }
+
+    void stopRebalancer() {
+        if (!rebalancer_running_) {
+            return;
+        }
+
+        rebalancer_running_ = false;
+        rebalancer_.join();
+    }
+
+    /* END OF RELAXED BALANCE */
+
+    /* TOMBSTONE REMOVES */
+
+    // removes of nodes with two children only mark them, copying
+    // the node alone, and the operations skip the tombstones. An
+    // insert of a removed key revives its tombstone. Tombstones are
+    // unlinked by compact(), which the removes run once the
+    // tombstones pass the compaction ratio. Not available with
+    // augmented data. Set before the tree is shared.
+    void setTombstoneRemoves(const bool enabled) {
+        tombstone_removes_ = enabled && TOMBSTONES_ELIGIBLE;
+
+        if (!tombstone_removes_) {
+            return;
+        }
+
+        if (!node_counts_) {
+            node_counts_ = allocate_per_thread<NodeCounter>();
+        }
+
+        // the counters only see the changes, so they start
+        // from the nodes already in the tree
+        const long tombstones = count_tombstones(root);
+
+        for (int i = 0; i < THREAD_AMOUNT_MAX; i++) {
+            node_counts_[i].nodes = 0;
+            node_counts_[i].tombstones = 0;
+        }
+
+        node_counts_[0].nodes = count_nodes(root) + tombstones;
+        node_counts_[0].tombstones = tombstones;
+    }
+
+    bool tombstoneRemoves() const {
+        return tombstone_removes_;
+    }
+
+    // fraction of tombstones in the nodes which starts a
+    // compaction, 0 to only compact when compact() is called
+    void setCompactionRatio(const double ratio) {
+        compaction_ratio_ = ratio;
+    }
+
+    double compactionRatio() const {
+        return compaction_ratio_;
+    }
+
+    // unlink the tombstones of a snapshot of the tree, one
+    // transaction each, returns the amount unlinked. Can run
+    // together with the other operations.
+    int compact(const int t_id) {
+        std::vector<int> keys;
+        collect_tombstones(root, keys);
+
+        int unlinked = 0;
+
+        for (int k : keys) {
+            if (unlink_tombstone(k, t_id)) {
+                ++unlinked;
+            }
+        }
+
+        count_nodes_change(t_id, -unlinked, -unlinked);
+
+        return unlinked;
+    }
+
+    // exact amount of tombstones, for validation
+    int tombstones() {
+        return count_tombstones(root);
+    }
+
+    /* END OF TOMBSTONE REMOVES */
+
     Result<ValueType> lookup(int desired_key) {
-        auto node = find<TreeNode>(root,desired_key);
-        
-        auto found = node != nullptr;
+        Result<ValueType> result = {false, ValueType()};
+        result.found = Values::lookup(*root_of(&root), desired_key, result.val, live);
+
+        return result;
+    }
 
-        return {found, found ? node->getValue(): ValueType() };
+    // lookup_ref: the value of the key without copying it, for large
+    // values. Inside a group it points to the group's copies, so it is
+    // valid until the group ends.
+    ValueRef<ValueType, IN_PLACE_ELIGIBLE> lookup_ref(int desired_key) {
+        return make_ref(live(find<TreeNode>(*root_of(&root), desired_key)), std::integral_constant<bool, IN_PLACE_ELIGIBLE>());
     }
 
+    /* ORDERED QUERIES */
+
+    // the tombstones are skipped in
+    // a single snapshot of the tree
+
+    // smallest key >= k
+    Entry<ValueType> lower_bound(int k) {
+        auto snapshot = *root_of(&root);
+        return entry_of(next_live(snapshot, find_ceiling<TreeNode>(snapshot, k)));
+    }
+
+    // smallest key > k
+    Entry<ValueType> upper_bound(int k) {
+        auto snapshot = *root_of(&root);
+        return entry_of(next_live(snapshot, find_ceiling<TreeNode>(snapshot, k, false)));
+    }
+
+    // largest key <= k
+    Entry<ValueType> floor(int k) {
+        auto snapshot = *root_of(&root);
+        return entry_of(previous_live(snapshot, find_floor<TreeNode>(snapshot, k)));
+    }
+
+    // smallest key >= k
+    Entry<ValueType> ceiling(int k) {
+        return lower_bound(k);
+    }
+
+    // next key after k, k does not need to exist
+    Entry<ValueType> successor(int k) {
+        return upper_bound(k);
+    }
+
+    // previous key before k, k does not need to exist
+    Entry<ValueType> predecessor(int k) {
+        auto snapshot = *root_of(&root);
+        return entry_of(previous_live(snapshot, find_floor<TreeNode>(snapshot, k, false)));
+    }
+
+    Entry<ValueType> min() {
+        auto snapshot = *root_of(&root);
+        return entry_of(next_live(snapshot, find_min<TreeNode>(snapshot)));
+    }
+
+    Entry<ValueType> max() {
+        auto snapshot = *root_of(&root);
+        return entry_of(previous_live(snapshot, find_max<TreeNode>(snapshot)));
+    }
+
+    /* END OF ORDERED QUERIES */
+
+    /* ORDER STATISTICS, require an augmentation with a count() of the subtree nodes */
+
+    // amount of keys smaller than k
+    int rank(int k) {
+        static_assert(Augmentation::enabled, "rank requires an augmentation which counts the subtree nodes");
+
+        int smaller = 0;
+
+        for (auto curr = *root_of(&root); curr;) {
+            if (k <= curr->getKey()) {
+                curr = curr->getL();
+            } else {
+                smaller += count_of(curr->getL()) + 1;
+                curr = curr->getR();
+            }
+        }
+
+        return smaller;
+    }
+
+    // the i-th smallest key, starting from 0
+    Entry<ValueType> select(int i) {
+        static_assert(Augmentation::enabled, "select requires an augmentation which counts the subtree nodes");
+
+        for (auto curr = *root_of(&root); curr;) {
+            const int left_nodes = count_of(curr->getL());
+
+            if (i < left_nodes) {
+                curr = curr->getL();
+            } else if (i == left_nodes) {
+                return entry_of(curr);
+            } else {
+                i -= left_nodes + 1;
+                curr = curr->getR();
+            }
+        }
+
+        return entry_of(nullptr);
+    }
+
+    /* END OF ORDER STATISTICS */
+
+    /* RANGE AGGREGATES, require a RangeAggregate augmentation */
+
+    // aggregate of the values with keys in [lo, hi],
+    // the identity of the monoid if there are none
+    template <class Aug = Augmentation>
+    typename Aug::AggregateType aggregate(int lo, int hi) {
+        // a single root read gives a consistent snapshot
+        auto curr = *root_of(&root);
+
+        // find the node where the paths
+        // to lo and hi split
+        while (curr) {
+            if (curr->getKey() < lo) {
+                curr = curr->getR();
+            } else if (curr->getKey() > hi) {
+                curr = curr->getL();
+            } else {
+                break;
+            }
+        }
+
+        if (!curr) {
+            return Aug::identity();
+        }
+
+        auto result = Aug::combine(aggregate_from<Aug>(curr->getL(), lo), curr->getValue());
+        return Aug::combine(result, aggregate_to<Aug>(curr->getR(), hi));
+    }
+
+    /* END OF RANGE AGGREGATES */
+
     // remove key value pair with key k
     bool remove(int k, int t_id) {
-        return remove_impl(k,t_id);
+        bool marked = false;
+        const bool removed = remove_impl(k,t_id, marked);
+
+        if (removed) {
+            count_nodes_change(t_id, marked ? 0 : -1, marked ? 1 : 0);
+
+            if (marked) {
+                compact_if_needed(t_id);
+            }
+        }
+
+        return removed;
+    }
+
+    /* MULTI KEY TRANSACTIONS */
+
+    // the operations of a transaction, each one sees
+    // the changes of the ones before it
+    class Transaction {
+        friend class AVLTree;
+
+        private:
+            AVLTree& tree_;
+            TreeNode** root_;
+
+            // changes of the amount of nodes and
+            // tombstones, for the compaction
+            long nodes_;
+            long tombstones_;
+
+            Transaction(AVLTree& tree, TreeNode** root): tree_(tree), root_(root), nodes_(0), tombstones_(0) {}
+
+            void count_insert(const bool revived) {
+                if (revived) {
+                    --tombstones_;
+                } else {
+                    ++nodes_;
+                }
+            }
+
+        public:
+            bool insert(const int k, ValueType val) {
+                auto conn_point_snapshot = find_conn_point<TreeNode>(k, root_);
+
+                if (found_live(conn_point_snapshot)) {
+                    return false;
+                }
+
+                ConnPoint<TreeNode> conn(conn_point_snapshot);
+
+                if (conn_point_snapshot.found()) {
+                    tree_.revive_step(conn, val);
+                } else {
+                    tree_.insert_step(conn, !conn_point_snapshot.connection_point(), k, val, false);
+                }
+
+                count_insert(conn_point_snapshot.found());
+
+                return true;
+            }
+
+            bool remove(const int k) {
+                auto conn_point_snapshot = find_conn_point<TreeNode>(k, root_);
+
+                if (!found_live(conn_point_snapshot)) {
+                    return false;
+                }
+
+                ConnPoint<TreeNode> conn(conn_point_snapshot);
+
+                if (tree_.remove_or_mark(conn)) {
+                    ++tombstones_;
+                } else {
+                    --nodes_;
+                }
+
+                return true;
+            }
+
+            bool upsert(const int k, ValueType val) {
+                auto conn_point_snapshot = find_conn_point<TreeNode>(k, root_);
+
+                const bool inserted = !found_live(conn_point_snapshot);
+
+                ConnPoint<TreeNode> conn(conn_point_snapshot);
+
+                if (inserted && conn_point_snapshot.found()) {
+                    tree_.revive_step(conn, val);
+                } else if (inserted) {
+                    tree_.insert_step(conn, !conn_point_snapshot.connection_point(), k, val, false);
+                } else {
+                    tree_.update_step(conn, val);
+                }
+
+                if (inserted) {
+                    count_insert(conn_point_snapshot.found());
+                }
+
+                return inserted;
+            }
+
+            template <class F>
+            Result<ValueType> compute(const int k, F fn) {
+                auto conn_point_snapshot = find_conn_point<TreeNode>(k, root_);
+
+                if (!found_live(conn_point_snapshot)) {
+                    return {false, ValueType()};
+                }
+
+                ConnPoint<TreeNode> conn(conn_point_snapshot);
+
+                const ValueType new_val = fn(Values::read_copy(conn));
+
+                tree_.update_step(conn, new_val);
+
+                return {true, new_val};
+            }
+
+            Result<ValueType> lookup(const int k) {
+                Result<ValueType> result = {false, ValueType()};
+                result.found = Values::lookup(*root_, k, result.val, live);
+
+                return result;
+            }
+    };
+
+    // run fn(Transaction&) as one atomic operation, other threads
+    // see all of its changes or none of them. Values are always
+    // copied, never updated in place. fn can be called more than
+    // once if the operation is retried, so it should change the
+    // tree only through the Transaction and have no other side effects.
+    template <class F>
+    void transaction(F fn, int t_id) {
+        long nodes = 0;
+        long tombstones = 0;
+
+        TM_SAFE_OPERATION_START(30) {
+            ConnPointGroup group;
+
+            if (group.active()) {
+                Transaction tx(*this, group.root(&root));
+                fn(tx);
+
+                nodes = tx.nodes_;
+                tombstones = tx.tombstones_;
+            }
+        } TM_SAFE_OPERATION_END
+
+        count_nodes_change(t_id, nodes, tombstones);
+
+        if (tombstones > 0) {
+            compact_if_needed(t_id);
+        }
     }
 
+    /* END OF MULTI KEY TRANSACTIONS */
+
 
     int size() {
-        return count_nodes(root);
+        return count_nodes(*root_of(&root));
     }
 
-    AVLNode<ValueType>* getRoot() {
+    TreeNode* getRoot() {
         return root;
     }
 
-    void setRoot(AVLNode<ValueType>* node) {
+    void setRoot(TreeNode* node) {
         root = node;
     }
 
     /* VALIDATORS */
 
+    // constant time if the augmentation keeps the key sum
     std::size_t key_sum() {
-        return key_sum_helper(root);
+        return key_sum_of(*root_of(&root), std::integral_constant<bool, has_key_sum<Augmentation>::value>());
     }
 
     bool isSorted() {
@@ -724,7 +1980,7 @@ class AVLTree {
     }
 
     bool isBalanced() {
-        return isBalancedHelper(root);
+        return isBalancedHelper(root) && checkedHeight(root) != -1;
     }
 
     /* END OF VALIDATORS */
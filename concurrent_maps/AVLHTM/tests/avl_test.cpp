@@ -5,6 +5,8 @@
 #include <random>
 #include <chrono>
 #include <atomic>
+#include <algorithm>
+#include <iterator>
 
 #include "../include/avl.hpp"
 #include "../../../include/catch2/catch.hpp"
@@ -250,6 +252,961 @@ TEST_CASE("AVLTree Remove Test","[remove]") {
 
 
 
+TEST_CASE("AVLTree Ordered Queries Test","[ordered]") {
+    AVLTree<int> someMap(nullptr, lock);
+
+    SECTION("empty tree") {
+        REQUIRE_FALSE(someMap.lower_bound(1).found);
+        REQUIRE_FALSE(someMap.floor(1).found);
+        REQUIRE_FALSE(someMap.min().found);
+        REQUIRE_FALSE(someMap.max().found);
+    }
+
+    SECTION("even keys") {
+        // keys 0, 2, ..., 98 with value key + 1
+        for (int i = 0; i < 100; i += 2) {
+            someMap.insert(i, i + 1, 0);
+        }
+
+        REQUIRE(someMap.min().key == 0);
+        REQUIRE(someMap.max().key == 98);
+
+        for (int i = 0; i < 100; i++) {
+            const bool even = i % 2 == 0;
+
+            auto lb = someMap.lower_bound(i);
+            REQUIRE(lb.found == (i <= 98));
+            if (lb.found) {
+                REQUIRE(lb.key == (even ? i : i + 1));
+                REQUIRE(lb.val == lb.key + 1);
+            }
+
+            auto ub = someMap.upper_bound(i);
+            REQUIRE(ub.found == (i < 98));
+            if (ub.found) {
+                REQUIRE(ub.key == (even ? i + 2 : i + 1));
+                REQUIRE(someMap.successor(i).key == ub.key);
+            }
+
+            auto fl = someMap.floor(i);
+            REQUIRE(fl.found);
+            REQUIRE(fl.key == (even ? i : i - 1));
+            REQUIRE(someMap.ceiling(i).key == lb.key);
+
+            auto pred = someMap.predecessor(i);
+            REQUIRE(pred.found == (i > 0));
+            if (pred.found) {
+                REQUIRE(pred.key == (even ? i - 2 : i - 1));
+            }
+        }
+
+        REQUIRE_FALSE(someMap.floor(-1).found);
+        REQUIRE(someMap.lower_bound(-10).key == 0);
+        REQUIRE(someMap.floor(1000).key == 98);
+    }
+}
+
+
+TEST_CASE("AVLTree Order Statistics Test","[order_stats]") {
+    using SizedTree = AVLTree<int, SubtreeSize>;
+
+    SECTION("empty tree") {
+        SizedTree someMap(nullptr, lock);
+
+        REQUIRE(someMap.rank(10) == 0);
+        REQUIRE_FALSE(someMap.select(0).found);
+    }
+
+    SECTION("inserts and removes") {
+        SizedTree someMap(nullptr, lock);
+
+        // keys 0, 2, ..., 998 with value key + 1
+        for (int i = 0; i < 1000; i += 2) {
+            someMap.insert(i, i + 1, 0);
+        }
+
+        REQUIRE(someMap.getRoot()->getAugmentation().count() == 500);
+
+        for (int i = 0; i < 1000; i++) {
+            REQUIRE(someMap.rank(i) == (i + 1) / 2);
+        }
+
+        for (int i = 0; i < 500; i++) {
+            auto entry = someMap.select(i);
+            REQUIRE(entry.found);
+            REQUIRE(entry.key == 2 * i);
+            REQUIRE(entry.val == 2 * i + 1);
+        }
+
+        REQUIRE_FALSE(someMap.select(500).found);
+
+        // remove multiples of 4, keys left are 2, 6, 10, ...
+        for (int i = 0; i < 1000; i += 4) {
+            someMap.remove(i, 0);
+        }
+
+        REQUIRE(someMap.getRoot()->getAugmentation().count() == 250);
+        REQUIRE(someMap.isBalanced());
+
+        for (int i = 0; i < 250; i++) {
+            REQUIRE(someMap.select(i).key == 4 * i + 2);
+            REQUIRE(someMap.rank(4 * i + 2) == i);
+        }
+    }
+
+    SECTION("mt inserts and removes") {
+        for (int j = 0; j < 10; j++) {
+            SizedTree someMap(nullptr, lock);
+            std::thread threads[THREADS];
+
+            for (int i = 0; i < THREADS; i++) {
+                threads[i] = std::thread([&someMap](int t_id) {
+                    for (int k = t_id * OPERATION_MULTIPLIER; k < (t_id + 1) * OPERATION_MULTIPLIER; k++) {
+                        someMap.insert(k, 1, t_id);
+                    }
+
+                    for (int k = t_id * OPERATION_MULTIPLIER; k < (t_id + 1) * OPERATION_MULTIPLIER; k += 2) {
+                        someMap.remove(k, t_id);
+                    }
+                }, i);
+            }
+
+            for (int i = 0; i < THREADS; i++) {
+                threads[i].join();
+            }
+
+            // only odd keys are left
+            const int remaining = THREADS * OPERATION_MULTIPLIER / 2;
+
+            REQUIRE(someMap.getRoot()->getAugmentation().count() == remaining);
+
+            for (int i = 0; i < remaining; i++) {
+                if (someMap.select(i).key != 2 * i + 1) {
+                    REQUIRE(someMap.select(i).key == 2 * i + 1);
+                }
+            }
+
+            REQUIRE(someMap.rank(THREADS * OPERATION_MULTIPLIER) == remaining);
+        }
+    }
+}
+
+
+// brute force aggregate of the values
+// in [lo, hi] of a key -> value array
+template <class Monoid>
+typename Monoid::type expected_aggregate(const std::vector<int>& values, int lo, int hi) {
+    auto result = Monoid::identity();
+
+    for (int k = std::max(lo, 0); k <= hi && k < (int)values.size(); k++) {
+        if (values[k] >= 0) {
+            result = Monoid::combine(result, values[k]);
+        }
+    }
+
+    return result;
+}
+
+
+TEST_CASE("AVLTree Range Aggregate Test","[aggregate]") {
+    using SumTree = AVLTree<int, RangeAggregate<SumMonoid<long>>>;
+    using MinTree = AVLTree<int, RangeAggregate<MinMonoid<int>>>;
+    using MaxTree = AVLTree<int, RangeAggregate<MaxMonoid<int>>>;
+
+    SumTree sumMap(nullptr, lock);
+    MinTree minMap(nullptr, lock);
+    MaxTree maxMap(nullptr, lock);
+
+    // value of key k, -1 if not in the maps
+    std::vector<int> values(300, -1);
+
+    for (int k = 0; k < 300; k += 3) {
+        values[k] = (k * 37) % 101;
+        sumMap.insert(k, values[k], 0);
+        minMap.insert(k, values[k], 0);
+        maxMap.insert(k, values[k], 0);
+    }
+
+    // remove some keys to get rotations
+    // and removes of inner nodes
+    for (int k = 0; k < 300; k += 15) {
+        values[k] = -1;
+        sumMap.remove(k, 0);
+        minMap.remove(k, 0);
+        maxMap.remove(k, 0);
+    }
+
+    REQUIRE(sumMap.isBalanced());
+
+    std::size_t expected_key_sum = 0;
+    for (int k = 0; k < 300; k++) {
+        if (values[k] >= 0) {
+            expected_key_sum += k;
+        }
+    }
+
+    REQUIRE(sumMap.key_sum() == expected_key_sum);
+    REQUIRE(minMap.key_sum() == expected_key_sum);
+
+    SECTION("empty ranges") {
+        REQUIRE(sumMap.aggregate(301, 400) == 0);
+        REQUIRE(sumMap.aggregate(1, 2) == 0);
+        REQUIRE(minMap.aggregate(-10, -1) == std::numeric_limits<int>::max());
+        REQUIRE(maxMap.aggregate(10, 5) == std::numeric_limits<int>::lowest());
+    }
+
+    SECTION("all ranges") {
+        for (int lo = -5; lo < 305; lo += 7) {
+            for (int hi = lo; hi < 305; hi += 11) {
+                REQUIRE(sumMap.aggregate(lo, hi) == expected_aggregate<SumMonoid<long>>(values, lo, hi));
+                REQUIRE(minMap.aggregate(lo, hi) == expected_aggregate<MinMonoid<int>>(values, lo, hi));
+                REQUIRE(maxMap.aggregate(lo, hi) == expected_aggregate<MaxMonoid<int>>(values, lo, hi));
+            }
+        }
+    }
+
+    SECTION("value updates") {
+        for (int k = 0; k < 300; k += 6) {
+            values[k] = 1000 + k;
+            sumMap.upsert(k, values[k], 0);
+        }
+
+        for (int k = 3; k < 300; k += 6) {
+            if (values[k] >= 0) {
+                values[k] = 2 * values[k];
+                REQUIRE(sumMap.compute(k, [](int v) { return 2 * v; }, 0).val == values[k]);
+            }
+        }
+
+        for (int lo = -5; lo < 305; lo += 7) {
+            for (int hi = lo; hi < 305; hi += 11) {
+                REQUIRE(sumMap.aggregate(lo, hi) == expected_aggregate<SumMonoid<long>>(values, lo, hi));
+            }
+        }
+    }
+}
+
+
+TEST_CASE("AVLTree Update Test","[update]") {
+    AVLTree<int> someMap(nullptr, lock);
+
+    SECTION("upsert") {
+        REQUIRE(someMap.upsert(5, 1, 0));
+        REQUIRE(someMap.lookup(5).val == 1);
+
+        REQUIRE_FALSE(someMap.upsert(5, 2, 0));
+        REQUIRE(someMap.lookup(5).val == 2);
+        REQUIRE(someMap.size() == 1);
+    }
+
+    SECTION("compute and compare and set") {
+        for (int i = 0; i < 100; i++) {
+            someMap.insert(i, i, 0);
+        }
+
+        auto res = someMap.compute(10, [](int v) { return v * 2; }, 0);
+        REQUIRE(res.found);
+        REQUIRE(res.val == 20);
+        REQUIRE(someMap.lookup(10).val == 20);
+
+        REQUIRE_FALSE(someMap.compute(1000, [](int v) { return v * 2; }, 0).found);
+        REQUIRE_FALSE(someMap.lookup(1000).found);
+
+        REQUIRE_FALSE(someMap.compare_and_set(11, 12, 0, 0));
+        REQUIRE(someMap.lookup(11).val == 11);
+        REQUIRE(someMap.compare_and_set(11, 11, 0, 0));
+        REQUIRE(someMap.lookup(11).val == 0);
+        REQUIRE_FALSE(someMap.compare_and_set(1000, 0, 0, 0));
+
+        // structure is untouched
+        REQUIRE(someMap.size() == 100);
+        REQUIRE(someMap.isSorted());
+    }
+
+    SECTION("mt compute") {
+        constexpr int KEYS = 16;
+        constexpr int INCREMENTS = 1000;
+
+        for (int i = 0; i < KEYS; i++) {
+            someMap.insert(i, 0, 0);
+        }
+
+        std::thread threads[THREADS];
+
+        for (int i = 0; i < THREADS; i++) {
+            threads[i] = std::thread([&someMap](int t_id) {
+                for (int j = 0; j < INCREMENTS; j++) {
+                    someMap.compute(j % KEYS, [](int v) { return v + 1; }, t_id);
+                }
+            }, i);
+        }
+
+        for (int i = 0; i < THREADS; i++) {
+            threads[i].join();
+        }
+
+        int sum = 0;
+        for (int i = 0; i < KEYS; i++) {
+            sum += someMap.lookup(i).val;
+        }
+
+        REQUIRE(sum == THREADS * INCREMENTS);
+        REQUIRE(someMap.size() == KEYS);
+    }
+}
+
+
+TEST_CASE("AVLTree In Place Update Test","[in_place]") {
+    SECTION("eligible values") {
+        AVLTree<int> someMap(nullptr, lock);
+        REQUIRE(someMap.inPlaceUpdates());
+
+        someMap.setInPlaceUpdates(false);
+        REQUIRE_FALSE(someMap.inPlaceUpdates());
+
+        AVLTree<std::string> stringMap(nullptr, lock);
+        REQUIRE_FALSE(stringMap.inPlaceUpdates());
+        stringMap.setInPlaceUpdates(true);
+        REQUIRE_FALSE(stringMap.inPlaceUpdates());
+
+        // augmented data changes up to the root
+        AVLTree<int, SubtreeSize> sizedMap(nullptr, lock);
+        REQUIRE_FALSE(sizedMap.inPlaceUpdates());
+    }
+
+    // counters are incremented in place while other threads
+    // insert and remove keys, copying the counter nodes
+    // for the rotations, no increment should be lost
+    const int workers = THREADS > 1 ? THREADS : 2;
+    constexpr int KEYS = 64;
+    constexpr int INCREMENTS = 2000;
+
+    for (int in_place = 0; in_place < 2; in_place++) {
+        AVLTree<int> someMap(nullptr, lock);
+        someMap.setInPlaceUpdates(in_place == 1);
+
+        for (int i = 0; i < 2 * KEYS; i += 2) {
+            someMap.insert(i, 0, 0);
+        }
+
+        std::vector<std::thread> threads;
+
+        for (int i = 0; i < workers; i++) {
+            threads.push_back(std::thread([&someMap](int t_id) {
+                for (int j = 0; j < INCREMENTS; j++) {
+                    if (t_id % 2 == 0) {
+                        someMap.compute(2 * (j % KEYS), [](int v) { return v + 1; }, t_id);
+                    } else {
+                        // odd keys are only inserted and removed
+                        const int key = 2 * ((j * 7) % KEYS) + 1;
+                        if (!someMap.insert(key, 0, t_id)) {
+                            someMap.remove(key, t_id);
+                        }
+                    }
+                }
+            }, i));
+        }
+
+        for (auto& t: threads) {
+            t.join();
+        }
+
+        int sum = 0;
+        for (int i = 0; i < 2 * KEYS; i += 2) {
+            sum += someMap.lookup(i).val;
+        }
+
+        REQUIRE(sum == ((workers + 1) / 2) * INCREMENTS);
+        REQUIRE(someMap.isSorted());
+    }
+}
+
+
+// too large to be written in place
+struct LargeValue {
+    int words[128];
+
+    LargeValue(int v = 0) {
+        std::fill(std::begin(words), std::end(words), v);
+    }
+};
+
+TEST_CASE("AVLTree Lookup Ref Test","[lookup_ref]") {
+    SECTION("large values are read in place") {
+        AVLTree<LargeValue> someMap(nullptr, lock);
+
+        for (int i = 0; i < 1000; i++) {
+            someMap.insert(i, LargeValue(i), 0);
+        }
+
+        REQUIRE_FALSE(someMap.lookup_ref(1000));
+        REQUIRE(someMap.lookup_ref(1000).get() == nullptr);
+
+        auto ref = someMap.lookup_ref(10);
+        REQUIRE(ref);
+        REQUIRE(ref->words[0] == 10);
+        REQUIRE(ref.get() == someMap.lookup_ref(10).get());
+
+        // the node read is replaced, not changed
+        REQUIRE_FALSE(someMap.upsert(10, LargeValue(20), 0));
+        someMap.remove(10, 0);
+
+        for (int i = 1000; i < 2000; i++) {
+            someMap.insert(i, LargeValue(i), 0);
+        }
+
+        REQUIRE((*ref).words[127] == 10);
+        REQUIRE_FALSE(someMap.lookup_ref(10));
+        REQUIRE(someMap.lookup_ref(1500)->words[127] == 1500);
+    }
+
+    SECTION("refs outlive the other trees of the type") {
+        AVLTree<LargeValue> someMap(nullptr, lock);
+        someMap.insert(5, LargeValue(5), 0);
+
+        auto ref = someMap.lookup_ref(5);
+
+        {
+            AVLTree<LargeValue> otherMap(nullptr, lock);
+            otherMap.insert(5, LargeValue(6), 0);
+        }
+
+        REQUIRE(ref->words[0] == 5);
+        REQUIRE(ref->words[127] == 5);
+    }
+
+    SECTION("values written in place are copied") {
+        AVLTree<int> someMap(nullptr, lock);
+
+        someMap.insert(5, 1, 0);
+
+        auto ref = someMap.lookup_ref(5);
+        REQUIRE(*ref == 1);
+
+        REQUIRE_FALSE(someMap.upsert(5, 2, 0));
+        REQUIRE(*ref == 1);
+        REQUIRE(*someMap.lookup_ref(5) == 2);
+        REQUIRE_FALSE(someMap.lookup_ref(6));
+    }
+
+    SECTION("mt upserts") {
+        AVLTree<LargeValue> someMap(nullptr, lock);
+        constexpr int KEYS = 64;
+        constexpr int UPSERTS = 2000;
+
+        for (int i = 0; i < KEYS; i++) {
+            someMap.insert(i, LargeValue(0), 0);
+        }
+
+        std::atomic<int> torn(0);
+        std::vector<std::thread> threads;
+
+        for (int i = 0; i < THREADS; i++) {
+            threads.push_back(std::thread([&someMap, &torn](int t_id) {
+                for (int j = 0; j < UPSERTS; j++) {
+                    if (t_id % 2) {
+                        someMap.upsert(j % KEYS, LargeValue(j), t_id);
+                        continue;
+                    }
+
+                    // all the words of a value are the same
+                    auto ref = someMap.lookup_ref(j % KEYS);
+
+                    if (!ref || ref->words[0] != ref->words[127]) {
+                        ++torn;
+                    }
+                }
+            }, i));
+        }
+
+        for (auto& t: threads) {
+            t.join();
+        }
+
+        REQUIRE(torn == 0);
+        REQUIRE(someMap.size() == KEYS);
+    }
+}
+
+
+TEST_CASE("AVLTree Out Of Line Value Test","[out_of_line]") {
+    REQUIRE(out_of_line_eligible<LargeValue>::value);
+    REQUIRE_FALSE(out_of_line_eligible<int>::value);
+
+    AVLTree<LargeValue> someMap(nullptr, lock);
+
+    someMap.insert(0, LargeValue(0), 0);
+    auto ref = someMap.lookup_ref(0);
+
+    // the rotations copy the node of 0, not its value
+    for (int i = 1; i < 1000; i++) {
+        someMap.insert(i, LargeValue(i), 0);
+    }
+
+    REQUIRE(someMap.lookup_ref(0).get() == ref.get());
+
+    // the values of the successors move up
+    for (int i = 1; i < 1000; i += 2) {
+        REQUIRE(someMap.remove(i, 0));
+    }
+
+    for (int i = 0; i < 1000; i++) {
+        auto value = someMap.lookup_ref(i);
+
+        if (i % 2) {
+            REQUIRE_FALSE(value);
+        } else {
+            REQUIRE(value->words[0] == i);
+            REQUIRE(value->words[127] == i);
+        }
+    }
+
+    REQUIRE(someMap.isSorted());
+
+    // the trees of LargeValue share the blocks
+    {
+        AVLTree<LargeValue> otherMap(nullptr, lock);
+        otherMap.insert(0, LargeValue(1), 0);
+    }
+
+    REQUIRE(someMap.lookup(998).val.words[127] == 998);
+}
+
+
+TEST_CASE("AVLTree Relaxed Balance Test","[relaxed]") {
+    AVLTree<int> someMap(nullptr, lock);
+    someMap.setRelaxedBalance(true);
+    REQUIRE(someMap.relaxedBalance());
+
+    std::mt19937 gen(1);
+    std::uniform_int_distribution<int> dist(0, 100000);
+    std::vector<int> keys;
+
+    for (int i = 0; i < 10000; i++) {
+        const int k = dist(gen);
+
+        if (someMap.insert(k,k,0)) {
+            keys.push_back(k);
+        }
+    }
+
+    SECTION("updates leave the rebalancing for later") {
+        REQUIRE(someMap.isSorted());
+        REQUIRE(!someMap.isBalanced());
+
+        for (auto k : keys) {
+            REQUIRE(someMap.lookup(k).val == k);
+        }
+
+        int passes = 0;
+        while (someMap.rebalance(0)) {
+            ++passes;
+        }
+
+        REQUIRE(passes > 0);
+        REQUIRE(someMap.isBalanced());
+        REQUIRE(someMap.isSorted());
+        REQUIRE(someMap.size() == static_cast<int>(keys.size()));
+
+        for (auto k : keys) {
+            REQUIRE(someMap.lookup(k).val == k);
+        }
+    }
+
+    SECTION("removes") {
+        for (std::size_t i = 0; i < keys.size(); i += 2) {
+            REQUIRE(someMap.remove(keys[i],0));
+        }
+
+        while (someMap.rebalance(0)) {
+        // until nothing is left to fix
+        }
+
+        REQUIRE(someMap.isBalanced());
+        REQUIRE(someMap.isSorted());
+
+        for (std::size_t i = 0; i < keys.size(); i++) {
+            REQUIRE(someMap.lookup(keys[i]).found == (i % 2 == 1));
+        }
+    }
+
+    SECTION("mt updates with the rebalancer thread") {
+        someMap.startRebalancer(THREADS);
+
+        std::thread threads[THREADS];
+
+        for (int i = 0; i < THREADS; i++) {
+            threads[i] = std::thread([&someMap](const int t_id) {
+                std::mt19937 t_gen(t_id);
+                std::uniform_int_distribution<int> t_dist(0, 100000);
+
+                for (int j = 0; j < OPERATION_MULTIPLIER; j++) {
+                    const int k = t_dist(t_gen);
+
+                    if (j % 2) {
+                        someMap.insert(k,k,t_id);
+                    } else {
+                        someMap.remove(k,t_id);
+                    }
+                }
+            }, i);
+        }
+
+        for (int i = 0; i < THREADS; i++) {
+            threads[i].join();
+        }
+
+        someMap.stopRebalancer();
+
+        while (someMap.rebalance(0)) {
+        // catch up with the last updates
+        }
+
+        REQUIRE(someMap.isBalanced());
+        REQUIRE(someMap.isSorted());
+    }
+}
+
+TEST_CASE("AVLTree Relaxed Balance Sorted Keys Test","[relaxed]") {
+    AVLTree<int> someMap(nullptr, lock);
+    someMap.setRelaxedBalance(true);
+
+    // every insert is at the end of the longest branch,
+    // the deep ones fix their path before returning
+    const int keys = 50000;
+
+    for (int k = 0; k < keys; k++) {
+        REQUIRE(someMap.insert(k,k,0));
+    }
+
+    REQUIRE(someMap.isSorted());
+    REQUIRE(someMap.size() == keys);
+
+    for (int k = 0; k < keys; k++) {
+        REQUIRE(someMap.lookup(k).val == k);
+    }
+
+    SECTION("rebalance") {
+        while (someMap.rebalance(0)) {
+        // until nothing is left to fix
+        }
+
+        REQUIRE(someMap.isBalanced());
+        REQUIRE(someMap.isSorted());
+    }
+
+    SECTION("sorted removes") {
+        for (int k = keys - 1; k >= 0; k -= 2) {
+            REQUIRE(someMap.remove(k,0));
+        }
+
+        while (someMap.rebalance(0)) {
+        // until nothing is left to fix
+        }
+
+        REQUIRE(someMap.isBalanced());
+        REQUIRE(someMap.isSorted());
+        REQUIRE(someMap.size() == keys / 2);
+
+        for (int k = 0; k < keys; k++) {
+            REQUIRE(someMap.lookup(k).found == (k % 2 == 0));
+        }
+    }
+}
+
+
+TEST_CASE("AVLTree Tombstone Remove Test","[tombstones]") {
+    AVLTree<int> someMap(nullptr, lock);
+    someMap.setTombstoneRemoves(true);
+    someMap.setCompactionRatio(0);
+    REQUIRE(someMap.tombstoneRemoves());
+
+    TestBenchType::binary_insert_map(0, 999, someMap);
+
+    // has two children
+    const int r = someMap.getRoot()->getKey();
+
+    SECTION("nodes with two children are only marked") {
+        REQUIRE(someMap.remove(r,0));
+        REQUIRE(someMap.remove(0,0));
+        REQUIRE(!someMap.remove(r,0));
+
+        REQUIRE(someMap.tombstones() == 1);
+        REQUIRE(someMap.getRoot()->getKey() == r);
+        REQUIRE(!someMap.lookup(r).found);
+        REQUIRE(!someMap.lookup(0).found);
+        REQUIRE(someMap.size() == 998);
+        REQUIRE(someMap.key_sum() == static_cast<std::size_t>(999 * 1000 / 2 - r));
+
+        SECTION("inserts revive the tombstones") {
+            REQUIRE(someMap.insert(r,5,0));
+            REQUIRE(!someMap.insert(r,6,0));
+            REQUIRE(someMap.lookup(r).val == 5);
+            REQUIRE(someMap.tombstones() == 0);
+
+            REQUIRE(someMap.remove(r,0));
+            REQUIRE(someMap.upsert(r,7,0));
+            REQUIRE(someMap.lookup(r).val == 7);
+            REQUIRE(someMap.size() == 999);
+        }
+
+        SECTION("updates skip the tombstones") {
+            REQUIRE(!someMap.compute(r, [](int v) { return v + 1; }, 0).found);
+            REQUIRE(!someMap.compare_and_set(r, 1, 2, 0));
+
+            someMap.setInPlaceUpdates(false);
+            REQUIRE(!someMap.compute(r, [](int v) { return v + 1; }, 0).found);
+            REQUIRE(!someMap.compare_and_set(r, 1, 2, 0));
+        }
+
+        SECTION("ordered queries skip the tombstones") {
+            REQUIRE(someMap.remove(r + 1,0));
+            REQUIRE(someMap.remove(1,0));
+
+            REQUIRE(someMap.lower_bound(r).key == r + 2);
+            REQUIRE(someMap.upper_bound(r - 1).key == r + 2);
+            REQUIRE(someMap.floor(r + 1).key == r - 1);
+            REQUIRE(someMap.predecessor(r + 2).key == r - 1);
+            REQUIRE(someMap.min().key == 2);
+            REQUIRE(someMap.max().key == 999);
+        }
+
+        SECTION("compaction unlinks the tombstones") {
+            REQUIRE(someMap.compact(0) == 1);
+            REQUIRE(someMap.tombstones() == 0);
+            REQUIRE(someMap.getRoot()->getKey() != r);
+            REQUIRE(someMap.size() == 998);
+            REQUIRE(someMap.isSorted());
+            REQUIRE(someMap.isBalanced());
+        }
+    }
+
+    SECTION("transactions") {
+        const int right = someMap.getRoot()->getR()->getKey();
+
+        someMap.transaction([r, right](AVLTree<int>::Transaction& tx) {
+            tx.remove(r);
+            tx.insert(r, 3);
+            tx.remove(right);
+        }, 0);
+
+        REQUIRE(someMap.lookup(r).val == 3);
+        REQUIRE(!someMap.lookup(right).found);
+        REQUIRE(someMap.tombstones() == 1);
+    }
+
+    SECTION("removes compact past the ratio") {
+        someMap.setCompactionRatio(0.1);
+
+        for (int i = 0; i < 1000; i += 2) {
+            REQUIRE(someMap.remove(i,0));
+        }
+
+        REQUIRE(someMap.tombstones() < 100);
+        REQUIRE(someMap.size() == 500);
+        REQUIRE(someMap.isSorted());
+        REQUIRE(someMap.isBalanced());
+
+        for (int i = 0; i < 1000; i++) {
+            REQUIRE(someMap.lookup(i).found == (i % 2 == 1));
+        }
+    }
+
+    SECTION("transactions compact past the ratio") {
+        someMap.setCompactionRatio(0.1);
+
+        for (int i = 0; i < 1000; i += 4) {
+            someMap.transaction([i](AVLTree<int>::Transaction& tx) {
+                tx.remove(i);
+                tx.remove(i + 2);
+            }, 0);
+        }
+
+        REQUIRE(someMap.tombstones() < 100);
+        REQUIRE(someMap.size() == 500);
+        REQUIRE(someMap.isSorted());
+        REQUIRE(someMap.isBalanced());
+    }
+
+    SECTION("the counters start from the nodes of a filled tree") {
+        AVLTree<int> filledMap(nullptr, lock);
+        TestBenchType::binary_insert_map(0, 999, filledMap);
+
+        filledMap.setTombstoneRemoves(true);
+        filledMap.setCompactionRatio(0.25);
+
+        // far from a quarter of the nodes
+        int marks = 0;
+
+        for (int i = 1; i < 1000 && marks < 128; i += 2) {
+            const int before = filledMap.tombstones();
+            REQUIRE(filledMap.remove(i,0));
+            marks += filledMap.tombstones() - before;
+        }
+
+        REQUIRE(marks == 128);
+        REQUIRE(filledMap.tombstones() == 128);
+    }
+
+    SECTION("mt removes") {
+        AVLTree<int> mtMap(nullptr, lock);
+        mtMap.setTombstoneRemoves(true);
+        TestBenchType::binary_insert_map(0, THREADS*OPERATION_MULTIPLIER - 1, mtMap);
+
+        std::thread threads[THREADS];
+
+        for (int i = 0; i < THREADS; i++) {
+            threads[i] = std::thread(even_remove, std::ref(mtMap), i);
+        }
+
+        for (int i = 0; i < THREADS; i++) {
+            threads[i].join();
+        }
+
+        for (int i = 0; i < THREADS*OPERATION_MULTIPLIER; i++) {
+            REQUIRE(mtMap.lookup(i).found == (i % 2 == 1));
+        }
+
+        mtMap.compact(0);
+
+        REQUIRE(mtMap.tombstones() == 0);
+        REQUIRE(mtMap.size() == THREADS*OPERATION_MULTIPLIER / 2);
+        REQUIRE(mtMap.isSorted());
+        REQUIRE(mtMap.isBalanced());
+    }
+}
+
+
+TEST_CASE("AVLTree Transaction Test","[transaction]") {
+    using Tx = AVLTree<int>::Transaction;
+
+    SECTION("move a value") {
+        AVLTree<int> someMap(nullptr, lock);
+
+        for (int i = 0; i < 100; i++) {
+            someMap.insert(i, i, 0);
+        }
+
+        someMap.transaction([](Tx& tx) {
+            auto moved = tx.lookup(10);
+
+            if (moved.found) {
+                tx.remove(10);
+                tx.insert(1000, moved.val);
+            }
+        }, 0);
+
+        REQUIRE_FALSE(someMap.lookup(10).found);
+        REQUIRE(someMap.lookup(1000).val == 10);
+        REQUIRE(someMap.size() == 100);
+        REQUIRE(someMap.isBalanced());
+    }
+
+    SECTION("operations see the earlier ones") {
+        AVLTree<int> someMap(nullptr, lock);
+
+        someMap.transaction([](Tx& tx) {
+            REQUIRE(tx.insert(5, 1));
+            REQUIRE_FALSE(tx.insert(5, 2));
+            REQUIRE(tx.lookup(5).val == 1);
+            REQUIRE_FALSE(tx.upsert(5, 3));
+            REQUIRE(tx.compute(5, [](int v) { return v + 1; }).val == 4);
+            REQUIRE(tx.insert(6, 6));
+            REQUIRE(tx.remove(5));
+            REQUIRE_FALSE(tx.lookup(5).found);
+        }, 0);
+
+        REQUIRE_FALSE(someMap.lookup(5).found);
+        REQUIRE(someMap.lookup(6).val == 6);
+        REQUIRE(someMap.size() == 1);
+    }
+
+    // the private roots of the group under the fallback lock
+    SECTION("queries see the earlier operations") {
+        AVLTree<int> someMap(nullptr, lock);
+        AVLTree<int, SubtreeSize> sizedMap(nullptr, lock);
+
+        for (int i = 0; i < 100; i += 10) {
+            someMap.insert(i, i, 0);
+            sizedMap.insert(i, i, 0);
+        }
+
+        SafeTree::atomically([&]() {
+            someMap.insert(15, 15, 0);
+            sizedMap.insert(15, 15, 0);
+
+            REQUIRE(someMap.ceiling(11).key == 15);
+            REQUIRE(someMap.floor(19).key == 15);
+            REQUIRE(someMap.size() == 11);
+            REQUIRE(sizedMap.rank(20) == 3);
+            REQUIRE(sizedMap.select(2).key == 15);
+        });
+
+        REQUIRE(someMap.ceiling(11).key == 15);
+        REQUIRE(sizedMap.rank(20) == 3);
+    }
+
+    // values are moved between accounts and pairs of keys are
+    // inserted and removed together, no partial transaction should
+    // be visible at the end
+    SECTION("mt transfers") {
+        const int workers = THREADS > 1 ? THREADS : 2;
+        constexpr int ACCOUNTS = 64;
+        constexpr int PAIRS = 32;
+        constexpr int ROUNDS = 2000;
+
+        AVLTree<int> someMap(nullptr, lock);
+
+        for (int i = 0; i < ACCOUNTS; i++) {
+            someMap.insert(i, 100, 0);
+        }
+
+        std::vector<std::thread> threads;
+
+        for (int i = 0; i < workers; i++) {
+            threads.push_back(std::thread([&someMap](int t_id) {
+                for (int j = 0; j < ROUNDS; j++) {
+                    const int from = (j * 7 + t_id) % ACCOUNTS;
+                    const int to = (j * 13 + 1) % ACCOUNTS;
+                    const int pair = ACCOUNTS + 2 * ((j * 5 + t_id) % PAIRS);
+
+                    someMap.transaction([from, to, pair](Tx& tx) {
+                        if (tx.lookup(from).val > 0) {
+                            tx.compute(from, [](int v) { return v - 1; });
+                            tx.compute(to, [](int v) { return v + 1; });
+                        }
+
+                        if (!tx.insert(pair, 0)) {
+                            tx.remove(pair);
+                            tx.remove(pair + 1);
+                        } else {
+                            tx.insert(pair + 1, 0);
+                        }
+                    }, t_id);
+                }
+            }, i));
+        }
+
+        for (auto& t: threads) {
+            t.join();
+        }
+
+        int sum = 0;
+        for (int i = 0; i < ACCOUNTS; i++) {
+            sum += someMap.lookup(i).val;
+        }
+
+        REQUIRE(sum == ACCOUNTS * 100);
+
+        for (int i = ACCOUNTS; i < ACCOUNTS + 2 * PAIRS; i += 2) {
+            REQUIRE(someMap.lookup(i).found == someMap.lookup(i + 1).found);
+        }
+
+        REQUIRE(someMap.isBalanced());
+    }
+}
+
+
 TEST_CASE("AVLTree MULTITHREADED Remove Test","[remove_mt]") {
     SECTION("intro") {
         std::cout << "MULTITHREADED Remove Test" << std::endl;
@@ -331,3 +1288,119 @@ TEST_CASE("THROUGHPUT TESTS","[tp]") {
 
 
 
+
+
+TEST_CASE("UPDATE THROUGHPUT TESTS","[tp][tp_update]") {
+    const std::size_t RANGE_OF_KEYS = 2000;
+    std::vector<int> threads_to_use = {1,2,4,7,14,20,28};
+
+    // 70% OVERWRITES OF EXISTING KEYS, 30% LOOKUPS
+    std::cout << "IN PLACE UPDATES" << std::endl;
+    TestBenchType::update_test(70, RANGE_OF_KEYS, threads_to_use, [](AVLTree<int>& map) { map.setInPlaceUpdates(true); });
+
+    std::cout << "COPY ON WRITE UPDATES" << std::endl;
+    TestBenchType::update_test(70, RANGE_OF_KEYS, threads_to_use, [](AVLTree<int>& map) { map.setInPlaceUpdates(false); });
+}
+
+
+TEST_CASE("LARGE LOOKUP THROUGHPUT TESTS","[tp][tp_lookup]") {
+    // 10M keys, to compare with the BTree lookups
+    const std::size_t RANGE_OF_KEYS = 20000000;
+    std::vector<int> threads_to_use = {1,2,4,7,14,20,28};
+
+    // 100% LOOKUPS
+    TestBenchType::experiment exp(0,0,100);
+    TestBenchType::test(exp,THREADS,RANGE_OF_KEYS,threads_to_use);
+
+    // 10 - 10 -80
+    TestBenchType::experiment exp_mixed(10,10,80);
+    TestBenchType::test(exp_mixed,THREADS,RANGE_OF_KEYS,threads_to_use);
+}
+
+
+TEST_CASE("LOOKUP REF BENCHMARKS","[tp][tp_lookup_ref]") {
+    AVLTree<LargeValue> someMap(nullptr, lock);
+    constexpr int KEYS = 10000;
+
+    for (int i = 0; i < KEYS; i++) {
+        someMap.insert(i, LargeValue(i), 0);
+    }
+
+    BENCHMARK("lookup of 512 byte values") {
+        int sum = 0;
+
+        for (int i = 0; i < KEYS; i += 10) {
+            sum += someMap.lookup(i).val.words[0];
+        }
+
+        return sum;
+    };
+
+    BENCHMARK("lookup_ref of 512 byte values") {
+        int sum = 0;
+
+        for (int i = 0; i < KEYS; i += 10) {
+            sum += someMap.lookup_ref(i)->words[0];
+        }
+
+        return sum;
+    };
+}
+
+
+TEST_CASE("RELAXED BALANCE THROUGHPUT TESTS","[tp][tp_relaxed]") {
+    const std::size_t RANGE_OF_KEYS = 2000000;
+    std::vector<int> threads_to_use = {1,2,4,7,14,20,28};
+
+    // the rebalancer uses the stats of the last thread
+    auto relaxed = [](AVLTree<int>& map) {
+        map.setRelaxedBalance(true);
+        map.startRebalancer(THREAD_AMOUNT_MAX - 1);
+    };
+
+    std::cout << "RELAXED BALANCE" << std::endl;
+
+    // 50-50 UPDATES
+    TestBenchType::experiment exp1(50,50,0);
+    TestBenchType::test(exp1,THREADS,RANGE_OF_KEYS,threads_to_use,relaxed);
+
+    // 25-25 UPDATES, 50 LOOKUPS
+    TestBenchType::experiment exp2(25,25,50);
+    TestBenchType::test(exp2,THREADS,RANGE_OF_KEYS,threads_to_use,relaxed);
+
+    std::cout << "STRICT BALANCE" << std::endl;
+
+    TestBenchType::test(exp1,THREADS,RANGE_OF_KEYS,threads_to_use);
+    TestBenchType::test(exp2,THREADS,RANGE_OF_KEYS,threads_to_use);
+}
+
+
+TEST_CASE("TOMBSTONE REMOVE THROUGHPUT TESTS","[tp][tp_tombstones]") {
+    const std::size_t RANGE_OF_KEYS = 2000000;
+    std::vector<int> threads_to_use = {1,2,4,7,14,20,28};
+
+    auto tombstones = [](AVLTree<int>& map) {
+        map.setTombstoneRemoves(true);
+    };
+
+    std::cout << "TOMBSTONE REMOVES" << std::endl;
+
+    // 50-50 UPDATES
+    TestBenchType::experiment exp1(50,50,0);
+    TestBenchType::test(exp1,THREADS,RANGE_OF_KEYS,threads_to_use,tombstones);
+
+    // 25-25 UPDATES, 50 LOOKUPS
+    TestBenchType::experiment exp2(25,25,50);
+    TestBenchType::test(exp2,THREADS,RANGE_OF_KEYS,threads_to_use,tombstones);
+}
+
+
+// same experiment as in the BST and ExternalBST
+// tests, compare the ABORTS/OP of the three
+TEST_CASE("50-50 UPDATE ABORT TESTS","[tp][tp_5050]") {
+    const std::size_t RANGE_OF_KEYS = 2000000;
+    std::vector<int> threads_to_use = {1,2,4,7,14,20,28};
+
+    TestBenchType::experiment exp(50,50,0);
+    TestBenchType::test(exp,THREADS,RANGE_OF_KEYS,threads_to_use);
+}
@@ -0,0 +1,765 @@
+#ifndef INCLUDE_BTREE_HPP
+#define INCLUDE_BTREE_HPP
+
+#define USER_NODE_POOL USER_MEM_POOL
+
+
+#include <cassert>
+#include <limits>
+#include <algorithm>
+#include "../../../include/SafeTree.hpp"
+#include "../../../include/key_search.hpp"
+
+
+using namespace SafeTree;
+
+
+constexpr int THREAD_AMOUNT_MAX = 100;
+TSX::TSXStats stats[THREAD_AMOUNT_MAX];
+
+template <class ValueType, int Fanout>
+class BTree;
+
+
+// A B+tree node. Keys are kept sorted and contiguous, so a node
+// is searched with a few cache misses and SIMD compares (see
+// key_search.hpp). Leaves hold the values,
+// internal nodes only route: the child i of an internal node
+// holds the keys in [keys[i - 1], keys[i]).
+template <class ValueType, int Fanout>
+class BTreeNode {
+    friend class BTree<ValueType, Fanout>;
+    private:
+        int n_keys;
+        bool leaf;
+        // one more slot than a node can keep,
+        // for the key added before a split
+        int keys[Fanout];
+        ValueType values[Fanout];
+        BTreeNode* children[Fanout + 1];
+
+        // position of the first key >= k
+        int position(const int k) const {
+            return KeySearch::lower_bound(keys, n_keys, k);
+        }
+
+        // LEAF MODIFICATIONS
+
+        void insert_entry(const int pos, const int k, const ValueType& val) {
+            for (int i = n_keys; i > pos; i--) {
+                keys[i] = keys[i - 1];
+                values[i] = values[i - 1];
+            }
+
+            keys[pos] = k;
+            values[pos] = val;
+            ++n_keys;
+        }
+
+        void remove_entry(const int pos) {
+            for (int i = pos; i < n_keys - 1; i++) {
+                keys[i] = keys[i + 1];
+                values[i] = values[i + 1];
+            }
+
+            --n_keys;
+        }
+
+        // INTERNAL NODE MODIFICATIONS
+
+        // add key and its right child after the child at pos
+        void insert_child(const int pos, const int k, BTreeNode* right) {
+            for (int i = n_keys; i > pos; i--) {
+                keys[i] = keys[i - 1];
+                children[i + 1] = children[i];
+            }
+
+            keys[pos] = k;
+            children[pos + 1] = right;
+            ++n_keys;
+        }
+
+        // remove the key at pos and its right child
+        void remove_child(const int pos) {
+            for (int i = pos; i < n_keys - 1; i++) {
+                keys[i] = keys[i + 1];
+                children[i + 1] = children[i + 2];
+            }
+
+            children[n_keys] = nullptr;
+            --n_keys;
+        }
+
+        // move the upper half of the keys to right,
+        // returns the key separating the two nodes
+        int split(BTreeNode* right) {
+            const int mid = n_keys / 2;
+
+            if (leaf) {
+                // the separator is copied up, it stays in the right leaf
+                right->n_keys = n_keys - mid;
+
+                for (int i = 0; i < right->n_keys; i++) {
+                    right->keys[i] = keys[mid + i];
+                    right->values[i] = values[mid + i];
+                }
+
+                n_keys = mid;
+
+                return right->keys[0];
+            }
+
+            // the separator is moved up
+            right->n_keys = n_keys - mid - 1;
+
+            for (int i = 0; i < right->n_keys; i++) {
+                right->keys[i] = keys[mid + 1 + i];
+            }
+
+            for (int i = 0; i <= right->n_keys; i++) {
+                right->children[i] = children[mid + 1 + i];
+                children[mid + 1 + i] = nullptr;
+            }
+
+            n_keys = mid;
+
+            return keys[mid];
+        }
+
+        // append the contents of right, separated by the key
+        // separator of the parent
+        void merge(const int separator, const BTreeNode* right) {
+            if (leaf) {
+                for (int i = 0; i < right->n_keys; i++) {
+                    keys[n_keys + i] = right->keys[i];
+                    values[n_keys + i] = right->values[i];
+                }
+
+                n_keys += right->n_keys;
+                return;
+            }
+
+            keys[n_keys] = separator;
+
+            for (int i = 0; i < right->n_keys; i++) {
+                keys[n_keys + 1 + i] = right->keys[i];
+            }
+
+            for (int i = 0; i <= right->n_keys; i++) {
+                children[n_keys + 1 + i] = right->children[i];
+            }
+
+            n_keys += right->n_keys + 1;
+        }
+
+    public:
+        using KeyType = int;
+
+        explicit BTreeNode(const bool leaf): n_keys(0), leaf(leaf) {
+            std::fill(children, children + Fanout + 1, nullptr);
+        }
+
+        bool isLeaf() const {
+            return leaf;
+        }
+
+        int size() const {
+            return n_keys;
+        }
+
+        int getKey(const int i) const {
+            return keys[i];
+        }
+
+        ValueType getValue(const int i) const {
+            return values[i];
+        }
+
+        bool hasKey(const int k) const {
+            const int pos = position(k);
+            return leaf && pos < n_keys && keys[pos] == k;
+        }
+
+        BTreeNode** getChildPointer(int i) {
+            assert(i >= 0 && i < maxChildren());
+            return &children[i];
+        }
+
+        BTreeNode* getChild(int i) {
+            assert(i >= 0 && i < maxChildren());
+            return children[i];
+        }
+
+        void setChild(int i, BTreeNode* node) {
+            assert(i >= 0 && i < maxChildren());
+            children[i] = node;
+        }
+
+        // including the slot used before a split
+        static constexpr int maxChildren() {
+            return Fanout + 1;
+        }
+
+        // the child with the first key > k, as
+        // equal keys are kept in the right subtree
+        int nextChild(const int k) const {
+            return KeySearch::upper_bound(keys, n_keys, k);
+        }
+
+        // a search always ends at a leaf
+        bool traversalDone(const int k) const {
+            (void)k;
+            return leaf;
+        }
+
+        // the keys of a node are in the range of
+        // its subtree, so any of them leads to it
+        int nextChild(const BTreeNode* target) const {
+            return target->n_keys ? nextChild(target->keys[0]) : 0;
+        }
+};
+
+template <class ValueType>
+struct Result {
+    bool found;
+    ValueType val;
+};
+
+
+// A B+tree map from int keys to values. Nodes have up to Fanout
+// children and are split or merged as keys are inserted and removed.
+// Every modification copies the nodes it changes, so readers never
+// need a transaction and see each node as a whole. The copies are
+// connected below the root, so a scan over several leaves is not a
+// snapshot: it can see a later change to a leaf it reaches later,
+// and miss an earlier one to a leaf it has passed.
+template <class ValueType, int Fanout = 16>
+class BTree {
+    static_assert(Fanout >= 4, "A B+tree node needs at least 4 children");
+
+    friend class BTreeNode<ValueType, Fanout>;
+    private:
+        using TreeNode = BTreeNode<ValueType, Fanout>;
+
+        static constexpr int MAX_KEYS = Fanout - 1;
+        static constexpr int MIN_KEYS = MAX_KEYS / 2;
+
+        TreeNode* root;
+        TSX::SpinLock &_lock;
+
+
+        // helpers
+
+        static TreeNode* create_node(const bool leaf) {
+            #ifdef USER_NODE_POOL
+                return ConnPoint<TreeNode>::create_new_node(leaf);
+            #else
+                return new TreeNode(leaf);
+            #endif
+        }
+
+        static Result<ValueType> find_in_leaf(const TreeNode* leaf, const int k) {
+            if (!leaf) {
+                return {false, ValueType()};
+            }
+
+            const int pos = leaf->position(k);
+
+            if (pos < leaf->n_keys && leaf->keys[pos] == k) {
+                return {true, leaf->values[pos]};
+            }
+
+            return {false, ValueType()};
+        }
+
+        template <class F>
+        static void scan_helper(const TreeNode* node, const int lo, const int hi, F& fn) {
+            if (!node) {
+                return;
+            }
+
+            if (node->leaf) {
+                for (int i = node->position(lo); i < node->n_keys && node->keys[i] <= hi; i++) {
+                    fn(node->keys[i], node->values[i]);
+                }
+
+                return;
+            }
+
+            // only the children whose range meets [lo, hi]
+            const int last = node->nextChild(hi);
+            for (int i = node->nextChild(lo); i <= last; i++) {
+                scan_helper(node->children[i], lo, hi, fn);
+            }
+        }
+
+        static std::size_t key_sum_helper(const TreeNode* node) {
+            if (!node) {
+                return 0;
+            }
+
+            std::size_t sum = 0;
+
+            if (node->leaf) {
+                for (int i = 0; i < node->n_keys; i++) {
+                    sum += node->keys[i];
+                }
+
+                return sum;
+            }
+
+            for (int i = 0; i <= node->n_keys; i++) {
+                sum += key_sum_helper(node->children[i]);
+            }
+
+            return sum;
+        }
+
+        static int count_keys(const TreeNode* node) {
+            if (!node) {
+                return 0;
+            }
+
+            if (node->leaf) {
+                return node->n_keys;
+            }
+
+            int count = 0;
+
+            for (int i = 0; i <= node->n_keys; i++) {
+                count += count_keys(node->children[i]);
+            }
+
+            return count;
+        }
+
+        // keys sorted and in the range given by the parent,
+        // separators included in the right subtree
+        static bool isSortedHelper(const TreeNode* node, const long long min, const long long max) {
+            for (int i = 0; i < node->n_keys; i++) {
+                if (node->keys[i] < min || node->keys[i] >= max || (i > 0 && node->keys[i - 1] >= node->keys[i])) {
+                    return false;
+                }
+            }
+
+            if (node->leaf) {
+                return true;
+            }
+
+            for (int i = 0; i <= node->n_keys; i++) {
+                const long long child_min = i > 0 ? node->keys[i - 1] : min;
+                const long long child_max = i < node->n_keys ? node->keys[i] : max;
+
+                if (!node->children[i] || !isSortedHelper(node->children[i], child_min, child_max)) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        // all the leaves at the same depth and every node but
+        // the root at least half full, returns the height or -1
+        static int balanced_height(const TreeNode* node, const bool is_root) {
+            if (node->n_keys > MAX_KEYS || (!is_root && node->n_keys < MIN_KEYS)) {
+                return -1;
+            }
+
+            if (node->leaf) {
+                return 1;
+            }
+
+            const int height = balanced_height(node->children[0], false);
+
+            for (int i = 1; i <= node->n_keys; i++) {
+                if (height == -1 || balanced_height(node->children[i], false) != height) {
+                    return -1;
+                }
+            }
+
+            return height == -1 ? -1 : height + 1;
+        }
+
+        static int height(const TreeNode* node) {
+            int levels = 0;
+
+            for (; node; node = node->leaf ? nullptr : node->children[0]) {
+                ++levels;
+            }
+
+            return levels;
+        }
+
+        static double average_fill(const TreeNode* node, int& n_nodes) {
+            if (!node) {
+                return 0;
+            }
+
+            ++n_nodes;
+            double fill = node->n_keys / static_cast<double>(MAX_KEYS);
+
+            if (!node->leaf) {
+                for (int i = 0; i <= node->n_keys; i++) {
+                    fill += average_fill(node->children[i], n_nodes);
+                }
+            }
+
+            return fill;
+        }
+
+        void rec_delete(TreeNode* node) {
+            if (!node) return;
+
+            if (!node->leaf) {
+                for (int i = 0; i <= node->n_keys; i++) {
+                    rec_delete(node->children[i]);
+                }
+            }
+
+            delete node;
+        }
+
+        // add the key to the leaf found, which is the root of the
+        // tree of copies, and split the nodes which overflow
+        // going up the path
+        void insert_step(ConnPoint<TreeNode>& conn, const int k, ValueType val) {
+            auto node = conn.getRoot();
+
+            // empty tree
+            if (!node) {
+                auto new_leaf = create_node(true);
+                new_leaf->insert_entry(0, k, val);
+                conn.setRoot(conn.create_safe(new_leaf));
+                return;
+            }
+
+            auto node_values = node->rwRef();
+            node_values->insert_entry(node_values->position(k), k, val);
+
+            while (node_values->n_keys > MAX_KEYS) {
+                auto right_values = create_node(node_values->leaf);
+                const int separator = node_values->split(right_values);
+                auto right = conn.create_safe(right_values);
+
+                auto parent = conn.pop_path();
+
+                // the root was split, the tree grows by a level
+                if (!parent) {
+                    auto new_root_values = create_node(false);
+                    auto new_root = conn.create_safe(new_root_values);
+
+                    new_root->setChild(0, node);
+                    new_root->setChild(1, right);
+                    new_root_values->keys[0] = separator;
+                    new_root_values->n_keys = 1;
+
+                    conn.setRoot(new_root);
+                    return;
+                }
+
+                // k still leads to the node split
+                auto parent_values = parent->rwRef();
+                parent_values->insert_child(parent_values->nextChild(k), separator, right_values);
+
+                node = parent;
+                node_values = parent_values;
+            }
+        }
+
+        // remove the key from the leaf found, which is the root of the
+        // tree of copies. Nodes left less than half full borrow a key
+        // from a sibling or are merged with it, going up the path.
+        void remove_step(ConnPoint<TreeNode>& conn, const int k) {
+            auto node = conn.getRoot();
+            auto node_values = node->rwRef();
+
+            node_values->remove_entry(node_values->position(k));
+
+            while (node_values->n_keys < MIN_KEYS) {
+                auto parent = conn.pop_path();
+
+                // the root can be less than half full,
+                // when empty its only child replaces it
+                if (!parent) {
+                    if (!node_values->n_keys) {
+                        conn.setRoot(node_values->leaf ? nullptr : node->getChild(0));
+                    }
+
+                    return;
+                }
+
+                auto parent_values = parent->rwRef();
+                const int pos = parent_values->nextChild(k);
+
+                // the left sibling, if there is one
+                const int sibling_pos = pos > 0 ? pos - 1 : pos + 1;
+                auto sibling_values = parent->getChild(sibling_pos)->rwRef();
+
+                if (sibling_values->n_keys > MIN_KEYS) {
+                    if (sibling_pos < pos) {
+                        borrow_from_left(parent_values, pos, sibling_values, node_values);
+                    } else {
+                        borrow_from_right(parent_values, pos, node_values, sibling_values);
+                    }
+
+                    return;
+                }
+
+                // merge the right one of the two into the left one
+                const int left_pos = std::min(pos, sibling_pos);
+                auto left_values = left_pos == pos ? node_values : sibling_values;
+                auto right_values = left_pos == pos ? sibling_values : node_values;
+
+                left_values->merge(parent_values->keys[left_pos], right_values);
+                parent_values->remove_child(left_pos);
+
+                node = parent;
+                node_values = parent_values;
+            }
+        }
+
+        // move the last key of left to the front of node,
+        // the child at pos of parent
+        static void borrow_from_left(TreeNode* parent, const int pos, TreeNode* left, TreeNode* node) {
+            if (node->leaf) {
+                node->insert_entry(0, left->keys[left->n_keys - 1], left->values[left->n_keys - 1]);
+                left->remove_entry(left->n_keys - 1);
+                parent->keys[pos - 1] = node->keys[0];
+                return;
+            }
+
+            for (int i = node->n_keys; i > 0; i--) {
+                node->keys[i] = node->keys[i - 1];
+            }
+
+            for (int i = node->n_keys + 1; i > 0; i--) {
+                node->children[i] = node->children[i - 1];
+            }
+
+            node->keys[0] = parent->keys[pos - 1];
+            node->children[0] = left->children[left->n_keys];
+            ++node->n_keys;
+
+            parent->keys[pos - 1] = left->keys[left->n_keys - 1];
+            left->children[left->n_keys] = nullptr;
+            --left->n_keys;
+        }
+
+        // move the first key of right to the end of node,
+        // the child at pos of parent
+        static void borrow_from_right(TreeNode* parent, const int pos, TreeNode* node, TreeNode* right) {
+            if (node->leaf) {
+                node->insert_entry(node->n_keys, right->keys[0], right->values[0]);
+                right->remove_entry(0);
+                parent->keys[pos] = right->keys[0];
+                return;
+            }
+
+            node->keys[node->n_keys] = parent->keys[pos];
+            node->children[node->n_keys + 1] = right->children[0];
+            ++node->n_keys;
+
+            parent->keys[pos] = right->keys[0];
+
+            for (int i = 0; i < right->n_keys - 1; i++) {
+                right->keys[i] = right->keys[i + 1];
+            }
+
+            for (int i = 0; i < right->n_keys; i++) {
+                right->children[i] = right->children[i + 1];
+            }
+
+            right->children[right->n_keys] = nullptr;
+            --right->n_keys;
+        }
+
+        bool insert_impl(const int k, ValueType val, int t_id) {
+            (void)t_id;
+
+            TM_SAFE_OPERATION_START(30) {
+                auto conn_point_snapshot = find_conn_point<TreeNode>(k,root_of(&root));
+
+                if (conn_point_snapshot.found()) {
+                    return false;
+                }
+
+                ConnPoint<TreeNode> conn(conn_point_snapshot);
+
+                insert_step(conn, k, val);
+            } TM_SAFE_OPERATION_END
+
+            return true;
+        }
+
+        // insert or replace the value,
+        // returns true if a new key was inserted
+        bool upsert_impl(const int k, ValueType val, int t_id) {
+            (void)t_id;
+
+            bool inserted = false;
+
+            TM_SAFE_OPERATION_START(30) {
+                auto conn_point_snapshot = find_conn_point<TreeNode>(k,root_of(&root));
+
+                inserted = !conn_point_snapshot.found();
+
+                ConnPoint<TreeNode> conn(conn_point_snapshot);
+
+                if (inserted) {
+                    insert_step(conn, k, val);
+                } else {
+                    // only the leaf is copied
+                    auto leaf_values = conn.getRoot()->rwRef();
+                    leaf_values->values[leaf_values->position(k)] = val;
+                }
+            } TM_SAFE_OPERATION_END
+
+            return inserted;
+        }
+
+        bool remove_impl(const int k, const int t_id) {
+            (void)t_id;
+
+            TM_SAFE_OPERATION_START(30) {
+                auto conn_point_snapshot = find_conn_point<TreeNode>(k,root_of(&root));
+
+                if (!conn_point_snapshot.found()) {
+                    return false;
+                }
+
+                ConnPoint<TreeNode> conn(conn_point_snapshot);
+
+                remove_step(conn, k);
+            } TM_SAFE_OPERATION_END
+
+            return true;
+        }
+
+
+    public:
+
+    BTree(TreeNode* root, TSX::SpinLock &lock): root(root), _lock(lock) {
+        #ifdef USER_NODE_POOL
+            ConnPoint<TreeNode>::init_node_pool();
+        #endif
+
+        for (int i = 0; i < THREAD_AMOUNT_MAX; i++) {
+            stats[i].reset();
+        }
+    }
+
+    ~BTree() {
+        #ifndef USER_NODE_POOL
+            rec_delete(root);
+        #endif
+
+        #ifdef USER_NODE_POOL
+            ConnPoint<TreeNode>::reset_node_pool();
+        #endif
+    }
+
+    bool insert(const int k, ValueType val, int t_id) {
+        return insert_impl(k, val, t_id);
+    }
+
+    // insert the key or replace its value if it exists,
+    // returns true if the key was inserted
+    bool upsert(const int k, ValueType val, int t_id) {
+        return upsert_impl(k, val, t_id);
+    }
+
+    bool remove(int k, int t_id) {
+        return remove_impl(k, t_id);
+    }
+
+    Result<ValueType> lookup(int desired_key) {
+        return find_in_leaf(find<TreeNode>(*root_of(&root), desired_key), desired_key);
+    }
+
+    // call fn(key, value) for the keys in [lo, hi] in order. Each
+    // leaf is read as a whole, but not all of them at the same time.
+    template <class F>
+    void scan(int lo, int hi, F fn) {
+        scan_helper(*root_of(&root), lo, hi, fn);
+    }
+
+    // exact only when no operation runs
+    int size() {
+        return count_keys(*root_of(&root));
+    }
+
+    TreeNode* getRoot() {
+        return root;
+    }
+
+    int height() {
+        return height(*root_of(&root));
+    }
+
+
+    /* VALIDATORS */
+
+    std::size_t key_sum() {
+        return key_sum_helper(root);
+    }
+
+    bool isSorted() {
+        if (!root) {
+            return true;
+        }
+
+        return isSortedHelper(root, std::numeric_limits<long long>::min(), std::numeric_limits<long long>::max());
+    }
+
+    bool isBalanced() {
+        return !root || balanced_height(root, true) != -1;
+    }
+
+    /* END OF VALIDATORS */
+
+
+    /* HELPERS */
+
+    // every leaf is at the same depth
+    void longest_branch() {
+        std::cout << "Longest branch is: " << height(root) << std::endl;
+    }
+
+    void average_branch() {
+        int n_nodes = 0;
+        const double fill = average_fill(root, n_nodes);
+
+        std::cout << "Average branch is: " << height(root) << std::endl;
+        std::cout << "Average node fill is: " << (n_nodes ? (fill * 100) / n_nodes : 0) << "%" << std::endl;
+    }
+
+    void stat_report(int n_threads) {
+        TSX::TSXStats t_stats;
+        for (int i = 0; i < n_threads; i++) {
+            t_stats += stats[i];
+        }
+        std::cout << std::endl << std::endl;
+        t_stats.print_stats();
+        std::cout << std::endl << std::endl;
+    }
+
+
+    void lite_stat(int n_threads, long long n_ops = -1) {
+        TSX::TSXStats total_stats;
+        for (int i = 0; i < n_threads; i++) {
+            total_stats += stats[i];
+        }
+
+        if (n_ops > 0) {
+            std::cout << std::endl;
+            std::cout << "ABORTS/OP: " << (total_stats.tx_aborts * 100.0)/(n_ops) << "%" << std::endl;
+        }
+        total_stats.print_lite_stats();
+    }
+
+    /* END OF HELPERS */
+};
+
+
+
+#endif
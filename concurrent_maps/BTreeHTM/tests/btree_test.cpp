@@ -0,0 +1,423 @@
+#include <iostream>
+#include <array>
+#include <thread>
+#include <cstdlib>
+#include <random>
+#include <chrono>
+#include <atomic>
+#include <vector>
+#include <string>
+
+#include "../include/btree.hpp"
+#include "../../../include/catch2/catch.hpp"
+#include "../../../include/TSXGuard.hpp"
+#include "../../../include/test_bench.hpp"
+
+
+using namespace SafeTree;
+
+#ifndef HACI3COMP
+const static int THREADS = std::thread::hardware_concurrency();
+#else
+const static int THREADS = 28;
+#endif
+
+constexpr static int OPERATION_MULTIPLIER = 10000;
+
+using TestBenchType = TestBench<BTree<int>>;
+
+TSX::SpinLock& lock = TestBenchType::global_lock;
+
+TEST_CASE("BTree Init Test","[init]") {
+    BTree<int> someMap(nullptr, lock);
+    (void)someMap;
+}
+
+
+void insert(int i, BTree<int>& map, int t_id) {
+    for (int j = i * OPERATION_MULTIPLIER; j < (i+1)*OPERATION_MULTIPLIER; j++) {
+         map.insert(j,1,t_id);
+    }
+}
+
+
+void even_remove(BTree<int>& map, int i) {
+    for (int j = i * OPERATION_MULTIPLIER; j < (i+1)*OPERATION_MULTIPLIER; j++) {
+        if (j % 2 == 0) {
+            map.remove(j,i);
+        }
+    }
+}
+
+
+TEST_CASE("BTree Insert Test","[insert]") {
+    BTree<int> someMap(nullptr, lock);
+
+    SECTION("empty insert") {
+        REQUIRE(someMap.insert(1,10,0));
+        REQUIRE(someMap.lookup(1).found);
+        REQUIRE(someMap.lookup(1).val == 10);
+        REQUIRE(!someMap.insert(1,20,0));
+        REQUIRE(someMap.lookup(1).val == 10);
+    }
+
+    SECTION("leaf split") {
+        // one more than a leaf can hold
+        for (int i = 0; i < 16; i++) {
+            REQUIRE(someMap.insert(i,i,0));
+        }
+
+        REQUIRE(!someMap.getRoot()->isLeaf());
+        REQUIRE(someMap.height() == 2);
+
+        for (int i = 0; i < 16; i++) {
+            REQUIRE(someMap.lookup(i).found);
+            REQUIRE(someMap.lookup(i).val == i);
+        }
+
+        REQUIRE(!someMap.lookup(16).found);
+        REQUIRE(someMap.isSorted());
+        REQUIRE(someMap.isBalanced());
+    }
+
+    SECTION("many splits") {
+        // descending keys split the leftmost nodes
+        for (int i = THREADS*OPERATION_MULTIPLIER - 1; i >= 0; i--) {
+            REQUIRE(someMap.insert(i,i,0));
+        }
+
+        REQUIRE(someMap.size() == THREADS*OPERATION_MULTIPLIER);
+        REQUIRE(someMap.height() > 2);
+        REQUIRE(someMap.isSorted());
+        REQUIRE(someMap.isBalanced());
+
+        for (int i = 0; i < THREADS*OPERATION_MULTIPLIER; i++) {
+            REQUIRE(someMap.lookup(i).val == i);
+        }
+    }
+
+    SECTION("upsert") {
+        REQUIRE(someMap.upsert(5,1,0));
+        REQUIRE(!someMap.upsert(5,2,0));
+        REQUIRE(someMap.lookup(5).val == 2);
+        REQUIRE(someMap.size() == 1);
+    }
+}
+
+
+TEST_CASE("BTree Multithreaded Insert Test","[mt_insert]") {
+    std::cout << "MULTITHREADED INSERT" << std::endl;
+
+    BTree<int> someMap(nullptr,lock);
+    std::thread threads[THREADS];
+
+    for (int i = 0; i < THREADS; i++) {
+        threads[i] = std::thread(insert, i, std::ref(someMap), i);
+    }
+
+    for (int i = 0; i < THREADS; i++) {
+        threads[i].join();
+    }
+
+    for (int i = 0; i < THREADS*OPERATION_MULTIPLIER; i++) {
+        if (!someMap.lookup(i).found) {
+            std::cout << "NOT " << i << std::endl;
+            REQUIRE(someMap.lookup(i).found);
+        }
+    }
+
+    REQUIRE(someMap.isSorted());
+    REQUIRE(someMap.isBalanced());
+}
+
+
+TEST_CASE("BTree Remove Test","[remove]") {
+    SECTION("INTRO") {
+        std::cout << "SINGLE THREADED REMOVE" << std::endl;
+    }
+
+    BTree<int> someMap(nullptr, lock);
+
+    SECTION("root remove") {
+        someMap.insert(1,1,0);
+
+        REQUIRE(someMap.remove(1,0));
+        REQUIRE(!someMap.remove(1,0));
+        REQUIRE(!someMap.lookup(1).found);
+        REQUIRE(someMap.getRoot() == nullptr);
+    }
+
+    SECTION("borrow and merge") {
+        for (int i = 0; i < 64; i++) {
+            someMap.insert(i,i,0);
+        }
+
+        // from the left, the leftmost nodes borrow from their right siblings
+        for (int i = 0; i < 32; i++) {
+            REQUIRE(someMap.remove(i,0));
+            REQUIRE(someMap.isBalanced());
+        }
+
+        // from the right, the rightmost nodes use their left siblings
+        for (int i = 63; i >= 48; i--) {
+            REQUIRE(someMap.remove(i,0));
+            REQUIRE(someMap.isBalanced());
+        }
+
+        for (int i = 0; i < 64; i++) {
+            REQUIRE(someMap.lookup(i).found == (i >= 32 && i < 48));
+        }
+
+        REQUIRE(someMap.size() == 16);
+        REQUIRE(someMap.isSorted());
+    }
+
+    SECTION("batch remove") {
+        TestBenchType::binary_insert_map(0, THREADS*OPERATION_MULTIPLIER - 1,someMap);
+
+        for (int i = 0; i < THREADS*OPERATION_MULTIPLIER; i++) {
+            if ((i % 2) == 0) {
+                REQUIRE(someMap.remove(i,0));
+                REQUIRE(!someMap.lookup(i).found);
+            }
+        }
+
+        for (int i = 0; i < THREADS*OPERATION_MULTIPLIER; i++) {
+            REQUIRE(someMap.lookup(i).found == (i % 2 == 1));
+        }
+
+        REQUIRE(someMap.isSorted());
+        REQUIRE(someMap.isBalanced());
+
+        // the tree shrinks back to an empty root
+        for (int i = 1; i < THREADS*OPERATION_MULTIPLIER; i += 2) {
+            REQUIRE(someMap.remove(i,0));
+        }
+
+        REQUIRE(someMap.size() == 0);
+        REQUIRE(someMap.getRoot() == nullptr);
+    }
+}
+
+
+TEST_CASE("BTree Scan Test","[scan]") {
+    BTree<int> someMap(nullptr, lock);
+
+    SECTION("empty tree") {
+        int count = 0;
+        someMap.scan(0, 100, [&count](int, int) { ++count; });
+        REQUIRE(count == 0);
+    }
+
+    SECTION("even keys") {
+        for (int i = 0; i < 1000; i += 2) {
+            someMap.insert(i,i * 10,0);
+        }
+
+        std::vector<int> keys;
+        bool values_match = true;
+
+        someMap.scan(101, 301, [&keys, &values_match](int k, int val) {
+            keys.push_back(k);
+            values_match = values_match && val == k * 10;
+        });
+
+        REQUIRE(values_match);
+        REQUIRE(keys.size() == 100);
+        REQUIRE(keys.front() == 102);
+        REQUIRE(keys.back() == 300);
+        REQUIRE(std::is_sorted(keys.begin(), keys.end()));
+
+        keys.clear();
+        someMap.scan(-10, 2000, [&keys](int k, int) { keys.push_back(k); });
+        REQUIRE(keys.size() == 500);
+
+        keys.clear();
+        someMap.scan(998, 998, [&keys](int k, int) { keys.push_back(k); });
+        REQUIRE(keys.size() == 1);
+    }
+}
+
+
+TEST_CASE("BTree MULTITHREADED Remove Test","[remove_mt]") {
+    SECTION("intro") {
+        std::cout << "MULTITHREADED Remove Test" << std::endl;
+    }
+
+
+    std::thread threads[THREADS];
+
+
+    SECTION("mt remove") {
+        for (int j = 0; j < 10; j++) {
+            BTree<int> someMap(nullptr, lock);
+            TestBenchType::binary_insert_map(0, THREADS*OPERATION_MULTIPLIER - 1,someMap);
+
+            for (int i = 0; i < THREADS; i++) {
+                threads[i] = std::thread(even_remove, std::ref(someMap), i);
+            }
+
+            for (int i = 0; i < THREADS; i++) {
+                threads[i].join();
+            }
+
+            for (int i = 0; i < THREADS*OPERATION_MULTIPLIER; i++) {
+                if (i % 2 == 0) {
+                    REQUIRE(!someMap.lookup(i).found);
+                } else {
+                    if (!someMap.lookup(i).found) {
+                        std::cerr << "MISSING " << i << std::endl;
+                        REQUIRE(someMap.lookup(i).found);
+                    }
+                }
+            }
+
+            REQUIRE(someMap.isSorted());
+            REQUIRE(someMap.isBalanced());
+        }
+
+    }
+}
+
+
+TEST_CASE("Key Search Test","[key_search]") {
+    std::vector<int> keys;
+
+    // every amount of keys up to the widest node, so
+    // that full vectors and the scalar rest are covered
+    for (int n = 0; n <= 64; n++) {
+        for (int k = -1; k <= 2 * n + 1; k++) {
+            const int lower = std::lower_bound(keys.begin(), keys.end(), k) - keys.begin();
+            const int upper = std::upper_bound(keys.begin(), keys.end(), k) - keys.begin();
+
+            REQUIRE(KeySearch::lower_bound_linear(keys.data(), n, k) == lower);
+            REQUIRE(KeySearch::upper_bound_linear(keys.data(), n, k) == upper);
+            REQUIRE(KeySearch::lower_bound_binary(keys.data(), n, k) == lower);
+            REQUIRE(KeySearch::upper_bound_binary(keys.data(), n, k) == upper);
+            REQUIRE(KeySearch::lower_bound(keys.data(), n, k) == lower);
+            REQUIRE(KeySearch::upper_bound(keys.data(), n, k) == upper);
+
+            #ifdef KEY_SEARCH_SIMD
+            if (KeySearch::has_sse()) {
+                REQUIRE(KeySearch::lower_bound_sse(keys.data(), n, k) == lower);
+                REQUIRE(KeySearch::upper_bound_sse(keys.data(), n, k) == upper);
+            }
+
+            if (KeySearch::has_avx2()) {
+                REQUIRE(KeySearch::lower_bound_avx2(keys.data(), n, k) == lower);
+                REQUIRE(KeySearch::upper_bound_avx2(keys.data(), n, k) == upper);
+            }
+            #endif
+        }
+
+        // odd keys, the even ones are missing
+        keys.push_back(2 * n + 1);
+    }
+}
+
+
+// search random keys in a node of n keys with the given search
+template <class F>
+int search_keys(const std::vector<int>& keys, const std::vector<int>& targets, F search) {
+    int sum = 0;
+
+    for (auto k : targets) {
+        sum += search(keys.data(), static_cast<int>(keys.size()), k);
+    }
+
+    return sum;
+}
+
+
+TEST_CASE("KEY SEARCH BENCHMARKS","[tp][tp_search]") {
+    std::mt19937 gen(1);
+
+    for (int n : {16, 32, 64}) {
+        std::vector<int> keys;
+        for (int i = 0; i < n; i++) {
+            keys.push_back(2 * i);
+        }
+
+        std::uniform_int_distribution<int> dist(0, 2 * n);
+        std::vector<int> targets(4096);
+        for (auto& k : targets) {
+            k = dist(gen);
+        }
+
+        std::cout << "Node of " << n << " keys, " << targets.size() << " searches" << std::endl;
+
+        BENCHMARK("linear " + std::to_string(n)) {
+            return search_keys(keys, targets, KeySearch::upper_bound_linear);
+        };
+
+        BENCHMARK("binary " + std::to_string(n)) {
+            return search_keys(keys, targets, KeySearch::upper_bound_binary);
+        };
+
+        #ifdef KEY_SEARCH_SIMD
+        if (KeySearch::has_sse()) {
+            BENCHMARK("sse " + std::to_string(n)) {
+                return search_keys(keys, targets, KeySearch::upper_bound_sse);
+            };
+        }
+
+        if (KeySearch::has_avx2()) {
+            BENCHMARK("avx2 " + std::to_string(n)) {
+                return search_keys(keys, targets, KeySearch::upper_bound_avx2);
+            };
+        }
+        #endif
+
+        BENCHMARK("dispatched " + std::to_string(n)) {
+            return search_keys(keys, targets, KeySearch::upper_bound);
+        };
+    }
+}
+
+
+TEST_CASE("THROUGHPUT TESTS","[tp]") {
+    const int OPERATION_MULTIPLIERS[] = {1000000,10000,1000};
+
+    for (int i = 0; i < 3; i++) {
+        std::cout << "Start of tests for tree size: " << OPERATION_MULTIPLIERS[i] << std::endl;
+        const std::size_t RANGE_OF_KEYS = 2 * OPERATION_MULTIPLIERS[i]; // RANGE IS 1 TO RANGE_OF_KEYS
+
+        std::vector<int> threads_to_use = {1,2,4,7,14,20,28};
+        // RANDOM OPS
+        TestBenchType::experiment exp1(33,33,34);
+        TestBenchType::test(exp1,THREADS,RANGE_OF_KEYS,threads_to_use);
+
+        // 10 - 10 -80
+        TestBenchType::experiment exp2(10,10,80);
+        TestBenchType::test(exp2,THREADS,RANGE_OF_KEYS,threads_to_use);
+
+        // 100% LOOKUPS
+        TestBenchType::experiment exp3(0,0,100);
+        TestBenchType::test(exp3,THREADS,RANGE_OF_KEYS, threads_to_use);
+
+
+        // 50-50 UPDATES
+        TestBenchType::experiment exp4(50,50,0);
+        TestBenchType::test(exp4,THREADS,RANGE_OF_KEYS,threads_to_use);
+
+        // 25-25 UPDATES, 50 LOOKUPS
+        TestBenchType::experiment exp5(25,25,50);
+        TestBenchType::test(exp5,THREADS,RANGE_OF_KEYS,threads_to_use);
+
+    }
+}
+
+
+TEST_CASE("LARGE LOOKUP THROUGHPUT TESTS","[tp][tp_lookup]") {
+    // 10M keys, to compare with the AVLTree lookups
+    const std::size_t RANGE_OF_KEYS = 20000000;
+    std::vector<int> threads_to_use = {1,2,4,7,14,20,28};
+
+    // 100% LOOKUPS
+    TestBenchType::experiment exp(0,0,100);
+    TestBenchType::test(exp,THREADS,RANGE_OF_KEYS,threads_to_use);
+
+    // 10 - 10 -80
+    TestBenchType::experiment exp_mixed(10,10,80);
+    TestBenchType::test(exp_mixed,THREADS,RANGE_OF_KEYS,threads_to_use);
+}
@@ -8,6 +8,7 @@
 #include <limits>
 #include <tuple>
 #include "../../../include/SafeTree.hpp"
+#include "../../../include/published_values.hpp"
 
 
 using namespace SafeTree;
@@ -23,9 +24,12 @@ class BST;
 template <class ValueType>
 class BSTNode {
     friend class BST<ValueType>;
+    friend struct PublishedValues<BSTNode, ValueType>;
     private:
         int key;
-        ValueType value; 
+        // large values are shared by the copies
+        StoredValue<ValueType, BSTNode> value;
+        NodeVersion version;
         BSTNode* children[2];
 
 
@@ -47,8 +51,8 @@ class BSTNode {
             return key;
         }
 
-        int getValue() const {
-            return value;
+        ValueType getValue() const {
+            return value.get();
         }
 
         void setKey(int new_key) {
@@ -56,7 +60,11 @@ class BSTNode {
         }
 
         void setValue(ValueType new_val) {
-            value = new_val;
+            value.set(new_val);
+        }
+
+        unsigned getVersion() const {
+            return version.load();
         }
 
         BSTNode** getChildPointer(int i) {
@@ -121,12 +129,26 @@ struct Result {
 
 };
 
+// result of the ordered queries, also
+// returns the key of the node found
+template <class ValueType>
+struct Entry {
+    bool found;
+    int key;
+    ValueType val;
+};
+
 template <class ValueType>
 class BST {
     friend class BSTNode<ValueType>;
     private:
         BSTNode<ValueType>* root;
         TSX::SpinLock &_lock;
+
+        static constexpr bool IN_PLACE_ELIGIBLE = in_place_eligible<ValueType>::value;
+
+        // existing values are updated in place
+        bool in_place_;
         using TreeNode = BSTNode<ValueType>;
         
 
@@ -140,6 +162,23 @@ class BST {
             return node->getKey() + key_sum_helper(node->getChild(0)) + key_sum_helper(node->getChild(1));
         }
 
+        // in place writes are seen at once, so not
+        // used by operations which are part of a group
+        bool in_place() const {
+            return in_place_ && !ConnPointGroup::current();
+        }
+
+        // reads and in place writes of the values
+        using Values = PublishedValues<TreeNode, ValueType>;
+
+        static Entry<ValueType> entry_of(TreeNode* node) {
+            if (!node) {
+                return {false, 0, ValueType()};
+            }
+
+            return {true, node->getKey(), Values::read(node)};
+        }
+
         static int count_nodes(TreeNode* node) {
             if (!node) {
                 return 0;
@@ -252,6 +291,27 @@ class BST {
             delete node;
         }
 
+        // connect a new node with key k
+        // as the root of the tree of copies
+        void insert_step(ConnPoint<TreeNode>& conn, const int k, ValueType val) {
+            // build new node
+            #ifdef USER_NODE_POOL
+                auto node_to_be_inserted = conn.create_safe(ConnPoint<TreeNode>::create_new_node(k,val,nullptr,nullptr));
+            #else
+                auto node_to_be_inserted = conn.create_safe(new BSTNode<ValueType>(k,val,nullptr,nullptr));
+            #endif
+
+
+            // insert it
+            conn.setRoot(node_to_be_inserted);
+        }
+
+        // replace the value of the node found, which is
+        // the root of the tree of copies, only the node is copied
+        void update_step(ConnPoint<TreeNode>& conn, ValueType val) {
+            conn.getRoot()->rwRef()->setValue(val);
+        }
+
         bool insert_impl(const int k, ValueType val, int t_id) {
             (void)t_id;
             
@@ -259,7 +319,7 @@ class BST {
                 /* FIND PHASE */
 
                 
-                auto conn_point_snapshot = find_conn_point<TreeNode>(k,&root);
+                auto conn_point_snapshot = find_conn_point<TreeNode>(k,root_of(&root));
 
 
                 if (conn_point_snapshot.found()) {
@@ -273,16 +333,7 @@ class BST {
 
                 /* INSERT */
 
-                // build new node
-                #ifdef USER_NODE_POOL
-                    auto node_to_be_inserted = conn.create_safe(ConnPoint<TreeNode>::create_new_node(k,val,nullptr,nullptr));
-                #else
-                    auto node_to_be_inserted = conn.create_safe(new BSTNode<ValueType>(k,val,nullptr,nullptr));
-                #endif
-
-
-                // insert it
-                conn.setRoot(node_to_be_inserted);
+                insert_step(conn, k, val);
                 
             } TM_SAFE_OPERATION_END
 
@@ -296,79 +347,162 @@ class BST {
 
 
 
-    bool remove_impl(const int k, const int t_id) {
+    // insert or replace the value,
+    // returns true if a new node was inserted
+    bool upsert_impl(const int k, ValueType val, int t_id) {
         (void)t_id;
 
+        bool inserted = false;
+
         TM_SAFE_OPERATION_START(30) {
-            /* FIND PHASE */
+            auto conn_point_snapshot = find_conn_point<TreeNode>(k,root_of(&root));
 
-                
-            auto conn_point_snapshot = find_conn_point<TreeNode>(k,&root);
+            inserted = !conn_point_snapshot.found();
+
+            ConnPoint<TreeNode> conn(conn_point_snapshot);
 
+            if (inserted) {
+                insert_step(conn, k, val);
+            } else {
+                update_step(conn, val);
+            }
+        } TM_SAFE_OPERATION_END
+
+        return inserted;
+    }
+
+    // replace the value with fn(value) if the key exists
+    template <class F>
+    Result<ValueType> compute_impl(const int k, F& fn, int t_id) {
+        (void)t_id;
+
+        Result<ValueType> result = {false, ValueType()};
+
+        TM_SAFE_OPERATION_START(30) {
+            auto conn_point_snapshot = find_conn_point<TreeNode>(k,root_of(&root));
 
             if (!conn_point_snapshot.found()) {
-                return false;
+                return {false, ValueType()};
             }
 
+            ConnPoint<TreeNode> conn(conn_point_snapshot);
+
+            const ValueType new_val = fn(Values::read_copy(conn));
+
+            update_step(conn, new_val);
+
+            result = {true, new_val};
+        } TM_SAFE_OPERATION_END
+
+        return result;
+    }
+
+    // replace the value with desired if it equals expected
+    bool compare_and_set_impl(const int k, const ValueType& expected, ValueType desired, int t_id) {
+        (void)t_id;
+
+        bool swapped = false;
+
+        TM_SAFE_OPERATION_START(30) {
+            auto conn_point_snapshot = find_conn_point<TreeNode>(k,root_of(&root));
+
+            if (!conn_point_snapshot.found() || !(Values::read(conn_point_snapshot.target()) == expected)) {
+                return false;
+            }
 
             ConnPoint<TreeNode> conn(conn_point_snapshot);
 
-            // the connection point is above the
-            // node which will be deleted
+            // again on the copy, as it may have
+            // been written in place meanwhile
+            swapped = Values::read_copy(conn) == expected;
 
-            // thus the node to be deleted will be
-            // the root of the copied tree
-            auto node_to_be_deleted = conn.getRoot();
+            if (swapped) {
+                update_step(conn, desired);
+            }
+        } TM_SAFE_OPERATION_END
 
-            // read only, to see if they exist
-            auto its_left_child = node_to_be_deleted->peekChild(0); 
-            auto its_right_child = node_to_be_deleted->peekChild(1);
+        return swapped;
+    }
 
-            if (!its_right_child && !its_left_child) {
-                conn.setRoot(nullptr);
-            } else if (!its_right_child) {
-                // get left child and replace node to be deleted with it
-                auto left_child = node_to_be_deleted->getChild(0);
-                conn.setRoot(left_child);
+    // remove the node found, which is
+    // the root of the tree of copies
+    void remove_step(ConnPoint<TreeNode>& conn) {
+        // the connection point is above the
+        // node which will be deleted
+
+        // thus the node to be deleted will be
+        // the root of the copied tree
+        auto node_to_be_deleted = conn.getRoot();
+
+        // read only, to see if they exist
+        auto its_left_child = node_to_be_deleted->peekChild(0); 
+        auto its_right_child = node_to_be_deleted->peekChild(1);
+
+        if (!its_right_child && !its_left_child) {
+            conn.setRoot(nullptr);
+        } else if (!its_right_child) {
+            // get left child and replace node to be deleted with it
+            auto left_child = node_to_be_deleted->getChild(0);
+            conn.setRoot(left_child);
+        } else {
+            // get right child and search for the lowest leaf
+            // going left
+            SafeNode<TreeNode>* prev = nullptr;
+            auto curr = node_to_be_deleted->getChild(1);
+            for (; curr && curr->getChild(0); prev = curr, curr = curr->getChild(0));
+
+            auto node_to_replace_root = curr;
+
+
+           
+            // to modify a node's internals we need a safe reference
+            // that causes a copy of the node
+            TreeNode* node_to_be_deleted_copy = node_to_be_deleted->rwRef();
+            // no need to copy node we will be removing
+            // just look at the original to get its key and value
+            const TreeNode* node_to_replace_view = node_to_replace_root->peekOriginal();
+
+            auto new_key = node_to_replace_view->getKey();
+
+            node_to_be_deleted_copy->setKey(new_key);
+            // shares a large value instead of copying it
+            node_to_be_deleted_copy->value = node_to_replace_view->value;
+
+            // new node is fine, now
+            // remove old node
+
+            // to remove it, its right child should take its place
+
+            // get the right child
+            // and wrap it to be able to
+            // insert it into the copied tree
+            auto right_child = conn.create_safe(node_to_replace_root->peekChild(1));
+            if (prev) {
+                prev->setChild(0,right_child);
             } else {
-                // get right child and search for the lowest leaf
-                // going left
-                SafeNode<TreeNode>* prev = nullptr;
-                auto curr = node_to_be_deleted->getChild(1);
-                for (; curr && curr->getChild(0); prev = curr, curr = curr->getChild(0));
+                node_to_be_deleted->setChild(1,right_child);
+            }
+        }
+    }
 
-                auto node_to_replace_root = curr;
+    bool remove_impl(const int k, const int t_id) {
+        (void)t_id;
 
+        TM_SAFE_OPERATION_START(30) {
+            /* FIND PHASE */
 
-               
-                // to modify a node's internals we need a safe reference
-                // that causes a copy of the node
-                TreeNode* node_to_be_deleted_copy = node_to_be_deleted->rwRef();
-                // no need to copy node we will be removing
-                // just look at the original to get its key and value
-                const TreeNode* node_to_replace_view = node_to_replace_root->peekOriginal();
+                
+            auto conn_point_snapshot = find_conn_point<TreeNode>(k,root_of(&root));
 
-                auto new_key = node_to_replace_view->getKey();
-                auto new_value = node_to_replace_view->getValue();
 
-                node_to_be_deleted_copy->setKey(new_key);
-                node_to_be_deleted_copy->setValue(new_value);
+            if (!conn_point_snapshot.found()) {
+                return false;
+            }
 
-                // new node is fine, now
-                // remove old node
 
-                // to remove it, its right child should take its place
+            ConnPoint<TreeNode> conn(conn_point_snapshot);
 
-                // get the right child
-                // and wrap it to be able to
-                // insert it into the copied tree
-                auto right_child = conn.create_safe(node_to_replace_root->peekChild(1));
-                if (prev) {
-                    prev->setChild(0,right_child);
-                } else {
-                    node_to_be_deleted->setChild(1,right_child);
-                }
-            }
+            remove_step(conn);
         } TM_SAFE_OPERATION_END
 
         return true;
@@ -379,9 +513,10 @@ class BST {
 
     public:
 
-    BST(TreeNode* root, TSX::SpinLock &lock): root(root), _lock(lock){
+    BST(TreeNode* root, TSX::SpinLock &lock): root(root), _lock(lock), in_place_(IN_PLACE_ELIGIBLE) {
         #ifdef USER_NODE_POOL
             ConnPoint<TreeNode>::init_node_pool();
+            StoredValue<ValueType, TreeNode>::init_pool();
         #endif
 
         for (int i = 0; i < THREAD_AMOUNT_MAX; i++) {
@@ -395,6 +530,7 @@ class BST {
 
         #ifdef USER_NODE_POOL
             ConnPoint<TreeNode>::reset_node_pool();
+            StoredValue<ValueType, TreeNode>::reset_pool();
         #endif
     }
 
@@ -402,8 +538,54 @@ class BST {
         return insert_impl(k,val, t_id);
     }
 
+    // insert the key or replace its value if it exists,
+    // returns true if the key was inserted
+    bool upsert(const int k, ValueType val, int t_id) {
+        if (in_place() && Values::update_in_place(&root, k, val, 30)) {
+            return false;
+        }
+
+        return upsert_impl(k, val, t_id);
+    }
+
+    // if the key exists, replace its value with fn(value)
+    // and return the new value. fn can be called more than
+    // once if the operation is retried, so it should have
+    // no side effects.
+    template <class F>
+    Result<ValueType> compute(const int k, F fn, int t_id) {
+        if (in_place()) {
+            Result<ValueType> result = {false, ValueType()};
+            result.found = Values::compute_in_place(&root, k, fn, result.val, 30);
+
+            return result;
+        }
+
+        return compute_impl(k, fn, t_id);
+    }
+
+    // set the value of the key to desired, only if
+    // it is currently equal to expected
+    bool compare_and_set(const int k, const ValueType& expected, ValueType desired, int t_id) {
+        if (in_place()) {
+            return Values::compare_and_set_in_place(&root, k, expected, desired, 30);
+        }
+
+        return compare_and_set_impl(k, expected, desired, t_id);
+    }
+
+    // use in place updates for existing keys when the value type
+    // allows it, else copy the node. Set before the tree is shared.
+    void setInPlaceUpdates(const bool enabled) {
+        in_place_ = enabled && IN_PLACE_ELIGIBLE;
+    }
+
+    bool inPlaceUpdates() const {
+        return in_place_;
+    }
+
     int size() {
-        return count_nodes(root);
+        return count_nodes(*root_of(&root));
     }
 
     BSTNode<ValueType>* getRoot() {
@@ -415,7 +597,7 @@ class BST {
     }
 
     std::size_t key_sum() {
-        return key_sum_helper(root);
+        return key_sum_helper(*root_of(&root));
     }
 
     bool isSorted() {
@@ -429,11 +611,50 @@ class BST {
 
 
     Result<ValueType> lookup(int desired_key) {
-        auto node = find<TreeNode>(root,desired_key);
-        
-        const auto found = node != nullptr;
-    
-        return {found, found ? node->getValue(): ValueType()};
+        Result<ValueType> result = {false, ValueType()};
+        result.found = Values::lookup(*root_of(&root), desired_key, result.val);
+
+        return result;
+    }
+
+    // ordered queries, no transactions needed
+
+    // smallest key >= k
+    Entry<ValueType> lower_bound(int k) {
+        return entry_of(find_ceiling<TreeNode>(*root_of(&root), k));
+    }
+
+    // smallest key > k
+    Entry<ValueType> upper_bound(int k) {
+        return entry_of(find_ceiling<TreeNode>(*root_of(&root), k, false));
+    }
+
+    // largest key <= k
+    Entry<ValueType> floor(int k) {
+        return entry_of(find_floor<TreeNode>(*root_of(&root), k));
+    }
+
+    // smallest key >= k
+    Entry<ValueType> ceiling(int k) {
+        return lower_bound(k);
+    }
+
+    // next key after k, k does not need to exist
+    Entry<ValueType> successor(int k) {
+        return upper_bound(k);
+    }
+
+    // previous key before k, k does not need to exist
+    Entry<ValueType> predecessor(int k) {
+        return entry_of(find_floor<TreeNode>(*root_of(&root), k, false));
+    }
+
+    Entry<ValueType> min() {
+        return entry_of(find_min<TreeNode>(*root_of(&root)));
+    }
+
+    Entry<ValueType> max() {
+        return entry_of(find_max<TreeNode>(*root_of(&root)));
     }
 
     int find_conn(int desired_key) {
@@ -446,6 +667,106 @@ class BST {
         return remove_impl(k,t_id);
     }
 
+    // the operations of a transaction, each one sees
+    // the changes of the ones before it
+    class Transaction {
+        friend class BST;
+
+        private:
+            BST& tree_;
+            TreeNode** root_;
+
+            Transaction(BST& tree, TreeNode** root): tree_(tree), root_(root) {}
+
+        public:
+            bool insert(const int k, ValueType val) {
+                auto conn_point_snapshot = find_conn_point<TreeNode>(k, root_);
+
+                if (conn_point_snapshot.found()) {
+                    return false;
+                }
+
+                ConnPoint<TreeNode> conn(conn_point_snapshot);
+
+                tree_.insert_step(conn, k, val);
+
+                return true;
+            }
+
+            bool remove(const int k) {
+                auto conn_point_snapshot = find_conn_point<TreeNode>(k, root_);
+
+                if (!conn_point_snapshot.found()) {
+                    return false;
+                }
+
+                ConnPoint<TreeNode> conn(conn_point_snapshot);
+
+                tree_.remove_step(conn);
+
+                return true;
+            }
+
+            bool upsert(const int k, ValueType val) {
+                auto conn_point_snapshot = find_conn_point<TreeNode>(k, root_);
+
+                const bool inserted = !conn_point_snapshot.found();
+
+                ConnPoint<TreeNode> conn(conn_point_snapshot);
+
+                if (inserted) {
+                    tree_.insert_step(conn, k, val);
+                } else {
+                    tree_.update_step(conn, val);
+                }
+
+                return inserted;
+            }
+
+            template <class F>
+            Result<ValueType> compute(const int k, F fn) {
+                auto conn_point_snapshot = find_conn_point<TreeNode>(k, root_);
+
+                if (!conn_point_snapshot.found()) {
+                    return {false, ValueType()};
+                }
+
+                ConnPoint<TreeNode> conn(conn_point_snapshot);
+
+                const ValueType new_val = fn(Values::read_copy(conn));
+
+                tree_.update_step(conn, new_val);
+
+                return {true, new_val};
+            }
+
+            Result<ValueType> lookup(const int k) {
+                Result<ValueType> result = {false, ValueType()};
+                result.found = Values::lookup(*root_, k, result.val);
+
+                return result;
+            }
+    };
+
+    // run fn(Transaction&) as one atomic operation, other threads
+    // see all of its changes or none of them. Values are always
+    // copied, never updated in place. fn can be called more than
+    // once if the operation is retried, so it should change the
+    // tree only through the Transaction and have no other side effects.
+    template <class F>
+    void transaction(F fn, int t_id) {
+        (void)t_id;
+
+        TM_SAFE_OPERATION_START(30) {
+            ConnPointGroup group;
+
+            if (group.active()) {
+                Transaction tx(*this, group.root(&root));
+                fn(tx);
+            }
+        } TM_SAFE_OPERATION_END
+    }
+
 
     void print() {
         print_contents(root);
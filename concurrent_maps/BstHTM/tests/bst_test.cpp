@@ -5,6 +5,8 @@
 #include <random>
 #include <chrono>
 #include <atomic>
+#include <algorithm>
+#include <iterator>
 
 #include "../include/bst.hpp"
 #include "../../../include/catch2/catch.hpp"
@@ -251,6 +253,364 @@ TEST_CASE("BST Remove Test","[remove]") {
 
 
 
+TEST_CASE("BST Ordered Queries Test","[ordered]") {
+    BST<int> someMap(nullptr, lock);
+
+    SECTION("empty tree") {
+        REQUIRE_FALSE(someMap.lower_bound(1).found);
+        REQUIRE_FALSE(someMap.floor(1).found);
+        REQUIRE_FALSE(someMap.min().found);
+        REQUIRE_FALSE(someMap.max().found);
+    }
+
+    SECTION("even keys") {
+        // keys 0, 2, ..., 98 with value key + 1
+        for (int i = 0; i < 100; i += 2) {
+            someMap.insert(i, i + 1, 0);
+        }
+
+        REQUIRE(someMap.min().key == 0);
+        REQUIRE(someMap.max().key == 98);
+
+        for (int i = 0; i < 100; i++) {
+            const bool even = i % 2 == 0;
+
+            auto lb = someMap.lower_bound(i);
+            REQUIRE(lb.found == (i <= 98));
+            if (lb.found) {
+                REQUIRE(lb.key == (even ? i : i + 1));
+                REQUIRE(lb.val == lb.key + 1);
+            }
+
+            auto ub = someMap.upper_bound(i);
+            REQUIRE(ub.found == (i < 98));
+            if (ub.found) {
+                REQUIRE(ub.key == (even ? i + 2 : i + 1));
+                REQUIRE(someMap.successor(i).key == ub.key);
+            }
+
+            auto fl = someMap.floor(i);
+            REQUIRE(fl.found);
+            REQUIRE(fl.key == (even ? i : i - 1));
+            REQUIRE(someMap.ceiling(i).key == lb.key);
+
+            auto pred = someMap.predecessor(i);
+            REQUIRE(pred.found == (i > 0));
+            if (pred.found) {
+                REQUIRE(pred.key == (even ? i - 2 : i - 1));
+            }
+        }
+
+        REQUIRE_FALSE(someMap.floor(-1).found);
+        REQUIRE(someMap.lower_bound(-10).key == 0);
+        REQUIRE(someMap.floor(1000).key == 98);
+    }
+}
+
+
+TEST_CASE("BST Update Test","[update]") {
+    BST<int> someMap(nullptr, lock);
+
+    SECTION("upsert") {
+        REQUIRE(someMap.upsert(5, 1, 0));
+        REQUIRE(someMap.lookup(5).val == 1);
+
+        REQUIRE_FALSE(someMap.upsert(5, 2, 0));
+        REQUIRE(someMap.lookup(5).val == 2);
+        REQUIRE(someMap.size() == 1);
+    }
+
+    SECTION("compute and compare and set") {
+        for (int i = 0; i < 100; i++) {
+            someMap.insert(i, i, 0);
+        }
+
+        auto res = someMap.compute(10, [](int v) { return v * 2; }, 0);
+        REQUIRE(res.found);
+        REQUIRE(res.val == 20);
+        REQUIRE(someMap.lookup(10).val == 20);
+
+        REQUIRE_FALSE(someMap.compute(1000, [](int v) { return v * 2; }, 0).found);
+        REQUIRE_FALSE(someMap.lookup(1000).found);
+
+        REQUIRE_FALSE(someMap.compare_and_set(11, 12, 0, 0));
+        REQUIRE(someMap.lookup(11).val == 11);
+        REQUIRE(someMap.compare_and_set(11, 11, 0, 0));
+        REQUIRE(someMap.lookup(11).val == 0);
+        REQUIRE_FALSE(someMap.compare_and_set(1000, 0, 0, 0));
+
+        // structure is untouched
+        REQUIRE(someMap.size() == 100);
+        REQUIRE(someMap.isSorted());
+    }
+
+    SECTION("mt compute") {
+        constexpr int KEYS = 16;
+        constexpr int INCREMENTS = 1000;
+
+        for (int i = 0; i < KEYS; i++) {
+            someMap.insert(i, 0, 0);
+        }
+
+        std::thread threads[THREADS];
+
+        for (int i = 0; i < THREADS; i++) {
+            threads[i] = std::thread([&someMap](int t_id) {
+                for (int j = 0; j < INCREMENTS; j++) {
+                    someMap.compute(j % KEYS, [](int v) { return v + 1; }, t_id);
+                }
+            }, i);
+        }
+
+        for (int i = 0; i < THREADS; i++) {
+            threads[i].join();
+        }
+
+        int sum = 0;
+        for (int i = 0; i < KEYS; i++) {
+            sum += someMap.lookup(i).val;
+        }
+
+        REQUIRE(sum == THREADS * INCREMENTS);
+        REQUIRE(someMap.size() == KEYS);
+    }
+}
+
+
+TEST_CASE("BST In Place Update Test","[in_place]") {
+    SECTION("eligible values") {
+        BST<int> someMap(nullptr, lock);
+        REQUIRE(someMap.inPlaceUpdates());
+
+        someMap.setInPlaceUpdates(false);
+        REQUIRE_FALSE(someMap.inPlaceUpdates());
+
+        BST<std::string> stringMap(nullptr, lock);
+        REQUIRE_FALSE(stringMap.inPlaceUpdates());
+        stringMap.setInPlaceUpdates(true);
+        REQUIRE_FALSE(stringMap.inPlaceUpdates());
+    }
+
+    // counters are incremented in place while other threads
+    // insert and remove keys, copying the counter nodes
+    // for the rotations, no increment should be lost
+    const int workers = THREADS > 1 ? THREADS : 2;
+    constexpr int KEYS = 64;
+    constexpr int INCREMENTS = 2000;
+
+    for (int in_place = 0; in_place < 2; in_place++) {
+        BST<int> someMap(nullptr, lock);
+        someMap.setInPlaceUpdates(in_place == 1);
+
+        for (int i = 0; i < 2 * KEYS; i += 2) {
+            someMap.insert(i, 0, 0);
+        }
+
+        std::vector<std::thread> threads;
+
+        for (int i = 0; i < workers; i++) {
+            threads.push_back(std::thread([&someMap](int t_id) {
+                for (int j = 0; j < INCREMENTS; j++) {
+                    if (t_id % 2 == 0) {
+                        someMap.compute(2 * (j % KEYS), [](int v) { return v + 1; }, t_id);
+                    } else {
+                        // odd keys are only inserted and removed
+                        const int key = 2 * ((j * 7) % KEYS) + 1;
+                        if (!someMap.insert(key, 0, t_id)) {
+                            someMap.remove(key, t_id);
+                        }
+                    }
+                }
+            }, i));
+        }
+
+        for (auto& t: threads) {
+            t.join();
+        }
+
+        int sum = 0;
+        for (int i = 0; i < 2 * KEYS; i += 2) {
+            sum += someMap.lookup(i).val;
+        }
+
+        REQUIRE(sum == ((workers + 1) / 2) * INCREMENTS);
+        REQUIRE(someMap.isSorted());
+    }
+}
+
+
+// too large to be copied with the nodes
+struct LargeValue {
+    int words[128];
+
+    LargeValue(int v = 0) {
+        std::fill(std::begin(words), std::end(words), v);
+    }
+};
+
+TEST_CASE("BST Out Of Line Value Test","[out_of_line]") {
+    REQUIRE(out_of_line_eligible<LargeValue>::value);
+
+    BST<LargeValue> someMap(nullptr, lock);
+
+    for (int i = 0; i < 1000; i++) {
+        someMap.insert((i * 7) % 1000, LargeValue((i * 7) % 1000), 0);
+    }
+
+    // the values of the successors move up
+    for (int i = 0; i < 1000; i += 2) {
+        REQUIRE(someMap.remove(i, 0));
+    }
+
+    REQUIRE_FALSE(someMap.upsert(1, LargeValue(-1), 0));
+
+    for (int i = 0; i < 1000; i++) {
+        auto res = someMap.lookup(i);
+
+        if (i % 2 == 0) {
+            REQUIRE_FALSE(res.found);
+        } else {
+            REQUIRE(res.val.words[0] == (i == 1 ? -1 : i));
+            REQUIRE(res.val.words[127] == res.val.words[0]);
+        }
+    }
+
+    REQUIRE(someMap.isSorted());
+
+    // the trees of LargeValue share the blocks
+    {
+        BST<LargeValue> otherMap(nullptr, lock);
+        otherMap.insert(0, LargeValue(1), 0);
+    }
+
+    REQUIRE(someMap.lookup(999).val.words[127] == 999);
+}
+
+
+TEST_CASE("BST Transaction Test","[transaction]") {
+    using Tx = BST<int>::Transaction;
+
+    SECTION("move a value") {
+        BST<int> someMap(nullptr, lock);
+
+        for (int i = 0; i < 100; i++) {
+            someMap.insert(i, i, 0);
+        }
+
+        someMap.transaction([](Tx& tx) {
+            auto moved = tx.lookup(10);
+
+            if (moved.found) {
+                tx.remove(10);
+                tx.insert(1000, moved.val);
+            }
+        }, 0);
+
+        REQUIRE_FALSE(someMap.lookup(10).found);
+        REQUIRE(someMap.lookup(1000).val == 10);
+        REQUIRE(someMap.size() == 100);
+        REQUIRE(someMap.isSorted());
+    }
+
+    // the private roots of the group under the fallback lock
+    SECTION("queries see the earlier operations") {
+        BST<int> someMap(nullptr, lock);
+
+        for (int i = 0; i < 100; i += 10) {
+            someMap.insert(i, i, 0);
+        }
+
+        SafeTree::atomically([&]() {
+            someMap.insert(15, 15, 0);
+
+            REQUIRE(someMap.ceiling(11).key == 15);
+            REQUIRE(someMap.floor(19).key == 15);
+            REQUIRE(someMap.size() == 11);
+        });
+
+        REQUIRE(someMap.ceiling(11).key == 15);
+    }
+
+    SECTION("operations see the earlier ones") {
+        BST<int> someMap(nullptr, lock);
+
+        someMap.transaction([](Tx& tx) {
+            REQUIRE(tx.insert(5, 1));
+            REQUIRE_FALSE(tx.insert(5, 2));
+            REQUIRE(tx.lookup(5).val == 1);
+            REQUIRE_FALSE(tx.upsert(5, 3));
+            REQUIRE(tx.compute(5, [](int v) { return v + 1; }).val == 4);
+            REQUIRE(tx.insert(6, 6));
+            REQUIRE(tx.remove(5));
+            REQUIRE_FALSE(tx.lookup(5).found);
+        }, 0);
+
+        REQUIRE_FALSE(someMap.lookup(5).found);
+        REQUIRE(someMap.lookup(6).val == 6);
+        REQUIRE(someMap.size() == 1);
+    }
+
+    // values are moved between accounts and pairs of keys are
+    // inserted and removed together, no partial transaction should
+    // be visible at the end
+    SECTION("mt transfers") {
+        const int workers = THREADS > 1 ? THREADS : 2;
+        constexpr int ACCOUNTS = 64;
+        constexpr int PAIRS = 32;
+        constexpr int ROUNDS = 2000;
+
+        BST<int> someMap(nullptr, lock);
+
+        for (int i = 0; i < ACCOUNTS; i++) {
+            someMap.insert(i, 100, 0);
+        }
+
+        std::vector<std::thread> threads;
+
+        for (int i = 0; i < workers; i++) {
+            threads.push_back(std::thread([&someMap](int t_id) {
+                for (int j = 0; j < ROUNDS; j++) {
+                    const int from = (j * 7 + t_id) % ACCOUNTS;
+                    const int to = (j * 13 + 1) % ACCOUNTS;
+                    const int pair = ACCOUNTS + 2 * ((j * 5 + t_id) % PAIRS);
+
+                    someMap.transaction([from, to, pair](Tx& tx) {
+                        if (tx.lookup(from).val > 0) {
+                            tx.compute(from, [](int v) { return v - 1; });
+                            tx.compute(to, [](int v) { return v + 1; });
+                        }
+
+                        if (!tx.insert(pair, 0)) {
+                            tx.remove(pair);
+                            tx.remove(pair + 1);
+                        } else {
+                            tx.insert(pair + 1, 0);
+                        }
+                    }, t_id);
+                }
+            }, i));
+        }
+
+        for (auto& t: threads) {
+            t.join();
+        }
+
+        int sum = 0;
+        for (int i = 0; i < ACCOUNTS; i++) {
+            sum += someMap.lookup(i).val;
+        }
+
+        REQUIRE(sum == ACCOUNTS * 100);
+
+        for (int i = ACCOUNTS; i < ACCOUNTS + 2 * PAIRS; i += 2) {
+            REQUIRE(someMap.lookup(i).found == someMap.lookup(i + 1).found);
+        }
+
+        REQUIRE(someMap.isSorted());
+    }
+}
+
+
 TEST_CASE("BST MULTITHREADED Remove Test","[remove_mt]") {
     SECTION("intro") {
         std::cout << "MULTITHREADED Remove Test" << std::endl;
@@ -333,3 +693,27 @@ TEST_CASE("THROUGHPUT TESTS","[tp]") {
 
 
 
+
+
+TEST_CASE("UPDATE THROUGHPUT TESTS","[tp][tp_update]") {
+    const std::size_t RANGE_OF_KEYS = 2000;
+    std::vector<int> threads_to_use = {1,2,4,7,14,20,28};
+
+    // 70% OVERWRITES OF EXISTING KEYS, 30% LOOKUPS
+    std::cout << "IN PLACE UPDATES" << std::endl;
+    TestBenchType::update_test(70, RANGE_OF_KEYS, threads_to_use, [](BST<int>& map) { map.setInPlaceUpdates(true); });
+
+    std::cout << "COPY ON WRITE UPDATES" << std::endl;
+    TestBenchType::update_test(70, RANGE_OF_KEYS, threads_to_use, [](BST<int>& map) { map.setInPlaceUpdates(false); });
+}
+
+
+// same experiment as in the AVLTree and ExternalBST
+// tests, compare the ABORTS/OP of the three
+TEST_CASE("50-50 UPDATE ABORT TESTS","[tp][tp_5050]") {
+    const std::size_t RANGE_OF_KEYS = 2000000;
+    std::vector<int> threads_to_use = {1,2,4,7,14,20,28};
+
+    TestBenchType::experiment exp(50,50,0);
+    TestBenchType::test(exp,THREADS,RANGE_OF_KEYS,threads_to_use);
+}
@@ -0,0 +1,572 @@
+#ifndef INCLUDE_EXTERNAL_BST_HPP
+#define INCLUDE_EXTERNAL_BST_HPP
+
+#define USER_NODE_POOL USER_MEM_POOL
+
+
+#include <cassert>
+#include <limits>
+#include <tuple>
+#include "../../../include/SafeTree.hpp"
+
+
+using namespace SafeTree;
+
+
+constexpr int THREAD_AMOUNT_MAX = 100;
+TSX::TSXStats stats[THREAD_AMOUNT_MAX];
+
+template <class ValueType>
+class ExternalBST;
+
+
+// A leaf oriented (external) BST: the keys and values are kept in
+// the leaves, the internal nodes only route the searches and always
+// have two children. Keys smaller than the key of an internal node
+// are on its left, the rest on its right.
+template <class ValueType>
+class ExternalBSTNode {
+    friend class ExternalBST<ValueType>;
+    private:
+        int key;
+        ValueType value;
+        NodeVersion version;
+        ExternalBSTNode* children[2];
+
+    public:
+        using KeyType = int;
+
+        ExternalBSTNode(int key, ValueType val, ExternalBSTNode* left_child, ExternalBSTNode* right_child): key(key), value(val) {
+            children[0] = left_child;
+            children[1] = right_child;
+        }
+
+        bool isLeaf() const {
+            return !children[0];
+        }
+
+        // only leaves hold keys
+        bool hasKey(int key_requested) const {
+            return isLeaf() && key == key_requested;
+        }
+
+        int getKey() const {
+            return key;
+        }
+
+        ValueType getValue() const {
+            return value;
+        }
+
+        void setKey(int new_key) {
+            key = new_key;
+        }
+
+        void setValue(ValueType new_val) {
+            value = new_val;
+        }
+
+        unsigned getVersion() const {
+            return version.load();
+        }
+
+        ExternalBSTNode** getChildPointer(int i) {
+            assert(i >= 0 && i < 2);
+            return &children[i];
+        }
+
+        ExternalBSTNode* getChild(int i) {
+            assert(i >= 0 && i < 2);
+            return children[i];
+        }
+
+        ExternalBSTNode* getL() {
+            return children[0];
+        }
+
+        ExternalBSTNode* getR() {
+            return children[1];
+        }
+
+        void setChild(int i, ExternalBSTNode* node) {
+            assert(i >= 0 && i < 2);
+            children[i] = node;
+        }
+
+        ExternalBSTNode** getChildren() {
+            return children;
+        }
+
+        static constexpr int maxChildren() {
+            return 2;
+        }
+
+        int nextChild(int desired_key) const {
+            return desired_key < key ? 0 : 1;
+        }
+
+        // every search ends at a leaf, the connection
+        // point is the parent of the leaf
+        bool traversalDone(int desired_key) const {
+            (void)desired_key;
+            return isLeaf();
+        }
+
+        int nextChild(const ExternalBSTNode* target) const {
+            return target->key < key ? 0 : 1;
+        }
+};
+
+template <class ValueType>
+struct Result {
+    bool found;
+    ValueType val;
+
+};
+
+template <class ValueType>
+class ExternalBST {
+    friend class ExternalBSTNode<ValueType>;
+    private:
+        ExternalBSTNode<ValueType>* root;
+        TSX::SpinLock &_lock;
+
+        static constexpr bool IN_PLACE_ELIGIBLE = in_place_eligible<ValueType>::value;
+
+        // existing values are updated in place
+        bool in_place_;
+        using TreeNode = ExternalBSTNode<ValueType>;
+
+
+        // helpers
+
+        static std::size_t key_sum_helper(TreeNode* node) {
+            if (!node) {
+                return 0;
+            }
+
+            if (node->isLeaf()) {
+                return node->getKey();
+            }
+
+            return key_sum_helper(node->getChild(0)) + key_sum_helper(node->getChild(1));
+        }
+
+        // amount of keys, the leaves
+        static int count_leaves(TreeNode* node) {
+            if (!node) {
+                return 0;
+            }
+
+            if (node->isLeaf()) {
+                return 1;
+            }
+
+            return count_leaves(node->getChild(0)) + count_leaves(node->getChild(1));
+        }
+
+        // in place writes are seen at once, so not
+        // used by operations which are part of a group
+        bool in_place() const {
+            return in_place_ && !ConnPointGroup::current();
+        }
+
+        // read the value of a published leaf,
+        // again if it was written in place meanwhile
+        static ValueType read_value(const TreeNode* node) {
+            ValueType val;
+            unsigned version;
+
+            do {
+                version = node->version.read_begin();
+                val = node->value;
+            } while (node->version.read_retry(version));
+
+            return val;
+        }
+
+        // write the value of a published leaf, only
+        // in a transaction or holding the lock
+        static void write_in_place(TreeNode* node, const ValueType& val) {
+            node->version.write_begin();
+            node->value = val;
+            node->version.write_end();
+        }
+
+        static TreeNode* new_node(int k, ValueType val, TreeNode* left, TreeNode* right) {
+            #ifdef USER_NODE_POOL
+                return ConnPoint<TreeNode>::create_new_node(k,val,left,right);
+            #else
+                return new TreeNode(k,val,left,right);
+            #endif
+        }
+
+        void print_contents(TreeNode* root) {
+            if (!root) {
+                return;
+            }
+
+            std::cout << root->key << (root->isLeaf() ? " " : "* ");
+            print_contents(root->getChild(0));
+            print_contents(root->getChild(1));
+        }
+
+        void print_sorted_contents(TreeNode* root) {
+            if (!root) {
+                return;
+            }
+
+            print_sorted_contents(root->getChild(0));
+
+            if (root->isLeaf()) {
+                std::cout << root->key << " ";
+            }
+
+            print_sorted_contents(root->getChild(1));
+        }
+
+        int longest_branch(TreeNode* root) {
+            if (!root) {
+                return 0;
+            }
+
+            const int left_branch_length = longest_branch(root->getChild(0));
+            const int right_branch_length = longest_branch(root->getChild(1));
+
+            return  left_branch_length > right_branch_length? 1 + left_branch_length:
+                    1 + right_branch_length;
+        }
+
+        void averageBranchHelper(TreeNode* root,int& total_leaves, int& total_length, int curr_branch_length = 1) {
+            if (!root) {
+                return;
+            }
+
+            if (root->isLeaf()) {
+                total_leaves += 1;
+                total_length += curr_branch_length;
+            }
+
+            averageBranchHelper(root->getChild(0), total_leaves, total_length,  curr_branch_length + 1);
+            averageBranchHelper(root->getChild(1), total_leaves, total_length,  curr_branch_length + 1);
+        }
+
+        int averageBranchLength(TreeNode* root) {
+            int total_leaves = 0;
+            int total_length = 0;
+
+            averageBranchHelper(root,total_leaves,total_length);
+
+            return total_leaves ? total_length / total_leaves: -1;
+        }
+
+        // the keys of a subtree are in [min, max),
+        // routing nodes have exactly two children
+        bool isBstHelper(TreeNode* node, long min, long max) {
+            if (!node) {
+                return true;
+            }
+
+            auto nodekey = node->key;
+
+            if (nodekey < min || nodekey >= max) {
+                return false;
+            }
+
+            if (node->isLeaf()) {
+                return !node->getChild(1);
+            }
+
+            return node->getChild(1) && isBstHelper(node->getChild(0), min, nodekey) && isBstHelper(node->getChild(1), nodekey, max);
+        }
+
+        void rec_delete(TreeNode* node) {
+            if (!node) return;
+
+            rec_delete(node->getChild(0));
+            rec_delete(node->getChild(1));
+
+            delete node;
+        }
+
+        // replace the leaf found, which is the target of the
+        // connection point, with a routing node over it and the
+        // new leaf. These are the only new nodes, nothing is copied.
+        void insert_step(ConnPoint<TreeNode>& conn, TreeNode* leaf, const int k, ValueType val) {
+            auto new_leaf = new_node(k, val, nullptr, nullptr);
+
+            if (!leaf) {
+                conn.setRoot(conn.create_safe(new_leaf));
+                return;
+            }
+
+            // the routing key is the smallest key on its right
+            auto router = k < leaf->getKey() ? new_node(leaf->getKey(), ValueType(), new_leaf, leaf):
+                                               new_node(k, ValueType(), leaf, new_leaf);
+
+            conn.setRoot(conn.create_safe(router));
+        }
+
+        // replace the value of the leaf found, which is
+        // the root of the tree of copies, only the leaf is copied
+        void update_step(ConnPoint<TreeNode>& conn, ValueType val) {
+            conn.getRoot()->rwRef()->setValue(val);
+        }
+
+        // remove the leaf found together with its parent: the sibling
+        // of the leaf takes the place of the parent, at the grandparent.
+        // Neither a successor nor any other node is copied into the tree.
+        void remove_step(ConnPoint<TreeNode>& conn, const ConnPointData<TreeNode>& conn_point_snapshot) {
+            auto parent = conn_point_snapshot.connection_point();
+
+            // the leaf is the root
+            if (!parent) {
+                conn.setRoot(nullptr);
+                return;
+            }
+
+            const int sibling_dir = 1 - parent->nextChild(conn_point_snapshot.target());
+
+            // connect at the grandparent, the parent is kept
+            // in the validation set so that a concurrent change
+            // of the sibling pointer aborts the remove
+            auto safe_parent = conn.pop_path();
+
+            // the sibling subtree is only moved, read from the
+            // children snapshot of the parent which is validated
+            conn.setRoot(conn.wrap_no_validate(safe_parent->peekChild(sibling_dir)));
+        }
+
+        bool insert_impl(const int k, ValueType val, int t_id) {
+            (void)t_id;
+
+            TM_SAFE_OPERATION_START(30) {
+                /* FIND PHASE */
+
+
+                auto conn_point_snapshot = find_conn_point<TreeNode>(k,root_of(&root));
+
+
+                if (conn_point_snapshot.found()) {
+                    return false;
+                }
+
+
+                    /* FIND PHASE END */
+
+                ConnPoint<TreeNode> conn(conn_point_snapshot);
+
+                /* INSERT */
+
+                insert_step(conn, conn_point_snapshot.target(), k, val);
+
+            } TM_SAFE_OPERATION_END
+
+            return true;
+        }
+
+    // insert or replace the value,
+    // returns true if a new leaf was inserted
+    bool upsert_impl(const int k, ValueType val, int t_id) {
+        (void)t_id;
+
+        bool inserted = false;
+
+        TM_SAFE_OPERATION_START(30) {
+            auto conn_point_snapshot = find_conn_point<TreeNode>(k,root_of(&root));
+
+            inserted = !conn_point_snapshot.found();
+
+            ConnPoint<TreeNode> conn(conn_point_snapshot);
+
+            if (inserted) {
+                insert_step(conn, conn_point_snapshot.target(), k, val);
+            } else {
+                update_step(conn, val);
+            }
+        } TM_SAFE_OPERATION_END
+
+        return inserted;
+    }
+
+    // replace the value if the key exists, in place,
+    // returns false if it doesn't
+    bool update_in_place(const int k, const ValueType& val) {
+        bool updated = false;
+
+        auto op = [k, &updated, &val](TreeNode* node) {
+            // the search ends at a leaf, which might have another key
+            updated = node && node->hasKey(k);
+
+            if (updated) {
+                write_in_place(node, val);
+            }
+        };
+
+        find_in_transaction<TreeNode>(&root, k, op, 30);
+
+        return updated;
+    }
+
+    bool remove_impl(const int k, const int t_id) {
+        (void)t_id;
+
+        TM_SAFE_OPERATION_START(30) {
+            /* FIND PHASE */
+
+
+            auto conn_point_snapshot = find_conn_point<TreeNode>(k,root_of(&root));
+
+
+            if (!conn_point_snapshot.found()) {
+                return false;
+            }
+
+
+            ConnPoint<TreeNode> conn(conn_point_snapshot);
+
+            remove_step(conn, conn_point_snapshot);
+        } TM_SAFE_OPERATION_END
+
+        return true;
+    }
+
+
+
+
+    public:
+
+    ExternalBST(TreeNode* root, TSX::SpinLock &lock): root(root), _lock(lock), in_place_(IN_PLACE_ELIGIBLE) {
+        #ifdef USER_NODE_POOL
+            ConnPoint<TreeNode>::init_node_pool();
+        #endif
+
+        for (int i = 0; i < THREAD_AMOUNT_MAX; i++) {
+            stats[i].reset();
+        }
+    }
+    ~ExternalBST() {
+        #ifndef USER_NODE_POOL
+            rec_delete(root);
+        #endif
+
+        #ifdef USER_NODE_POOL
+            ConnPoint<TreeNode>::reset_node_pool();
+        #endif
+    }
+
+    // at most a leaf and a routing node are created
+    bool insert(const int k, ValueType val, int t_id) {
+        return insert_impl(k,val, t_id);
+    }
+
+    // insert the key or replace its value if it exists,
+    // returns true if the key was inserted
+    bool upsert(const int k, ValueType val, int t_id) {
+        if (in_place() && update_in_place(k, val)) {
+            return false;
+        }
+
+        return upsert_impl(k, val, t_id);
+    }
+
+    // unlinks the leaf and its parent, no new nodes
+    bool remove(int k, int t_id) {
+        return remove_impl(k,t_id);
+    }
+
+    Result<ValueType> lookup(int desired_key) {
+        auto node = find<TreeNode>(*root_of(&root),desired_key);
+
+        const auto found = node && node->hasKey(desired_key);
+
+        return {found, found ? read_value(node): ValueType()};
+    }
+
+    // use in place updates for existing keys when the value type
+    // allows it, else copy the leaf. Set before the tree is shared.
+    void setInPlaceUpdates(const bool enabled) {
+        in_place_ = enabled && IN_PLACE_ELIGIBLE;
+    }
+
+    bool inPlaceUpdates() const {
+        return in_place_;
+    }
+
+    int size() {
+        return count_leaves(root);
+    }
+
+    TreeNode* getRoot() {
+        return root;
+    }
+
+    void setRoot(TreeNode* node) {
+        root = node;
+    }
+
+    /* VALIDATORS */
+
+    std::size_t key_sum() {
+        return key_sum_helper(root);
+    }
+
+    // also checks that every routing node has two children
+    bool isSorted() {
+        return isBstHelper(root,std::numeric_limits<int>::min(),static_cast<long>(std::numeric_limits<int>::max()) + 1);
+    }
+
+    /* END OF VALIDATORS */
+
+
+    void print() {
+        print_contents(root);
+        std::cout << std::endl;
+        std::cout << "Longest Branch is: " << longest_branch(root) << std::endl;
+    }
+
+    void longest_branch() {
+        std::cout << "Longest branch is: " << longest_branch(root) << std::endl;
+    }
+
+    void average_branch() {
+        std::cout << "Average branch is: " << averageBranchLength(root) << std::endl;
+    }
+
+
+    void print_sorted() {
+        print_sorted_contents(root);
+        std::cout << std::endl;
+        std::cout << "Longest Branch is: " << longest_branch(root) << std::endl;
+    }
+
+    void stat_report(int n_threads) {
+        TSX::TSXStats t_stats;
+        for (int i = 0; i < n_threads; i++) {
+            t_stats += stats[i];
+        }
+        std::cout << std::endl << std::endl;
+        t_stats.print_stats();
+        std::cout << std::endl << std::endl;
+    }
+
+
+    void lite_stat(int n_threads, long long n_ops = -1) {
+        TSX::TSXStats total_stats;
+        for (int i = 0; i < n_threads; i++) {
+            total_stats += stats[i];
+        }
+
+        if (n_ops > 0) {
+            std::cout << std::endl;
+            std::cout << "ABORTS/OP: " << (total_stats.tx_aborts * 100.0)/(n_ops) << "%" << std::endl;
+        }
+        total_stats.print_lite_stats();
+    }
+
+
+};
+
+
+
+#endif
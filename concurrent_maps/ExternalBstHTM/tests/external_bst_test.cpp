@@ -0,0 +1,377 @@
+#include <iostream>
+#include <array>
+#include <thread>
+#include <cstdlib>
+#include <random>
+#include <chrono>
+#include <atomic>
+
+#include "../include/external_bst.hpp"
+#include "../../../include/catch2/catch.hpp"
+#include "../../../include/TSXGuard.hpp"
+#include "../../../include/test_bench.hpp"
+
+
+using namespace SafeTree;
+
+#ifndef HACI3COMP
+const static int THREADS = std::thread::hardware_concurrency();
+#else
+const static int THREADS = 28;
+#endif
+
+constexpr static int OPERATION_MULTIPLIER = 10000;
+
+using TestBenchType = TestBench<ExternalBST<int>>;
+
+TSX::SpinLock& lock = TestBenchType::global_lock;
+
+TEST_CASE("ExternalBST Init Test","[init]") {
+    ExternalBST<int> someMap(nullptr, lock);
+    (void)someMap;
+}
+
+
+void insert(int i, ExternalBST<int>& map, int t_id) {
+    for (int j = i * OPERATION_MULTIPLIER; j < (i+1)*OPERATION_MULTIPLIER; j++) {
+         map.insert(j,1,t_id);
+    }
+}
+
+
+void even_remove(ExternalBST<int>& map, int i) {
+    for (int j = i * OPERATION_MULTIPLIER; j < (i+1)*OPERATION_MULTIPLIER; j++) {
+        if (j % 2 == 0) {
+            map.remove(j,i);
+        }
+    }
+}
+
+
+// removes the even keys and inserts the odd
+// ones next to them, which share their parents
+void even_remove_odd_insert(ExternalBST<int>& map, int i) {
+    for (int j = i * OPERATION_MULTIPLIER; j < (i+1)*OPERATION_MULTIPLIER; j++) {
+        if (j % 2 == 0) {
+            map.remove(j,i);
+        } else {
+            map.insert(j,1,i);
+        }
+    }
+}
+
+
+TEST_CASE("ExternalBST Find Test") {
+    ExternalBST<int> someMap(nullptr, lock);
+    someMap.setRoot(new ExternalBSTNode<int>(100,0, new ExternalBSTNode<int>(50,0,nullptr,nullptr),new ExternalBSTNode<int>(100,0,nullptr,nullptr)));
+
+    REQUIRE(someMap.getRoot()->nextChild(120) == 1);
+    REQUIRE(someMap.getRoot()->nextChild(100) == 1);
+    REQUIRE(someMap.getRoot()->traversalDone(100) == false);
+    REQUIRE(!someMap.getRoot()->hasKey(100));
+    REQUIRE(someMap.getRoot()->getR()->hasKey(100));
+
+    REQUIRE(someMap.lookup(50).found);
+    REQUIRE(someMap.lookup(100).found);
+    REQUIRE(!someMap.lookup(75).found);
+    REQUIRE(someMap.isSorted());
+}
+
+
+TEST_CASE("ExternalBST Insert Test","[insert]") {
+    std::cout << "SINGLE THREADED INSERT" << std::endl;
+    ExternalBST<int> someMap(nullptr, lock);
+
+    SECTION("empty insert") {
+        REQUIRE(someMap.insert(1,2,0));
+        REQUIRE(someMap.lookup(1).found);
+        REQUIRE(someMap.lookup(1).val == 2);
+        REQUIRE(!someMap.insert(1,3,0));
+        REQUIRE(someMap.getRoot()->isLeaf());
+
+        SECTION("a leaf becomes a routing node") {
+            REQUIRE(someMap.insert(0,1,0));
+
+            auto router = someMap.getRoot();
+            REQUIRE(!router->isLeaf());
+            REQUIRE(router->getKey() == 1);
+            REQUIRE(router->getL()->hasKey(0));
+            REQUIRE(router->getR()->hasKey(1));
+            REQUIRE(someMap.size() == 2);
+        }
+
+        SECTION("inserts all work together") {
+            for (int k : {4, 5, -1, 6, 2}) {
+                REQUIRE(someMap.insert(k,k,0));
+            }
+
+            for (int k : {4, 5, -1, 6, 2, 1}) {
+                REQUIRE(someMap.lookup(k).found);
+            }
+
+            REQUIRE_FALSE(someMap.lookup(10).found);
+            REQUIRE_FALSE(someMap.lookup(3).found);
+            REQUIRE(someMap.size() == 6);
+            REQUIRE(someMap.isSorted());
+        }
+
+        SECTION("too many inserts") {
+            TestBenchType::binary_insert_map(2,THREADS*OPERATION_MULTIPLIER - 1,someMap);
+
+            for (int i = 1; i < THREADS*OPERATION_MULTIPLIER; i++ ) {
+                REQUIRE(someMap.lookup(i).found);
+            }
+
+            REQUIRE(someMap.size() == THREADS*OPERATION_MULTIPLIER - 1);
+            REQUIRE(someMap.isSorted());
+        }
+    }
+}
+
+
+TEST_CASE("ExternalBST Multithreaded Insert Test","[mt_insert]") {
+    std::cout << "MULTITHREADED INSERT" << std::endl;
+
+    ExternalBST<int> someMap(nullptr,lock);
+    std::thread threads[THREADS];
+
+    for (int i = 0; i < THREADS; i++) {
+        threads[i] = std::thread(insert, i, std::ref(someMap), i);
+    }
+
+    for (int i = 0; i < THREADS; i++) {
+        threads[i].join();
+    }
+
+    for (int i = 0; i < THREADS*OPERATION_MULTIPLIER; i++) {
+        if (!someMap.lookup(i).found) {
+            std::cout << "NOT " << i << std::endl;
+            REQUIRE(someMap.lookup(i).found);
+        }
+    }
+
+    REQUIRE(someMap.isSorted());
+}
+
+
+TEST_CASE("ExternalBST Remove Test","[remove]") {
+    SECTION("INTRO") {
+        std::cout << "SINGLE THREADED REMOVE" << std::endl;
+    }
+
+    ExternalBST<int> someMap(nullptr, lock);
+
+    SECTION("root remove") {
+        someMap.insert(1,1,0);
+
+        REQUIRE(someMap.remove(1,0));
+        REQUIRE(!someMap.remove(1,0));
+        REQUIRE(!someMap.lookup(1).found);
+        REQUIRE(someMap.getRoot() == nullptr);
+    }
+
+    SECTION("the sibling replaces the parent") {
+        someMap.insert(1,1,0);
+        someMap.insert(2,2,0);
+
+        auto leaf = someMap.getRoot()->getR();
+
+        REQUIRE(someMap.remove(1,0));
+
+        // moved, not copied
+        REQUIRE(someMap.getRoot() == leaf);
+        REQUIRE(someMap.lookup(2).val == 2);
+    }
+
+    SECTION("remove of a key with two neighbours") {
+        for (int k : {6, 3, 9, 7, 10, 1, 4, 8}) {
+            someMap.insert(k,k,0);
+        }
+
+        REQUIRE(someMap.remove(6,0));
+        REQUIRE(!someMap.lookup(6).found);
+
+        for (int k : {3, 9, 7, 10, 1, 4, 8}) {
+            REQUIRE(someMap.lookup(k).val == k);
+        }
+
+        REQUIRE(someMap.size() == 7);
+        REQUIRE(someMap.isSorted());
+    }
+
+    SECTION("batch remove") {
+        TestBenchType::binary_insert_map(0, THREADS*OPERATION_MULTIPLIER - 1,someMap);
+
+        for (int i = 0; i < THREADS*OPERATION_MULTIPLIER; i++) {
+            if ((i % 2) == 0) {
+                REQUIRE(someMap.remove(i,0));
+                REQUIRE(!someMap.lookup(i).found);
+            } else {
+                REQUIRE(someMap.lookup(i).found);
+            }
+        }
+
+        REQUIRE(someMap.size() == THREADS*OPERATION_MULTIPLIER / 2);
+        REQUIRE(someMap.isSorted());
+    }
+
+    SECTION("random removes") {
+        std::mt19937 gen(1);
+        std::uniform_int_distribution<int> dist(0, 2000);
+
+        for (int i = 0; i < 20000; i++) {
+            const int k = dist(gen);
+
+            if (i % 2) {
+                someMap.insert(k,1,0);
+                REQUIRE(someMap.lookup(k).found);
+            } else {
+                someMap.remove(k,0);
+                REQUIRE(!someMap.lookup(k).found);
+            }
+        }
+
+        REQUIRE(someMap.isSorted());
+    }
+}
+
+
+TEST_CASE("ExternalBST Update Test","[update]") {
+    ExternalBST<int> someMap(nullptr, lock);
+
+    for (int i = 0; i < 100; i++) {
+        someMap.insert(i, i, 0);
+    }
+
+    SECTION("upsert") {
+        REQUIRE(someMap.upsert(500, 1, 0));
+        REQUIRE(someMap.lookup(500).val == 1);
+
+        REQUIRE_FALSE(someMap.upsert(500, 2, 0));
+        REQUIRE(someMap.lookup(500).val == 2);
+        REQUIRE(someMap.size() == 101);
+    }
+
+    SECTION("copy on write upsert") {
+        someMap.setInPlaceUpdates(false);
+
+        REQUIRE_FALSE(someMap.upsert(10, 20, 0));
+        REQUIRE(someMap.lookup(10).val == 20);
+
+        // the routing nodes have the keys but not the values
+        REQUIRE(someMap.upsert(1000, 1, 0));
+        REQUIRE(someMap.lookup(1000).val == 1);
+
+        REQUIRE(someMap.size() == 101);
+        REQUIRE(someMap.isSorted());
+    }
+}
+
+
+TEST_CASE("ExternalBST MULTITHREADED Remove Test","[remove_mt]") {
+    SECTION("intro") {
+        std::cout << "MULTITHREADED Remove Test" << std::endl;
+    }
+
+
+    std::thread threads[THREADS];
+
+
+    SECTION("mt remove") {
+        for (int j = 0; j < 10; j++) {
+            ExternalBST<int> someMap(nullptr, lock);
+            TestBenchType::binary_insert_map(0, THREADS*OPERATION_MULTIPLIER - 1,someMap);
+
+            for (int i = 0; i < THREADS; i++) {
+                threads[i] = std::thread(even_remove, std::ref(someMap), i);
+            }
+
+            for (int i = 0; i < THREADS; i++) {
+                threads[i].join();
+            }
+
+            for (int i = 0; i < THREADS*OPERATION_MULTIPLIER; i++) {
+                if (i % 2 == 0) {
+                    REQUIRE(!someMap.lookup(i).found);
+                } else {
+                    if (!someMap.lookup(i).found) {
+                        std::cerr << "MISSING " << i << std::endl;
+                        REQUIRE(someMap.lookup(i).found);
+                    }
+                }
+            }
+
+            REQUIRE(someMap.isSorted());
+        }
+
+    }
+
+    SECTION("mt removes next to inserts") {
+        for (int j = 0; j < 10; j++) {
+            ExternalBST<int> someMap(nullptr, lock);
+            TestBenchType::binary_insert_map(0, THREADS*OPERATION_MULTIPLIER - 1,someMap);
+
+            std::size_t odd_sum = 0;
+
+            for (int i = 1; i < THREADS*OPERATION_MULTIPLIER; i += 2) {
+                someMap.remove(i,0);
+                odd_sum += i;
+            }
+
+            for (int i = 0; i < THREADS; i++) {
+                threads[i] = std::thread(even_remove_odd_insert, std::ref(someMap), i);
+            }
+
+            for (int i = 0; i < THREADS; i++) {
+                threads[i].join();
+            }
+
+            REQUIRE(someMap.key_sum() == odd_sum);
+            REQUIRE(someMap.isSorted());
+        }
+    }
+}
+
+
+TEST_CASE("THROUGHPUT TESTS","[tp]") {
+    const int OPERATION_MULTIPLIERS[] = {1000000,10000,1000};
+
+    for (int i = 0; i < 3; i++) {
+        std::cout << "Start of tests for tree size: " << OPERATION_MULTIPLIERS[i] << std::endl;
+        const std::size_t RANGE_OF_KEYS = 2 * OPERATION_MULTIPLIERS[i]; // RANGE IS 1 TO RANGE_OF_KEYS
+
+        std::vector<int> threads_to_use = {1,2,4,7,14,20,28};
+        // RANDOM OPS
+        TestBenchType::experiment exp1(33,33,34);
+        TestBenchType::test(exp1,THREADS,RANGE_OF_KEYS,threads_to_use);
+
+        // 10 - 10 -80
+        TestBenchType::experiment exp2(10,10,80);
+        TestBenchType::test(exp2,THREADS,RANGE_OF_KEYS,threads_to_use);
+
+        // 100% LOOKUPS
+        TestBenchType::experiment exp3(0,0,100);
+        TestBenchType::test(exp3,THREADS,RANGE_OF_KEYS, threads_to_use);
+
+
+        // 50-50 UPDATES
+        TestBenchType::experiment exp4(50,50,0);
+        TestBenchType::test(exp4,THREADS,RANGE_OF_KEYS,threads_to_use);
+
+        // 25-25 UPDATES, 50 LOOKUPS
+        TestBenchType::experiment exp5(25,25,50);
+        TestBenchType::test(exp5,THREADS,RANGE_OF_KEYS,threads_to_use);
+
+    }
+}
+
+
+// same experiment as in the BST and AVLTree
+// tests, compare the ABORTS/OP of the three
+TEST_CASE("50-50 UPDATE ABORT TESTS","[tp][tp_5050]") {
+    const std::size_t RANGE_OF_KEYS = 2000000;
+    std::vector<int> threads_to_use = {1,2,4,7,14,20,28};
+
+    TestBenchType::experiment exp(50,50,0);
+    TestBenchType::test(exp,THREADS,RANGE_OF_KEYS,threads_to_use);
+}
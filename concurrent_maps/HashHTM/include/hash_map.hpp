@@ -0,0 +1,677 @@
+#ifndef INCLUDE_HASH_MAP_HPP
+#define INCLUDE_HASH_MAP_HPP
+
+/*  An open addressing hash map. The table is made of buckets of a few
+    slots each, on a cache line of their own, and the buckets are grouped
+    in segments. A key is placed in its home bucket, or in the next ones
+    of the same segment when it is full, so an operation never leaves the
+    segment of its key.
+
+    Updates run in a transaction, falling back to the lock of the segment
+    of the key, so updates of different segments never wait for each
+    other. Lookups run without a transaction, checking the version of
+    every bucket they read, like the in place writes of the trees.
+
+    Resizing:
+        When an insert finds the segment of its key full, a table with
+        twice the buckets is made and the segments of the old table are
+        moved to it one at a time, each in a small transaction. Every
+        update moves a segment before its own operation, so no operation
+        rehashes the whole table. Until a segment is moved, its keys
+        stay in the old table, afterwards they are in the new one.
+
+    The old tables are kept until the map is destroyed, lookups may
+    still be reading them.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <type_traits>
+#include <vector>
+#include "../../../include/SafeTree.hpp"
+
+
+using namespace SafeTree;
+
+
+constexpr int THREAD_AMOUNT_MAX = 100;
+TSX::TSXStats stats[THREAD_AMOUNT_MAX];
+
+
+template <class ValueType>
+struct Result {
+    bool found;
+    ValueType val;
+
+};
+
+
+template <class ValueType>
+class HashMap {
+    // lookups copy the values out of the buckets without a transaction
+    static_assert(std::is_trivially_copyable<ValueType>::value,
+                  "the values of a HashMap have to be trivially copyable");
+
+    private:
+        static constexpr int BUCKET_SLOTS = 4;
+        static constexpr std::size_t SEGMENT_BUCKETS = 16;
+        static constexpr std::size_t DEFAULT_BUCKETS = 1024;
+        static constexpr int TRANSACTION_RETRIES = 30;
+
+        struct alignas(64) Bucket {
+            NodeVersion version;
+            unsigned char used;     // a bit for each slot
+            bool overflowed;        // keys of this bucket went on to the next ones
+            int keys[BUCKET_SLOTS];
+            ValueType values[BUCKET_SLOTS];
+
+            Bucket(): used(0), overflowed(false) {}
+
+            bool full() const {
+                return used == (1 << BUCKET_SLOTS) - 1;
+            }
+
+            bool inUse(const int slot) const {
+                return used & (1 << slot);
+            }
+
+            // slot of the key, -1 if not in the bucket
+            int find(const int key) const {
+                for (int i = 0; i < BUCKET_SLOTS; i++) {
+                    if (inUse(i) && keys[i] == key) {
+                        return i;
+                    }
+                }
+
+                return -1;
+            }
+
+            int freeSlot() const {
+                for (int i = 0; i < BUCKET_SLOTS; i++) {
+                    if (!inUse(i)) {
+                        return i;
+                    }
+                }
+
+                return -1;
+            }
+        };
+
+        struct alignas(64) Segment {
+            TSX::SpinLock lock;
+            std::atomic<bool> moved;    // to the next table
+
+            Segment(): moved(false) {}
+        };
+
+        struct Table {
+            const std::size_t n_buckets;
+            const std::size_t n_segments;
+            Bucket* buckets;
+            Segment* segments;
+            std::atomic<Table*> next;                   // set when resizing
+            std::atomic<std::size_t> next_segment;      // to be moved
+            std::atomic<std::size_t> moved_segments;
+
+            explicit Table(const std::size_t n_buckets):
+            n_buckets(n_buckets), n_segments(n_buckets / SEGMENT_BUCKETS),
+            buckets(allocate<Bucket>(n_buckets)), segments(allocate<Segment>(n_segments)),
+            next(nullptr), next_segment(0), moved_segments(0) {}
+
+            ~Table() {
+                release(buckets, n_buckets);
+                release(segments, n_segments);
+            }
+
+            std::size_t segmentOf(const std::size_t hash) const {
+                return (hash & (n_buckets - 1)) / SEGMENT_BUCKETS;
+            }
+
+            // the i-th bucket looked at for the hash
+            Bucket& probe(const std::size_t hash, const std::size_t i) {
+                const std::size_t home = hash & (n_buckets - 1);
+                const std::size_t first = home - home % SEGMENT_BUCKETS;
+
+                return buckets[first + (home + i) % SEGMENT_BUCKETS];
+            }
+        };
+
+        enum class Outcome {
+            DONE,
+            FULL,       // no free slot in the segment
+            MOVED       // the segment is in the next table
+        };
+
+        std::atomic<Table*> table_;
+        std::vector<Table*> tables_;    // all of them, for the destructor
+        TSX::SpinLock resize_lock_;
+
+
+        // buckets and segments have the alignment of a
+        // cache line, which plain new doesn't give before C++17
+        template <class T>
+        static T* allocate(const std::size_t amount) {
+            void* memory = nullptr;
+
+            if (posix_memalign(&memory, alignof(T), amount * sizeof(T))) {
+                throw std::bad_alloc();
+            }
+
+            T* items = static_cast<T*>(memory);
+            for (std::size_t i = 0; i < amount; i++) {
+                new (&items[i]) T();
+            }
+
+            return items;
+        }
+
+        template <class T>
+        static void release(T* items, const std::size_t amount) {
+            for (std::size_t i = 0; i < amount; i++) {
+                items[i].~T();
+            }
+
+            free(items);
+        }
+
+        static std::size_t hash_of(const int key) {
+            std::uint64_t h = static_cast<std::uint32_t>(key);
+
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdULL;
+            h ^= h >> 33;
+            h *= 0xc4ceb9fe1a85ec53ULL;
+            h ^= h >> 33;
+
+            return static_cast<std::size_t>(h);
+        }
+
+        // the table with the segment of the key, following the
+        // tables the segment was moved to
+        Table* locate(const std::size_t hash) {
+            Table* table = table_.load(std::memory_order_acquire);
+
+            while (table->segments[table->segmentOf(hash)].moved.load(std::memory_order_acquire)) {
+                table = table->next.load(std::memory_order_acquire);
+            }
+
+            return table;
+        }
+
+        // finds the key along the probe sequence, returning its
+        // bucket and slot. Only for updates, without versions.
+        static bool find_slot(Table* table, const std::size_t hash, const int key, Bucket*& bucket, int& slot) {
+            for (std::size_t i = 0; i < SEGMENT_BUCKETS; i++) {
+                bucket = &table->probe(hash, i);
+                slot = bucket->find(key);
+
+                if (slot >= 0) {
+                    return true;
+                }
+
+                if (!bucket->overflowed) {
+                    return false;
+                }
+            }
+
+            return false;
+        }
+
+        // places a key which is not in the table, in the first bucket
+        // with a free slot. The full ones before it are overflowed.
+        static Outcome place(Table* table, const std::size_t hash, const int key, const ValueType& val) {
+            std::size_t i = 0;
+            while (i < SEGMENT_BUCKETS && table->probe(hash, i).full()) {
+                i++;
+            }
+
+            if (i == SEGMENT_BUCKETS) {
+                return Outcome::FULL;
+            }
+
+            for (std::size_t j = 0; j < i; j++) {
+                Bucket& full = table->probe(hash, j);
+
+                if (!full.overflowed) {
+                    full.version.write_begin();
+                    full.overflowed = true;
+                    full.version.write_end();
+                }
+            }
+
+            Bucket& bucket = table->probe(hash, i);
+            const int slot = bucket.freeSlot();
+
+            bucket.version.write_begin();
+            bucket.keys[slot] = key;
+            bucket.values[slot] = val;
+            bucket.used |= 1 << slot;
+            bucket.version.write_end();
+
+            return Outcome::DONE;
+        }
+
+        // runs fn on the table with the segment of the key, in a
+        // transaction or holding the lock of the segment.
+        // Moves a segment first, if the map is being resized.
+        template <typename F>
+        void update(const int key, const int t_id, F&& fn) {
+            const std::size_t hash = hash_of(key);
+
+            for (;;) {
+                move_some(table_.load(std::memory_order_acquire), t_id);
+
+                Table* table = locate(hash);
+                Segment& segment = table->segments[table->segmentOf(hash)];
+                Outcome outcome = Outcome::MOVED;
+
+                {
+                    unsigned char err_status = 0;
+                    TSX::TSXGuardWithStats guard(TRANSACTION_RETRIES, segment.lock, err_status, stats[t_id]);
+
+                    // moved since it was located
+                    if (!segment.moved.load(std::memory_order_relaxed)) {
+                        outcome = fn(table, hash);
+                    }
+                }
+
+                if (outcome == Outcome::DONE) {
+                    return;
+                }
+
+                if (outcome == Outcome::FULL) {
+                    grow(table, t_id);
+                }
+            }
+        }
+
+        // a full segment of the table, resizes it. If it is the
+        // new table of a resize, that one is finished first.
+        void grow(Table* table, const int t_id) {
+            Table* current = table_.load(std::memory_order_acquire);
+
+            if (current->next.load(std::memory_order_acquire) == table) {
+                while (table_.load(std::memory_order_acquire) == current) {
+                    if (!move_some(current, t_id)) {
+                        _mm_pause();
+                    }
+                }
+
+                return;
+            }
+
+            // an old table, already moved on
+            if (current == table) {
+                start_resize(table);
+            }
+        }
+
+        bool start_resize(Table* table) {
+            bool started = false;
+
+            resize_lock_.lock();
+            if (table_.load() == table && !table->next.load()) {
+                Table* next = new Table(table->n_buckets * 2);
+                tables_.push_back(next);
+                table->next.store(next, std::memory_order_release);
+                started = true;
+            }
+            resize_lock_.unlock();
+
+            return started;
+        }
+
+        // moves the next segment of a table being resized,
+        // returns false if there was none to move
+        bool move_some(Table* table, const int t_id) {
+            Table* next = table->next.load(std::memory_order_acquire);
+
+            if (!next || table->next_segment.load(std::memory_order_relaxed) >= table->n_segments) {
+                return false;
+            }
+
+            const std::size_t seg = table->next_segment.fetch_add(1);
+            if (seg >= table->n_segments) {
+                return false;
+            }
+
+            move_segment(table, next, seg, t_id);
+
+            // the last one moved, the next table takes over
+            if (table->moved_segments.fetch_add(1) + 1 == table->n_segments) {
+                table_.store(next, std::memory_order_release);
+            }
+
+            return true;
+        }
+
+        // the keys of a segment go to the two segments of the next
+        // table their buckets split into, no other segment reaches
+        // those before the segment is marked moved. The old buckets
+        // stay as they are, lookups check the mark after reading them.
+        void move_segment(Table* table, Table* next, const std::size_t seg, const int t_id) {
+            Segment& segment = table->segments[seg];
+            unsigned char err_status = 0;
+            TSX::TSXGuardWithStats guard(TRANSACTION_RETRIES, segment.lock, err_status, stats[t_id]);
+
+            for (std::size_t b = seg * SEGMENT_BUCKETS; b < (seg + 1) * SEGMENT_BUCKETS; b++) {
+                const Bucket& bucket = table->buckets[b];
+
+                for (int i = 0; i < BUCKET_SLOTS; i++) {
+                    if (bucket.inUse(i)) {
+                        place(next, hash_of(bucket.keys[i]), bucket.keys[i], bucket.values[i]);
+                    }
+                }
+            }
+
+            segment.moved.store(true, std::memory_order_release);
+        }
+
+        // the tables holding the keys, with the segments of each to visit,
+        // without updates running. A resize may have been left half way.
+        template <typename F>
+        void for_each_segment(F&& fn) {
+            Table* table = table_.load();
+            Table* next = table->next.load();
+
+            for (std::size_t s = 0; s < table->n_segments; s++) {
+                if (!table->segments[s].moved.load()) {
+                    fn(table, s);
+                }
+            }
+
+            if (!next) {
+                return;
+            }
+
+            // a segment of the next table has the keys
+            // of the one it was split from, once moved
+            for (std::size_t s = 0; s < next->n_segments; s++) {
+                if (table->segments[s % table->n_segments].moved.load()) {
+                    fn(next, s);
+                }
+            }
+        }
+
+        template <typename F>
+        void for_each_entry(F&& fn) {
+            for_each_segment([&fn](Table* table, const std::size_t seg) {
+                for (std::size_t b = seg * SEGMENT_BUCKETS; b < (seg + 1) * SEGMENT_BUCKETS; b++) {
+                    const Bucket& bucket = table->buckets[b];
+
+                    for (int i = 0; i < BUCKET_SLOTS; i++) {
+                        if (bucket.inUse(i)) {
+                            fn(table, b, bucket.keys[i], bucket.values[i]);
+                        }
+                    }
+                }
+            });
+        }
+
+        // buckets looked at by a lookup of the key in the bucket
+        static std::size_t probe_length(Table* table, const std::size_t bucket, const int key) {
+            const std::size_t home = hash_of(key) & (table->n_buckets - 1);
+            return (bucket + SEGMENT_BUCKETS - home % SEGMENT_BUCKETS) % SEGMENT_BUCKETS + 1;
+        }
+
+    public:
+        // the lock is not used, every segment has its own, it is
+        // there for the same constructor as the trees. The amount
+        // of buckets is rounded up to a power of two.
+        HashMap(std::nullptr_t, TSX::SpinLock& lock, const std::size_t n_buckets = DEFAULT_BUCKETS) {
+            (void)lock;
+
+            std::size_t size = SEGMENT_BUCKETS;
+            while (size < n_buckets) {
+                size *= 2;
+            }
+
+            tables_.push_back(new Table(size));
+            table_.store(tables_.back());
+
+            for (int i = 0; i < THREAD_AMOUNT_MAX; i++) {
+                stats[i].reset();
+            }
+        }
+
+        ~HashMap() {
+            for (Table* table: tables_) {
+                delete table;
+            }
+        }
+
+        HashMap(const HashMap&) = delete;
+        HashMap& operator=(const HashMap&) = delete;
+
+        bool insert(const int k, ValueType val, int t_id) {
+            bool inserted = false;
+
+            update(k, t_id, [&](Table* table, const std::size_t hash) {
+                Bucket* bucket;
+                int slot;
+
+                if (find_slot(table, hash, k, bucket, slot)) {
+                    inserted = false;
+                    return Outcome::DONE;
+                }
+
+                inserted = true;
+                return place(table, hash, k, val);
+            });
+
+            return inserted;
+        }
+
+        // returns true if the key was inserted,
+        // false if its value was overwritten
+        bool upsert(const int k, ValueType val, int t_id) {
+            bool inserted = false;
+
+            update(k, t_id, [&](Table* table, const std::size_t hash) {
+                Bucket* bucket;
+                int slot;
+
+                if (find_slot(table, hash, k, bucket, slot)) {
+                    bucket->version.write_begin();
+                    bucket->values[slot] = val;
+                    bucket->version.write_end();
+
+                    inserted = false;
+                    return Outcome::DONE;
+                }
+
+                inserted = true;
+                return place(table, hash, k, val);
+            });
+
+            return inserted;
+        }
+
+        // the overflowed marks stay, until the segment is moved
+        bool remove(const int k, int t_id) {
+            bool removed = false;
+
+            update(k, t_id, [&](Table* table, const std::size_t hash) {
+                Bucket* bucket;
+                int slot;
+
+                removed = find_slot(table, hash, k, bucket, slot);
+
+                if (removed) {
+                    bucket->version.write_begin();
+                    bucket->used &= ~(1 << slot);
+                    bucket->version.write_end();
+                }
+
+                return Outcome::DONE;
+            });
+
+            return removed;
+        }
+
+        Result<ValueType> lookup(const int k) {
+            const std::size_t hash = hash_of(k);
+
+            for (;;) {
+                Table* table = locate(hash);
+                Result<ValueType> result = {false, ValueType()};
+                bool retry = false;
+
+                for (std::size_t i = 0; i < SEGMENT_BUCKETS; i++) {
+                    const Bucket& bucket = table->probe(hash, i);
+                    const unsigned version = bucket.version.read_begin();
+
+                    const int slot = bucket.find(k);
+                    if (slot >= 0) {
+                        result.val = bucket.values[slot];
+                    }
+                    const bool overflowed = bucket.overflowed;
+
+                    if (bucket.version.read_retry(version)) {
+                        retry = true;
+                        break;
+                    }
+
+                    if (slot >= 0) {
+                        result.found = true;
+                        break;
+                    }
+
+                    if (!overflowed) {
+                        break;
+                    }
+                }
+
+                // moved while reading, the keys could have been updated since
+                if (retry || table->segments[table->segmentOf(hash)].moved.load(std::memory_order_acquire)) {
+                    continue;
+                }
+
+                return result;
+            }
+        }
+
+        // resizes the map, if it is not being resized already.
+        // The segments are moved by the following updates.
+        bool startResize() {
+            return start_resize(table_.load());
+        }
+
+        bool resizing() {
+            return table_.load()->next.load() != nullptr;
+        }
+
+        // of the table the keys are moved to, if resizing
+        std::size_t bucketCount() {
+            Table* table = table_.load();
+            Table* next = table->next.load();
+
+            return next ? next->n_buckets : table->n_buckets;
+        }
+
+        /* VALIDATORS, without updates running */
+
+        int size() {
+            int amount = 0;
+
+            for_each_entry([&amount](Table*, std::size_t, int, const ValueType&) {
+                amount++;
+            });
+
+            return amount;
+        }
+
+        std::size_t key_sum() {
+            std::size_t sum = 0;
+
+            for_each_entry([&sum](Table*, std::size_t, int key, const ValueType&) {
+                sum += key;
+            });
+
+            return sum;
+        }
+
+        // named as in the trees, checks that every key is found by its
+        // probe sequence: in the segment of its hash, with the buckets
+        // before it overflowed. Also that no key is there twice.
+        bool isSorted() {
+            bool consistent = true;
+            std::vector<int> keys;
+
+            for_each_entry([&](Table* table, const std::size_t b, int key, const ValueType&) {
+                const std::size_t hash = hash_of(key);
+                keys.push_back(key);
+
+                if (table->segmentOf(hash) != b / SEGMENT_BUCKETS) {
+                    consistent = false;
+                    return;
+                }
+
+                for (std::size_t i = 0; &table->probe(hash, i) != &table->buckets[b]; i++) {
+                    if (!table->probe(hash, i).overflowed) {
+                        consistent = false;
+                        return;
+                    }
+                }
+            });
+
+            std::sort(keys.begin(), keys.end());
+
+            return consistent && std::adjacent_find(keys.begin(), keys.end()) == keys.end();
+        }
+
+        /* END OF VALIDATORS */
+
+        void longest_branch() {
+            std::size_t longest = 0;
+
+            for_each_entry([&longest](Table* table, const std::size_t b, int key, const ValueType&) {
+                longest = std::max(longest, probe_length(table, b, key));
+            });
+
+            std::cout << "Longest probe is: " << longest << " buckets" << std::endl;
+        }
+
+        void average_branch() {
+            std::size_t total = 0;
+            std::size_t amount = 0;
+
+            for_each_entry([&](Table* table, const std::size_t b, int key, const ValueType&) {
+                total += probe_length(table, b, key);
+                amount++;
+            });
+
+            std::cout << "Average probe is: " << (amount ? static_cast<double>(total) / amount : 0.0) << " buckets" << std::endl;
+        }
+
+        void stat_report(int n_threads) {
+            TSX::TSXStats t_stats;
+            for (int i = 0; i < n_threads; i++) {
+                t_stats += stats[i];
+            }
+            std::cout << std::endl << std::endl;
+            t_stats.print_stats();
+            std::cout << std::endl << std::endl;
+        }
+
+        void lite_stat(int n_threads, long long n_ops = -1) {
+            TSX::TSXStats total_stats;
+            for (int i = 0; i < n_threads; i++) {
+                total_stats += stats[i];
+            }
+
+            if (n_ops > 0) {
+                std::cout << std::endl;
+                std::cout << "ABORTS/OP: " << (total_stats.tx_aborts * 100.0)/(n_ops) << "%" << std::endl;
+            }
+            total_stats.print_lite_stats();
+        }
+};
+
+
+#endif
@@ -0,0 +1,284 @@
+#include <iostream>
+#include <array>
+#include <thread>
+#include <cstdlib>
+#include <random>
+#include <chrono>
+#include <atomic>
+
+#include "../include/hash_map.hpp"
+#include "../../../include/catch2/catch.hpp"
+#include "../../../include/TSXGuard.hpp"
+#include "../../../include/test_bench.hpp"
+
+
+using namespace SafeTree;
+
+#ifndef HACI3COMP
+const static int THREADS = std::thread::hardware_concurrency();
+#else
+const static int THREADS = 28;
+#endif
+
+constexpr static int OPERATION_MULTIPLIER = 10000;
+
+using TestBenchType = TestBench<HashMap<int>>;
+
+TSX::SpinLock& lock = TestBenchType::global_lock;
+
+TEST_CASE("HashMap Init Test","[init]") {
+    HashMap<int> someMap(nullptr, lock);
+    REQUIRE(someMap.bucketCount() == 1024);
+    REQUIRE(someMap.size() == 0);
+
+    // rounded up to a power of two
+    HashMap<int> otherMap(nullptr, lock, 100);
+    REQUIRE(otherMap.bucketCount() == 128);
+}
+
+
+void insert(int i, HashMap<int>& map, int t_id) {
+    for (int j = i * OPERATION_MULTIPLIER; j < (i+1)*OPERATION_MULTIPLIER; j++) {
+         map.insert(j,j,t_id);
+    }
+}
+
+
+void even_remove(HashMap<int>& map, int i) {
+    for (int j = i * OPERATION_MULTIPLIER; j < (i+1)*OPERATION_MULTIPLIER; j++) {
+        if (j % 2 == 0) {
+            map.remove(j,i);
+        }
+    }
+}
+
+
+TEST_CASE("HashMap Insert Test","[insert]") {
+    std::cout << "SINGLE THREADED INSERT" << std::endl;
+    HashMap<int> someMap(nullptr, lock);
+
+    SECTION("empty insert") {
+        REQUIRE(someMap.insert(1,2,0));
+        REQUIRE(someMap.lookup(1).found);
+        REQUIRE(someMap.lookup(1).val == 2);
+        REQUIRE(!someMap.insert(1,3,0));
+        REQUIRE(someMap.lookup(1).val == 2);
+        REQUIRE(!someMap.lookup(2).found);
+    }
+
+    SECTION("negative keys") {
+        for (int k : {-1, -100, 0, 100}) {
+            REQUIRE(someMap.insert(k,k,0));
+        }
+
+        for (int k : {-1, -100, 0, 100}) {
+            REQUIRE(someMap.lookup(k).val == k);
+        }
+
+        REQUIRE(someMap.size() == 4);
+        REQUIRE(someMap.key_sum() == static_cast<std::size_t>(-1));
+    }
+
+    SECTION("upsert") {
+        REQUIRE(someMap.upsert(5,1,0));
+        REQUIRE(!someMap.upsert(5,2,0));
+        REQUIRE(someMap.lookup(5).val == 2);
+        REQUIRE(someMap.size() == 1);
+    }
+
+    SECTION("many inserts") {
+        for (int i = 0; i < 2000; i++) {
+            REQUIRE(someMap.insert(i,i,0));
+        }
+
+        for (int i = 0; i < 2000; i++) {
+            REQUIRE(someMap.lookup(i).val == i);
+        }
+
+        REQUIRE(!someMap.lookup(2000).found);
+        REQUIRE(someMap.size() == 2000);
+        REQUIRE(someMap.key_sum() == 1999 * 2000 / 2);
+        REQUIRE(someMap.isSorted());
+    }
+}
+
+
+TEST_CASE("HashMap Remove Test","[remove]") {
+    HashMap<int> someMap(nullptr, lock);
+
+    SECTION("remove and insert again") {
+        REQUIRE(someMap.insert(1,1,0));
+        REQUIRE(someMap.remove(1,0));
+        REQUIRE(!someMap.remove(1,0));
+        REQUIRE(!someMap.lookup(1).found);
+        REQUIRE(someMap.insert(1,2,0));
+        REQUIRE(someMap.lookup(1).val == 2);
+    }
+
+    SECTION("random removes") {
+        std::mt19937 gen(1);
+        std::uniform_int_distribution<int> dist(0, 5000);
+
+        for (int i = 0; i < 50000; i++) {
+            const int k = dist(gen);
+
+            if (i % 2) {
+                someMap.insert(k,1,0);
+                REQUIRE(someMap.lookup(k).found);
+            } else {
+                someMap.remove(k,0);
+                REQUIRE(!someMap.lookup(k).found);
+            }
+        }
+
+        REQUIRE(someMap.isSorted());
+    }
+}
+
+
+TEST_CASE("HashMap Resize Test","[resize]") {
+    // 4 segments
+    HashMap<int> someMap(nullptr, lock, 64);
+
+    SECTION("full segments resize the table") {
+        for (int i = 0; i < 10000; i++) {
+            REQUIRE(someMap.insert(i,i,0));
+        }
+
+        REQUIRE(someMap.bucketCount() > 64);
+
+        for (int i = 0; i < 10000; i++) {
+            REQUIRE(someMap.lookup(i).val == i);
+        }
+
+        REQUIRE(someMap.size() == 10000);
+        REQUIRE(someMap.isSorted());
+    }
+
+    SECTION("updates move the segments one by one") {
+        for (int i = 0; i < 100; i++) {
+            REQUIRE(someMap.insert(i,i,0));
+        }
+
+        REQUIRE(someMap.startResize());
+        REQUIRE(!someMap.startResize());
+        REQUIRE(someMap.resizing());
+        REQUIRE(someMap.bucketCount() == 128);
+
+        // half of the table moved
+        REQUIRE(someMap.insert(1000,1000,0));
+        REQUIRE(someMap.remove(0,0));
+        REQUIRE(someMap.resizing());
+
+        for (int i = 1; i < 100; i++) {
+            REQUIRE(someMap.lookup(i).val == i);
+        }
+
+        REQUIRE(someMap.lookup(1000).found);
+        REQUIRE(!someMap.lookup(0).found);
+        REQUIRE(someMap.size() == 100);
+        REQUIRE(someMap.isSorted());
+
+        REQUIRE(!someMap.upsert(1,-1,0));
+        REQUIRE(!someMap.upsert(2,-2,0));
+        REQUIRE(!someMap.resizing());
+
+        REQUIRE(someMap.lookup(1).val == -1);
+        REQUIRE(someMap.size() == 100);
+        REQUIRE(someMap.key_sum() == 99 * 100 / 2 + 1000);
+        REQUIRE(someMap.isSorted());
+    }
+}
+
+
+TEST_CASE("HashMap Multithreaded Insert Test","[mt_insert]") {
+    std::cout << "MULTITHREADED INSERT" << std::endl;
+
+    // resized while the threads insert
+    HashMap<int> someMap(nullptr,lock,64);
+    std::thread threads[THREADS];
+
+    for (int i = 0; i < THREADS; i++) {
+        threads[i] = std::thread(insert, i, std::ref(someMap), i);
+    }
+
+    for (int i = 0; i < THREADS; i++) {
+        threads[i].join();
+    }
+
+    for (int i = 0; i < THREADS*OPERATION_MULTIPLIER; i++) {
+        if (someMap.lookup(i).val != i) {
+            std::cout << "NOT " << i << std::endl;
+            REQUIRE(someMap.lookup(i).found);
+        }
+    }
+
+    REQUIRE(someMap.size() == THREADS*OPERATION_MULTIPLIER);
+    REQUIRE(someMap.isSorted());
+}
+
+
+TEST_CASE("HashMap MULTITHREADED Remove Test","[remove_mt]") {
+    SECTION("intro") {
+        std::cout << "MULTITHREADED Remove Test" << std::endl;
+    }
+
+
+    std::thread threads[THREADS];
+
+
+    SECTION("mt remove") {
+        for (int j = 0; j < 10; j++) {
+            HashMap<int> someMap(nullptr, lock);
+            TestBenchType::binary_insert_map(0, THREADS*OPERATION_MULTIPLIER - 1,someMap);
+
+            // the removes move the segments
+            someMap.startResize();
+
+            for (int i = 0; i < THREADS; i++) {
+                threads[i] = std::thread(even_remove, std::ref(someMap), i);
+            }
+
+            for (int i = 0; i < THREADS; i++) {
+                threads[i].join();
+            }
+
+            for (int i = 0; i < THREADS*OPERATION_MULTIPLIER; i++) {
+                if (i % 2 == 0) {
+                    REQUIRE(!someMap.lookup(i).found);
+                } else {
+                    if (!someMap.lookup(i).found) {
+                        std::cerr << "MISSING " << i << std::endl;
+                        REQUIRE(someMap.lookup(i).found);
+                    }
+                }
+            }
+
+            REQUIRE(someMap.isSorted());
+        }
+
+    }
+}
+
+
+TEST_CASE("THROUGHPUT TESTS","[tp]") {
+    const int OPERATION_MULTIPLIERS[] = {1000000,10000,1000};
+
+    for (int i = 0; i < 3; i++) {
+        std::cout << "Start of tests for map size: " << OPERATION_MULTIPLIERS[i] << std::endl;
+        const std::size_t RANGE_OF_KEYS = 2 * OPERATION_MULTIPLIERS[i]; // RANGE IS 1 TO RANGE_OF_KEYS
+
+        std::vector<int> threads_to_use = {1,2,4,7,14,20,28};
+        // RANDOM OPS
+        TestBenchType::experiment exp1(33,33,34);
+        TestBenchType::test(exp1,THREADS,RANGE_OF_KEYS,threads_to_use);
+
+        // 100% LOOKUPS
+        TestBenchType::experiment exp2(0,0,100);
+        TestBenchType::test(exp2,THREADS,RANGE_OF_KEYS, threads_to_use);
+
+        // 50-50 UPDATES
+        TestBenchType::experiment exp3(50,50,0);
+        TestBenchType::test(exp3,THREADS,RANGE_OF_KEYS,threads_to_use);
+    }
+}
@@ -0,0 +1,650 @@
+#ifndef INCLUDE_RBTREE_HPP
+#define INCLUDE_RBTREE_HPP
+
+#define USER_NODE_POOL USER_MEM_POOL
+
+
+#include <cassert>
+#include <limits>
+#include "../../../include/SafeTree.hpp"
+
+using namespace SafeTree;
+
+
+constexpr int THREAD_AMOUNT_MAX = 100;
+TSX::TSXStats stats[THREAD_AMOUNT_MAX];
+
+template <class ValueType>
+class RBTree;
+
+
+template <class ValueType>
+class RBNode {
+    friend class RBTree<ValueType>;
+    private:
+        int key;
+        ValueType value;
+        RBNode* children[2];
+        bool red;
+
+        using SafeRBNode = SafeNode<RBNode<ValueType>>;
+
+        static bool is_red(const RBNode* node) {
+            return node && node->red;
+        }
+
+        // rotate z down to side dir, its child on
+        // the other side becomes the root of the subtree
+        static SafeRBNode* rotate(SafeRBNode* z, const int dir) {
+            /*      z      rotate(z, 0)       y
+                   / \    - - - - - - ->     / \
+                 T1   y                     z   T3
+                     / \                   / \
+                   T2   T3               T1   T2   */
+
+            assert(z != nullptr);
+            auto newRoot = z->getChild(1 - dir);
+
+            assert(newRoot != nullptr);
+            auto inner = newRoot->getChild(dir);
+
+            newRoot->setChild(dir, z);
+            z->setChild(1 - dir, inner);
+
+            return newRoot;
+        }
+
+    public:
+        using KeyType = int;
+
+        // new nodes are red
+        RBNode(int key, ValueType val, RBNode* left_child, RBNode* right_child): key(key), value(val), red(true) {
+            children[0] = left_child;
+            children[1] = right_child;
+        }
+
+        // to satisfy search tree interface
+        bool hasKey(int key_requested) {
+            return key == key_requested;
+        }
+
+        int nextChild(int desired_key) const {
+            return desired_key < key ? 0 : 1;
+        }
+
+        bool traversalDone(int desired_key) const {
+            return key == desired_key;
+        }
+
+        int nextChild(const RBNode* target) const {
+            return target->key < key ? 0 : 1;
+        }
+
+        // and the basic required methods
+        static constexpr int maxChildren() {
+            return 2;
+        }
+
+        RBNode** getChildPointer(int i) {
+            assert(i >= 0 && i < 2);
+            return &children[i];
+        }
+
+        RBNode* getChild(int i) {
+            assert(i >= 0 && i < 2);
+            return children[i];
+        }
+
+        void setChild(int i, RBNode* node) {
+            assert(i >= 0 && i < 2);
+            children[i] = node;
+        }
+
+        // helpers for the red black tree
+
+        int getKey() const {
+            return key;
+        }
+
+        ValueType getValue() const {
+            return value;
+        }
+
+        bool isRed() const {
+            return red;
+        }
+};
+
+template <class ValueType>
+struct Result {
+    bool found;
+    ValueType val;
+};
+
+
+// A red black tree map. An insert does at most two rotations and
+// a remove at most three, the recoloring going up the path stops
+// as soon as the tree is valid again, so most updates copy only
+// a few nodes close to the one changed.
+template <class ValueType>
+class RBTree {
+    friend class RBNode<ValueType>;
+    private:
+        using TreeNode = RBNode<ValueType>;
+        using SafeRBNode = SafeNode<TreeNode>;
+
+        TreeNode* root;
+        TSX::SpinLock &_lock;
+
+
+        // helpers
+
+        // sum of keys of tree
+        // for validation
+        static std::size_t key_sum_helper(TreeNode* node) {
+            if (!node) {
+                return 0;
+            }
+
+            return node->getKey() + key_sum_helper(node->getChild(0)) + key_sum_helper(node->getChild(1));
+        }
+
+        // number of nodes of tree
+        static int count_nodes(TreeNode* node) {
+            if (!node) {
+                return 0;
+            }
+
+            return 1 + count_nodes(node->getChild(0)) + count_nodes(node->getChild(1));
+        }
+
+        // print the tree pre-order
+        void print_contents(TreeNode* root) {
+            if (!root) {
+                return;
+            }
+
+            std::cout << root->key << (root->red ? "R " : "B ");
+            print_contents(root->getChild(0));
+            print_contents(root->getChild(1));
+        }
+
+        // tree's longest branch
+        int longest_branch(TreeNode* root) {
+            if (!root) {
+                return 0;
+            }
+
+            const int left_branch_length = longest_branch(root->getChild(0));
+            const int right_branch_length = longest_branch(root->getChild(1));
+
+            return  left_branch_length > right_branch_length? 1 + left_branch_length:
+                    1 + right_branch_length;
+        }
+
+        // tree's averge branch size
+        void averageBranchHelper(TreeNode* root,int& total_leaves, int& total_length, int curr_branch_length = 1) {
+            if (!root) {
+                return;
+            }
+
+            if (!root->getChild(0) && !root->getChild(1)) {
+                total_leaves += 1;
+                total_length += curr_branch_length;
+            }
+
+            averageBranchHelper(root->getChild(0), total_leaves, total_length,  curr_branch_length + 1);
+            averageBranchHelper(root->getChild(1), total_leaves, total_length,  curr_branch_length + 1);
+        }
+
+        int averageBranchLength(TreeNode* root) {
+            int total_leaves = 0;
+            int total_length = 0;
+
+            averageBranchHelper(root,total_leaves,total_length);
+
+            return total_leaves ? total_length / total_leaves: -1;
+        }
+
+        // bst validator
+        bool isBstHelper(TreeNode* node,int min, int max) {
+            if (!node) {
+                return true;
+            }
+
+            auto nodekey = node->key;
+
+            if ( nodekey < min || nodekey > max) {
+                return false;
+            }
+
+            return isBstHelper(node->getChild(0), min, nodekey) && isBstHelper(node->getChild(1), nodekey, max);
+        }
+
+        // red black validator, returns the black height
+        // of the subtree or -1 if it is not valid
+        int blackHeight(TreeNode* node) {
+            if (!node) {
+                return 1;
+            }
+
+            // no red node has a red child
+            if (node->red && (TreeNode::is_red(node->getChild(0)) || TreeNode::is_red(node->getChild(1)))) {
+                return -1;
+            }
+
+            const int l_height = blackHeight(node->getChild(0));
+            const int r_height = blackHeight(node->getChild(1));
+
+            // every path has the same amount of black nodes
+            if (l_height == -1 || l_height != r_height) {
+                return -1;
+            }
+
+            return l_height + (node->red ? 0 : 1);
+        }
+
+        // recursively delete
+        void rec_delete(TreeNode* node) {
+            if (!node) return;
+
+            rec_delete(node->getChild(0));
+            rec_delete(node->getChild(1));
+
+            delete node;
+        }
+
+        // connect a new red node with key k as the root of the tree
+        // of copies and fix red parents going up the path
+        void insert_step(ConnPoint<TreeNode>& conn, const int k, ValueType val) {
+            // build new node
+            #ifdef USER_NODE_POOL
+                SafeRBNode* n = conn.create_safe(ConnPoint<TreeNode>::create_new_node(k,val,nullptr,nullptr));
+            #else
+                SafeRBNode* n = conn.create_safe(new TreeNode(k,val,nullptr,nullptr));
+            #endif
+
+            conn.setRoot(n);
+
+            // n is red, the only rule that can be
+            // broken is a red parent of a red node
+            for (;;) {
+                auto parent = conn.pop_path();
+
+                // n is the root, which is always black
+                if (!parent) {
+                    n->rwRef()->red = false;
+                    return;
+                }
+
+                auto parent_values = parent->rwRef();
+
+                if (!parent_values->red) {
+                    return;
+                }
+
+                // a red parent is never the root
+                auto grandparent = conn.pop_path();
+                assert(grandparent != nullptr);
+
+                auto grandparent_values = grandparent->rwRef();
+                const int parent_dir = grandparent_values->nextChild(k);
+
+                // red uncle: recolor and continue
+                // two levels higher, no rotations
+                if (TreeNode::is_red(grandparent->peekChild(1 - parent_dir))) {
+                    grandparent->getChild(1 - parent_dir)->rwRef()->red = false;
+                    parent_values->red = false;
+                    grandparent_values->red = true;
+
+                    n = grandparent;
+                    continue;
+                }
+
+                // black uncle: at most two rotations and done
+                if (parent_values->nextChild(k) != parent_dir) {
+                    grandparent->setChild(parent_dir, TreeNode::rotate(parent, parent_dir));
+                }
+
+                auto new_root = TreeNode::rotate(grandparent, 1 - parent_dir);
+                new_root->rwRef()->red = false;
+                grandparent_values->red = true;
+
+                conn.setRoot(new_root);
+                return;
+            }
+        }
+
+        // the child at side dir of parent is missing a black node,
+        // recolor and rotate to fix it. Returns the new root of the
+        // subtree of parent, done is false if the whole subtree is
+        // still missing a black node and the fix has to go up
+        static SafeRBNode* fix_black_height(SafeRBNode* parent, const int dir, bool& done) {
+            auto parent_values = parent->rwRef();
+
+            // the sibling exists, its side has a black node more
+            auto sibling = parent->getChild(1 - dir);
+            auto sibling_values = sibling->rwRef();
+
+            SafeRBNode* top = nullptr;
+
+            // red sibling: rotate it above parent, the
+            // new sibling is black and parent is red
+            if (sibling_values->red) {
+                top = TreeNode::rotate(parent, dir);
+                sibling_values->red = false;
+                parent_values->red = true;
+
+                sibling = parent->getChild(1 - dir);
+                sibling_values = sibling->rwRef();
+            }
+
+            SafeRBNode* new_parent = parent;
+
+            if (!TreeNode::is_red(sibling->peekChild(0)) && !TreeNode::is_red(sibling->peekChild(1))) {
+                // black nephews: remove a black node from the
+                // side of the sibling too, a red parent makes up for it
+                sibling_values->red = true;
+
+                done = parent_values->red;
+                parent_values->red = false;
+            } else {
+                // the nephew closer to dir is red, rotate
+                // it above the sibling to make the far one red
+                if (!TreeNode::is_red(sibling->peekChild(1 - dir))) {
+                    sibling->getChild(dir)->rwRef()->red = false;
+                    sibling_values->red = true;
+
+                    sibling = TreeNode::rotate(sibling, 1 - dir);
+                    parent->setChild(1 - dir, sibling);
+                    sibling_values = sibling->rwRef();
+                }
+
+                // far nephew red: rotate the sibling above parent
+                // and add a black node to the side of dir
+                sibling->getChild(1 - dir)->rwRef()->red = false;
+                sibling_values->red = parent_values->red;
+                parent_values->red = false;
+
+                new_parent = TreeNode::rotate(parent, dir);
+                done = true;
+            }
+
+            if (top) {
+                top->setChild(dir, new_parent);
+                return top;
+            }
+
+            return new_parent;
+        }
+
+        // remove the node found, which is the root of the tree of
+        // copies, and fix the black height going up while needed
+        void remove_step(ConnPoint<TreeNode>& conn, const int k) {
+            auto node_to_be_deleted = conn.getRoot();
+            auto node_to_be_deleted_values = node_to_be_deleted->rwRef();
+
+            // just read them to see if they exist
+            auto l_child = node_to_be_deleted->peekChild(0);
+            auto r_child = node_to_be_deleted->peekChild(1);
+
+            // a black node is missing at the root of the tree of copies
+            bool done = true;
+
+            if (!l_child || !r_child) {
+                // the only child of a node is red, and a red
+                // node has no single child, recolor the child
+                if (l_child || r_child) {
+                    auto child = node_to_be_deleted->getChild(l_child ? 0 : 1);
+                    child->rwRef()->red = false;
+                    conn.setRoot(child);
+                } else {
+                    done = node_to_be_deleted_values->red;
+                    conn.setRoot(nullptr);
+                }
+            } else {
+                // replace with the smallest of the right subtree
+                NodeStack<SafeRBNode, 10000> del_stack;
+
+                auto smallest = node_to_be_deleted->getChild(1);
+
+                while (smallest->peekChild(0)) {
+                    del_stack.push(smallest);
+                    smallest = smallest->getChild(0);
+                }
+
+                auto smallest_ref = smallest->rwRef();
+
+                node_to_be_deleted_values->key = smallest_ref->key;
+                node_to_be_deleted_values->value = smallest_ref->value;
+
+                // unlink the smallest, its only possible child is red
+                auto parent_of_smallest = del_stack.Empty() ? node_to_be_deleted : del_stack.pop();
+                int dir = parent_of_smallest == node_to_be_deleted ? 1 : 0;
+
+                if (smallest->peekChild(1)) {
+                    auto child = smallest->getChild(1);
+                    child->rwRef()->red = false;
+                    parent_of_smallest->setChild(dir, child);
+                } else {
+                    parent_of_smallest->setChild(dir, nullptr);
+                    done = smallest_ref->red;
+                }
+
+                // fix going up to the node to be deleted,
+                // reconnecting the subtrees that were rotated
+                auto subtree = done ? parent_of_smallest : fix_black_height(parent_of_smallest, dir, done);
+
+                while (parent_of_smallest != node_to_be_deleted) {
+                    parent_of_smallest = del_stack.Empty() ? node_to_be_deleted : del_stack.pop();
+                    dir = parent_of_smallest == node_to_be_deleted ? 1 : 0;
+
+                    parent_of_smallest->setChild(dir, subtree);
+                    subtree = done ? parent_of_smallest : fix_black_height(parent_of_smallest, dir, done);
+                }
+
+                conn.setRoot(subtree);
+            }
+
+            // continue up the path, k still leads to the
+            // tree of copies as it was in its range
+            while (!done) {
+                auto parent = conn.pop_path();
+
+                // the whole tree lost a black node
+                if (!parent) {
+                    break;
+                }
+
+                conn.setRoot(fix_black_height(parent, parent->rwRef()->nextChild(k), done));
+            }
+        }
+
+        // the insert operation
+        bool insert_impl(const int k, ValueType val, int t_id) {
+            (void)t_id;
+
+            TM_SAFE_OPERATION_START(30) {
+                auto conn_point_snapshot = find_conn_point<TreeNode>(k,root_of(&root));
+
+                if (conn_point_snapshot.found()) {
+                    return false;
+                }
+
+                ConnPoint<TreeNode> conn(conn_point_snapshot);
+
+                insert_step(conn, k, val);
+            } TM_SAFE_OPERATION_END
+
+            return true;
+        }
+
+        // insert or replace the value,
+        // returns true if a new node was inserted
+        bool upsert_impl(const int k, ValueType val, int t_id) {
+            (void)t_id;
+
+            bool inserted = false;
+
+            TM_SAFE_OPERATION_START(30) {
+                auto conn_point_snapshot = find_conn_point<TreeNode>(k,root_of(&root));
+
+                inserted = !conn_point_snapshot.found();
+
+                ConnPoint<TreeNode> conn(conn_point_snapshot);
+
+                if (inserted) {
+                    insert_step(conn, k, val);
+                } else {
+                    // the structure does not change,
+                    // only the node is copied
+                    conn.getRoot()->rwRef()->value = val;
+                }
+            } TM_SAFE_OPERATION_END
+
+            return inserted;
+        }
+
+        bool remove_impl(const int k, const int t_id) {
+            (void)t_id;
+
+            TM_SAFE_OPERATION_START(30) {
+                auto conn_point_snapshot = find_conn_point<TreeNode>(k,root_of(&root));
+
+                if (!conn_point_snapshot.found()) {
+                    return false;
+                }
+
+                ConnPoint<TreeNode> conn(conn_point_snapshot);
+
+                remove_step(conn, k);
+            } TM_SAFE_OPERATION_END
+
+            return true;
+        }
+
+
+    public:
+
+    RBTree(TreeNode* root, TSX::SpinLock &lock): root(root), _lock(lock) {
+        #ifdef USER_NODE_POOL
+            ConnPoint<TreeNode>::init_node_pool();
+        #endif
+
+        for (int i = 0; i < THREAD_AMOUNT_MAX; i++) {
+            stats[i].reset();
+        }
+    }
+
+    ~RBTree() {
+        #ifndef USER_NODE_POOL
+            rec_delete(root);
+        #endif
+
+        #ifdef USER_NODE_POOL
+            ConnPoint<TreeNode>::reset_node_pool();
+        #endif
+    }
+
+    bool insert(const int k, ValueType val, int t_id) {
+        return insert_impl(k, val, t_id);
+    }
+
+    // insert the key or replace its value if it exists,
+    // returns true if the key was inserted
+    bool upsert(const int k, ValueType val, int t_id) {
+        return upsert_impl(k, val, t_id);
+    }
+
+    // remove key value pair with key k
+    bool remove(int k, int t_id) {
+        return remove_impl(k, t_id);
+    }
+
+    Result<ValueType> lookup(int desired_key) {
+        auto node = find<TreeNode>(*root_of(&root),desired_key);
+
+        auto found = node != nullptr;
+
+        return {found, found ? node->getValue(): ValueType() };
+    }
+
+    int size() {
+        return count_nodes(root);
+    }
+
+    TreeNode* getRoot() {
+        return root;
+    }
+
+
+    /* VALIDATORS */
+
+    std::size_t key_sum() {
+        return key_sum_helper(root);
+    }
+
+    bool isSorted() {
+        if (!root) {
+            return true;
+        }
+
+        return isBstHelper(root,std::numeric_limits<int>::min(),std::numeric_limits<int>::max());
+    }
+
+    // black root, no red node with a red child and
+    // the same amount of black nodes on every path
+    bool isBalanced() {
+        return !TreeNode::is_red(root) && blackHeight(root) != -1;
+    }
+
+    /* END OF VALIDATORS */
+
+
+    /* HELPERS */
+
+    void print() {
+        print_contents(root);
+        std::cout << std::endl;
+        std::cout << "Longest Branch is: " << longest_branch(root) << std::endl;
+    }
+
+    void longest_branch() {
+        std::cout << "Longest branch is: " << longest_branch(root) << std::endl;
+    }
+
+
+    void average_branch() {
+        std::cout << "Average branch is: " << averageBranchLength(root) << std::endl;
+    }
+
+    void stat_report(int n_threads) {
+        TSX::TSXStats t_stats;
+        for (int i = 0; i < n_threads; i++) {
+            t_stats += stats[i];
+        }
+        std::cout << std::endl << std::endl;
+        t_stats.print_stats();
+        std::cout << std::endl << std::endl;
+    }
+
+
+    void lite_stat(int n_threads, long long n_ops = -1) {
+        TSX::TSXStats total_stats;
+        for (int i = 0; i < n_threads; i++) {
+            total_stats += stats[i];
+        }
+
+        if (n_ops > 0) {
+            std::cout << std::endl;
+            std::cout << "ABORTS/OP: " << (total_stats.tx_aborts * 100.0)/(n_ops) << "%" << std::endl;
+        }
+        total_stats.print_lite_stats();
+    }
+
+    /* END OF HELPERS */
+};
+
+
+
+#endif
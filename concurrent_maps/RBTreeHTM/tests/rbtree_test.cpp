@@ -0,0 +1,283 @@
+#include <iostream>
+#include <array>
+#include <thread>
+#include <cstdlib>
+#include <random>
+#include <chrono>
+#include <atomic>
+
+#include "../include/rbtree.hpp"
+#include "../../../include/catch2/catch.hpp"
+#include "../../../include/TSXGuard.hpp"
+#include "../../../include/test_bench.hpp"
+
+
+using namespace SafeTree;
+
+#ifndef HACI3COMP
+const static int THREADS = std::thread::hardware_concurrency();
+#else
+const static int THREADS = 28;
+#endif
+
+constexpr static int OPERATION_MULTIPLIER = 10000;
+
+using TestBenchType = TestBench<RBTree<int>>;
+
+TSX::SpinLock& lock = TestBenchType::global_lock;
+
+TEST_CASE("RBTree Init Test","[init]") {
+    RBTree<int> someMap(nullptr, lock);
+    (void)someMap;
+}
+
+
+void insert(int i, RBTree<int>& map, int t_id) {
+    for (int j = i * OPERATION_MULTIPLIER; j < (i+1)*OPERATION_MULTIPLIER; j++) {
+         map.insert(j,1,t_id);
+    }
+}
+
+
+void even_remove(RBTree<int>& map, int i) {
+    for (int j = i * OPERATION_MULTIPLIER; j < (i+1)*OPERATION_MULTIPLIER; j++) {
+        if (j % 2 == 0) {
+            map.remove(j,i);
+        }
+    }
+}
+
+
+TEST_CASE("RBTree Insert Test","[insert]") {
+    std::cout << "SINGLE THREADED INSERT" << std::endl;
+    RBTree<int> someMap(nullptr, lock);
+
+    SECTION("empty insert") {
+        REQUIRE(someMap.insert(1,2,0));
+        REQUIRE(someMap.lookup(1).found);
+        REQUIRE(someMap.lookup(1).val == 2);
+        REQUIRE(!someMap.insert(1,3,0));
+        REQUIRE(!someMap.getRoot()->isRed());
+
+        SECTION("upsert") {
+            REQUIRE(!someMap.upsert(1,3,0));
+            REQUIRE(someMap.lookup(1).val == 3);
+            REQUIRE(someMap.upsert(2,4,0));
+            REQUIRE(someMap.lookup(2).val == 4);
+            REQUIRE(someMap.isBalanced());
+        }
+
+        SECTION("ascending inserts") {
+            // every insert at the rightmost leaf
+            for (int i = 2; i < THREADS*OPERATION_MULTIPLIER; i++) {
+                REQUIRE(someMap.insert(i,1,0));
+                REQUIRE(someMap.lookup(i).found);
+            }
+
+            REQUIRE(someMap.isSorted());
+            REQUIRE(someMap.isBalanced());
+        }
+
+        SECTION("zig zag inserts") {
+            // alternate sides to cover the inner child rotations
+            for (int i = 1; i < 1000; i++) {
+                REQUIRE(someMap.insert(i % 2 ? -i : i + 1,1,0));
+                REQUIRE(someMap.isBalanced());
+            }
+
+            REQUIRE(someMap.size() == 1000);
+            REQUIRE(someMap.isSorted());
+        }
+
+        SECTION("random inserts") {
+            std::mt19937 gen(1);
+            std::uniform_int_distribution<int> dist(0, 100000);
+
+            for (int i = 0; i < 10000; i++) {
+                const int k = dist(gen);
+                someMap.insert(k,1,0);
+                REQUIRE(someMap.lookup(k).found);
+            }
+
+            REQUIRE(someMap.isSorted());
+            REQUIRE(someMap.isBalanced());
+        }
+    }
+}
+
+
+TEST_CASE("RBTree Multithreaded Insert Test","[mt_insert]") {
+    std::cout << "MULTITHREADED INSERT" << std::endl;
+
+    RBTree<int> someMap(nullptr,lock);
+    std::thread threads[THREADS];
+
+    for (int i = 0; i < THREADS; i++) {
+        threads[i] = std::thread(insert, i, std::ref(someMap), i);
+    }
+
+    for (int i = 0; i < THREADS; i++) {
+        threads[i].join();
+    }
+
+    for (int i = 0; i < THREADS*OPERATION_MULTIPLIER; i++) {
+        if (!someMap.lookup(i).found) {
+            std::cout << "NOT " << i << std::endl;
+            REQUIRE(someMap.lookup(i).found);
+        }
+    }
+
+    REQUIRE(someMap.isSorted());
+    REQUIRE(someMap.isBalanced());
+}
+
+
+TEST_CASE("RBTree Remove Test","[remove]") {
+    SECTION("INTRO") {
+        std::cout << "SINGLE THREADED REMOVE" << std::endl;
+    }
+
+    RBTree<int> someMap(nullptr, lock);
+
+    SECTION("root remove") {
+        someMap.insert(1,1,0);
+
+        REQUIRE(someMap.lookup(1).found);
+        REQUIRE(someMap.remove(1,0));
+        REQUIRE(!someMap.remove(1,0));
+        REQUIRE(!someMap.lookup(1).found);
+        REQUIRE(someMap.getRoot() == nullptr);
+    }
+
+    SECTION("remove by replacing with the smallest of the right subtree") {
+        for (int k : {6, 3, 9, 7, 10, 1, 4, 8}) {
+            someMap.insert(k,k,0);
+        }
+
+        REQUIRE(someMap.remove(6,0));
+
+        REQUIRE(!someMap.lookup(6).found);
+
+        for (int k : {3, 9, 7, 10, 1, 4, 8}) {
+            REQUIRE(someMap.lookup(k).val == k);
+        }
+
+        REQUIRE(someMap.isSorted());
+        REQUIRE(someMap.isBalanced());
+    }
+
+    SECTION("batch remove") {
+        TestBenchType::binary_insert_map(0, THREADS*OPERATION_MULTIPLIER - 1,someMap);
+
+        for (int i = 0; i < THREADS*OPERATION_MULTIPLIER; i++) {
+            if ((i % 2) == 0) {
+                REQUIRE(someMap.remove(i,0));
+                REQUIRE(!someMap.lookup(i).found);
+            } else {
+                REQUIRE(someMap.lookup(i).found);
+            }
+        }
+
+        REQUIRE(someMap.isSorted());
+        REQUIRE(someMap.isBalanced());
+    }
+
+    SECTION("random removes") {
+        std::mt19937 gen(1);
+        std::uniform_int_distribution<int> dist(0, 2000);
+
+        for (int i = 0; i < 1000; i++) {
+            someMap.insert(dist(gen),1,0);
+        }
+
+        // every case of the black height fix
+        for (int i = 0; i < 20000; i++) {
+            const int k = dist(gen);
+
+            if (i % 2) {
+                someMap.insert(k,1,0);
+            } else {
+                someMap.remove(k,0);
+                REQUIRE(!someMap.lookup(k).found);
+            }
+
+            REQUIRE(someMap.isBalanced());
+        }
+
+        REQUIRE(someMap.isSorted());
+    }
+}
+
+
+TEST_CASE("RBTree MULTITHREADED Remove Test","[remove_mt]") {
+    SECTION("intro") {
+        std::cout << "MULTITHREADED Remove Test" << std::endl;
+    }
+
+
+    std::thread threads[THREADS];
+
+
+    SECTION("mt remove") {
+        for (int j = 0; j < 10; j++) {
+            RBTree<int> someMap(nullptr, lock);
+            TestBenchType::binary_insert_map(0, THREADS*OPERATION_MULTIPLIER - 1,someMap);
+
+            for (int i = 0; i < THREADS; i++) {
+                threads[i] = std::thread(even_remove, std::ref(someMap), i);
+            }
+
+            for (int i = 0; i < THREADS; i++) {
+                threads[i].join();
+            }
+
+            for (int i = 0; i < THREADS*OPERATION_MULTIPLIER; i++) {
+                if (i % 2 == 0) {
+                    REQUIRE(!someMap.lookup(i).found);
+                } else {
+                    if (!someMap.lookup(i).found) {
+                        std::cerr << "MISSING " << i << std::endl;
+                        REQUIRE(someMap.lookup(i).found);
+                    }
+                }
+            }
+
+            REQUIRE(someMap.isSorted());
+            REQUIRE(someMap.isBalanced());
+        }
+
+    }
+}
+
+
+TEST_CASE("THROUGHPUT TESTS","[tp]") {
+    const int OPERATION_MULTIPLIERS[] = {1000000,10000,1000};
+
+    for (int i = 0; i < 3; i++) {
+        std::cout << "Start of tests for tree size: " << OPERATION_MULTIPLIERS[i] << std::endl;
+        const std::size_t RANGE_OF_KEYS = 2 * OPERATION_MULTIPLIERS[i]; // RANGE IS 1 TO RANGE_OF_KEYS
+
+        std::vector<int> threads_to_use = {1,2,4,7,14,20,28};
+        // RANDOM OPS
+        TestBenchType::experiment exp1(33,33,34);
+        TestBenchType::test(exp1,THREADS,RANGE_OF_KEYS,threads_to_use);
+
+        // 10 - 10 -80
+        TestBenchType::experiment exp2(10,10,80);
+        TestBenchType::test(exp2,THREADS,RANGE_OF_KEYS,threads_to_use);
+
+        // 100% LOOKUPS
+        TestBenchType::experiment exp3(0,0,100);
+        TestBenchType::test(exp3,THREADS,RANGE_OF_KEYS, threads_to_use);
+
+
+        // 50-50 UPDATES
+        TestBenchType::experiment exp4(50,50,0);
+        TestBenchType::test(exp4,THREADS,RANGE_OF_KEYS,threads_to_use);
+
+        // 25-25 UPDATES, 50 LOOKUPS
+        TestBenchType::experiment exp5(25,25,50);
+        TestBenchType::test(exp5,THREADS,RANGE_OF_KEYS,threads_to_use);
+
+    }
+}
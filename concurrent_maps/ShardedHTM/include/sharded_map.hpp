@@ -0,0 +1,450 @@
+#ifndef INCLUDE_SHARDED_MAP_HPP
+#define INCLUDE_SHARDED_MAP_HPP
+
+/*  A map made of independent trees, the shards, each with its own root
+    and fallback lock. Every key belongs to exactly one shard, so updates
+    of different shards never conflict: neither at the roots, nor when
+    one of them falls back to its lock.
+
+    TreeT is any of the maps, with a (root, lock) constructor and the
+    insert, upsert, remove and lookup operations. The ordered iteration
+    and the range partitioning also need lower_bound and upper_bound.
+
+    Partitioning:
+        1.     HASH: the shard of a key is given by a hash of it, for point
+                operations. Iterating in order merges the shards.
+        2.     RANGE: every shard has a range of keys, given by boundaries.
+                Iterating in order visits the shards one after the other.
+                rebalanceShards() moves the boundaries when the shards are
+                skewed, stopping the other operations while keys move.
+
+    The node pools are per thread and kind of node, so the shards of
+    a map share the pool of each thread.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "../../../include/TSXGuard.hpp"
+
+
+enum class Partitioning {
+    HASH,
+    RANGE
+};
+
+template <class TreeT>
+class ShardedMap {
+    private:
+        using ResultType = decltype(std::declval<TreeT&>().lookup(0));
+        using ValueType = decltype(std::declval<ResultType&>().val);
+
+        static constexpr int DEFAULT_SHARDS = 16;
+
+        // slots of the threads running operations,
+        // threads with the same slot share its counter
+        static constexpr int OPERATION_SLOTS = 128;
+
+        // a tree and the lock its operations fall back to
+        struct Shard {
+            TSX::SpinLock lock;
+            TreeT tree;
+
+            Shard(): tree(nullptr, lock) {}
+        };
+
+        std::vector<std::unique_ptr<Shard>> shards_;
+        const Partitioning partitioning_;
+
+        // RANGE: shard i has the keys in [bounds_[i-1], bounds_[i]),
+        // only changed while the operations are stopped
+        std::vector<int> bounds_;
+
+        // RANGE: operations running per slot, on a cache line
+        // of their own so that the operations don't share one
+        struct alignas(64) OperationCounter {
+            std::atomic<int> count;
+        };
+        OperationCounter running_[OPERATION_SLOTS];
+
+        // set while the keys move between the shards
+        std::atomic<bool> migrating_;
+
+        static int thread_slot() {
+            static std::atomic<int> next_slot(0);
+            thread_local int slot = next_slot++ % OPERATION_SLOTS;
+
+            return slot;
+        }
+
+        // RANGE: holds off a migration while an operation
+        // runs, waits for it to end before starting
+        class OperationGuard {
+            private:
+                ShardedMap& map_;
+                int slot_;
+
+            public:
+                explicit OperationGuard(ShardedMap& map): map_(map), slot_(-1) {
+                    if (map_.partitioning_ != Partitioning::RANGE) {
+                        return;
+                    }
+
+                    slot_ = thread_slot();
+
+                    for (;;) {
+                        map_.running_[slot_].count.fetch_add(1);
+
+                        if (!map_.migrating_.load()) {
+                            break;
+                        }
+
+                        map_.running_[slot_].count.fetch_sub(1);
+
+                        while (map_.migrating_.load(std::memory_order_relaxed)) {
+                            std::this_thread::yield();
+                        }
+                    }
+                }
+
+                OperationGuard(const OperationGuard&) = delete;
+                OperationGuard& operator=(const OperationGuard&) = delete;
+
+                ~OperationGuard() {
+                    if (slot_ != -1) {
+                        map_.running_[slot_].count.fetch_sub(1, std::memory_order_release);
+                    }
+                }
+        };
+
+        // spread consecutive keys over the shards
+        static unsigned hash(const int k) {
+            return (static_cast<unsigned>(k) * 2654435761u) >> 8;
+        }
+
+        int shard_of(const int k) const {
+            if (partitioning_ == Partitioning::HASH) {
+                return hash(k) % shards_.size();
+            }
+
+            return std::upper_bound(bounds_.begin(), bounds_.end(), k) - bounds_.begin();
+        }
+
+        // run fn with the tree of the shard,
+        // falling back to the lock of the shard
+        template <class F>
+        auto on_shard(const int shard, F fn) -> decltype(fn(std::declval<TreeT&>())) {
+            auto& s = *shards_[shard];
+            TSX::FallbackLockScope scope(s.lock);
+
+            return fn(s.tree);
+        }
+
+        template <class F>
+        auto on_key(const int k, F fn) -> decltype(fn(std::declval<TreeT&>())) {
+            OperationGuard guard(*this);
+
+            return on_shard(shard_of(k), fn);
+        }
+
+        // wait for the running operations to end,
+        // and hold off new ones, one migration at a time
+        void stop_operations() {
+            while (migrating_.exchange(true)) {
+                std::this_thread::yield();
+            }
+
+            for (int i = 0; i < OPERATION_SLOTS; i++) {
+                while (running_[i].count.load()) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        void resume_operations() {
+            migrating_.store(false);
+        }
+
+        // the entries of a shard in order, while no other
+        // operation runs
+        std::vector<std::pair<int, ValueType>> shard_entries(const int shard) {
+            std::vector<std::pair<int, ValueType>> entries;
+
+            on_shard(shard, [&entries](TreeT& tree) {
+                for (auto e = tree.lower_bound(std::numeric_limits<int>::min()); e.found; e = tree.upper_bound(e.key)) {
+                    entries.push_back(std::make_pair(e.key, e.val));
+                }
+            });
+
+            return entries;
+        }
+
+        // RANGE: bounds splitting [min_key, max_key] evenly
+        void split_evenly(const int min_key, const int max_key) {
+            const int n = shards_.size();
+            const long long width = (static_cast<long long>(max_key) - min_key + 1) / n;
+
+            for (int i = 1; i < n; i++) {
+                bounds_.push_back(static_cast<int>(min_key + i * width));
+            }
+        }
+
+    public:
+        // the lock is not used, every shard has its own, it is
+        // there for the same constructor as the trees. RANGE
+        // partitioning splits [min_key, max_key] evenly at first.
+        ShardedMap(std::nullptr_t, TSX::SpinLock& lock, const int n_shards = DEFAULT_SHARDS,
+                   const Partitioning partitioning = Partitioning::HASH,
+                   const int min_key = 0, const int max_key = std::numeric_limits<int>::max()):
+        partitioning_(partitioning), migrating_(false) {
+            (void)lock;
+
+            for (int i = 0; i < n_shards; i++) {
+                shards_.push_back(std::unique_ptr<Shard>(new Shard()));
+            }
+
+            for (int i = 0; i < OPERATION_SLOTS; i++) {
+                running_[i].count = 0;
+            }
+
+            if (partitioning_ == Partitioning::RANGE) {
+                split_evenly(min_key, max_key);
+            }
+        }
+
+        bool insert(const int k, ValueType val, int t_id) {
+            return on_key(k, [&](TreeT& tree) { return tree.insert(k, val, t_id); });
+        }
+
+        // insert the key or replace its value if it exists,
+        // returns true if the key was inserted
+        bool upsert(const int k, ValueType val, int t_id) {
+            return on_key(k, [&](TreeT& tree) { return tree.upsert(k, val, t_id); });
+        }
+
+        bool remove(const int k, int t_id) {
+            return on_key(k, [&](TreeT& tree) { return tree.remove(k, t_id); });
+        }
+
+        ResultType lookup(const int k) {
+            return on_key(k, [&](TreeT& tree) { return tree.lookup(k); });
+        }
+
+        // call fn(key, value) for the keys in [lo, hi] in order. Every
+        // step reads the shards again, so changes made meanwhile may or
+        // may not be seen, but keys present throughout are never missed.
+        template <class F>
+        void for_each(const int lo, const int hi, F fn) {
+            if (lo > hi) {
+                return;
+            }
+
+            if (partitioning_ == Partitioning::RANGE) {
+                // visit the shards in order, starting from the shard
+                // of the next key each time, as boundaries can move
+                long long next = lo;
+
+                while (next <= hi) {
+                    OperationGuard guard(*this);
+
+                    const int shard = shard_of(static_cast<int>(next));
+                    auto e = on_shard(shard, [next](TreeT& tree) { return tree.lower_bound(static_cast<int>(next)); });
+
+                    const bool last_shard = shard == static_cast<int>(bounds_.size());
+                    const long long shard_end = last_shard ? static_cast<long long>(hi) + 1 : bounds_[shard];
+
+                    if (e.found && e.key < shard_end) {
+                        if (e.key > hi) {
+                            return;
+                        }
+
+                        fn(e.key, e.val);
+                        next = static_cast<long long>(e.key) + 1;
+                    } else {
+                        next = shard_end;
+                    }
+                }
+
+                return;
+            }
+
+            // HASH: merge the shards, smallest key first
+            using Head = std::pair<int, int>;
+            std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+            std::vector<decltype(std::declval<TreeT&>().lower_bound(0))> entries;
+
+            for (std::size_t i = 0; i < shards_.size(); i++) {
+                entries.push_back(on_shard(i, [lo](TreeT& tree) { return tree.lower_bound(lo); }));
+
+                if (entries[i].found && entries[i].key <= hi) {
+                    heads.push(std::make_pair(entries[i].key, static_cast<int>(i)));
+                }
+            }
+
+            while (!heads.empty()) {
+                const int shard = heads.top().second;
+                heads.pop();
+
+                auto& e = entries[shard];
+                fn(e.key, e.val);
+
+                const int key = e.key;
+                e = on_shard(shard, [key](TreeT& tree) { return tree.upper_bound(key); });
+
+                if (e.found && e.key <= hi) {
+                    heads.push(std::make_pair(e.key, shard));
+                }
+            }
+        }
+
+        // RANGE: move the boundaries so that the shards have about
+        // the same amount of keys, and move the keys to their new
+        // shards. The other operations wait until it is done.
+        // Returns the amount of keys moved.
+        int rebalanceShards(const int t_id) {
+            if (partitioning_ != Partitioning::RANGE) {
+                return 0;
+            }
+
+            stop_operations();
+
+            const int n = shards_.size();
+
+            // the shards are in order, so are their keys
+            std::vector<std::vector<std::pair<int, ValueType>>> entries;
+            std::size_t total = 0;
+
+            for (int i = 0; i < n; i++) {
+                entries.push_back(shard_entries(i));
+                total += entries[i].size();
+            }
+
+            int moved = 0;
+
+            if (total >= static_cast<std::size_t>(n)) {
+                // the key at every n-th of the keys starts a shard
+                std::vector<int> new_bounds;
+                std::size_t shard = 0;
+                std::size_t index = 0;
+
+                for (int i = 1; i < n; i++) {
+                    std::size_t target = i * total / n;
+
+                    while (index + entries[shard].size() <= target) {
+                        index += entries[shard].size();
+                        ++shard;
+                    }
+
+                    new_bounds.push_back(entries[shard][target - index].first);
+                }
+
+                bounds_ = new_bounds;
+
+                for (int i = 0; i < n; i++) {
+                    for (const auto& entry : entries[i]) {
+                        const int to = shard_of(entry.first);
+
+                        if (to != i) {
+                            on_shard(i, [&](TreeT& tree) { tree.remove(entry.first, t_id); });
+                            on_shard(to, [&](TreeT& tree) { tree.insert(entry.first, entry.second, t_id); });
+                            ++moved;
+                        }
+                    }
+                }
+            }
+
+            resume_operations();
+
+            return moved;
+        }
+
+        Partitioning partitioning() const {
+            return partitioning_;
+        }
+
+        int shardCount() const {
+            return shards_.size();
+        }
+
+        // amount of keys of a shard, for validation
+        int shardSize(const int shard) {
+            return on_shard(shard, [](TreeT& tree) { return tree.size(); });
+        }
+
+        TreeT& shard(const int shard) {
+            return shards_[shard]->tree;
+        }
+
+        int size() {
+            int total = 0;
+
+            for (int i = 0; i < shardCount(); i++) {
+                total += shardSize(i);
+            }
+
+            return total;
+        }
+
+        /* VALIDATORS */
+
+        std::size_t key_sum() {
+            std::size_t total = 0;
+
+            for (int i = 0; i < shardCount(); i++) {
+                total += on_shard(i, [](TreeT& tree) { return tree.key_sum(); });
+            }
+
+            return total;
+        }
+
+        // every shard is sorted and only has its own keys
+        bool isSorted() {
+            for (int i = 0; i < shardCount(); i++) {
+                if (!shards_[i]->tree.isSorted()) {
+                    return false;
+                }
+
+                for (const auto& entry : shard_entries(i)) {
+                    if (shard_of(entry.first) != i) {
+                        return false;
+                    }
+                }
+            }
+
+            return true;
+        }
+
+        /* END OF VALIDATORS */
+
+        // of every shard
+        void longest_branch() {
+            for (auto& s : shards_) {
+                s->tree.longest_branch();
+            }
+        }
+
+        void average_branch() {
+            for (auto& s : shards_) {
+                s->tree.average_branch();
+            }
+        }
+
+        // the statistics are kept per thread for all the trees
+        void stat_report(int n_threads) {
+            shards_[0]->tree.stat_report(n_threads);
+        }
+
+        void lite_stat(int n_threads, long long n_ops = -1) {
+            shards_[0]->tree.lite_stat(n_threads, n_ops);
+        }
+};
+
+
+#endif
@@ -0,0 +1,284 @@
+#include <iostream>
+#include <array>
+#include <thread>
+#include <cstdlib>
+#include <random>
+#include <chrono>
+#include <atomic>
+
+#include "../../AVLHTM/include/avl.hpp"
+#include "../include/sharded_map.hpp"
+#include "../../../include/catch2/catch.hpp"
+#include "../../../include/TSXGuard.hpp"
+#include "../../../include/test_bench.hpp"
+
+
+using namespace SafeTree;
+
+#ifndef HACI3COMP
+const static int THREADS = std::thread::hardware_concurrency();
+#else
+const static int THREADS = 28;
+#endif
+
+constexpr static int OPERATION_MULTIPLIER = 10000;
+
+using ShardedAVL = ShardedMap<AVLTree<int>>;
+using TestBenchType = TestBench<ShardedAVL>;
+
+TSX::SpinLock& lock = TestBenchType::global_lock;
+
+TEST_CASE("ShardedMap Init Test","[init]") {
+    ShardedAVL someMap(nullptr, lock);
+    REQUIRE(someMap.shardCount() == 16);
+    REQUIRE(someMap.partitioning() == Partitioning::HASH);
+    REQUIRE(someMap.size() == 0);
+}
+
+
+// the shards share the node pool with the other trees of their type
+TEST_CASE("ShardedMap Shared Node Pool Test","[init]") {
+    AVLTree<int> someTree(nullptr, lock);
+
+    for (int i = 0; i < 1000; i++) {
+        REQUIRE(someTree.insert(i,i,0));
+    }
+
+    {
+        ShardedAVL someMap(nullptr, lock);
+
+        for (int i = 0; i < 1000; i++) {
+            REQUIRE(someMap.insert(i,i,0));
+        }
+    }
+
+    for (int i = 0; i < 1000; i++) {
+        REQUIRE(someTree.lookup(i).val == i);
+    }
+
+    REQUIRE(someTree.insert(1000,1000,0));
+    REQUIRE(someTree.size() == 1001);
+    REQUIRE(someTree.isBalanced());
+}
+
+
+void insert(int i, ShardedAVL& map, int t_id) {
+    for (int j = i * OPERATION_MULTIPLIER; j < (i+1)*OPERATION_MULTIPLIER; j++) {
+         map.insert(j,j,t_id);
+    }
+}
+
+
+// the keys seen by for_each, checking that they are in order
+std::vector<int> keys_in_order(ShardedAVL& map, const int lo, const int hi) {
+    std::vector<int> keys;
+
+    map.for_each(lo, hi, [&keys](int k, int v) {
+        REQUIRE(v == k);
+        REQUIRE((keys.empty() || keys.back() < k));
+        keys.push_back(k);
+    });
+
+    return keys;
+}
+
+
+TEST_CASE("ShardedMap Hash Partitioning Test","[hash]") {
+    ShardedAVL someMap(nullptr, lock, 8);
+
+    for (int i = 0; i < 1000; i++) {
+        REQUIRE(someMap.insert(i,i,0));
+    }
+
+    REQUIRE(!someMap.insert(10,10,0));
+
+    SECTION("keys spread over the shards") {
+        for (int i = 0; i < someMap.shardCount(); i++) {
+            REQUIRE(someMap.shardSize(i) > 1000 / someMap.shardCount() / 2);
+        }
+
+        REQUIRE(someMap.size() == 1000);
+        REQUIRE(someMap.key_sum() == 999 * 1000 / 2);
+        REQUIRE(someMap.isSorted());
+    }
+
+    SECTION("updates") {
+        REQUIRE(!someMap.upsert(10,11,0));
+        REQUIRE(someMap.lookup(10).val == 11);
+        REQUIRE(someMap.upsert(-5,-5,0));
+
+        for (int i = 0; i < 1000; i += 2) {
+            REQUIRE(someMap.remove(i,0));
+        }
+
+        for (int i = 0; i < 1000; i++) {
+            REQUIRE(someMap.lookup(i).found == (i % 2 == 1));
+        }
+
+        REQUIRE(someMap.lookup(-5).found);
+        REQUIRE(someMap.size() == 501);
+    }
+
+    SECTION("ordered iteration merges the shards") {
+        auto keys = keys_in_order(someMap, 0, 999);
+        REQUIRE(keys.size() == 1000);
+
+        keys = keys_in_order(someMap, 100, 199);
+        REQUIRE(keys.size() == 100);
+        REQUIRE(keys.front() == 100);
+        REQUIRE(keys.back() == 199);
+
+        REQUIRE(keys_in_order(someMap, 2000, 3000).empty());
+    }
+}
+
+
+TEST_CASE("ShardedMap Range Partitioning Test","[range]") {
+    // shards of [0, 4000), [4000, 8000), ...
+    ShardedAVL someMap(nullptr, lock, 4, Partitioning::RANGE, 0, 15999);
+
+    SECTION("ordered iteration visits the shards in order") {
+        for (int i = 0; i < 16000; i += 7) {
+            REQUIRE(someMap.insert(i,i,0));
+        }
+
+        for (int i = 0; i < someMap.shardCount(); i++) {
+            REQUIRE(someMap.shardSize(i) > 0);
+        }
+
+        auto keys = keys_in_order(someMap, 0, 15999);
+        REQUIRE(keys.size() == static_cast<std::size_t>(someMap.size()));
+
+        // across the boundary of the first two shards
+        keys = keys_in_order(someMap, 3990, 4010);
+        REQUIRE(keys == std::vector<int>({3990, 3997, 4004}));
+
+        // keys out of the initial range go to the first and last shards
+        const std::size_t before = someMap.size();
+        REQUIRE(someMap.insert(-1,-1,0));
+        REQUIRE(someMap.insert(20000,20000,0));
+        REQUIRE(someMap.lookup(-1).found);
+        REQUIRE(someMap.lookup(20000).found);
+        REQUIRE(someMap.shardSize(0) + someMap.shardSize(3) == static_cast<int>(before / 2 + 2));
+        REQUIRE(keys_in_order(someMap, -10, 30000).size() == before + 2);
+        REQUIRE(someMap.isSorted());
+    }
+
+    SECTION("rebalancing moves the boundaries") {
+        // all in the first shard
+        for (int i = 0; i < 1000; i++) {
+            REQUIRE(someMap.insert(i,i,0));
+        }
+
+        REQUIRE(someMap.shardSize(0) == 1000);
+
+        REQUIRE(someMap.rebalanceShards(0) == 750);
+
+        for (int i = 0; i < someMap.shardCount(); i++) {
+            REQUIRE(someMap.shardSize(i) == 250);
+        }
+
+        for (int i = 0; i < 1000; i++) {
+            REQUIRE(someMap.lookup(i).val == i);
+        }
+
+        REQUIRE(someMap.isSorted());
+        REQUIRE(keys_in_order(someMap, 0, 999).size() == 1000);
+
+        // balanced already
+        REQUIRE(someMap.rebalanceShards(0) == 0);
+    }
+
+    SECTION("too few keys to rebalance") {
+        REQUIRE(someMap.insert(1,1,0));
+        REQUIRE(someMap.rebalanceShards(0) == 0);
+        REQUIRE(someMap.lookup(1).found);
+    }
+}
+
+
+TEST_CASE("ShardedMap Multithreaded Insert Test","[mt_insert]") {
+    std::cout << "MULTITHREADED INSERT" << std::endl;
+
+    ShardedAVL someMap(nullptr,lock);
+    std::thread threads[THREADS];
+
+    for (int i = 0; i < THREADS; i++) {
+        threads[i] = std::thread(insert, i, std::ref(someMap), i);
+    }
+
+    for (int i = 0; i < THREADS; i++) {
+        threads[i].join();
+    }
+
+    for (int i = 0; i < THREADS*OPERATION_MULTIPLIER; i++) {
+        if (!someMap.lookup(i).found) {
+            std::cout << "NOT " << i << std::endl;
+            REQUIRE(someMap.lookup(i).found);
+        }
+    }
+
+    REQUIRE(someMap.size() == THREADS*OPERATION_MULTIPLIER);
+    REQUIRE(someMap.isSorted());
+}
+
+
+TEST_CASE("ShardedMap Rebalance With Updates Test","[mt_rebalance]") {
+    std::cout << "REBALANCE WITH UPDATES" << std::endl;
+
+    // the inserts fill the first shards only
+    ShardedAVL someMap(nullptr, lock, 8, Partitioning::RANGE, 0, 8 * THREADS * OPERATION_MULTIPLIER);
+
+    std::atomic<bool> done(false);
+    std::thread threads[THREADS];
+
+    for (int i = 0; i < THREADS; i++) {
+        threads[i] = std::thread(insert, i, std::ref(someMap), i);
+    }
+
+    std::thread rebalancer([&someMap, &done]() {
+        while (!done) {
+            someMap.rebalanceShards(THREADS);
+        }
+    });
+
+    for (int i = 0; i < THREADS; i++) {
+        threads[i].join();
+    }
+
+    done = true;
+    rebalancer.join();
+
+    for (int i = 0; i < THREADS*OPERATION_MULTIPLIER; i++) {
+        REQUIRE(someMap.lookup(i).val == i);
+    }
+
+    REQUIRE(someMap.size() == THREADS*OPERATION_MULTIPLIER);
+    REQUIRE(someMap.isSorted());
+}
+
+
+TEST_CASE("THROUGHPUT TESTS","[tp]") {
+    const std::size_t RANGE_OF_KEYS = 2000000;
+    std::vector<int> threads_to_use = {1,2,4,7,14,20,28};
+
+    TestBenchType::experiment exp1(50,50,0);
+    TestBenchType::experiment exp2(25,25,50);
+
+    std::cout << "SHARDED AVL TREE" << std::endl;
+
+    // 50-50 UPDATES
+    TestBenchType::test(exp1,THREADS,RANGE_OF_KEYS,threads_to_use);
+
+    // 25-25 UPDATES, 50 LOOKUPS
+    TestBenchType::test(exp2,THREADS,RANGE_OF_KEYS,threads_to_use);
+
+    std::cout << "SINGLE AVL TREE" << std::endl;
+
+    using SingleTestBench = TestBench<AVLTree<int>>;
+    SingleTestBench::experiment single_exp1(50,50,0);
+    SingleTestBench::experiment single_exp2(25,25,50);
+
+    SingleTestBench::test(single_exp1,THREADS,RANGE_OF_KEYS,threads_to_use);
+    SingleTestBench::test(single_exp2,THREADS,RANGE_OF_KEYS,threads_to_use);
+}
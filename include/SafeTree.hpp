@@ -26,7 +26,8 @@
     // conflict detection mechanism
     #define GENERAL_TREE 1
 
-    // Set desired tree type
+    // Set desired tree type, the default of
+    // node types without a treeType() method
     #ifndef TREE_TYPE
         #define TREE_TYPE SEARCH_TREE
     #endif
@@ -39,10 +40,22 @@
     // memory pools for user defined nodes
     #define USER_MEM_POOL
 
+    // the pool of each thread holds up to USER_MEM_POOL_MAX_NODES
+    // nodes, but takes no more than USER_MEM_POOL_BYTES of memory,
+    // so that pools of large nodes fit
+    #define USER_MEM_POOL_MAX_NODES 50000000
+
+    #ifndef USER_MEM_POOL_BYTES
+        #define USER_MEM_POOL_BYTES (std::size_t(1) << 32)
+    #endif
+
     #define PREALLOC_VALIDATION_SET
 
     #define PATH_MAX_LEN 10000
 
+    // the most SafeNodes a ConnPoint can create
+    #define CONN_POINT_MAX_SAFE_NODES 100
+
     // all internal vectors and arrays are
     // static (decreases performance in my tests)
     //#define STATIC_VECTORS_AND_ARRAYS
@@ -73,6 +86,8 @@
 #include <new>
 #include <cassert>
 #include <algorithm>
+#include <atomic>
+#include <type_traits>
 
 
 
@@ -96,14 +111,33 @@ namespace SafeTree {
                 consider other factors like if it is a terminal node
         9.     int nextChild(KeyType target_key): return index of next child when looking for node with target_key
         10.     int nextChild(NodeType* target): return index of next child when looking for target node
+        Optionally, nodes whose values are changed in place (without a copy) provide:
+        11.     unsigned getVersion() const: changes on every in place write, see NodeVersion
+        Optionally, to be used together with nodes of the other tree type:
+        12.     static constexpr int treeType(): SEARCH_TREE or GENERAL_TREE, TREE_TYPE if missing
     */
 
     // internal use
     enum INSERT_POSITIONS {AT_ROOT = -1, UNDEFINED = -2};
 
 
+    // the tree type of a node type, given by its treeType()
+    // method or TREE_TYPE, so that search trees and general
+    // trees can be used in the same program
+    template <class NodeType>
+    constexpr auto tree_type_helper(int) -> decltype(NodeType::treeType()) {
+        return NodeType::treeType();
+    }
+
+    template <class NodeType>
+    constexpr int tree_type_helper(...) {
+        return TREE_TYPE;
+    }
+
+    template <class NodeType>
+    struct tree_type_of: std::integral_constant<int, tree_type_helper<NodeType>(0)> {};
+
 
-    #if TREE_TYPE == GENERAL_TREE
         template <class NodeType>
         struct ConnPointData;
 
@@ -146,15 +180,10 @@ namespace SafeTree {
                 // moveUp: move the tracker up
                 // n levels on the path it has followed
                 void moveUp(int n_levels = 1) {
-                    at_level_ = at_level_ >= n_levels ? at_level_ - n_levels: -1;
-
-                    for (int i = 0; at_level_ >= 0 && i < n_levels - 1; i++) {
-                        path_.pop();
+                    for (int i = 0; i < n_levels && !path_.Empty(); i++) {
+                        current_pos_ = path_.pop().node;
+                        --at_level_;
                     }
-
-                    if (!path_.Empty()) {
-                        current_pos_ =  path_.pop().node;
-                    }   
                 }
 
                 // set previous node in path followed
@@ -188,11 +217,97 @@ namespace SafeTree {
                     return conn_point_snapshot;
                 }
         };
-    #endif
 
 
     static constexpr unsigned char VALIDATION_FAILED = TSX::ABORT_VALIDATION_FAILURE;
 
+
+    // values small and simple enough to be written
+    // directly on a published node in a short transaction
+    static constexpr std::size_t IN_PLACE_MAX_VALUE_SIZE = 64;
+
+    template <class ValueType>
+    struct in_place_eligible: std::integral_constant<bool, 
+        std::is_trivially_copyable<ValueType>::value && sizeof(ValueType) <= IN_PLACE_MAX_VALUE_SIZE> {};
+
+
+    // NodeVersion: version of a node whose value is written in place.
+    // Works as a sequence lock, it is odd while a write is in progress.
+    // Writers have to be exclusive (in a transaction or holding the lock).
+    // Copies of the node are validated against the version, so a copy
+    // made before an in place write is never connected.
+    class NodeVersion {
+        private:
+            std::atomic<unsigned> version_;
+
+        public:
+            NodeVersion(): version_(0) {}
+
+            // a copy is a new node which
+            // no one is writing to
+            NodeVersion(const NodeVersion&): version_(0) {}
+
+            NodeVersion& operator=(const NodeVersion&) {
+                return *this;
+            }
+
+            unsigned load() const {
+                return version_.load(std::memory_order_acquire);
+            }
+
+            // wait for a write in progress and return
+            // the version to check the read against
+            unsigned read_begin() const {
+                unsigned version;
+                while ((version = load()) & 1) {
+                    _mm_pause();
+                }
+
+                return version;
+            }
+
+            // returns true if the value was written
+            // since read_begin and should be read again
+            bool read_retry(const unsigned version) const {
+                std::atomic_thread_fence(std::memory_order_acquire);
+                return version_.load(std::memory_order_relaxed) != version;
+            }
+
+            void write_begin() {
+                version_.store(version_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+            }
+
+            void write_end() {
+                version_.store(version_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            }
+    };
+
+
+    // version of a node, 0 for nodes without getVersion
+    template <class NodeType>
+    struct NodeVersionOf {
+        private:
+            template <class T>
+            static auto test(const T* node) -> decltype(node->getVersion(), std::true_type());
+
+            template <class T>
+            static std::false_type test(...);
+
+            static unsigned get(const NodeType* node, std::true_type) {
+                return node->getVersion();
+            }
+
+            static unsigned get(const NodeType*, std::false_type) {
+                return 0;
+            }
+
+        public:
+            static unsigned of(const NodeType* node) {
+                return get(node, decltype(test<NodeType>(nullptr))());
+            }
+    };
+
     #ifdef TM_EARLY_ABORT
         class ValidationAbortException: std::exception{};   
     #endif
@@ -218,6 +333,10 @@ namespace SafeTree {
             std::array<bool,NodeType::maxChildren()> modified_;
             std::array<NodeType*, NodeType::maxChildren()> children_pointers_snapshot_;
 
+            // version of the original when wrapped,
+            // the copy is made from this version
+            unsigned version_snapshot_;
+
             bool deleted_;
 
             SAFENODE_TYPE node_type_;
@@ -324,6 +443,9 @@ namespace SafeTree {
                 conn_point_.add_to_validation_set(this);
 
                 if (node_type_ == ORIG_TREE_NODE) {
+                    // read before the contents of the node
+                    version_snapshot_ = NodeVersionOf<NodeType>::of(original_);
+
                     for (int i = 0; i < NodeType::maxChildren(); i++) {
                         // keep backup of the original_ child pointers
                         const auto original_child = original_->getChild(i);
@@ -516,29 +638,37 @@ namespace SafeTree {
         friend class ConnPoint<T>;
         template <class NodeType>
         friend ConnPointData<NodeType> find_conn_point(typename NodeType::KeyType key, NodeType** root);
-        #if TREE_TYPE == GENERAL_TREE
-            friend class PathTracker<T>;
-        #endif
+        friend class PathTracker<T>;
 
         private:
             ConnectionPointer<T> con_ptr;    
             T* connection_point_;
-            #if TREE_TYPE == SEARCH_TREE
-                bool found_;
-            #endif
+            // search trees only
+            bool found_;
             TreePathStackWithIndex<T,PATH_MAX_LEN> path;
             T** root_of_structure;
         public:
-            #if TREE_TYPE == SEARCH_TREE
-                bool found() const {
-                    return found_;
-                }
-            #endif
+            // search trees only
+            bool found() const {
+                return found_;
+            }
 
             T* connection_point() const {
                 return connection_point_;
             }
 
+            // the amount of nodes on the path
+            // above the connection point
+            int depth() const {
+                return path.size();
+            }
+
+            // the node the connection pointer points to, for
+            // search trees the node with the key, if found
+            T* target() const {
+                return con_ptr.snapshot;
+            }
+
             T** root() {
                 return root_of_structure;
             }
@@ -556,8 +686,8 @@ namespace SafeTree {
 
             static_assert(sizeof(buffer_type) >= sizeof(Object), "wrong size");
 
-            explicit memory_pool(std::size_t limit)
-                    : objects_(new buffer_type[limit]),limit_(limit), used_(0) {
+            explicit memory_pool(std::size_t limit, bool allocate = true)
+                    : objects_(allocate ? new buffer_type[limit] : nullptr),limit_(limit), used_(0) {
             }
 
             memory_pool(const memory_pool&) = delete;
@@ -597,17 +727,37 @@ namespace SafeTree {
             using buffer_type = typename std::aligned_storage<sizeof(Object), alignof(Object)>::type;
 
             
-            explicit memory_pool_tracked(std::size_t limit): memory_pool<Object>(limit) {
-                pool_lock_.lock();
-                ++index_;
-                thread_buffers_[index_] = memory_pool<Object>::objects_;
-                pool_lock_.unlock();
+            // the buffer is allocated on first use, as thread locals
+            // are constructed for every thread, even if it never
+            // uses this kind of node
+            explicit memory_pool_tracked(std::size_t limit): memory_pool<Object>(limit, false), generation_seen_(0) {
+            }
+
+            template<class...Args>
+            Object* create(Args &&...args) {
+                ensure_pool();
+
+                return memory_pool<Object>::create(std::forward<Args>(args)...);
+            }
+
+            // allocate the buffer of the thread, if it has none,
+            // or if it was freed by a reset of another thread
+            void ensure_pool() {
+                if (!memory_pool<Object>::objects_ || generation_seen_ != generation_.load(std::memory_order_acquire)) {
+                    fill_pool();
+                }
             }
 
             void fill_pool() {
                 memory_pool<Object>::objects_ = new buffer_type[memory_pool<Object>::limit_];
+                memory_pool<Object>::used_ = 0;
+                generation_seen_ = generation_.load(std::memory_order_acquire);
                 pool_lock_.lock();
                 ++index_;
+                if (index_ == MAX_THREADS) {
+                    std::cerr << "PoolError: more than " << MAX_THREADS << " buffers in use" << std::endl;
+                    exit(-1);
+                }
                 thread_buffers_[index_] = memory_pool<Object>::objects_;
                 pool_lock_.unlock();
             }
@@ -623,7 +773,26 @@ namespace SafeTree {
                 memory_pool<Object>::objects_ = nullptr;
 
                 index_ = -1;
+                generation_.fetch_add(1, std::memory_order_release);
+            }
 
+            // the structures with the same kind of object share the
+            // buffers, each one acquires them when it is created and
+            // the release of the last one frees them
+            void acquire() {
+                pool_lock_.lock();
+                ++owners_;
+                pool_lock_.unlock();
+
+                ensure_pool();
+            }
+
+            void release() {
+                pool_lock_.lock();
+                if (--owners_ == 0) {
+                    hard_reset();
+                }
+                pool_lock_.unlock();
             }
 
             void set_checkpoint() {
@@ -635,10 +804,13 @@ namespace SafeTree {
             }
 
             std::size_t checkpoint_;
+            unsigned generation_seen_;
 
             static TSX::SpinLock pool_lock_;
             static typename memory_pool_tracked<Object>::buffer_type** thread_buffers_;
             static int index_;
+            static int owners_;
+            static std::atomic<unsigned> generation_;
 
         };
 
@@ -650,9 +822,303 @@ namespace SafeTree {
 
         template<class Object>
         int memory_pool_tracked<Object>::index_ = -1;
+
+        template<class Object>
+        int memory_pool_tracked<Object>::owners_ = 0;
+
+        template<class Object>
+        std::atomic<unsigned> memory_pool_tracked<Object>::generation_(0);
     #endif
 
 
+    // VALUE STORAGE: a copy of a node copies its value too, on every path
+    // of copies of an operation. Values larger than INLINE_MAX_VALUE_SIZE
+    // are kept out of line instead, in immutable blocks which the copies
+    // share, and a new value gets a new block. Specialize
+    // out_of_line_eligible to choose for a value type.
+    static constexpr std::size_t INLINE_MAX_VALUE_SIZE = IN_PLACE_MAX_VALUE_SIZE;
+
+    template <class ValueType>
+    struct out_of_line_eligible: std::integral_constant<bool, (sizeof(ValueType) > INLINE_MAX_VALUE_SIZE)> {};
+
+    // StoredValue: the value of a node of type NodeType
+    template <class ValueType, class NodeType, bool OutOfLine = out_of_line_eligible<ValueType>::value>
+    class StoredValue {
+        private:
+            ValueType value_;
+
+        public:
+            explicit StoredValue(const ValueType& value): value_(value) {}
+
+            const ValueType& get() const {
+                return value_;
+            }
+
+            void set(const ValueType& value) {
+                value_ = value;
+            }
+
+            static void init_pool() {}
+
+            static void reset_pool() {}
+    };
+
+    // the blocks come from a pool of each thread, like the nodes. They are
+    // kept until the pool is reset, as replaced nodes still point to them,
+    // and the blocks of failed attempts are not reused.
+    template <class ValueType, class NodeType>
+    class StoredValue<ValueType, NodeType, true> {
+        private:
+            // a kind of block for each kind of node,
+            // so that their pools are reset separately
+            struct Block {
+                ValueType value;
+
+                explicit Block(const ValueType& value): value(value) {}
+            };
+
+            #ifdef USER_MEM_POOL
+                thread_local static memory_pool_tracked<Block> pool_;
+            #endif
+
+            const Block* block_;
+
+            static const Block* new_block(const ValueType& value) {
+                #ifdef USER_MEM_POOL
+                    return pool_.create(value);
+                #else
+                    return new Block(value);
+                #endif
+            }
+
+        public:
+            explicit StoredValue(const ValueType& value): block_(new_block(value)) {}
+
+            const ValueType& get() const {
+                return block_->value;
+            }
+
+            void set(const ValueType& value) {
+                block_ = new_block(value);
+            }
+
+            // like the node pools, the trees of the same kind
+            // share the blocks, only the last reset frees them
+            static void init_pool() {
+                #ifdef USER_MEM_POOL
+                    pool_.acquire();
+                #endif
+            }
+
+            static void reset_pool() {
+                #ifdef USER_MEM_POOL
+                    pool_.release();
+                #endif
+            }
+    };
+
+
+    // ConnPointGroup: makes the ConnPoints created by the thread during its
+    // lifetime one atomic operation, to modify several keys of a structure,
+    // or several structures, at once. Structures of any node type can take
+    // part. It has to be used in a TM_SAFE_OPERATION and the operations
+    // should only run if the group is active:
+    //
+    //  TM_SAFE_OPERATION_START(30) {
+    //      ConnPointGroup group;
+    //      if (group.active()) {
+    //          ... find_conn_point(key, group.root(&root)) ...
+    //      }
+    //  } TM_SAFE_OPERATION_END
+    //
+    // In a transaction, each ConnPoint validates and connects its copy when
+    // destroyed, so the next one sees the change, and all of them commit
+    // together when the group is destroyed. Any failed validation aborts
+    // the whole group.
+    // With the fallback lock held, no other writer can run. The structures
+    // which ask for a private root with root(), instead of using their root
+    // directly, connect every tree of copies at the private root, so their
+    // published tree is never changed and readers see all the changes or
+    // none when the private roots are published at the end of the group.
+    // This suits search trees, where copying up to the root is cheap.
+    // A group created while another one is active joins it.
+    // Code which has to see the changes committed, eg. waking up the
+    // threads waiting for them, is registered with onCommit and runs
+    // after the transaction of the group ends.
+    class ConnPointGroup
+    {
+        private:
+            // a private root of a structure
+            struct PrivateRoot {
+                void* root;
+                void* private_root;
+                void (*publish)(void* root, void* private_root);
+            };
+
+            static constexpr int MAX_STRUCTURES = 16;
+
+            struct Callback {
+                void (*fn)(void* arg);
+                void* arg;
+            };
+
+            // destroyed after the guard, so the
+            // callbacks run out of the transaction
+            struct AfterCommit {
+                const unsigned char& err_status;
+                bool outer;
+                std::array<Callback, MAX_STRUCTURES> callbacks;
+                int n_callbacks;
+
+                AfterCommit(const unsigned char& err_status, const bool outer):
+                err_status(err_status), outer(outer), n_callbacks(0) {}
+
+                ~AfterCommit() {
+                    if (outer && err_status != VALIDATION_FAILED) {
+                        for (int i = 0; i < n_callbacks; i++) {
+                            callbacks[i].fn(callbacks[i].arg);
+                        }
+                    }
+                }
+            };
+
+            thread_local static ConnPointGroup* current_;
+
+            // the group this one joined, if any
+            ConnPointGroup* outer_;
+
+            bool locked_;
+
+            unsigned char err_status_;
+
+            std::array<PrivateRoot, MAX_STRUCTURES> private_roots_;
+            int n_private_roots_;
+
+            AfterCommit after_commit_;
+
+            TSX::TSXTransOnlyGuard guard_;
+
+            template <class NodeType>
+            static void publish(void* root, void* private_root) {
+                *static_cast<NodeType**>(root) = *static_cast<NodeType**>(private_root);
+            }
+
+        public:
+            // no copying or moving
+            ConnPointGroup& operator=(const ConnPointGroup&) = delete;
+            ConnPointGroup(const ConnPointGroup&) = delete;
+
+            ConnPointGroup():
+            outer_(current_),
+            locked_(TSX::__internal__trans_pointer->has_locked()),
+            err_status_(0),
+            n_private_roots_(0),
+            after_commit_(err_status_, !outer_),
+            guard_(TSX::__internal__trans_pointer->get_retries(), TSX::__internal__trans_pointer->get_lock(),
+                   err_status_, TSX::__internal__trans_pointer->get_stats(), locked_ || outer_, TSX::STUBBORN)
+            {
+                if (!outer_) {
+                    current_ = this;
+                }
+            }
+
+            ~ConnPointGroup() {
+                if (!outer_) {
+                    if (active() && locked_) {
+                        for (int i = 0; i < n_private_roots_; i++) {
+                            private_roots_[i].publish(private_roots_[i].root, private_roots_[i].private_root);
+                        }
+                    }
+
+                    current_ = nullptr;
+                }
+
+                __internal__thread_transaction_success_flag__ = active();
+            }
+
+            // the group of the current thread, nullptr if none
+            static ConnPointGroup* current() {
+                return current_;
+            }
+
+            // false if the transaction failed,
+            // the operation will be retried
+            bool active() const {
+                return err_status_ != VALIDATION_FAILED;
+            }
+
+            // the root the operations of the group should use
+            // for the structure with the given root
+            template <class NodeType>
+            NodeType** root(NodeType** root) {
+                if (outer_) {
+                    return outer_->root(root);
+                }
+
+                if (!locked_) {
+                    return root;
+                }
+
+                for (int i = 0; i < n_private_roots_; i++) {
+                    if (private_roots_[i].root == root) {
+                        return static_cast<NodeType**>(private_roots_[i].private_root);
+                    }
+                }
+
+                if (n_private_roots_ == MAX_STRUCTURES) {
+                    std::cerr << "GroupError: more than " << MAX_STRUCTURES << " structures in a group" << std::endl;
+                    exit(-1);
+                }
+
+                // the copies of the published roots
+                thread_local static NodeType* private_root_storage[MAX_STRUCTURES];
+
+                NodeType** private_root = &private_root_storage[n_private_roots_];
+                *private_root = *root;
+
+                private_roots_[n_private_roots_++] = {root, private_root, &publish<NodeType>};
+
+                return private_root;
+            }
+
+            // onCommit: fn(arg) is called once after the outermost group
+            // commits, not at all if it fails. Registering the same call
+            // again has no effect.
+            void onCommit(void (*fn)(void*), void* arg) {
+                if (outer_) {
+                    outer_->onCommit(fn, arg);
+                    return;
+                }
+
+                for (int i = 0; i < after_commit_.n_callbacks; i++) {
+                    if (after_commit_.callbacks[i].fn == fn && after_commit_.callbacks[i].arg == arg) {
+                        return;
+                    }
+                }
+
+                if (after_commit_.n_callbacks == MAX_STRUCTURES) {
+                    std::cerr << "GroupError: more than " << MAX_STRUCTURES << " callbacks in a group" << std::endl;
+                    exit(-1);
+                }
+
+                after_commit_.callbacks[after_commit_.n_callbacks++] = {fn, arg};
+            }
+
+            // copies of a private tree are connected at its root
+            bool connectsAtRoot(const void* root) const {
+                for (int i = 0; locked_ && i < n_private_roots_; i++) {
+                    if (private_roots_[i].private_root == root) {
+                        return true;
+                    }
+                }
+
+                return false;
+            }
+    };
+
+    thread_local ConnPointGroup* ConnPointGroup::current_ = nullptr;
+
+
     template <class NodeType>
     class ConnPoint
     {
@@ -732,11 +1198,15 @@ namespace SafeTree {
             // set to true if operation
             // throws a validation error
             bool validation_aborted_;
+
+            // the group of the operation,
+            // if it is part of one
+            ConnPointGroup* group_;
             
 
             using SafeNodeType = SafeNode<NodeType>;
 
-            #if TREE_TYPE == GENERAL_TREE
+            // general trees
                 // chech if path to connPoint hasn't changed
                 // and if conn_point exists in the tree
                 bool path_unchanged() {
@@ -780,18 +1250,21 @@ namespace SafeTree {
                     // the last node of the path should be the connection point 
                     return supposed_next_child == connection_point_;
                 }
-            #endif
 
 
             
             
             // lookup but returns node, nullptr when not found
             bool connPointConnected() {
-                #if TREE_TYPE == SEARCH_TREE
-                    return find_target_node<NodeType>(*root_, connection_point_);
-                #else
-                    return path_unchanged();
-                #endif
+                return connPointConnected(std::integral_constant<bool, tree_type_of<NodeType>::value == SEARCH_TREE>());
+            }
+
+            bool connPointConnected(std::true_type) {
+                return find_target_node<NodeType>(*root_, connection_point_);
+            }
+
+            bool connPointConnected(std::false_type) {
+                return path_unchanged();
             }
 
 
@@ -816,7 +1289,10 @@ namespace SafeTree {
 
                 unsigned char err_status = 0;
                 
-                TSX::TSXTransOnlyGuard guard(trans_retries_,_lock,err_status,stats_, already_locked_, TSX::STUBBORN);
+                // a group runs in its own transaction
+                const bool in_transaction = already_locked_ || group_ != nullptr;
+
+                TSX::TSXTransOnlyGuard guard(trans_retries_,_lock,err_status,stats_, in_transaction, TSX::STUBBORN);
 
                 if (err_status != VALIDATION_FAILED) {
 
@@ -896,6 +1372,13 @@ namespace SafeTree {
                                 // the original node and its current children
                                 const auto original_node = safe_node->original_;
 
+                                // was the value written in place after the copy was made?
+                                if (safe_node->copy_ != original_node && 
+                                    safe_node->version_snapshot_ != NodeVersionOf<NodeType>::of(original_node)) {
+                                    TSX::TSXGuard::abort<VALIDATION_FAILED>();
+                                    return false;
+                                }
+
                                 // the saved children which shouldn't have changed
                                 const auto &saved_children = safe_node->children_pointers_snapshot_;
 
@@ -916,6 +1399,13 @@ namespace SafeTree {
                                 // the original node and its current children
                                 const auto original_node = (*it)->original_;
 
+                                // was the value written in place after the copy was made?
+                                if ((*it)->copy_ != original_node && 
+                                    (*it)->version_snapshot_ != NodeVersionOf<NodeType>::of(original_node)) {
+                                    TSX::TSXGuard::abort<VALIDATION_FAILED>();
+                                    return false;
+                                }
+
                                 // the saved children which shouldn't have changed
                                 const auto &saved_children = (*it)->children_pointers_snapshot_;
 
@@ -957,7 +1447,8 @@ namespace SafeTree {
             tree_was_modified_(false),
             already_locked_(TSX::__internal__trans_pointer->has_locked()),
             trans_retries_(TSX::__internal__trans_pointer->get_retries()),
-            validation_aborted_(false)
+            validation_aborted_(false),
+            group_(ConnPointGroup::current())
             {
                 #ifdef TSX_MEM_POOL
                     pool_.reset();
@@ -990,6 +1481,14 @@ namespace SafeTree {
 
                 // in transaction
                 if (tree_was_modified_ && !copy_connected_) {
+                    // the published tree can't change before
+                    // the group ends, copy up to the root
+                    if (group_ && group_->connectsAtRoot(root_)) {
+                        while (connection_point_) {
+                            pop_path();
+                        }
+                    }
+
                     connect_success_ = connect_atomically();
                 }
 
@@ -1052,12 +1551,16 @@ namespace SafeTree {
 
                 }
 
+                // structures with the same kind of node, such as
+                // the shards of a ShardedMap, share the buffers. Each
+                // one inits the pool when it is created and resets it
+                // when it is destroyed, only the last reset frees them.
                 static void init_node_pool() {
-                    user_node_pool_.fill_pool();
+                    user_node_pool_.acquire();
                 }
 
                 static void reset_node_pool() {
-                    user_node_pool_.hard_reset();
+                    user_node_pool_.release();
                 }
 
             #endif
@@ -1252,12 +1755,21 @@ namespace SafeTree {
     //---------------------//
     #ifdef TSX_MEM_POOL
         template <class NodeType>
-        thread_local memory_pool<SafeNode<NodeType>> ConnPoint<NodeType>::pool_(100);
+        thread_local memory_pool<SafeNode<NodeType>> ConnPoint<NodeType>::pool_(CONN_POINT_MAX_SAFE_NODES);
     #endif
 
     #ifdef USER_MEM_POOL
         template <class NodeType>
-        thread_local memory_pool_tracked<NodeType> ConnPoint<NodeType>::user_node_pool_(50000000);
+        constexpr std::size_t user_mem_pool_limit() {
+            return USER_MEM_POOL_BYTES / sizeof(NodeType) < USER_MEM_POOL_MAX_NODES ?
+                   USER_MEM_POOL_BYTES / sizeof(NodeType) : USER_MEM_POOL_MAX_NODES;
+        }
+
+        template <class NodeType>
+        thread_local memory_pool_tracked<NodeType> ConnPoint<NodeType>::user_node_pool_(user_mem_pool_limit<NodeType>());
+
+        template <class ValueType, class NodeType>
+        thread_local memory_pool_tracked<typename StoredValue<ValueType, NodeType, true>::Block> StoredValue<ValueType, NodeType, true>::pool_(user_mem_pool_limit<typename StoredValue<ValueType, NodeType, true>::Block>());
     #endif
 
      #ifdef PREALLOC_VALIDATION_SET
@@ -1267,11 +1779,35 @@ namespace SafeTree {
 
     //---------------------//
 
+
+    // root_of: the root an operation on the structure with the given
+    // root should use, to take part in the group of the thread
+    template <class NodeType>
+    inline NodeType** root_of(NodeType** root) {
+        auto group = ConnPointGroup::current();
+
+        return group ? group->root(root) : root;
+    }
+
+    // atomically: run fn() as one atomic operation, the changes
+    // fn makes to SafeTree structures, even of different node types,
+    // are committed together. fn can be called more than once
+    // if the operation is retried, so it should have no other
+    // side effects.
+    template <class F>
+    inline void atomically(F fn) {
+        TM_SAFE_OPERATION_START(30) {
+            ConnPointGroup group;
+
+            if (group.active()) {
+                fn();
+            }
+        } TM_SAFE_OPERATION_END
+    }
+
     // Search functions come for free, if 
     // building a search tree
 
-    #if TREE_TYPE == SEARCH_TREE
-
         // Traverse tree with given root and return the node with
         // the key given. The node will be determined by the traversalDone
         // method and the path taken by the nextChild method. 
@@ -1285,6 +1821,22 @@ namespace SafeTree {
             return curr;
         }
 
+        // find_in_transaction: find the node with the given key and call
+        // fn with it (nullptr if not found) in a short hardware transaction,
+        // or holding the fallback lock instead. Commits of trees of copies
+        // are excluded, so fn can write to the node found, as long as the node
+        // keeps a NodeVersion to invalidate concurrent copies of it.
+        // fn can run more than once and should not have side effects
+        // outside of the transaction.
+        template <class NodeType, class F>
+        inline void find_in_transaction(NodeType** root, typename NodeType::KeyType key, F& fn, const int retries = 30) {
+            unsigned char err_status = 0;
+
+            TSX::TSXGuardWithStats guard(retries, *TSX::__internal__fallback_lock, err_status, TSX::__internal__trans_stats);
+
+            fn(find<NodeType>(*root, key));
+        }
+
         // Traverse tree with given root and find if it contains
         // the target node. The nextChild method determines the
         // path taken
@@ -1301,6 +1853,90 @@ namespace SafeTree {
             return curr == target;
         }
 
+        // Ordered navigation for binary search trees. The direction
+        // of the search is given by the nextChild method, where index 0
+        // is the subtree with the smaller keys, and hasKey detects an
+        // exact match. No transaction is needed as the walks only read
+        // keys and child pointers, which are never written in place on a
+        // published node. Values can be, they are read through the node
+        // version (see published_values.hpp).
+
+        // find_ceiling: return the node with the smallest key
+        // which is larger than (or equal to, if inclusive) the
+        // given key, nullptr if there is none
+        template <class NodeType>
+        inline NodeType* find_ceiling(NodeType* root, typename NodeType::KeyType key, const bool inclusive = true) {
+            NodeType* candidate = nullptr;
+
+            for (auto curr = root; curr;) {
+                if (curr->hasKey(key)) {
+                    if (inclusive) {
+                        return curr;
+                    }
+
+                    curr = curr->getChild(1);
+                } else if (curr->nextChild(key) == 0) {
+                    // key is smaller, curr is a candidate
+                    // but a closer one might exist on the left
+                    candidate = curr;
+                    curr = curr->getChild(0);
+                } else {
+                    curr = curr->getChild(1);
+                }
+            }
+
+            return candidate;
+        }
+
+        // find_floor: return the node with the largest key
+        // which is smaller than (or equal to, if inclusive) the
+        // given key, nullptr if there is none
+        template <class NodeType>
+        inline NodeType* find_floor(NodeType* root, typename NodeType::KeyType key, const bool inclusive = true) {
+            NodeType* candidate = nullptr;
+
+            for (auto curr = root; curr;) {
+                if (curr->hasKey(key)) {
+                    if (inclusive) {
+                        return curr;
+                    }
+
+                    curr = curr->getChild(0);
+                } else if (curr->nextChild(key) == 1) {
+                    // key is larger, curr is a candidate
+                    // but a closer one might exist on the right
+                    candidate = curr;
+                    curr = curr->getChild(1);
+                } else {
+                    curr = curr->getChild(0);
+                }
+            }
+
+            return candidate;
+        }
+
+        // find_min: return the node with the smallest key, nullptr if empty
+        template <class NodeType>
+        inline NodeType* find_min(NodeType* root) {
+            auto curr = root;
+            for (; curr && curr->getChild(0); curr = curr->getChild(0)) {
+            // go left
+            }
+
+            return curr;
+        }
+
+        // find_max: return the node with the largest key, nullptr if empty
+        template <class NodeType>
+        inline NodeType* find_max(NodeType* root) {
+            auto curr = root;
+            for (; curr && curr->getChild(1); curr = curr->getChild(1)) {
+            // go right
+            }
+
+            return curr;
+        }
+
         // find_conn_point: traverse tree with given root and return a ConnPointData object for the
         // node with the given key. The node will be determined by the traversalDone
         // method and the path taken by the nextChild method.
@@ -1364,8 +2000,6 @@ namespace SafeTree {
             return result;
         }
 
-    #endif
-
     
 
         
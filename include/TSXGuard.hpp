@@ -519,6 +519,32 @@ namespace TSX {
     static SpinLock __internal__global_lock;
     thread_local TSXStats __internal__trans_stats;
 
+    // the fallback lock of the operations of the thread, the
+    // global lock unless a FallbackLockScope is active
+    thread_local SpinLock* __internal__fallback_lock = &__internal__global_lock;
+
+    // the operations of the thread in the scope fall back to the
+    // given lock, and their transactions only conflict with the
+    // fallbacks holding it. Only for structures which share no
+    // nodes with the ones using other locks, such as the shards
+    // of a ShardedMap.
+    class FallbackLockScope {
+        private:
+            SpinLock* previous_;
+
+        public:
+            explicit FallbackLockScope(SpinLock& lock): previous_(__internal__fallback_lock) {
+                __internal__fallback_lock = &lock;
+            }
+
+            FallbackLockScope(const FallbackLockScope&) = delete;
+            FallbackLockScope& operator=(const FallbackLockScope&) = delete;
+
+            ~FallbackLockScope() {
+                __internal__fallback_lock = previous_;
+            }
+    };
+
 
     // Handles the fallback and retries
     // when using a TransOnlyGuard
@@ -532,7 +558,7 @@ namespace TSX {
         public:
             Transaction(int &retries): 
             retries_(retries), 
-            lock_(__internal__global_lock), 
+            lock_(*__internal__fallback_lock), 
             stats_(__internal__trans_stats),
             has_locked_(false) {
                 if (retries == 0) {
@@ -0,0 +1,165 @@
+#ifndef AUGMENTATIONS_HPP
+    #define AUGMENTATIONS_HPP
+
+/*  Augmentations keep extra data in every node of a tree, calculated
+    from the node itself and the augmentations of its children.
+
+    An augmentation is a class with:
+        1.     static constexpr bool enabled: if false, the tree can skip all the bookkeeping
+        2.     A default constructor
+        3.     template <class NodeType> void update(const NodeType& node, const Self* l, const Self* r):
+                recalculate the data, l and r are nullptr for missing children
+
+    The tree calls update bottom up whenever the children of a node change.
+    As nodes are copied before being modified, an update has to copy the whole
+    path to the root for the augmented data to stay correct, so enabling
+    an augmentation makes every modification conflict at the root.
+*/
+
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+
+namespace SafeTree {
+
+    // default, nodes keep no extra data
+    struct NoAugmentation {
+        static constexpr bool enabled = false;
+
+        template <class NodeType>
+        void update(const NodeType&, const NoAugmentation*, const NoAugmentation*) {}
+    };
+
+    // amount of nodes of the subtree,
+    // used for order statistics
+    struct SubtreeSize {
+        static constexpr bool enabled = true;
+
+        int size;
+
+        SubtreeSize(): size(1) {}
+
+        static int count_of(const SubtreeSize* aug) {
+            return aug ? aug->size : 0;
+        }
+
+        int count() const {
+            return size;
+        }
+
+        template <class NodeType>
+        void update(const NodeType&, const SubtreeSize* l, const SubtreeSize* r) {
+            size = 1 + count_of(l) + count_of(r);
+        }
+    };
+
+    /*  Monoids for RangeAggregate. A monoid requires:
+        1.     A using type = (type of the aggregate) declaration
+        2.     static type identity(): the neutral element
+        3.     static type combine(const type& a, const type& b): associative,
+                a holds the smaller keys
+    */
+
+    template <class T>
+    struct SumMonoid {
+        using type = T;
+
+        static type identity() {
+            return T();
+        }
+
+        static type combine(const type& a, const type& b) {
+            return a + b;
+        }
+    };
+
+    template <class T>
+    struct MinMonoid {
+        using type = T;
+
+        static type identity() {
+            return std::numeric_limits<T>::max();
+        }
+
+        static type combine(const type& a, const type& b) {
+            return b < a ? b : a;
+        }
+    };
+
+    template <class T>
+    struct MaxMonoid {
+        using type = T;
+
+        static type identity() {
+            return std::numeric_limits<T>::lowest();
+        }
+
+        static type combine(const type& a, const type& b) {
+            return a < b ? b : a;
+        }
+    };
+
+    // amount of nodes, sum of keys and
+    // a monoid aggregate of the values of the subtree,
+    // used for range queries
+    template <class Monoid>
+    struct RangeAggregate {
+        static constexpr bool enabled = true;
+
+        using AggregateType = typename Monoid::type;
+
+        int size;
+        std::size_t key_sum;
+        AggregateType agg;
+
+        RangeAggregate(): size(1), key_sum(0), agg(Monoid::identity()) {}
+
+        static int count_of(const RangeAggregate* aug) {
+            return aug ? aug->size : 0;
+        }
+
+        static std::size_t key_sum_of(const RangeAggregate* aug) {
+            return aug ? aug->key_sum : 0;
+        }
+
+        static AggregateType agg_of(const RangeAggregate* aug) {
+            return aug ? aug->agg : Monoid::identity();
+        }
+
+        static AggregateType combine(const AggregateType& a, const AggregateType& b) {
+            return Monoid::combine(a, b);
+        }
+
+        static AggregateType identity() {
+            return Monoid::identity();
+        }
+
+        int count() const {
+            return size;
+        }
+
+        template <class NodeType>
+        void update(const NodeType& node, const RangeAggregate* l, const RangeAggregate* r) {
+            size = 1 + count_of(l) + count_of(r);
+            key_sum = node.getKey() + key_sum_of(l) + key_sum_of(r);
+            agg = combine(combine(agg_of(l), node.getValue()), agg_of(r));
+        }
+    };
+
+    // detects augmentations which keep the sum of the keys
+    template <class Aug>
+    struct has_key_sum {
+        private:
+            template <class T>
+            static std::true_type test(decltype(&T::key_sum));
+
+            template <class T>
+            static std::false_type test(...);
+
+        public:
+            static constexpr bool value = decltype(test<Aug>(nullptr))::value;
+    };
+
+}
+
+#endif
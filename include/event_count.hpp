@@ -0,0 +1,177 @@
+#ifndef EVENT_COUNT_HPP
+    #define EVENT_COUNT_HPP
+
+/*  EventCount: lets threads sleep until a condition they poll for, such
+    as a queue not being empty, may have become true.
+
+    A waiter announces itself before checking the condition a last time,
+    so a notifier which changed the condition either sees the waiter and
+    wakes it up, or the waiter sees the change and doesn't sleep:
+
+        auto key = ec.prepareWait();
+        if (condition()) {
+            ec.cancelWait();
+        } else {
+            ec.wait(key);
+        }
+
+    Notifying costs a fence and a load when no thread is waiting.
+    Waiters sleep on a futex, elsewhere they yield until notified.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <thread>
+#include <emmintrin.h>
+
+#ifdef __linux__
+    #include <linux/futex.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+    #include <ctime>
+#endif
+
+namespace SafeTree {
+
+    class EventCount {
+        public:
+            using Clock = std::chrono::steady_clock;
+
+            // polls of the condition before sleeping
+            enum { SPINS = 128 };
+
+        private:
+            // changes on every notify that finds waiters, waiters
+            // sleep while it has the value they read
+            std::atomic<std::uint32_t> epoch_;
+            std::atomic<std::uint32_t> waiters_;
+
+            // sleeps while the epoch is key, or until the deadline
+            void sleep(const std::uint32_t key, const Clock::time_point deadline) {
+            #ifdef __linux__
+                struct timespec timeout;
+                struct timespec* timeout_ptr = nullptr;
+
+                if (deadline != Clock::time_point::max()) {
+                    const auto left = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - Clock::now()).count();
+
+                    if (left <= 0) {
+                        return;
+                    }
+
+                    timeout.tv_sec = left / 1000000000;
+                    timeout.tv_nsec = left % 1000000000;
+                    timeout_ptr = &timeout;
+                }
+
+                syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&epoch_), FUTEX_WAIT_PRIVATE, key, timeout_ptr, nullptr, 0);
+            #else
+                while (epoch_.load(std::memory_order_acquire) == key && Clock::now() < deadline) {
+                    std::this_thread::yield();
+                }
+            #endif
+            }
+
+            void wake(const int n_threads) {
+            #ifdef __linux__
+                syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&epoch_), FUTEX_WAKE_PRIVATE, n_threads, nullptr, nullptr, 0);
+            #else
+                (void)n_threads;
+            #endif
+            }
+
+        public:
+            static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t), "the futex word has to be 32 bits");
+
+            EventCount(): epoch_(0), waiters_(0) {}
+
+            EventCount(const EventCount&) = delete;
+            EventCount& operator=(const EventCount&) = delete;
+
+            std::uint32_t prepareWait() {
+                waiters_.fetch_add(1, std::memory_order_seq_cst);
+                return epoch_.load(std::memory_order_seq_cst);
+            }
+
+            void cancelWait() {
+                waiters_.fetch_sub(1, std::memory_order_seq_cst);
+            }
+
+            // returns false if the deadline passed
+            bool wait(const std::uint32_t key, const Clock::time_point deadline = Clock::time_point::max()) {
+                while (epoch_.load(std::memory_order_acquire) == key) {
+                    if (Clock::now() >= deadline) {
+                        cancelWait();
+                        return false;
+                    }
+
+                    sleep(key, deadline);
+                }
+
+                cancelWait();
+                return true;
+            }
+
+            // wakes up to n_threads waiters, if there are any
+            void notify(const int n_threads = 1) {
+                // orders the change of the condition
+                // before the check for waiters
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+
+                if (!waiters_.load(std::memory_order_seq_cst)) {
+                    return;
+                }
+
+                epoch_.fetch_add(1, std::memory_order_seq_cst);
+                wake(n_threads);
+            }
+
+            void notifyAll() {
+                notify(INT_MAX);
+            }
+
+            // for ConnPointGroup::onCommit
+            static void notifyOf(void* event_count) {
+                static_cast<EventCount*>(event_count)->notify();
+            }
+
+            static void notifyAllOf(void* event_count) {
+                static_cast<EventCount*>(event_count)->notifyAll();
+            }
+
+            // awaitResult: returns the first result of try_get() which is
+            // not null, sleeping between tries after a short spin.
+            // Returns null if the deadline passes first.
+            template <class F>
+            auto awaitResult(F&& try_get, const Clock::time_point deadline = Clock::time_point::max()) -> decltype(try_get()) {
+                for (int i = 0; i < SPINS; i++) {
+                    auto result = try_get();
+
+                    if (result) {
+                        return result;
+                    }
+
+                    _mm_pause();
+                }
+
+                for (;;) {
+                    const std::uint32_t key = prepareWait();
+                    auto result = try_get();
+
+                    if (result) {
+                        cancelWait();
+                        return result;
+                    }
+
+                    if (!wait(key, deadline)) {
+                        return try_get();
+                    }
+                }
+            }
+    };
+
+}
+
+#endif
@@ -0,0 +1,194 @@
+#ifndef KEY_SEARCH_HPP
+    #define KEY_SEARCH_HPP
+
+/*  Search helpers for the sorted int key arrays of wide nodes.
+
+    Every level of find and find_conn_point calls nextChild, so for nodes
+    with tens of keys the key search is most of the cost of a traversal.
+    The keys are sorted, so the position of a key is the amount of keys
+    smaller than it, which SIMD compares count a vector at a time, without
+    the unpredictable branches of a binary search.
+
+    For each search there is:
+        1.     *_linear: scalar, for small arrays
+        2.     *_binary: scalar, for large arrays
+        3.     *_sse, *_avx2: SIMD, only callable when the cpu supports them
+        4.     a dispatched version picking the best one once, at runtime
+
+    lower_bound(keys, n, k): index of the first key >= k
+    upper_bound(keys, n, k): index of the first key > k
+
+    Define KEY_SEARCH_NO_SIMD to always use the scalar versions.
+*/
+
+#include <algorithm>
+#include <cstring>
+
+#if !defined(KEY_SEARCH_NO_SIMD) && (defined(__x86_64__) || defined(__i386__))
+    #define KEY_SEARCH_SIMD
+#endif
+
+namespace SafeTree {
+namespace KeySearch {
+
+    // SCALAR VERSIONS
+
+    inline int lower_bound_linear(const int* keys, const int n, const int k) {
+        int i = 0;
+        for (; i < n && keys[i] < k; i++) {
+        // keep going
+        }
+
+        return i;
+    }
+
+    inline int upper_bound_linear(const int* keys, const int n, const int k) {
+        int i = 0;
+        for (; i < n && keys[i] <= k; i++) {
+        // keep going
+        }
+
+        return i;
+    }
+
+    inline int lower_bound_binary(const int* keys, const int n, const int k) {
+        return std::lower_bound(keys, keys + n, k) - keys;
+    }
+
+    inline int upper_bound_binary(const int* keys, const int n, const int k) {
+        return std::upper_bound(keys, keys + n, k) - keys;
+    }
+
+
+    #ifdef KEY_SEARCH_SIMD
+
+    // SIMD VERSIONS
+    // count the keys smaller than (lower bound) or not larger
+    // than (upper bound) k, the rest of the keys after the
+    // last full vector are counted by the scalar loop.
+    // Written with vector extensions instead of intrinsics, as
+    // <immintrin.h> clashes with the RTM definitions of rtm.h
+
+    typedef int Vec4 __attribute__((vector_size(16)));
+    typedef int Vec8 __attribute__((vector_size(32)));
+
+    // a true comparison gives -1 in its lane,
+    // so subtracting the results counts them
+    template <class Vec, int Lanes, bool Upper>
+    __attribute__((always_inline))
+    inline int count_keys(const int* keys, const int n, const int k) {
+        Vec key;
+        Vec counts;
+        for (int lane = 0; lane < Lanes; lane++) {
+            key[lane] = k;
+            counts[lane] = 0;
+        }
+
+        int i = 0;
+
+        for (; i + Lanes <= n; i += Lanes) {
+            Vec block;
+            std::memcpy(&block, keys + i, sizeof(block));
+            counts -= Upper ? (block <= key) : (block < key);
+        }
+
+        int count = 0;
+        for (int lane = 0; lane < Lanes; lane++) {
+            count += counts[lane];
+        }
+
+        for (; i < n; i++) {
+            count += Upper ? keys[i] <= k : keys[i] < k;
+        }
+
+        return count;
+    }
+
+    __attribute__((target("sse4.2")))
+    inline int lower_bound_sse(const int* keys, const int n, const int k) {
+        return count_keys<Vec4, 4, false>(keys, n, k);
+    }
+
+    __attribute__((target("sse4.2")))
+    inline int upper_bound_sse(const int* keys, const int n, const int k) {
+        return count_keys<Vec4, 4, true>(keys, n, k);
+    }
+
+    __attribute__((target("avx2")))
+    inline int lower_bound_avx2(const int* keys, const int n, const int k) {
+        return count_keys<Vec8, 8, false>(keys, n, k);
+    }
+
+    __attribute__((target("avx2")))
+    inline int upper_bound_avx2(const int* keys, const int n, const int k) {
+        return count_keys<Vec8, 8, true>(keys, n, k);
+    }
+
+    #endif
+
+
+    // RUNTIME DISPATCH
+
+    using SearchFunction = int (*)(const int*, const int, const int);
+
+    inline bool has_sse() {
+        #ifdef KEY_SEARCH_SIMD
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse4.2");
+        #else
+            return false;
+        #endif
+    }
+
+    inline bool has_avx2() {
+        #ifdef KEY_SEARCH_SIMD
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+        #else
+            return false;
+        #endif
+    }
+
+    inline SearchFunction select_lower_bound() {
+        #ifdef KEY_SEARCH_SIMD
+            if (has_avx2()) {
+                return lower_bound_avx2;
+            }
+
+            if (has_sse()) {
+                return lower_bound_sse;
+            }
+        #endif
+
+        return lower_bound_linear;
+    }
+
+    inline SearchFunction select_upper_bound() {
+        #ifdef KEY_SEARCH_SIMD
+            if (has_avx2()) {
+                return upper_bound_avx2;
+            }
+
+            if (has_sse()) {
+                return upper_bound_sse;
+            }
+        #endif
+
+        return upper_bound_linear;
+    }
+
+    // the best version for the cpu, chosen on the first call
+    inline int lower_bound(const int* keys, const int n, const int k) {
+        static const SearchFunction search = select_lower_bound();
+        return search(keys, n, k);
+    }
+
+    inline int upper_bound(const int* keys, const int n, const int k) {
+        static const SearchFunction search = select_upper_bound();
+        return search(keys, n, k);
+    }
+
+}
+}
+
+#endif
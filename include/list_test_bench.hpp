@@ -0,0 +1,230 @@
+#ifndef LIST_TEST_BENCH_HPP
+    #define LIST_TEST_BENCH_HPP
+
+
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <type_traits>
+
+#include "catch2/catch.hpp"
+#include "../include/TSXGuard.hpp"
+
+
+// ListTestBench: throughput of a queue or a stack with many producers
+// and consumers. The list is given by two functions:
+//      put(list, item): adds the item, a bounded list may
+//          return false when it is full
+//      take(list): removes an item, returns its node or nullptr if empty,
+//          lists which return items by value can return a TakenItem
+// TakenItem: an item taken by value, used like a node
+struct TakenItem {
+    bool found;
+    int item;
+
+    explicit operator bool() const {
+        return found;
+    }
+
+    const TakenItem* operator->() const {
+        return this;
+    }
+
+    int getItem() const {
+        return item;
+    }
+};
+
+// Each run takes RunMillis.
+template <class ListType, int RunMillis = 5000>
+class ListTestBench {
+    public:
+
+        // operation stats per thread
+        struct t_ops {
+            std::size_t n_ops;
+            std::size_t puts;
+            std::size_t takes;
+            std::size_t empty_takes;
+            std::size_t full_puts;
+            std::size_t sum_puts;
+            std::size_t sum_takes;
+
+            void reset() {
+                n_ops = puts = takes = empty_takes = full_puts = 0;
+                sum_puts = sum_takes = 0;
+            }
+        };
+
+        // test parameters, the percent of operations that put and
+        // the items in the list before the threads start
+        struct experiment {
+            int puts;
+            int prefill;
+
+            experiment(int puts, int prefill): puts(puts), prefill(prefill) {}
+        };
+
+        enum { RUN_MILLIS = RunMillis };
+
+        // each thread puts or takes at random, at the given ratio. With
+        // dedicated set, the first half of the threads only put and the
+        // rest only take, otherwise every thread does both.
+        template <typename Put, typename Take>
+        static void test(experiment exp, std::vector<int>& threads_to_use, Put&& put, Take&& take, const bool dedicated = false) {
+            test(exp, threads_to_use, put, take, [](ListType&) {}, dedicated);
+        }
+
+        // configure is called with each new list before it is filled,
+        // eg. to enable a mode of the list
+        template <typename Put, typename Take, typename F>
+        static void test(experiment exp, std::vector<int>& threads_to_use, Put&& put, Take&& take, F&& configure, const bool dedicated) {
+            static std::atomic<bool> run;
+
+            for (auto thread_el = threads_to_use.begin(); thread_el != threads_to_use.end(); ++thread_el) {
+                const int max_threads = *thread_el;
+                ListType list;
+                configure(list);
+
+                std::size_t start_sum = 0;
+                for (int i = 0; i < exp.prefill; i++) {
+                    if (put_item(put, list, i)) {
+                        start_sum += i;
+                    }
+                }
+
+                std::vector<t_ops> stats(max_threads);
+                std::vector<std::thread> threads;
+
+                run = false;
+
+                for (int i = 0; i < max_threads; i++) {
+                    // a producer or a consumer, or both
+                    int put_freq = exp.puts;
+                    if (dedicated && max_threads > 1) {
+                        put_freq = i < max_threads / 2 ? 100 : 0;
+                    }
+
+                    stats[i].reset();
+                    threads.emplace_back(rand_op<Put, Take>, std::ref(run), std::ref(list), i, std::ref(stats[i]),
+                                         put_freq, std::ref(put), std::ref(take));
+                }
+
+                run = true;
+
+                std::this_thread::sleep_for(std::chrono::milliseconds(RUN_MILLIS));
+
+                run = false;
+
+                for (auto& thread: threads) {
+                    thread.join();
+                }
+
+                op_stats(stats, max_threads, exp.puts, dedicated);
+
+                // every item put is taken once
+                std::size_t put_sum = start_sum;
+                std::size_t take_sum = 0;
+
+                for (int i = 0; i < max_threads; i++) {
+                    put_sum += stats[i].sum_puts;
+                    take_sum += stats[i].sum_takes;
+                }
+
+                for (auto item = take(list); item; item = take(list)) {
+                    take_sum += item->getItem();
+                }
+
+                REQUIRE(put_sum == take_sum);
+            }
+        }
+
+        template <typename Put, typename Take>
+        static void rand_op(std::atomic<bool>& run, ListType& list, const int t_id, t_ops& t_op, const int put_freq, Put& put, Take& take) {
+            // items are unique per thread
+            int next_item = (t_id + 1) << 24;
+            unsigned seed = t_id * 2654435761u + 1;
+
+            while (!run);  // wait for start
+
+            while (run.load(std::memory_order_relaxed)) {
+                seed ^= seed << 13;
+                seed ^= seed >> 17;
+                seed ^= seed << 5;
+
+                if (static_cast<int>(seed % 100) < put_freq) {
+                    if (put_item(put, list, next_item)) {
+                        t_op.sum_puts += next_item++;
+                    } else {
+                        ++t_op.full_puts;
+                    }
+
+                    ++t_op.puts;
+                } else {
+                    auto item = take(list);
+
+                    if (item) {
+                        t_op.sum_takes += item->getItem();
+                    } else {
+                        ++t_op.empty_takes;
+                    }
+
+                    ++t_op.takes;
+                }
+
+                ++t_op.n_ops;
+            }
+        }
+
+        // true if the item was put
+        template <typename Put>
+        static bool put_item(Put& put, ListType& list, const int item) {
+            return put_item(put, list, item, std::is_void<decltype(put(list, item))>());
+        }
+
+        template <typename Put>
+        static bool put_item(Put& put, ListType& list, const int item, std::true_type) {
+            put(list, item);
+            return true;
+        }
+
+        template <typename Put>
+        static bool put_item(Put& put, ListType& list, const int item, std::false_type) {
+            return put(list, item);
+        }
+
+        static void op_stats(const std::vector<t_ops>& ops, const int threads, const int put_freq, const bool dedicated) {
+            std::size_t sum = 0;
+            std::size_t sum_puts = 0;
+            std::size_t sum_takes = 0;
+            std::size_t sum_empty = 0;
+            std::size_t sum_full = 0;
+
+            for (int i = 0; i < threads; i++) {
+                sum += ops[i].n_ops;
+                sum_puts += ops[i].puts;
+                sum_takes += ops[i].takes;
+                sum_empty += ops[i].empty_takes;
+                sum_full += ops[i].full_puts;
+            }
+
+            double M_OPS = (1.0 * sum) / (RUN_MILLIS * 1000);
+
+            std::cout << "THREADS: " << threads;
+            if (dedicated) {
+                std::cout << " PRODUCERS/CONSUMERS";
+            } else {
+                std::cout << " P: " << put_freq << " T: " << 100 - put_freq;
+            }
+            std::cout << " MOPS: " << M_OPS << std::endl;
+            std::cout << "EMPTY TAKES: " << (sum_takes ? (sum_empty * 100.0) / sum_takes : 0.0) << "%" << std::endl;
+
+            if (sum_full) {
+                std::cout << "FULL PUTS: " << (sum_full * 100.0) / sum_puts << "%" << std::endl;
+            }
+        }
+};
+
+#endif
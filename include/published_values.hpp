@@ -0,0 +1,141 @@
+#ifndef PUBLISHED_VALUES_HPP
+    #define PUBLISHED_VALUES_HPP
+
+/*  Values of the published nodes of the search trees (AVLTree, BST).
+
+    Small trivially copyable values are written directly on a published
+    node (in place), so a node is not immutable once published. Its
+    NodeVersion changes on every in place write:
+        1.     reads of a published node use read(), which reads again
+               if the value was written meanwhile
+        2.     updates which copy the node read the value from the copy,
+               made after the ConnPoint took the version of the node, so
+               an in place write before the commit fails the validation
+        3.     in place writes run in a short transaction, or holding the
+               fallback lock, see find_in_transaction
+
+    The node type keeps its value in a StoredValue member named value and
+    its NodeVersion in one named version, and is a friend of
+    PublishedValues. Live filters the nodes found, eg. to skip the
+    logically removed ones.
+*/
+
+#include "SafeTree.hpp"
+
+namespace SafeTree {
+
+    template <class NodeType, class ValueType>
+    struct PublishedValues {
+        using KeyType = typename NodeType::KeyType;
+        using Live = NodeType* (*)(NodeType*);
+
+        // every node found is live
+        static NodeType* any(NodeType* node) {
+            return node;
+        }
+
+        // read the value of a published node,
+        // again if it was written in place meanwhile
+        static ValueType read(const NodeType* node) {
+            ValueType val;
+            unsigned version;
+
+            do {
+                version = node->version.read_begin();
+                val = node->value.get();
+            } while (node->version.read_retry(version));
+
+            return val;
+        }
+
+        // write the value of a published node, only
+        // in a transaction or holding the lock
+        static void write(NodeType* node, const ValueType& val) {
+            node->version.write_begin();
+            node->value.set(val);
+            node->version.write_end();
+        }
+
+        // lookup: sets val to the value of the key in the
+        // tree with the given root, returns if it was found
+        static bool lookup(NodeType* root, const KeyType key, ValueType& val, Live live = any) {
+            const NodeType* const node = live(find<NodeType>(root, key));
+
+            if (node) {
+                val = read(node);
+            }
+
+            return node != nullptr;
+        }
+
+        // read_copy: the value of the root of the tree of copies, read
+        // from its copy, which is validated against the version of the
+        // published node
+        static const ValueType& read_copy(ConnPoint<NodeType>& conn) {
+            return conn.getRoot()->rwRef()->value.get();
+        }
+
+        // IN PLACE UPDATES: a change of an existing value is written
+        // directly on the published node in a short transaction,
+        // no copies are made
+
+        // replace the value if the key exists,
+        // returns false if it doesn't
+        static bool update_in_place(NodeType** root, const KeyType key, const ValueType& val, const int retries, Live live = any) {
+            bool updated = false;
+
+            auto op = [&updated, &val, live](NodeType* node) {
+                node = live(node);
+                updated = node != nullptr;
+
+                if (updated) {
+                    write(node, val);
+                }
+            };
+
+            find_in_transaction<NodeType>(root, key, op, retries);
+
+            return updated;
+        }
+
+        // replace the value with fn(value) if the key exists, new_val is
+        // set to the new value. Returns false if the key doesn't exist.
+        template <class F>
+        static bool compute_in_place(NodeType** root, const KeyType key, F& fn, ValueType& new_val, const int retries, Live live = any) {
+            bool found = false;
+
+            auto op = [&found, &fn, &new_val, live](NodeType* node) {
+                node = live(node);
+                found = node != nullptr;
+
+                if (found) {
+                    new_val = fn(node->value.get());
+                    write(node, new_val);
+                }
+            };
+
+            find_in_transaction<NodeType>(root, key, op, retries);
+
+            return found;
+        }
+
+        static bool compare_and_set_in_place(NodeType** root, const KeyType key, const ValueType& expected, const ValueType& desired, const int retries, Live live = any) {
+            bool swapped = false;
+
+            auto op = [&swapped, &expected, &desired, live](NodeType* node) {
+                node = live(node);
+                swapped = node && node->value.get() == expected;
+
+                if (swapped) {
+                    write(node, desired);
+                }
+            };
+
+            find_in_transaction<NodeType>(root, key, op, retries);
+
+            return swapped;
+        }
+    };
+}
+
+#endif
@@ -44,9 +44,10 @@ class TestBench {
             std::size_t light_ops_rems;
             std::size_t sum_inserts;
             std::size_t sum_removes;
+            std::size_t found_lookups;
 
             void reset() {
-                n_ops = i_ops = r_ops = l_ops = 0;
+                n_ops = i_ops = r_ops = l_ops = found_lookups = 0;
                 sum_inserts = sum_removes = 0;
                 light_ops_ins = light_ops_rems = 0;
             }
@@ -151,8 +152,56 @@ class TestBench {
 
        
 
+        // pin each thread to a cpu
+        static void pin_threads(const int max_threads) {
+            #ifndef HACI3COMP
+            // Create a cpu_set_t object representing a set of CPUs. Clear it and mark
+            // only CPU i as set.
+            for (int i = 0; i < max_threads; i++) {
+                cpu_set_t cpuset;
+                CPU_ZERO(&cpuset);
+                CPU_SET(i, &cpuset);
+                int rc = pthread_setaffinity_np(threads[i].native_handle(),
+                                sizeof(cpu_set_t), &cpuset);
+                if (rc != 0) {
+                    std::cerr << "Error calling pthread_setaffinity_np: " << rc << "\n";
+                }
+            }
+            #else
+            for (int i = 0; i < max_threads/2; i++) {
+                cpu_set_t cpuset;
+                CPU_ZERO(&cpuset);
+                CPU_SET(i, &cpuset);
+                int rc = pthread_setaffinity_np(threads[i].native_handle(),
+                                sizeof(cpu_set_t), &cpuset);
+                if (rc != 0) {
+                    std::cerr << "Error calling pthread_setaffinity_np: " << rc << "\n";
+                }
+            }
+
+            for (int i = max_threads/2; i < max_threads; i++) {
+                cpu_set_t cpuset;
+                CPU_ZERO(&cpuset);
+                CPU_SET(28 + i - max_threads/2, &cpuset);
+                int rc = pthread_setaffinity_np(threads[i].native_handle(),
+                                sizeof(cpu_set_t), &cpuset);
+                if (rc != 0) {
+                    std::cerr << "Error calling pthread_setaffinity_np: " << rc << "\n";
+                }
+            }
+
+            #endif
+        }
+
         // perform a test using the given operations
         static void test(experiment exp,int maximum_thread_amount, const std::size_t RANGE_OF_KEYS, std::vector<int>& threads_to_use) {
+            test(exp, maximum_thread_amount, RANGE_OF_KEYS, threads_to_use, [](MapType&) {});
+        }
+
+        // configure is called with each new map after it is filled,
+        // before the threads start, eg. to enable a mode of the map
+        template <typename F>
+        static void test(experiment exp,int maximum_thread_amount, const std::size_t RANGE_OF_KEYS, std::vector<int>& threads_to_use, F&& configure) {
 
             for (int i = 0; i < maximum_thread_amount; i++) {
                 thread_stats[i].reset();
@@ -167,6 +216,7 @@ class TestBench {
                     binary_insert_map_random(0,RANGE_OF_KEYS,RANGE_OF_KEYS/2, aMap); // insert even numbers only
 
                     REQUIRE(aMap.size() == RANGE_OF_KEYS/2);
+                    configure(aMap);
 
                     std::size_t insert_sum = 0;
                     std::size_t rem_sum = 0;
@@ -184,43 +234,7 @@ class TestBench {
                     }
 
 
-                    #ifndef HACI3COMP
-                    // Create a cpu_set_t object representing a set of CPUs. Clear it and mark
-                    // only CPU i as set.
-                    for (int i = 0; i < max_threads; i++) {
-                        cpu_set_t cpuset;
-                        CPU_ZERO(&cpuset);
-                        CPU_SET(i, &cpuset);
-                        int rc = pthread_setaffinity_np(threads[i].native_handle(),
-                                        sizeof(cpu_set_t), &cpuset);
-                        if (rc != 0) {
-                            std::cerr << "Error calling pthread_setaffinity_np: " << rc << "\n";
-                        }
-                    }
-                    #else
-                    for (int i = 0; i < max_threads/2; i++) {
-                        cpu_set_t cpuset;
-                        CPU_ZERO(&cpuset);
-                        CPU_SET(i, &cpuset);
-                        int rc = pthread_setaffinity_np(threads[i].native_handle(),
-                                        sizeof(cpu_set_t), &cpuset);
-                        if (rc != 0) {
-                            std::cerr << "Error calling pthread_setaffinity_np: " << rc << "\n";
-                        }
-                    }
-
-                    for (int i = max_threads/2; i < max_threads; i++) {
-                        cpu_set_t cpuset;
-                        CPU_ZERO(&cpuset);
-                        CPU_SET(28 + i - max_threads/2, &cpuset);
-                        int rc = pthread_setaffinity_np(threads[i].native_handle(),
-                                        sizeof(cpu_set_t), &cpuset);
-                        if (rc != 0) {
-                            std::cerr << "Error calling pthread_setaffinity_np: " << rc << "\n";
-                        }
-                    }
-
-                    #endif
+                    pin_threads(max_threads);
 
 
 
@@ -265,7 +279,73 @@ class TestBench {
             }
         }
 
-       
+
+        // perform a test where all the keys exist and update_freq% of the
+        // operations overwrite a value with upsert, the rest are lookups.
+        // configure is called with each new map before the threads start,
+        // eg. to choose how the values are updated.
+        template <typename F>
+        static void update_test(const int update_freq, const std::size_t RANGE_OF_KEYS, std::vector<int>& threads_to_use, F&& configure) {
+            static std::atomic<bool> run;
+
+            for (auto thread_el = threads_to_use.begin(); thread_el != threads_to_use.end(); ++ thread_el) {
+                    const int max_threads = *thread_el;
+                    MapType aMap(nullptr,global_lock);
+                    binary_insert_map(0, RANGE_OF_KEYS - 1, aMap);
+                    configure(aMap);
+
+                    const std::size_t start_sum = aMap.key_sum();
+
+                    run = false;
+
+                    for (int i = 0; i < max_threads; i++) {
+                        thread_stats[i].reset();
+                        threads[i] = std::thread(update_op, std::ref(run), std::ref(aMap), RANGE_OF_KEYS - 1, i, std::ref(thread_stats[i]), update_freq);
+                    }
+
+                    pin_threads(max_threads);
+
+                    run = true;
+
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+
+                    run = false;
+
+                    for (int i = 0; i < max_threads; i++) {
+                            threads[i].join();
+                    }
+
+                    op_stats(thread_stats, max_threads, update_freq, 0, 100 - update_freq);
+
+                    // overwrites never change the structure
+                    for (int i = 0; i < max_threads; i++) {
+                        REQUIRE(thread_stats[i].found_lookups == thread_stats[i].l_ops);
+                    }
+
+                    REQUIRE(static_cast<std::size_t>(aMap.size()) == RANGE_OF_KEYS);
+                    REQUIRE(aMap.key_sum() == start_sum);
+                    REQUIRE(aMap.isSorted());
+            }
+        }
+
+        static void update_op(std::atomic<bool>& run,MapType& map, const int range, const int t_id,t_ops& t_op, const int update_freq) {
+            while(!run);  // wait for start
+
+            while (run.load(std::memory_order_relaxed)) {
+                int key = intRand(range);
+                int rand_n = 1 + intRand(99);
+
+                if (rand_n <= update_freq) {
+                    map.upsert(key, rand_n, t_id);
+                    ++t_op.i_ops;
+                } else {
+                    t_op.found_lookups += map.lookup(key).found;
+                    ++t_op.l_ops;
+                }
+
+                ++t_op.n_ops;
+            }
+        }
 
         
         struct xorshift128_state {